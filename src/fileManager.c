@@ -24,8 +24,9 @@
 
 //internal backup to detach sequence and save file + have some recover capability 
 int _mainFileFd = -1; // Initalized at open
-Buffer _mainFileSaveAndWriteMMAP = {NULL, 0, 0}; // If file has some content: initially put into write buffer otherwise nothing there 
+Buffer _mainFileSaveAndWriteMMAP = {NULL, 0, 0, 0}; // If file has some content: initially put into write buffer otherwise nothing there 
 int _internalOriginalFileCopyFd = -1; // If file has some content before opening it with TxT: copy of original state upon first save and sequence then redirected to mmap on this copy. 
+int _addBufferSpillFd = -1; // Sparse (already unlinked) temp file backing the add buffer above the spill threshold
 
 
 
@@ -104,7 +105,7 @@ ReturnCode saveSequenceToOpenFile(Sequence* sequence) {
 
   // Calculate required size (size for current sequence state)
   size_t requiredSize = (size_t) getCurrentTotalSize(sequence);
-  DEBG_PRINT("Got SizeToSave:%d\n", requiredSize);
+  DEBG_PRINT("Got SizeToSave:%zu\n", requiredSize);
   if (requiredSize < 0) {
     ERR_PRINT("calculation failed\n");
     return -1;
@@ -129,6 +130,7 @@ ReturnCode saveSequenceToOpenFile(Sequence* sequence) {
       ERR_PRINT("Failed to create copy of original file, aborting save: %s\n", strerror(errno));
       return -1;
     }
+    unlink(backupPath); // Only read through the mapping while open, removed with the last close (also after a crash)
 
     off_t offset = 0;
     size_t copied = simpleFileCopy(_mainFileFd, _internalOriginalFileCopyFd, mainFileStat.st_size);
@@ -180,7 +182,7 @@ ReturnCode saveSequenceToOpenFile(Sequence* sequence) {
     //   copied = 
     // }
     if (copied != mainFileStat.st_size) {
-      ERR_PRINT("Failed to create complete backup (copied %d), aborting backup and save: %s\n", copied, strerror(errno));
+      ERR_PRINT("Failed to create complete backup (copied %zu), aborting backup and save: %s\n", copied, strerror(errno));
       return -1;
     }
     DEBG_PRINT("Ended needed temp copy...\n");
@@ -190,7 +192,7 @@ ReturnCode saveSequenceToOpenFile(Sequence* sequence) {
   // >> Prepare actual save operation
   const size_t mask = (size_t) sysconf(_SC_PAGESIZE) - 1;
   size_t newAlignedSize = (requiredSize + mask) & ~mask; 
-  DEBG_PRINT("Got aligned size:%d\n", newAlignedSize);
+  DEBG_PRINT("Got aligned size:%zu\n", newAlignedSize);
 
   if(_mainFileSaveAndWriteMMAP.data != NULL && _mainFileSaveAndWriteMMAP.size == requiredSize && _mainFileSaveAndWriteMMAP.capacity == newAlignedSize){
     //Nothing to do
@@ -253,7 +255,7 @@ void handler(int sig, siginfo_t *info, void *ucontext) {
 
 ReturnCode replaceFileBufferInSeq(int fd, size_t fileSize, Sequence *seq){
   if (fd < 0 || fileSize <= 0 || seq == NULL) {
-    ERR_PRINT("Invalid parameters to replaceFileBufferInSeq: fd:%d, size:%d, seqPtr%d\n",fd, fileSize, seq);
+    ERR_PRINT("Invalid parameters to replaceFileBufferInSeq: fd:%d, size:%zu, seqPtr%p\n",fd, fileSize, (void*)seq);
     return -1;
   }
 
@@ -269,7 +271,7 @@ ReturnCode replaceFileBufferInSeq(int fd, size_t fileSize, Sequence *seq){
     return -1;
   }
 
-  DEBG_PRINT("Replaced file buffer with capacity:%d, size:%d, pointer %p\n",alignedCapacity,fileSize,fileMapping);
+  DEBG_PRINT("Replaced file buffer with capacity:%zu, size:%zu, pointer %p\n",alignedCapacity,fileSize,fileMapping);
   seq->fileBuffer.capacity = alignedCapacity;
   seq->fileBuffer.data = (Atomic*) fileMapping;
   seq->fileBuffer.size = fileSize;
@@ -304,7 +306,7 @@ size_t simpleFileCopy(int sourceFd, int destFd, size_t fileSize) {
     
     if (copied == 0) {
       //EOF Issue
-      ERR_PRINT("Unexpected EOF during copy at %d bytes\n", totalCopied);
+      ERR_PRINT("Unexpected EOF during copy at %zu bytes\n", totalCopied);
       return -1;
     }
 
@@ -341,7 +343,7 @@ ReturnCode resizeFileAndMapping(int fd, void** mapping, size_t currentSize, size
       return -1;
     }
     
-    DEBG_PRINT("Created mapping: size:%d, aligned:%d, ptr:%p\n", newSize, newAlignedSize, *mapping);
+    DEBG_PRINT("Created mapping: size:%zu, aligned:%zu, ptr:%p\n", newSize, newAlignedSize, *mapping);
     return 1;
   }
 
@@ -404,20 +406,29 @@ ReturnCode writeSequenceToMapping(Atomic* writeMapping, size_t newSize, size_t n
   size_t rollingAtomicCount = 0;
   size_t writeOffset = 0; 
   Atomic *currentItemBlock = NULL;
+  BlockIterator blockIterator;
+  bool firstBlock = true;
+  if (initBlockIterator(&blockIterator, seq, 0) == -1) {
+    ERR_PRINT("Failed to create block iterator for writing the sequence.\n");
+    return -1;
+  }
 
   while (atomicsCount < newSize) {
     if (rollingAtomicCount >= size) {
       blockOffset = blockOffset + rollingAtomicCount;
       atomicsCount += rollingAtomicCount; 
       rollingAtomicCount = 0;
-      DEBG_PRINT("Requesting next block in seek, at atomic:%d\n", blockOffset);
-      size = getItemBlock(seq, blockOffset, &currentItemBlock);
-      DEBG_PRINT("New blockOffset=%d, size=%d\n", blockOffset, size);
+      DEBG_PRINT("Requesting next block in seek, at atomic:%zu\n", blockOffset);
+      // Walk the pieces one after another instead of looking up every block again
+      Size blockSize = firstBlock ? getCurrentBlock(&blockIterator, &currentItemBlock) : getNextBlock(&blockIterator, &currentItemBlock);
+      firstBlock = false;
+      DEBG_PRINT("New blockOffset=%zu, size=%ld\n", blockOffset, blockSize);
       
-      if (size <= 0 || currentItemBlock[0] == END_OF_TEXT_CHAR) {
-        ERR_PRINT("Position at end of file or size<0:%d curr block start:%d\n", size, blockOffset);
+      if (blockSize <= 0 || currentItemBlock[0] == END_OF_TEXT_CHAR) {
+        ERR_PRINT("Position at end of file or size<0:%ld curr block start:%zu\n", blockSize, blockOffset);
         return -1;
       }
+      size = (size_t)blockSize;
     }
 
     // Safety check parameters for copy operation
@@ -444,7 +455,7 @@ ReturnCode writeSequenceToMapping(Atomic* writeMapping, size_t newSize, size_t n
     }
 
     // Copy data to write buffer
-    DEBG_PRINT("Writing %d atomics to offset %zu\n", atomicsToCopy, writeOffset);
+    DEBG_PRINT("Writing %zu atomics to offset %zu\n", atomicsToCopy, writeOffset);
     memcpy(writeMapping + writeOffset, currentItemBlock + rollingAtomicCount, atomicsToCopy * sizeof(Atomic));
     
     // Update counters
@@ -466,6 +477,38 @@ if (writeOffset < newAlignedSize) {
   return 1;
 }
 
+ReturnCode mapAddBufferSpill(Sequence *seq, size_t spillStart, size_t fromOffset, size_t toOffset){
+  if (seq == NULL || seq->addBuffer.data == NULL || fromOffset < spillStart || toOffset < fromOffset || toOffset > seq->addBuffer.reserved) {
+    ERR_PRINT("Invalid range for add buffer spill mapping.\n");
+    return -1;
+  }
+
+  if (_addBufferSpillFd == -1) {
+    char spillPath[] = "/tmp/TxTinternal-addBuffer-XXXXXX";
+    _addBufferSpillFd = mkstemp(spillPath);
+    if (_addBufferSpillFd < 0) {
+      ERR_PRINT("Failed to create add buffer spill file: %s\n", strerror(errno));
+      _addBufferSpillFd = -1;
+      return -1;
+    }
+    unlink(spillPath); // Only needed while open, this way it also disappears after a crash
+    DEBG_PRINT("Add buffer spills to temp file from offset %zu on.\n", spillStart);
+  }
+
+  // Grow the (sparse) file, then map it over the reserved address space
+  if (ftruncate(_addBufferSpillFd, (off_t)(toOffset - spillStart)) < 0) {
+    ERR_PRINT("Failed to resize add buffer spill file: %s\n", strerror(errno));
+    return -1;
+  }
+  void *mapped = mmap(seq->addBuffer.data + fromOffset, toOffset - fromOffset, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, _addBufferSpillFd, (off_t)(fromOffset - spillStart));
+  if (mapped == MAP_FAILED) {
+    ERR_PRINT("Failed to map add buffer spill file: %s\n", strerror(errno));
+    return -1;
+  }
+
+  return 1;
+}
+
 void closeAllFileResources(Sequence *seq){
   // Unmap temp copy
   if(_internalOriginalFileCopyFd >= 0){
@@ -484,4 +527,10 @@ void closeAllFileResources(Sequence *seq){
     _internalOriginalFileCopyFd = -1;
     close(_mainFileFd);
     _mainFileFd  = -1;
+
+  // The spill file itself was already unlinked, closing it releases its space
+  if (_addBufferSpillFd >= 0) {
+    close(_addBufferSpillFd);
+    _addBufferSpillFd = -1;
+  }
 }
@@ -6,4 +6,11 @@
 LineBstd initSequenceFromOpenOrCreate(const char* pathname, Sequence* emptySequences, LineBstd lbStdForNewFile);
 ReturnCode saveSequenceToOpenFile(Sequence* sequence);
 void closeAllFileResources(Sequence *seq);
+
+/**
+ * Backs the add buffer range [fromOffset, toOffset) with a sparse temporary file (/tmp/TxTinternal-addBuffer-*),
+ * so that the kernel can page out cold edits. spillStart is the add buffer offset stored at the beginning of the file.
+ * All offsets have to be page aligned, the range has to lie inside the reserved address space of the add buffer.
+ */
+ReturnCode mapAddBufferSpill(Sequence *seq, size_t spillStart, size_t fromOffset, size_t toOffset);
 #endif
\ No newline at end of file
@@ -10,11 +10,11 @@
 // Data structure for currently shown lines' statistics.
 typedef struct {
     // Currently shown upper most line's line number counted from the very beginning of text:
-    int topMostLineNbr;
+    long topMostLineNbr;
     // Number of UTF-8 chars in line without counting control chars:
     int charCount[75]; 
     // Absolute atomic position of curent lines:
-    int absolutePos[75]; // here -1 consistently inserted into last index +1 => if at index 0 value == -1 -> signifies not in update state! 
+    Position absolutePos[75]; // here -1 consistently inserted into last index +1 => if at index 0 value == -1 -> signifies not in update state! 
 } LineStats;
 LineStats lineStats = {
     .topMostLineNbr = 0,
@@ -25,14 +25,14 @@ LineStats lineStats = {
 // For horizontal scrolling:
 static int _horizontalScreenOffset = 0;
 
-static int _portTopIdxForNext = 0;
+static Position _portTopIdxForNext = 0;
 
 /**
  * Returns the absolute line nbr from the very start, of a specific screen line.
  * >> The line number requires counting from 0. Returns -1 on error.
  * >> Returns -1 if general state invalid, but does not check if requested relative line (on screen) is beyond range.
  */
-int getGeneralLineNbr(int lineNbrOnScreen){
+long getGeneralLineNbr(int lineNbrOnScreen){
     // Make sure internal state is indeed updated:
     if (lineStats.absolutePos[0] != -1){ 
         return lineStats.topMostLineNbr + lineNbrOnScreen;
@@ -78,8 +78,8 @@ ReturnCode setLineStatsNotUpdated(){
 /**
  * Function to update internal line statistics data structure. Relative line number counting from 0. 
  */
-ReturnCode updateLine(int relativeLineNumber, int absoluteGeneralAtomicPosition , int nbrOfUtf8CNoControlChars){
-    DEBG_PRINT("[Line Stats] : Updated line nbr %d to Atomic Idx: %d, charCount: %d.\n", relativeLineNumber, absoluteGeneralAtomicPosition, nbrOfUtf8CNoControlChars);
+ReturnCode updateLine(int relativeLineNumber, Position absoluteGeneralAtomicPosition , int nbrOfUtf8CNoControlChars){
+    DEBG_PRINT("[Line Stats] : Updated line nbr %d to Atomic Idx: %ld, charCount: %d.\n", relativeLineNumber, absoluteGeneralAtomicPosition, nbrOfUtf8CNoControlChars);
     lineStats.absolutePos[relativeLineNumber] = absoluteGeneralAtomicPosition;
     lineStats.charCount[relativeLineNumber] = nbrOfUtf8CNoControlChars;
     lineStats.absolutePos[relativeLineNumber +1] = -1;
@@ -90,7 +90,7 @@ ReturnCode updateLine(int relativeLineNumber, int absoluteGeneralAtomicPosition
 /**
  * Get Line number at the top of the screen.
  */
-int gettopMostLineNbr(){
+long gettopMostLineNbr(){
     return lineStats.topMostLineNbr;
 }
 
@@ -100,16 +100,16 @@ int gettopMostLineNbr(){
  *  except for first relative screen line due to need of leap of faith. 
  */
 ReturnCode moveAbsoluteLineNumbers(Sequence* sequence, int addOrSubstractOne){
-    DEBG_PRINT("moveAbsoluteLineNumbers, initial _portTopIdxForNext: %d\n", _portTopIdxForNext);
+    DEBG_PRINT("moveAbsoluteLineNumbers, initial _portTopIdxForNext: %ld\n", _portTopIdxForNext);
     if (addOrSubstractOne > 0){
         DEBG_PRINT("Scrolling down\n");
         if(getTotalAmountOfRelativeLines() > 1){
             if (lineStats.absolutePos[1] != -1){
             lineStats.topMostLineNbr++;
-            DEBG_PRINT("topMostLineNbr: %d\n", lineStats.topMostLineNbr);
+            DEBG_PRINT("topMostLineNbr: %ld\n", lineStats.topMostLineNbr);
             // Leap of faith:
             _portTopIdxForNext = lineStats.absolutePos[1];
-            DEBG_PRINT("Scroll down case _portTopIdxForNext: %d\n", _portTopIdxForNext);
+            DEBG_PRINT("Scroll down case _portTopIdxForNext: %ld\n", _portTopIdxForNext);
             } else{
                 ERR_PRINT("Failed to scroll down, internal state issue...\n");
                 // try to recover from bad state...
@@ -124,7 +124,7 @@ ReturnCode moveAbsoluteLineNumbers(Sequence* sequence, int addOrSubstractOne){
         if (lineStats.absolutePos[0] > 0){
             lineStats.topMostLineNbr--;
             _portTopIdxForNext = backtrackToFirstAtomicInLine(sequence, lineStats.absolutePos[0]-1);
-            DEBG_PRINT("Scroll up case _portTopIdxForNext: %d\n", _portTopIdxForNext);
+            DEBG_PRINT("Scroll up case _portTopIdxForNext: %ld\n", _portTopIdxForNext);
         } else{
             ERR_PRINT("Scroll up illegal!\n");
             return -1;
@@ -140,7 +140,7 @@ ReturnCode moveAbsoluteLineNumbers(Sequence* sequence, int addOrSubstractOne){
  * Function to call when jumping to specific line. Counting line numbers form 0. 
  *  requires full update of statistics afterwards since operation invalidates internal state.
  */
-ReturnCode jumpAbsoluteLineNumber(int newTopLineNumber, int atomicIdxOfTop){
+ReturnCode jumpAbsoluteLineNumber(long newTopLineNumber, Position atomicIdxOfTop){
     lineStats.topMostLineNbr = newTopLineNumber;
     // leap of faith for next print:
     _portTopIdxForNext = atomicIdxOfTop;
@@ -182,18 +182,18 @@ ReturnCode setHorizontalScrollOffset(int newValue){
 /**
  * Special function to port in  "leap of faith" fashion an atomic index value to next printing round since line stats will be invalidated by then.
  */
-int getPrintingPortAtomicPosition(){
-    DEBG_PRINT("Requesting top idx for print, is%d\n", _portTopIdxForNext);
+Position getPrintingPortAtomicPosition(){
+    DEBG_PRINT("Requesting top idx for print, is%ld\n", _portTopIdxForNext);
     return _portTopIdxForNext;
 }
 
 void debugPrintInternalLineStats(){
     DEBG_PRINT(">>>Internal line stats<<<\n");
-    DEBG_PRINT("Top most absNbr:%d, Atomic IDX:%d\n", _portTopIdxForNext, lineStats.topMostLineNbr);
+    DEBG_PRINT("Top most absNbr:%ld, Atomic IDX:%ld\n", lineStats.topMostLineNbr, _portTopIdxForNext);
     DEBG_PRINT("===================================\n");
     DEBG_PRINT("||Line|scrnCharCount|absAtomicStart\n");
     for(int i = 0; i < 74; i++){
-        DEBG_PRINT("|| %02d | %04d        | %04d\n", i, lineStats.charCount[i], lineStats.absolutePos[i]);
+        DEBG_PRINT("|| %02d | %04d        | %04ld\n", i, lineStats.charCount[i], lineStats.absolutePos[i]);
         if (lineStats.absolutePos[i] == -1){
             break;
         }
@@ -206,7 +206,7 @@ void debugPrintInternalLineStats(){
  * Function to translate current screen position to (general) absolute atomic index. 
  * >> relativeLine and charColumn require counting form position 0.
  */
-int getAbsoluteAtomicIndex(int relativeLine, int charColumn, Sequence* sequence){
+Position getAbsoluteAtomicIndex(int relativeLine, int charColumn, Sequence* sequence){
     DEBG_PRINT("Calculating abs atomic index for: line%d, column%d...\n", relativeLine, charColumn);
     //debugPrintInternalState(sequence, true, false);
     //debugPrintInternalLineStats();
@@ -225,22 +225,27 @@ int getAbsoluteAtomicIndex(int relativeLine, int charColumn, Sequence* sequence)
 
     LineBidentifier linBidentifier = getCurrentLineBidentifier();
 
-    int size = 0;
-    int blockOffset = 0;
+    Size size = 0;
+    Size blockOffset = 0;
     int charCount = 0;
-    int rollingAtomicCount = 0;
+    Size rollingAtomicCount = 0;
     Atomic *currentItemBlock = NULL;
+    BlockIterator blockIterator;
+    if(initBlockIterator(&blockIterator, sequence, lineStats.absolutePos[relativeLine]) == -1){
+        ERR_PRINT("Position determination failed (no block at atomic:%ld).\n", lineStats.absolutePos[relativeLine]);
+        return -1;
+    }
 
     while (charCount < charColumn + _horizontalScreenOffset +1){
-        DEBG_PRINT("rollingAtmcCount:%d, blockOffs:%d, size:%d.\n", rollingAtomicCount, blockOffset, size);
+        DEBG_PRINT("rollingAtmcCount:%ld, blockOffs:%ld, size:%ld.\n", rollingAtomicCount, blockOffset, size);
         if(rollingAtomicCount >= size){
             blockOffset = blockOffset + rollingAtomicCount;
             rollingAtomicCount = 0;
-            DEBG_PRINT("Requesting next block in seek, at atomic:%d\n", lineStats.absolutePos[relativeLine] + blockOffset);
-            size = getItemBlock(sequence, lineStats.absolutePos[relativeLine] + blockOffset, &currentItemBlock);
-            DEBG_PRINT("New blockOffset=%d, size=%d\n", blockOffset, size);
+            DEBG_PRINT("Requesting next block in seek, at atomic:%ld\n", lineStats.absolutePos[relativeLine] + blockOffset);
+            size = (blockOffset == 0) ? getCurrentBlock(&blockIterator, &currentItemBlock) : getNextBlock(&blockIterator, &currentItemBlock);
+            DEBG_PRINT("New blockOffset=%ld, size=%ld\n", blockOffset, size);
             if(size <= 0){
-                ERR_PRINT("Position determination failed (on block request for atomic:%d).\n", lineStats.absolutePos[relativeLine] + blockOffset);
+                ERR_PRINT("Position determination failed (on block request for atomic:%ld).\n", lineStats.absolutePos[relativeLine] + blockOffset);
                 return -1;
             }
         }
@@ -273,7 +278,7 @@ int getAbsoluteAtomicIndex(int relativeLine, int charColumn, Sequence* sequence)
         } 
         rollingAtomicCount++;
     }
-    DEBG_PRINT("Atomic start of line:%d, blockOffs:%d, rollingAtomCont:%d\n",lineStats.absolutePos[relativeLine],blockOffset,rollingAtomicCount);
+    DEBG_PRINT("Atomic start of line:%ld, blockOffs:%ld, rollingAtomCont:%ld\n",lineStats.absolutePos[relativeLine],blockOffset,rollingAtomicCount);
     return lineStats.absolutePos[relativeLine] + blockOffset + rollingAtomicCount - 1;
 }
     
@@ -286,7 +291,7 @@ int getAbsoluteAtomicIndex(int relativeLine, int charColumn, Sequence* sequence)
 /*Function that returns a wChar string with L'\0' terminator. 
 >> sizeToPass == last parsed index of itemArray **+1**; 
 >> precomputedWCharCount == nbr of wChars without the here added null terminator*/
-wchar_t* utf8_to_wchar(const Atomic* itemArray, int sizeToParse, int precomputedWCharCount){
+wchar_t* utf8_to_wchar(const Atomic* itemArray, Size sizeToParse, Size precomputedWCharCount){
     if(precomputedWCharCount == 0){
         /* Might add extra calculation algorithm here if needed.*/
         ERR_PRINT("Compute utf-8 char count not implemented!! Please pass precalculated value with function call.\n");
@@ -309,10 +314,10 @@ wchar_t* utf8_to_wchar(const Atomic* itemArray, int sizeToParse, int precomputed
     size_t destIndx = 0;
     
     //DEBG_PRINT("Bool: %d\n", (((int)atomicIndx) < sizeToParse) && (((int)destIndx) < precomputedWCharCount));
-    while((((int)atomicIndx) < sizeToParse) && (((int)destIndx) < precomputedWCharCount)){
+    while((((Size)atomicIndx) < sizeToParse) && (((Size)destIndx) < precomputedWCharCount)){
         //DEBG_PRINT("Trying to parse\n");
         //DEBG_PRINT("Current parser byte: %02x\n", (uint8_t) itemArray[(int)atomicIndx]);
-        size_t lenOfCurrentParse = mbrtowc(&wStrToReturn[(int)destIndx], (const char*) &itemArray[(int)atomicIndx], sizeToParse - atomicIndx, &state);
+        size_t lenOfCurrentParse = mbrtowc(&wStrToReturn[destIndx], (const char*) &itemArray[atomicIndx], sizeToParse - atomicIndx, &state);
         //BG_PRINT("Got parser size:%d\n", (int) lenOfCurrentParse);
         if((int) lenOfCurrentParse == -1){
             ERR_PRINT("Encountered invalid utf-8 char while converting!\n");
@@ -326,16 +331,16 @@ wchar_t* utf8_to_wchar(const Atomic* itemArray, int sizeToParse, int precomputed
             //Increment to next utf-8 byte (sequence) start:
             //DEBG_PRINT("Incrementing atomic postion by: %d\n", (int) lenOfCurrentParse);
             destIndx+=1;
-            atomicIndx += (int)lenOfCurrentParse;
+            atomicIndx += lenOfCurrentParse;
         }
         //DEBG_PRINT("Bool: %d\n", (((int)atomicIndx) < sizeToParse) && (((int)destIndx) < precomputedWCharCount));
     }
     //Finalize parse
-    if (( (int) destIndx < precomputedWCharCount)){
-        ERR_PRINT("Parser did not reach expected nbr of UTF-8 chars: Atomics index %d ; UTF-8 chars index: %d\n",(int) atomicIndx,(int) destIndx);
-        wStrToReturn[(int)destIndx] = L'\0';
+    if (( (Size) destIndx < precomputedWCharCount)){
+        ERR_PRINT("Parser did not reach expected nbr of UTF-8 chars: Atomics index %zu ; UTF-8 chars index: %zu\n", atomicIndx, destIndx);
+        wStrToReturn[destIndx] = L'\0';
     } else{
-        wStrToReturn[(int)precomputedWCharCount] = L'\0';
+        wStrToReturn[precomputedWCharCount] = L'\0';
     }
     return wStrToReturn;
 }
\ No newline at end of file
@@ -36,7 +36,7 @@ ReturnCode sendToXclip(const char* text);
  * >> The line number requires counting from 0. Returns -1 on error.
  * >> Returns -1 if general state invalid, but does not check if requested relative line (on screen) is beyond range.
  */
-int getGeneralLineNbr(int lineNbrOnScreen);
+long getGeneralLineNbr(int lineNbrOnScreen);
 
 /**
  * Returns the quantity of lines currently stored in line stats system.
@@ -52,7 +52,7 @@ int getUtfNoControlCharCount(int relativeLine);
  * Function to translate current screen position to (general) absolute atomic index. 
  * >> relativeLine and charColumn require counting form position 0.
  */
-int getAbsoluteAtomicIndex(int relativeLine, int charColumn, Sequence* sequence);
+Position getAbsoluteAtomicIndex(int relativeLine, int charColumn, Sequence* sequence);
 
 /**
  * Interface to invalidate current line statistics until first line is updated again. 
@@ -62,12 +62,12 @@ ReturnCode setLineStatsNotUpdated();
 /**
  * Function to update internal line statistics data structure. Line number counting from 0. 
  */
-ReturnCode updateLine(int relativeLineNumber, int absoluteGeneralAtomicPosition , int nbrOfUtf8CNoControlChars);
+ReturnCode updateLine(int relativeLineNumber, Position absoluteGeneralAtomicPosition , int nbrOfUtf8CNoControlChars);
 
 /**
  * Get Line number at the top of the screen.
  */
-int gettopMostLineNbr();
+long gettopMostLineNbr();
 
 /**
  * Function to call when scrolling.
@@ -79,7 +79,7 @@ ReturnCode moveAbsoluteLineNumbers(Sequence *sequence, int addOrSubstractOne);
  * Function to call when scrolling. Counting line numbers form 0. 
  *  requires full update of statistics afterwards since operation invalidates internal state.
  */
-ReturnCode jumpAbsoluteLineNumber(int newTopLineNumber, int atomicIdxOfTop);
+ReturnCode jumpAbsoluteLineNumber(long newTopLineNumber, Position atomicIdxOfTop);
 
 /**
  * Returns the current horizontal scrolling state, returns integer >= 0. 
@@ -98,7 +98,7 @@ ReturnCode setHorizontalScrollOffset(int newValue);
 /**
  * Special function to port leap of faith value to next printing round since line stats will be invalidated by then.
  */
-int getPrintingPortAtomicPosition();
+Position getPrintingPortAtomicPosition();
 
 /*
 ====================
@@ -109,7 +109,7 @@ int getPrintingPortAtomicPosition();
 /*Function that returns a wChar string with L'\0' terminator. 
 >> sizeToPass == last parsed index of itemArray **+1**; 
 >> precomputedWCharCount == nbr of wChars without the here added null terminator*/
-wchar_t* utf8_to_wchar(const Atomic* itemArray, int sizeToParse, int precomputedWCharCount);
+wchar_t* utf8_to_wchar(const Atomic* itemArray, Size sizeToParse, Size precomputedWCharCount);
 
 
 #endif 
\ No newline at end of file
@@ -0,0 +1,87 @@
+#include "incrementalSearch.h"
+#include <stdlib.h>
+#include <string.h>
+
+#include "debugUtil.h"
+
+ReturnCode updateIncrementalSearch(IncrementalSearch *search, const wchar_t *findText, Position origin) {
+    size_t needleLength = findText != NULL ? wcstombs(NULL, findText, 0) : 0;
+    if (needleLength == 0 || needleLength == (size_t)-1) {
+        cancelIncrementalSearch(search);
+        return -1;
+    }
+    Atomic *needle = malloc(needleLength + 1);
+    if (needle == NULL) {
+        ERR_PRINT("Memory allocation failed for incremental search.\n");
+        cancelIncrementalSearch(search);
+        return -1;
+    }
+    wcstombs((char *)needle, findText, needleLength + 1);
+
+    // An occurrence of the extended text is an occurrence of the previous one: no match before the previous hit
+    bool extended = search->needle != NULL && search->origin == origin && needleLength >= search->needleLength
+                    && memcmp(needle, search->needle, search->needleLength) == 0;
+    if (extended) {
+        DEBG_PRINT("Incremental search resumes at %ld.\n", search->finished ? search->found : search->next);
+        if (search->finished && search->found != -1) {
+            search->next = search->found; // Check the previous hit first
+            search->wrapped = search->found < origin;
+            search->finished = false;
+        }
+    } else {
+        search->origin = origin;
+        search->next = origin;
+        search->wrapped = false;
+        search->finished = false;
+    }
+    free(search->needle);
+    search->needle = needle;
+    search->needleLength = needleLength;
+    search->found = -1;
+    return 1;
+}
+
+ReturnCode continueIncrementalSearch(IncrementalSearch *search, Sequence *sequence, Size budget) {
+    if (search->needle == NULL || budget <= 0) {
+        ERR_PRINT("continueIncrementalSearch called without search or budget.\n");
+        return -1;
+    }
+    Position totalSize = (Position)getCurrentTotalSize(sequence);
+    if (search->origin > totalSize) {
+        search->origin = totalSize;
+        search->next = totalSize;
+    }
+
+    while (!search->finished && budget > 0) {
+        Position end = search->wrapped ? search->origin : totalSize;
+        Position to = end - search->next > budget ? search->next + budget : end;
+        Position found = findNeedleBetween(sequence, search->needle, search->needleLength, search->next, to);
+        budget -= to - search->next;
+        if (found != -1) {
+            search->next = found;
+            search->found = found;
+            search->finished = true;
+        } else if (to < end) {
+            search->next = to;
+        } else if (!search->wrapped && search->origin > 0) {
+            search->next = 0; // Continue at the beginning of the text
+            search->wrapped = true;
+        } else {
+            search->next = end;
+            search->finished = true; // No match at all
+        }
+    }
+    return search->finished ? 1 : 0;
+}
+
+bool isIncrementalSearchRunning(IncrementalSearch *search) {
+    return search->needle != NULL && !search->finished;
+}
+
+void cancelIncrementalSearch(IncrementalSearch *search) {
+    free(search->needle);
+    search->needle = NULL;
+    search->needleLength = 0;
+    search->finished = false;
+    search->found = -1;
+}
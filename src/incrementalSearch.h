@@ -0,0 +1,49 @@
+#ifndef INCREMENTALSEARCH_H
+#define INCREMENTALSEARCH_H
+
+#include "textStructure.h"
+
+/*
+Search-as-you-type: the search for the current find text runs in slices (see continueIncrementalSearch()) which the
+editor executes while it waits for input, so a new character simply replaces the running search.
+Every occurrence of an extended find text is also an occurrence of the shorter one at the same position, so after
+typing one more character the search resumes at the previous hit instead of scanning the skipped text again.
+*/
+
+#define INCREMENTAL_SEARCH_SLICE_SIZE (4 * 1024 * 1024) /* atomics scanned per slice, keeps the input responsive */
+
+/* State of the incremental search, initialize with {0} */
+typedef struct {
+    Atomic *needle;       // UTF-8 find text, NULL if no search is running
+    size_t needleLength;
+    Position origin;      // the search starts here and wraps around at the end of the text
+    Position next;        // no match starts between origin and next (in search order)
+    bool wrapped;         // next lies before origin
+    bool finished;        // done, found holds the result
+    Position found;       // position of the hit, -1 if there is none
+} IncrementalSearch;
+
+/**
+ * (Re)starts the search for the find text (nullterminated string of wide chars) at origin.
+ * If the text extends the previous find text and origin is the same, the progress of the previous search is kept.
+ * Returns -1 on error (e.g. empty find text), the search is cancelled then.
+ */
+ReturnCode updateIncrementalSearch(IncrementalSearch *search, const wchar_t *findText, Position origin);
+
+/**
+ * Scans up to budget further atomics.
+ * Returns 1 once the search is finished (search->found holds the hit or -1), 0 if it has to be continued and -1 on error.
+ */
+ReturnCode continueIncrementalSearch(IncrementalSearch *search, Sequence *sequence, Size budget);
+
+/**
+ * Returns true if a search was started and is not finished yet.
+ */
+bool isIncrementalSearchRunning(IncrementalSearch *search);
+
+/**
+ * Stops the search and releases its find text.
+ */
+void cancelIncrementalSearch(IncrementalSearch *search);
+
+#endif
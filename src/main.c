@@ -16,11 +16,19 @@
 #include "debugUtil.h" // For easy managmenet of logger and error messages
 #include "profiler.h" //Custom profiler for easy metrics
 #include "undoRedoUtilities.h" // handler for all undo/redos
+#include "regexSearch.h" // Regular expression search (find text written as /pattern/)
+#include "matchIndex.h" // Index of all matches of the searched text (match count, previous match)
+#include "multiSearch.h" // Search for a list of texts at once (find text written as {a,b,c} or {@file})
+#include "incrementalSearch.h" // Search-as-you-type in the find menu
+#include "trigramIndex.h" // Optionally stored search index of large files
 
 #define CTRL_KEY(k) ((k) & 0x1f)
 
 #define MENU_HEIGHT 2 //lines of menu
 
+#define IDLE_TIMEOUT_MS 1000 // get_wch() gives up after this time without input, the idle time is used for piece compaction
+#define COUNT_PROGRESS_REFRESH_MS 200 // refresh interval of the progress while a large file is counted in the background
+
 #define BUTTON_HEIGHT 1
 #define BUTTON_SAVE_WIDTH 6
 #define BUTTON_SEARCH_WIDTH 8  
@@ -57,10 +65,15 @@ static int lastGuiHeight = 0, lastGuiWidth = 0;
 // Menu implementations:
 enum _MenuState { NOT_IN_MENU, FIND, FIND_CYCLE, F_AND_R1, F_AND_R2, F_AND_R_CYCLE };
 static enum _MenuState currMenuState = NOT_IN_MENU;
+enum _MenuSearchAction { MENU_FIND, MENU_FIND_PREVIOUS, MENU_REPLACE, MENU_REPLACE_ALL };
 static int menuCursor = 0;
 #define MAX_MENU_INPUT 15
 static wchar_t firstMenuInput[MAX_MENU_INPUT] = L"";// access first menue
 static wchar_t secondMenuInput[MAX_MENU_INPUT] = L"";//access second menue
+static bool ignoreCaseInFind = false; // toggled with Ctrl-t in the find menu
+static char foundPatternText[64] = ""; // pattern of a pattern list found by the last search
+static IncrementalSearch incrementalSearch = {0}; // runs while the find text is typed
+static Position incrementalOrigin = 0; // cursor position when the find menu was opened
 
 /*======== forward declarations ========*/
 void init_editor(void);
@@ -92,6 +105,12 @@ bool autoAdjustHorizontalScrolling(bool forEndCursor);
 
 // Helper functions:
 ReturnCode deleteCurrentSelectionRange();
+SearchResult run_menu_search(enum _MenuSearchAction action, Position startPosition);
+void jump_to_search_result(SearchResult result);
+PatternSet *parse_pattern_list(const wchar_t *input);
+void restart_incremental_search();
+void format_match_status(char *buffer, size_t bufferSize);
+void format_count_status(char *buffer, size_t bufferSize);
 
 
 /*======== operations ========*/
@@ -122,7 +141,7 @@ ReturnCode print_items_after(Position firstAtomic, int nbrOfLines){
     }
     int currLineBcount = 0;
     bool requestNextBlock = false;
-    int size = -1;
+    Size size = -1;
 
     //In order to ensure porting line variables for if split over multiple blocks:
     int atomicsInLine = 0; // not an index! (+1 generally) 
@@ -130,7 +149,13 @@ ReturnCode print_items_after(Position firstAtomic, int nbrOfLines){
     int sinceHorizScrollCounter = 0;
     int nbrOfUtf8CharsInLine = 0;
     int nbrOfUtf8CharsNoControlCharsInLine = 0; // If we want to ignore line breaks.
-    int frozenLineStart = firstAtomic; // Stays set until line break or end of text for statistics
+    Position frozenLineStart = firstAtomic; // Stays set until line break or end of text for statistics
+
+    // Only the first block is looked up, the following ones are reached by walking the pieces
+    BlockIterator blockIterator;
+    if (initBlockIterator(&blockIterator, activeSequence, firstAtomic) == -1){
+        return -1;
+    }
 
     while( currLineBcount < nbrOfLines ){
         //DEBG_PRINT("[Trace] : in main print while loop, %p %d %d \n", activeSequence, currentLineBreakStd, currentLineBidentifier);
@@ -138,7 +163,7 @@ ReturnCode print_items_after(Position firstAtomic, int nbrOfLines){
         if(requestNextBlock){
             //DEBG_PRINT("[Trace] : Consecutive block requested\n");
             firstAtomic = firstAtomic + size; // since size == last index +1 no additional +1 needed.
-            size = (int) getItemBlock(activeSequence, firstAtomic, &currentItemBlock);
+            size = getNextBlock(&blockIterator, &currentItemBlock);
             //DEBG_PRINT("The size value %d\n", size);
             if (size < 0){
                 return 2;
@@ -146,15 +171,15 @@ ReturnCode print_items_after(Position firstAtomic, int nbrOfLines){
             requestNextBlock = false;
         } else{
             //DEBG_PRINT("[Trace] : First block requested\n");
-            size = (int) getItemBlock(activeSequence, firstAtomic, &currentItemBlock);
+            size = getCurrentBlock(&blockIterator, &currentItemBlock);
             //DEBG_PRINT("The size value %d\n", size);
         }
         
 
-        if(( size <= 0 ) || ( currentItemBlock == NULL )){DEBG_PRINT("Main error: size value %d\n", size); return -1; }//Error!!
+        if(( size <= 0 ) || ( currentItemBlock == NULL )){DEBG_PRINT("Main error: size value %ld\n", size); return -1; }//Error!!
 
-        int currentSectionStart = 0; //i.e. offset of nbr of Items form pointer start
-        int offsetCounter = 0; //i.e. RUNNING offset of nbr of Items form currentSectionStart
+        Size currentSectionStart = 0; //i.e. offset of nbr of Items form pointer start
+        Size offsetCounter = 0; //i.e. RUNNING offset of nbr of Items form currentSectionStart
         int nbrOfUtf8Chars = 0;
         int nbrOfUtf8CharsNoControlChars = 0;// If we want to ignore line breaks etc.
 
@@ -383,9 +408,20 @@ int main(int argc, char *argv[]){
                     break;
             }
         }
+        if(argc > 3){
+            DEBG_PRINT("handling add buffer spill threshold arg input.\n");
+            long spillThresholdMiB = atol(argv[3]);
+            if (spillThresholdMiB > 0) {
+                setAddBufferSpillThreshold((size_t)spillThresholdMiB << 20);
+            }
+        }
+        if(argc > 4){
+            DEBG_PRINT("handling trigram index persistence arg input.\n");
+            setTrigramIndexPersistence(atoi(argv[4]) == 1);
+        }
     } else{
         ERR_PRINT("Error argc insufficient.\n");
-        fprintf(stderr, "Argument issue, usage: ./textterminal.out [mandatory relative path to existing or new file] [for new file or file with no line breaks: file standard 0,1, or 2]\n");
+        fprintf(stderr, "Argument issue, usage: ./textterminal.out [mandatory relative path to existing or new file] [for new file or file with no line breaks: file standard 0,1, or 2] [optional: add buffer spill threshold in MiB] [optional: 1 to store the search index of large files]\n");
         exit(-1);
     }
 
@@ -415,7 +451,7 @@ int main(int argc, char *argv[]){
         if (activeSequence != NULL && lastGuiHeight > MENU_HEIGHT) {
             int linesToRender = lastGuiHeight - MENU_HEIGHT;
             if (linesToRender > 0) {
-                DEBG_PRINT("Refreshing text now, from atomic %d.\n", getPrintingPortAtomicPosition());
+                DEBG_PRINT("Refreshing text now, from atomic %ld.\n", getPrintingPortAtomicPosition());
                 print_items_after(getPrintingPortAtomicPosition(), linesToRender);
             }
         }
@@ -441,6 +477,7 @@ void init_editor(void) {
     raw();                    // Disable line buffering
     noecho();                 // Don't echo keys to screen
     keypad(stdscr, TRUE);     // Enable function keys
+    timeout(getBackgroundCountProgress(activeSequence) != -1 ? COUNT_PROGRESS_REFRESH_MS : IDLE_TIMEOUT_MS); // Return from input reads when idle
     
     // Get initial screen size
     getmaxyx(stdscr, lastGuiHeight, lastGuiWidth);
@@ -517,6 +554,11 @@ void handle_button_press(int button_index) {
             menuCursor = 0;
             // Clear the search input
             wmemset(firstMenuInput, L'\0', MAX_MENU_INPUT);
+            cancelIncrementalSearch(&incrementalSearch);
+            incrementalOrigin = getAbsoluteAtomicIndex(cursorY, cursorX, activeSequence);
+            if (incrementalOrigin < 0) {
+                incrementalOrigin = 0;
+            }
             refreshFlag = true;
             break;
             
@@ -593,7 +635,9 @@ void draw_menu_interface() {
             draw_text_input_field(menu_y, field_start_x, FIELD_WIDTH, L"Search", firstMenuInput, menuCursor, true);
             // Optional: Add instruction text if there's space
             int instr_x = field_start_x + FIELD_WIDTH + FIELD_PROMPT_WIDTH + 5;
-            if (instr_x < lastGuiWidth - 20) {
+            if (instr_x < lastGuiWidth - 56) {
+                mvprintw(menu_y, instr_x, "Enter to search, Ctrl-t: ignore case [%c], Esc to cancel", ignoreCaseInFind ? 'x' : ' ');
+            } else if (instr_x < lastGuiWidth - 20) {
                 mvprintw(menu_y, instr_x, "Enter to search, Esc to cancel");
             }
             break;
@@ -626,6 +670,198 @@ void draw_menu_interface() {
     }
 }
 
+/**
+ * Turns a position found in the match index into a SearchResult (-1 stays not found).
+ */
+static SearchResult indexed_search_result(Position foundPosition) {
+    SearchResult result = {-1, -1};
+    if (foundPosition != -1) {
+        result.foundPosition = foundPosition;
+        result.lineNumber = getLineNumber(activeSequence, foundPosition);
+    }
+    return result;
+}
+
+/**
+ * Runs the search action of the menu with the current inputs.
+ * A find text written as /pattern/ is searched as regular expression (see regexSearch.h), otherwise as plain text.
+ */
+SearchResult run_menu_search(enum _MenuSearchAction action, Position startPosition) {
+    size_t length = wcslen(firstMenuInput);
+    foundPatternText[0] = '\0';
+    if (length > 2 && firstMenuInput[0] == L'{' && firstMenuInput[length - 1] == L'}') {
+        SearchResult result = {-1, -1};
+        PatternSet *patternSet = parse_pattern_list(firstMenuInput);
+        if (patternSet == NULL || action != MENU_FIND) {
+            freePatternSet(patternSet);
+            return result; // Invalid list, pattern lists are only searched forward (no replace)
+        }
+        int patternIndex = -1;
+        result = findAnyPattern(activeSequence, patternSet, startPosition, &patternIndex);
+        if (result.foundPosition != -1) {
+            snprintf(foundPatternText, sizeof(foundPatternText), "%s", getPatternText(patternSet, patternIndex));
+        }
+        freePatternSet(patternSet);
+        return result;
+    }
+    if (length <= 2 || firstMenuInput[0] != L'/' || firstMenuInput[length - 1] != L'/') {
+        if (ignoreCaseInFind && (action == MENU_FIND || action == MENU_FIND_PREVIOUS)) {
+            clearMatchIndex(activeSequence); // The index only holds exact matches
+            return action == MENU_FIND ? findIgnoringCase(activeSequence, firstMenuInput, startPosition)
+                                       : findPreviousIgnoringCase(activeSequence, firstMenuInput, startPosition);
+        }
+        switch (action) {
+            case MENU_FIND:
+                if (setMatchIndexNeedle(activeSequence, firstMenuInput) == 1) {
+                    if (isMatchIndexComplete(activeSequence)) {
+                        return indexed_search_result(findIndexedMatch(activeSequence, startPosition, false));
+                    }
+                    timeout(0); // Build the rest of the index in the idle slices of process_input()
+                }
+                return find(activeSequence, firstMenuInput, startPosition);
+            case MENU_FIND_PREVIOUS:
+                if (setMatchIndexNeedle(activeSequence, firstMenuInput) == 1) {
+                    if (isMatchIndexComplete(activeSequence)) {
+                        return indexed_search_result(findIndexedMatch(activeSequence, startPosition, true));
+                    }
+                    timeout(0);
+                }
+                return findPrevious(activeSequence, firstMenuInput, startPosition);
+            case MENU_REPLACE:
+                return findAndReplace(activeSequence, firstMenuInput, secondMenuInput, startPosition);
+            default:
+                return findAndReplaceAll(activeSequence, firstMenuInput, secondMenuInput, startPosition);
+        }
+    }
+
+    wchar_t pattern[MAX_MENU_INPUT];
+    wmemcpy(pattern, firstMenuInput + 1, length - 2);
+    pattern[length - 2] = L'\0';
+    SearchResult result = {-1, -1};
+    Regex *regex = compileRegex(pattern);
+    if (regex == NULL) {
+        return result; // Invalid pattern, nothing found
+    }
+    switch (action) {
+        case MENU_FIND:
+            result = findRegex(activeSequence, regex, startPosition, NULL);
+            break;
+        case MENU_FIND_PREVIOUS:
+            break; // Regular expressions are only searched forward
+        case MENU_REPLACE:
+            result = findAndReplaceRegex(activeSequence, regex, secondMenuInput, startPosition);
+            break;
+        default:
+            result = findAndReplaceAllRegex(activeSequence, regex, secondMenuInput, startPosition);
+            break;
+    }
+    freeRegex(regex);
+    return result;
+}
+
+/**
+ * Compiles a find text written as {a,b,c} (comma separated patterns) or {@path} (file with one pattern per line).
+ * Returns NULL if the list is empty or the file can not be read.
+ */
+PatternSet *parse_pattern_list(const wchar_t *input) {
+    size_t length = wcslen(input);
+    wchar_t list[MAX_MENU_INPUT];
+    wmemcpy(list, input + 1, length - 2);
+    list[length - 2] = L'\0';
+
+    if (list[0] == L'@') {
+        char filePath[MAX_MENU_INPUT * 4];
+        if (wcstombs(filePath, list + 1, sizeof(filePath)) == (size_t)-1) {
+            return NULL;
+        }
+        return loadPatternSet(filePath);
+    }
+
+    const wchar_t *patterns[MAX_MENU_INPUT];
+    int patternCount = 0;
+    wchar_t *savePointer = NULL;
+    for (wchar_t *pattern = wcstok(list, L",", &savePointer); pattern != NULL; pattern = wcstok(NULL, L",", &savePointer)) {
+        patterns[patternCount++] = pattern;
+    }
+    return patternCount > 0 ? compilePatternSet(patterns, patternCount) : NULL;
+}
+
+/**
+ * Starts searching the find text while it is typed (plain, case-sensitive find texts only), see process_input().
+ */
+void restart_incremental_search() {
+    size_t length = wcslen(firstMenuInput);
+    bool special = length > 2 && ((firstMenuInput[0] == L'/' && firstMenuInput[length - 1] == L'/')
+                                  || (firstMenuInput[0] == L'{' && firstMenuInput[length - 1] == L'}'));
+    if (length == 0 || special || ignoreCaseInFind) {
+        cancelIncrementalSearch(&incrementalSearch); // Searched on Enter only
+        return;
+    }
+    if (updateIncrementalSearch(&incrementalSearch, firstMenuInput, incrementalOrigin) == 1) {
+        timeout(0); // Run the slices between the key presses
+    }
+}
+
+/**
+ * Moves the view and the cursor to the found text (does nothing if nothing was found).
+ */
+void jump_to_search_result(SearchResult result) {
+    if (result.foundPosition == -1) {
+        return;
+    }
+    Position foundLineStart = backtrackToFirstAtomicInLine(activeSequence, result.foundPosition);
+    if (foundLineStart >= 0) {
+        // While the file is counted the line number is unknown, it is taken over once the count is done (see process_input())
+        jumpAbsoluteLineNumber(result.lineNumber != -1 ? result.lineNumber - 1 : 0, foundLineStart);
+        cursorY = 0;
+        cursorEndY = 0;
+        cursorX = (int)(result.foundPosition - foundLineStart);
+        cursorEndX = (int)(result.foundPosition - foundLineStart);
+        refreshFlag = true;
+    }
+}
+
+/**
+ * Writes "Match k of N || " (or "N matches || ") for the find menu to the buffer, an empty string if there is no match index.
+ * While the index is still being built the count is marked as incomplete. After a pattern list search the found pattern is shown.
+ */
+void format_match_status(char *buffer, size_t bufferSize) {
+    buffer[0] = '\0';
+    if ((currMenuState == FIND || currMenuState == FIND_CYCLE) && foundPatternText[0] != '\0') {
+        snprintf(buffer, bufferSize, "Found: %s || ", foundPatternText);
+        return;
+    }
+    if ((currMenuState != FIND && currMenuState != FIND_CYCLE) || !hasMatchIndex(activeSequence, firstMenuInput)) {
+        return;
+    }
+    long count = getIndexedMatchCount(activeSequence);
+    const char *incomplete = isMatchIndexComplete(activeSequence) ? "" : "+";
+    Position cursorPosition = getAbsoluteAtomicIndex(cursorY, cursorX, activeSequence);
+    long rank = cursorPosition >= 0 ? getIndexedMatchRank(activeSequence, cursorPosition) : -1;
+    if (rank >= 0 && getIndexedMatchRank(activeSequence, cursorPosition + 1) > rank) {
+        snprintf(buffer, bufferSize, "Match %ld of %ld%s", rank + 1, count, incomplete);
+    } else {
+        snprintf(buffer, bufferSize, "%ld%s matches", count, incomplete);
+    }
+    if (!isMatchIndexComplete(activeSequence)) {
+        size_t length = strlen(buffer);
+        snprintf(buffer + length, bufferSize - length, " (indexing %d%%)", (int)(getMatchIndexProgress(activeSequence) * 100));
+    }
+    strncat(buffer, " || ", bufferSize - strlen(buffer) - 1);
+}
+
+/**
+ * Writes "N words, M lines" to the buffer, or the progress while the file is still counted in the background.
+ */
+void format_count_status(char *buffer, size_t bufferSize) {
+    int progress = getBackgroundCountProgress(activeSequence);
+    if (progress != -1) {
+        snprintf(buffer, bufferSize, "counting… %d%%", progress);
+    } else {
+        snprintf(buffer, bufferSize, "%ld words, %ld lines", getCurrentWordCount(activeSequence), getCurrentLineCount(activeSequence));
+    }
+}
+
 int check_button_click(int mouse_x, int mouse_y) {
     for (int i = 0; i < 3; i++) {
         if (mouse_y == lastGuiHeight-1 && 
@@ -645,6 +881,17 @@ void handle_menu_input(wint_t wch, int status) {
     // --- Handle Special Keys (Arrows, Backspace) ---
     if (status == KEY_CODE_YES) {
         switch (wch) {
+            case KEY_UP: // Previous match
+                if (currMenuState == FIND || currMenuState == FIND_CYCLE) {
+                    Position cursorForFind = getAbsoluteAtomicIndex(cursorY, cursorX, activeSequence);
+                    if (cursorForFind != -1) {
+                        jump_to_search_result(run_menu_search(MENU_FIND_PREVIOUS, cursorForFind));
+                    }
+                    currMenuState = FIND_CYCLE;
+                    refreshFlag = true;
+                }
+                break;
+
             case KEY_LEFT:
                 if (menuCursor > 0) {
                     menuCursor--;
@@ -682,6 +929,9 @@ void handle_menu_input(wint_t wch, int status) {
                              wcslen(target_input) - menuCursor + 1); 
                     menuCursor--;
                     menu_needs_refresh = true;
+                    if (currMenuState == FIND || currMenuState == FIND_CYCLE) {
+                        restart_incremental_search();
+                    }
                 }
                 break;
             }
@@ -689,6 +939,14 @@ void handle_menu_input(wint_t wch, int status) {
     }
     else if (status == OK) {
         switch (wch) {
+            case CTRL_KEY('t'): // Toggle case-insensitive search
+                if (currMenuState == FIND || currMenuState == FIND_CYCLE) {
+                    ignoreCaseInFind = !ignoreCaseInFind;
+                    menu_needs_refresh = true;
+                    restart_incremental_search();
+                }
+                break;
+
             case 27: // Escape key: exit menu mode
                 currMenuState = NOT_IN_MENU;
                 refreshFlag = true; // Request a full redraw to erase menu UI
@@ -696,19 +954,9 @@ void handle_menu_input(wint_t wch, int status) {
 
             case 9: // Tab key: replace all
                 if (currMenuState == F_AND_R2) {
-                    int cursorForFind = getAbsoluteAtomicIndex(cursorY, cursorX, activeSequence);
-                    SearchResult resultFindAndReplace = findAndReplaceAll(activeSequence, firstMenuInput, secondMenuInput, cursorForFind);
-                    if( resultFindAndReplace.foundPosition != -1) {
-                        int foundLineStart = backtrackToFirstAtomicInLine(activeSequence, resultFindAndReplace.foundPosition);
-                        if (foundLineStart >= 0) {
-                            jumpAbsoluteLineNumber(resultFindAndReplace.lineNumber - 1, foundLineStart);
-                            cursorY = 0;
-                            cursorEndY = 0;
-                            cursorX = resultFindAndReplace.foundPosition - foundLineStart;
-                            cursorEndX = resultFindAndReplace.foundPosition - foundLineStart;
-                            refreshFlag = true;
-                        }
-                    }
+                    Position cursorForFind = getAbsoluteAtomicIndex(cursorY, cursorX, activeSequence);
+                    SearchResult resultFindAndReplace = run_menu_search(MENU_REPLACE_ALL, cursorForFind);
+                    jump_to_search_result(resultFindAndReplace);
                     currMenuState = NOT_IN_MENU;
                     refreshFlag = true;
                 }
@@ -717,31 +965,22 @@ void handle_menu_input(wint_t wch, int status) {
             case KEY_ENTER:
             case 10:
             case 13: // Enter key: transition menu state or execute action
-                int cursorForFind = 0;
+                Position cursorForFind = 0;
                 if(currMenuState == FIND_CYCLE || currMenuState == F_AND_R_CYCLE){
                     cursorForFind = getAbsoluteAtomicIndex(cursorY, cursorX+1, activeSequence);
                 } else {
-                    int cursorForFind = getAbsoluteAtomicIndex(cursorY, cursorX+1, activeSequence);
-                    DEBG_PRINT("lastAtomic test: %d", getAbsoluteAtomicIndex(cursorY, cursorX+1, activeSequence));
+                    Position cursorForFind = getAbsoluteAtomicIndex(cursorY, cursorX+1, activeSequence);
+                    DEBG_PRINT("lastAtomic test: %ld", getAbsoluteAtomicIndex(cursorY, cursorX+1, activeSequence));
                     if(getAbsoluteAtomicIndex(cursorY, cursorX+1, activeSequence) == -1){
                         cursorForFind = getAbsoluteAtomicIndex(cursorY, cursorX, activeSequence);
                     }
                 }
                 if (currMenuState == FIND || currMenuState == FIND_CYCLE) {
                     DEBG_PRINT("Searching for: %ls\n", firstMenuInput);
+                    cancelIncrementalSearch(&incrementalSearch); // Enter searches on its own
                     // In the search case (FIND or FIND_CYCLE):
-                    SearchResult resultFind = find(activeSequence, firstMenuInput, cursorForFind);
-                    if(resultFind.foundPosition != -1) {
-                        int foundLineStart = backtrackToFirstAtomicInLine(activeSequence, resultFind.foundPosition);
-                        if (foundLineStart >= 0) {
-                            jumpAbsoluteLineNumber(resultFind.lineNumber - 1, foundLineStart);
-                            cursorY = 0;
-                            cursorEndY = 0;
-                            cursorX = resultFind.foundPosition - foundLineStart;
-                            cursorEndX = resultFind.foundPosition - foundLineStart;
-                            refreshFlag = true;
-                        }
-                    }
+                    SearchResult resultFind = run_menu_search(MENU_FIND, cursorForFind);
+                    jump_to_search_result(resultFind);
                     currMenuState = FIND_CYCLE;
                     DEBG_PRINT("Set currMenuState to FIND_CYCLE\n");
                     refreshFlag = true; // Request full redraw after action
@@ -752,18 +991,8 @@ void handle_menu_input(wint_t wch, int status) {
                     menu_needs_refresh = true;
                 } else if (currMenuState == F_AND_R2 || currMenuState == F_AND_R_CYCLE) {
                     DEBG_PRINT("Find: %ls, Replace: %ls\n", firstMenuInput, secondMenuInput);
-                    SearchResult resultFindAndReplace = findAndReplace(activeSequence, firstMenuInput, secondMenuInput, cursorForFind);
-                    if(resultFindAndReplace.foundPosition != -1) {
-                        int foundLineStart = backtrackToFirstAtomicInLine(activeSequence, resultFindAndReplace.foundPosition);
-                        if (foundLineStart >= 0) {
-                            jumpAbsoluteLineNumber(resultFindAndReplace.lineNumber - 1, foundLineStart);
-                            cursorY = 0;
-                            cursorEndY = 0;
-                            cursorX = resultFindAndReplace.foundPosition - foundLineStart;
-                            cursorEndX = resultFindAndReplace.foundPosition - foundLineStart;
-                            refreshFlag = true;
-                        }
-                    }
+                    SearchResult resultFindAndReplace = run_menu_search(MENU_REPLACE, cursorForFind);
+                    jump_to_search_result(resultFindAndReplace);
                     currMenuState = F_AND_R_CYCLE;
                     DEBG_PRINT("Set currMenuState to F_AND_R_CYCLE\n");
                     refreshFlag = true; // Request full redraw after action
@@ -793,6 +1022,9 @@ void handle_menu_input(wint_t wch, int status) {
 
                         menuCursor++;
                         menu_needs_refresh = true;
+                        if (currMenuState == FIND || currMenuState == FIND_CYCLE) {
+                            restart_incremental_search();
+                        }
                     }
                 }
                 break;
@@ -820,35 +1052,21 @@ ReturnCode pasteFromClipboard(Sequence* sequence, int cursorY, int cursorX) {
         return -1;
     }
     
-    // Convert UTF-8 to wide characters
-    size_t wcharCount = mbstowcs(NULL, clipboardText, 0);
-    if (wcharCount == (size_t)-1) {
-        ERR_PRINT("Invalid UTF-8 in clipboard text\n");
-        free(clipboardText);
-        return -1;
-    }
-    
-    wchar_t* wideText = malloc((wcharCount + 1) * sizeof(wchar_t));
-    if (wideText == NULL) {
-        ERR_PRINT("Failed to allocate memory for wide character conversion\n");
-        free(clipboardText);
-        return -1;
-    }
-    
-    mbstowcs(wideText, clipboardText, wcharCount + 1);
-    free(clipboardText);
-    
     // Insert the text at cursor position using getAbsoluteAtomicIndex
-    int insertPos = getAbsoluteAtomicIndex(cursorY, cursorX, sequence);
+    Position insertPos = getAbsoluteAtomicIndex(cursorY, cursorX, sequence);
     if (insertPos < 0) {
         ERR_PRINT("Failed to calculate insertion position\n");
-        free(wideText);
+        free(clipboardText);
         return -1;
     }
 
+    // xclip already delivers UTF-8, so it is copied into the sequence without any conversion
     DEBG_PRINT("Pasting at position: Y=%d, X=%d\n", cursorY, cursorX);
-    ReturnCode result = insert(sequence, insertPos, wideText);
-    free(wideText);
+    ReturnCode result = insertUtf8(sequence, insertPos, (const Atomic*)clipboardText, strlen(clipboardText));
+    if (result < 0) {
+        ERR_PRINT("Invalid UTF-8 in clipboard text\n");
+    }
+    free(clipboardText);
     
     return result;
 }
@@ -943,8 +1161,8 @@ ReturnCode copySelectionToClipboard(Sequence* sequence) {
     copyXoffset = endX-startX;
 
     // Use getAbsoluteAtomicIndex to get positions
-    int startPos = getAbsoluteAtomicIndex(startY, startX, sequence);
-    int endPos = getAbsoluteAtomicIndex(endY, endX, sequence)-1;
+    Position startPos = getAbsoluteAtomicIndex(startY, startX, sequence);
+    Position endPos = getAbsoluteAtomicIndex(endY, endX, sequence)-1;
     
     if (startPos < 0 || endPos < 0) {
         ERR_PRINT("Failed to calculate absolute positions for copy\n");
@@ -953,7 +1171,7 @@ ReturnCode copySelectionToClipboard(Sequence* sequence) {
     
     // Ensure proper order
     if (startPos > endPos) {
-        int temp = startPos;
+        Position temp = startPos;
         startPos = endPos;
         endPos = temp;
     }
@@ -979,7 +1197,7 @@ ReturnCode copySelectionToClipboard(Sequence* sequence) {
     }
     
     DEBG_PRINT("Copying selection: startY=%d, startX=%d, endY=%d, endX=%d\n", startY, startX, endY, endX);
-    DEBG_PRINT("Copying selection Atomic: startPos=%d, endPos=%d\n", startPos, endPos);
+    DEBG_PRINT("Copying selection Atomic: startPos=%ld, endPos=%ld\n", startPos, endPos);
     wcstombs(utf8Text, copiedText, utf8Size + 1);
     free(copiedText);
     
@@ -1051,20 +1269,24 @@ ReturnCode sendToXclip(const char* text) {
  * Extract text between abs positions
  * Returns allocated wchar_t string must be freed
  */
-wchar_t* extractTextRange(Sequence* sequence, int startPos, int endPos) {
+wchar_t* extractTextRange(Sequence* sequence, Position startPos, Position endPos) {
     if (sequence == NULL || startPos < 0 || endPos < startPos) {
         return NULL;
     }
     
     // Calculate total length needed
-    int totalLength = endPos - startPos + 1;
-    int utf8CharCount = 0;
-    int currentPos = startPos;
+    Size totalLength = endPos - startPos + 1;
+    Size utf8CharCount = 0;
+    Position currentPos = startPos;
+    BlockIterator blockIterator;
+    if (initBlockIterator(&blockIterator, sequence, startPos) == -1) {
+        return NULL;
+    }
     
     // Count UTF-8 characters in range
     while (currentPos <= endPos) {
         Atomic* block = NULL;
-        Size blockSize = getItemBlock(sequence, currentPos, &block);
+        Size blockSize = (currentPos == startPos) ? getCurrentBlock(&blockIterator, &block) : getNextBlock(&blockIterator, &block);
         if (blockSize <= 0 || block == NULL) {
             break;
         }
@@ -1072,7 +1294,7 @@ wchar_t* extractTextRange(Sequence* sequence, int startPos, int endPos) {
         Size remainingInRange = endPos - currentPos + 1;
         Size toProcess = (blockSize < remainingInRange) ? blockSize : remainingInRange;
         
-        for (int i = 0; i < toProcess; i++) {
+        for (Size i = 0; i < toProcess; i++) {
             if ((block[i] & 0xC0) != 0x80) {
                 utf8CharCount++;
             }
@@ -1094,11 +1316,12 @@ wchar_t* extractTextRange(Sequence* sequence, int startPos, int endPos) {
     
     // Extract actual text
     currentPos = startPos;
-    int resultPos = 0;
+    Size resultPos = 0;
+    initBlockIterator(&blockIterator, sequence, startPos);
     
     while (currentPos <= endPos && resultPos < utf8CharCount) {
         Atomic* block = NULL;
-        Size blockSize = getItemBlock(sequence, currentPos, &block);
+        Size blockSize = (currentPos == startPos) ? getCurrentBlock(&blockIterator, &block) : getNextBlock(&blockIterator, &block);
         if (blockSize <= 0 || block == NULL) {
             break;
         }
@@ -1173,6 +1396,46 @@ void process_input(void) {
     int status;
 
     status = get_wch(&wch);
+    if (status == ERR) {
+        // No input for a while: merge pieces fragmented by the previous edits, the text itself does not change
+        long savedPieces = compactPieces(activeSequence);
+        if (savedPieces > 0) {
+            DEBG_PRINT("Idle compaction saved %ld pieces.\n", savedPieces);
+        }
+        // Continue the search-as-you-type or the indexing of the matches, input is polled between the slices
+        bool pendingWork = false;
+        if (isIncrementalSearchRunning(&incrementalSearch)) {
+            if (currMenuState != FIND && currMenuState != FIND_CYCLE) {
+                cancelIncrementalSearch(&incrementalSearch); // Menu was left, the text may change now
+            } else if (continueIncrementalSearch(&incrementalSearch, activeSequence, INCREMENTAL_SEARCH_SLICE_SIZE) == 0) {
+                pendingWork = true;
+            } else if (incrementalSearch.found != -1) {
+                SearchResult result = {incrementalSearch.found, getLineNumber(activeSequence, incrementalSearch.found)};
+                jump_to_search_result(result);
+                currMenuState = FIND_CYCLE; // Enter continues with the next match
+                refreshFlag = true;
+            }
+        } else if (hasMatchIndex(activeSequence, NULL) && !isMatchIndexComplete(activeSequence)) {
+            pendingWork = extendMatchIndex(activeSequence, MATCH_INDEX_SLICE_SIZE) == 0;
+            refreshFlag = true; // Show the new match count
+        }
+        // Take over the totals once the background count of the file is done, show its progress until then
+        bool counting = false;
+        if (getBackgroundCountProgress(activeSequence) != -1) {
+            counting = finishBackgroundCount(activeSequence, false) == 0;
+            if (!counting && getGeneralLineNbr(0) != -1) {
+                // Jumps to search results during the count did not know the line number of the top line
+                Position top = getAbsoluteAtomicIndex(0, 0, activeSequence);
+                long topLine = top > 0 ? getLineNumber(activeSequence, top - 1) : 1;
+                if (topLine != -1) {
+                    jumpAbsoluteLineNumber(topLine - 1, top);
+                }
+            }
+            refreshFlag = true;
+        }
+        timeout(pendingWork ? 0 : (counting ? COUNT_PROGRESS_REFRESH_MS : IDLE_TIMEOUT_MS)); // Back to waiting once everything is done
+        return;
+    }
     DEBG_PRINT("process_input start: currMenuState=%d\n", currMenuState);
     if (currMenuState != NOT_IN_MENU) {
         handle_menu_input(wch, status);
@@ -1258,8 +1521,8 @@ if (status == OK && wch == CTRL_KEY('y')) {
 
     if (status == KEY_CODE_YES) {
         // Function key pressed
-        int posStart = -1; // Used for delete and backspace
-        int posEnd = -1; // Used for delete and backspace
+        Position posStart = -1; // Used for delete and backspace
+        Position posEnd = -1; // Used for delete and backspace
         switch (wch){
             case KEY_MOUSE:
                 MEVENT event;
@@ -1354,13 +1617,13 @@ if (status == OK && wch == CTRL_KEY('y')) {
                         if(!(getCurrentLineBstd() == MSDOS)){
                             DEBG_PRINT("Backspace remove '\n' case...\n");
                             posStart = getAbsoluteAtomicIndex(cursorY,0, activeSequence)-1;
-                            DEBG_PRINT("Pos would have been: %d but now %d",posStart +1, posStart);
+                            DEBG_PRINT("Pos would have been: %ld but now %ld",posStart +1, posStart);
                             posEnd = posStart;
                         } else{
                             //special MSDOS handling:
                             DEBG_PRINT("Backspace remove '\r\n' case...\n");
                             posStart = getAbsoluteAtomicIndex(cursorY,0, activeSequence)-2;
-                            DEBG_PRINT("(MSDOS); Pos would have been: %d but now %d",posStart +2, posStart);
+                            DEBG_PRINT("(MSDOS); Pos would have been: %ld but now %ld",posStart +2, posStart);
                             posEnd = posStart+1;
                         }
                         //debugPrintInternalState(activeSequence, true, false);
@@ -1380,7 +1643,7 @@ if (status == OK && wch == CTRL_KEY('y')) {
                         break;
                     }
 
-                    DEBG_PRINT("Backspace with atomics: %d to %d\n", posStart, posEnd);
+                    DEBG_PRINT("Backspace with atomics: %ld to %ld\n", posStart, posEnd);
                     if(delete(activeSequence, posStart, posEnd) < 0) {
                         ERR_PRINT("Backspace failed...\n");
                         break;
@@ -1409,13 +1672,13 @@ if (status == OK && wch == CTRL_KEY('y')) {
                             // Case of at end of a line:
                             posStart = getAbsoluteAtomicIndex(cursorY + 1, 0, activeSequence)-1;
                             posEnd = posStart;
-                            DEBG_PRINT("Pos would have been: %d but now %d",posStart +1, posStart);
+                            DEBG_PRINT("Pos would have been: %ld but now %ld",posStart +1, posStart);
                             //debugPrintInternalState(activeSequence, true, false);
                         } else{
                             //special MSDOS handling:
                             posStart = getAbsoluteAtomicIndex(cursorY + 1, 0, activeSequence)-2;
                             posEnd = posStart+1;
-                            DEBG_PRINT("(MSDOS); Pos would have been: %d but now %d",posStart +2, posStart);
+                            DEBG_PRINT("(MSDOS); Pos would have been: %ld but now %ld",posStart +2, posStart);
                             //debugPrintInternalState(activeSequence, true, false);
                         }
 
@@ -1430,7 +1693,7 @@ if (status == OK && wch == CTRL_KEY('y')) {
                         DEBG_PRINT("DELETE invalid case...\n");
                         break;
                     }
-                    DEBG_PRINT("Delete with atomics: %d to %d\n", posStart, posStart);
+                    DEBG_PRINT("Delete with atomics: %ld to %ld\n", posStart, posStart);
                     if(delete(activeSequence, posStart, posEnd) < 0) {
                         ERR_PRINT("Delete failed...\n");
                         break;
@@ -1483,30 +1746,30 @@ if (status == OK && wch == CTRL_KEY('y')) {
                 }
                 // Set here already since at least delete succeeded: 
                 
-                int atomicPos = getAbsoluteAtomicIndex(cursorY, cursorX, activeSequence);
-                DEBG_PRINT("Calculated atomic position: %d\n", atomicPos);
+                Position atomicPos = getAbsoluteAtomicIndex(cursorY, cursorX, activeSequence);
+                DEBG_PRINT("Calculated atomic position: %ld\n", atomicPos);
                 
                 if (atomicPos >= 0) {
-                    wchar_t toInsert[3];  // Buffer to hold the line ending
+                    const char *toInsert;  // The line ending (already UTF-8)
 
                     switch (getCurrentLineBstd()) {
                         case LINUX:
-                            wcscpy(toInsert, L"\n");
+                            toInsert = "\n";
                             break;
                         case MSDOS:
-                            wcscpy(toInsert, L"\r\n");
+                            toInsert = "\r\n";
                             break;
                         case MAC:
-                            wcscpy(toInsert, L"\r");
+                            toInsert = "\r";
                             break;
                         default:
                             ERR_PRINT("Enter input could not be handled since line break std not properly initialized.\n");
-                            wcscpy(toInsert, L"");
+                            toInsert = "";
                     }
                     
-                    DEBG_PRINT("Inserting line break at atomic:%d position with std:%d\n", atomicPos, getCurrentLineBstd());
+                    DEBG_PRINT("Inserting line break at atomic:%ld position with std:%d\n", atomicPos, getCurrentLineBstd());
 
-                    if (insert(activeSequence, atomicPos, toInsert) > 0) {
+                    if (insertUtf8(activeSequence, atomicPos, (const Atomic*)toInsert, strlen(toInsert)) > 0) {
                         DEBG_PRINT("Enter Scroll: lastGuiHeight - MENU_HEIGHT -1=%d, cursorY=%d", lastGuiHeight - MENU_HEIGHT -1, cursorY);
                         if(lastGuiHeight - MENU_HEIGHT -1 == cursorY){
                             changeScrolling(1);
@@ -1537,11 +1800,11 @@ if (status == OK && wch == CTRL_KEY('y')) {
                     }
 
                     // Get position for insertion
-                    int atomicPos = getAbsoluteAtomicIndex(cursorY, cursorX, activeSequence);
+                    Position atomicPos = getAbsoluteAtomicIndex(cursorY, cursorX, activeSequence);
                     if (atomicPos >= 0) {
                         // Convert single character to null-terminated wide string
                         
-                        DEBG_PRINT("Inserting Unicode character: U+%04X '%lc' at position %d\n", (unsigned int)wch, wch, atomicPos);
+                        DEBG_PRINT("Inserting Unicode character: U+%04X '%lc' at position %ld\n", (unsigned int)wch, wch, atomicPos);
                         DEBG_PRINT("The character width: %d", wcwidth(wch));
                         wchar_t convertedWchar[2];  // Wide string to hold the character + null terminator
                         convertedWchar[0] = (wchar_t)wch;
@@ -1554,7 +1817,7 @@ if (status == OK && wch == CTRL_KEY('y')) {
                             resetRangeSelectionState();   
                         }
                     } else {
-                        DEBG_PRINT("Invalid atomic position for insert: %d\n", atomicPos);
+                        DEBG_PRINT("Invalid atomic position for insert: %ld\n", atomicPos);
                     }
                     refreshFlag = true;
                     setLineStatsNotUpdated();
@@ -1584,8 +1847,8 @@ void changeScrolling(int incrY){
 
     if (incrY != 0) {
         DEBG_PRINT("changeScrolling in if statement (incrY != 0)\n");
-        int totalLines = getCurrentLineCount(activeSequence);
-        DEBG_PRINT("totalLines: %d\n", totalLines);
+        long totalLines = getCurrentLineCount(activeSequence);
+        DEBG_PRINT("totalLines: %ld\n", totalLines);
         if (totalLines < 0) totalLines = 0;  // Handle error case if totalLines negative
         
         int visibleLines = lastGuiHeight - MENU_HEIGHT; // Lines on screen
@@ -1915,9 +2178,13 @@ void updateCursorAndMenu(){
             // Draw buttons first
             draw_buttons();
             
-            mvprintw(lastGuiHeight - 2, 0, "Ln %d, Col %d || Line breaks: %s || %d words, %d lines || Ctrl-l to quit           ", 
+            char matchStatus[96];
+            char countStatus[64];
+            format_match_status(matchStatus, sizeof(matchStatus));
+            format_count_status(countStatus, sizeof(countStatus));
+            mvprintw(lastGuiHeight - 2, 0, "Ln %ld, Col %d || Line breaks: %s || %s || %sCtrl-l to quit           ", 
                 getGeneralLineNbr(cursorY + horizOffs + 1), cursorX + horizOffs + 1, getLineBreakString(currentLineBreakStd), 
-                getCurrentWordCount(activeSequence), getCurrentLineCount(activeSequence));
+                countStatus, matchStatus);
         }
     } else {
         autoAdjustHorizontalScrolling(true);
@@ -1946,10 +2213,12 @@ void updateCursorAndMenu(){
             if (currMenuState == NOT_IN_MENU) {
                 int horizOffs = getCurrHorizontalScrollOffset();
                 int status_x = buttons[2].x + buttons[2].width + 10;
-                mvprintw(lastGuiHeight - 2, 0, "Ln %d-%d, Col %d-%d || Line breaks: %s || %d words, %d lines || Ctrl-l to quit        ", 
+                char countStatus[64];
+                format_count_status(countStatus, sizeof(countStatus));
+                mvprintw(lastGuiHeight - 2, 0, "Ln %ld-%ld, Col %d-%d || Line breaks: %s || %s || Ctrl-l to quit        ", 
                     getGeneralLineNbr(cursorY + horizOffs + 1), getGeneralLineNbr(cursorEndY + horizOffs +1), 
                     cursorX + horizOffs + 1, cursorEndX + horizOffs + 1, getLineBreakString(currentLineBreakStd),
-                    getCurrentWordCount(activeSequence), getCurrentLineCount(activeSequence));
+                    countStatus);
             }
 
         }
@@ -0,0 +1,351 @@
+#include "matchIndex.h"
+#include <string.h>
+
+#include "debugUtil.h"
+#include "pieceTree.h"
+
+/*------ Definitions for internal use ------*/
+#define MATCH_NODES_PER_SLAB 4096
+
+/*------ Data structures for internal use ------*/
+typedef struct MatchNode MatchNode;
+struct MatchNode {
+    MatchNode *left;
+    MatchNode *right;
+    uint32_t priority;
+    Position gap;   // distance to the previous match (to position 0 for the first match)
+    Position span;  // sum of the gaps in the subtree
+    size_t count;   // amount of matches in the subtree
+};
+
+struct MatchIndex {
+    wchar_t *needle;      // needle as given
+    Atomic *utf8Needle;   // needle as searched
+    size_t needleLength;  // byte length of utf8Needle
+    MatchNode *root;
+    Position scannedUpTo; // all matches starting before this position are indexed
+    SlabAllocator nodeAllocator;
+    uint32_t randomState;
+};
+
+/* Collects the matches of a scan, see appendMatch() */
+typedef struct {
+    MatchIndex *index;
+    MatchNode *tree;       // matches collected so far
+    Position lastPosition; // position of the last match in tree (0 if empty)
+    bool failed;
+} MatchCollector;
+
+/*
+======================
+  Treap
+======================
+*/
+
+static inline Position spanOf(MatchNode *node) {
+    return node != NULL ? node->span : 0;
+}
+
+static inline size_t countOf(MatchNode *node) {
+    return node != NULL ? node->count : 0;
+}
+
+static inline void updateNode(MatchNode *node) {
+    node->span = spanOf(node->left) + node->gap + spanOf(node->right);
+    node->count = countOf(node->left) + 1 + countOf(node->right);
+}
+
+/**
+ * Concatenates two trees, the matches of right continue after the last match of left.
+ */
+static MatchNode *mergeTrees(MatchNode *left, MatchNode *right) {
+    if (left == NULL) {
+        return right;
+    }
+    if (right == NULL) {
+        return left;
+    }
+    if (left->priority > right->priority) {
+        left->right = mergeTrees(left->right, right);
+        updateNode(left);
+        return left;
+    }
+    right->left = mergeTrees(left, right->left);
+    updateNode(right);
+    return right;
+}
+
+/**
+ * Splits a tree into the matches before the position (relative to the start of the tree) and the remaining ones.
+ * The positions in right stay relative to the last match of left, i.e. merging both again gives the original tree.
+ */
+static void splitTree(MatchNode *tree, Position position, MatchNode **left, MatchNode **right) {
+    if (tree == NULL) {
+        *left = NULL;
+        *right = NULL;
+        return;
+    }
+    Position nodePosition = spanOf(tree->left) + tree->gap;
+    if (nodePosition < position) {
+        splitTree(tree->right, position - nodePosition, &tree->right, right);
+        *left = tree;
+    } else {
+        splitTree(tree->left, position, left, &tree->left);
+        *right = tree;
+    }
+    updateNode(tree);
+}
+
+/**
+ * Moves all matches of the tree by delta (changes only the gap of the first match).
+ */
+static void shiftTree(MatchNode *tree, Position delta) {
+    for (MatchNode *node = tree; node != NULL; node = node->left) {
+        node->span += delta;
+        if (node->left == NULL) {
+            node->gap += delta;
+        }
+    }
+}
+
+static void freeTree(MatchIndex *index, MatchNode *tree) {
+    if (tree == NULL) {
+        return;
+    }
+    freeTree(index, tree->left);
+    freeTree(index, tree->right);
+    slabFree(&index->nodeAllocator, tree);
+}
+
+/* Callback of forEachNeedleMatch(), appends a match behind all matches collected so far */
+static void appendMatch(Position position, void *context) {
+    MatchCollector *collector = (MatchCollector *)context;
+    MatchIndex *index = collector->index;
+    MatchNode *node = slabAlloc(&index->nodeAllocator);
+    if (node == NULL) {
+        collector->failed = true;
+        return;
+    }
+    index->randomState = index->randomState * 1664525u + 1013904223u;
+    node->left = NULL;
+    node->right = NULL;
+    node->priority = index->randomState;
+    node->gap = position - collector->lastPosition;
+    updateNode(node);
+    collector->tree = mergeTrees(collector->tree, node);
+    collector->lastPosition = position;
+}
+
+/*
+======================
+  Index
+======================
+*/
+
+ReturnCode setMatchIndexNeedle(Sequence *sequence, const wchar_t *needle) {
+    if (sequence == NULL || needle == NULL || needle[0] == L'\0') {
+        ERR_PRINT("setMatchIndexNeedle called with invalid sequence or empty needle.\n");
+        return -1;
+    }
+    if (hasMatchIndex(sequence, needle)) {
+        return 1; // Keep the index (and its progress)
+    }
+    clearMatchIndex(sequence);
+
+    MatchIndex *index = calloc(1, sizeof(MatchIndex));
+    size_t needleLength = wcstombs(NULL, needle, 0);
+    if (index == NULL || needleLength == (size_t)-1) {
+        ERR_PRINT("Could not create the match index.\n");
+        free(index);
+        return -1;
+    }
+    index->needle = malloc((wcslen(needle) + 1) * sizeof(wchar_t));
+    index->utf8Needle = malloc(needleLength + 1);
+    if (index->needle == NULL || index->utf8Needle == NULL) {
+        ERR_PRINT("Fatal malloc fail at match index creation!\n");
+        free(index->needle);
+        free(index->utf8Needle);
+        free(index);
+        return -1;
+    }
+    wcscpy(index->needle, needle);
+    wcstombs((char *)index->utf8Needle, needle, needleLength + 1);
+    index->needleLength = needleLength;
+    index->randomState = 2463534242u;
+    slabInit(&index->nodeAllocator, sizeof(MatchNode), MATCH_NODES_PER_SLAB);
+    sequence->matchIndex = index;
+    return 1;
+}
+
+void clearMatchIndex(Sequence *sequence) {
+    if (sequence == NULL || sequence->matchIndex == NULL) {
+        return;
+    }
+    MatchIndex *index = sequence->matchIndex;
+    slabFreeAll(&index->nodeAllocator);
+    free(index->needle);
+    free(index->utf8Needle);
+    free(index);
+    sequence->matchIndex = NULL;
+}
+
+bool hasMatchIndex(Sequence *sequence, const wchar_t *needleOrNull) {
+    if (sequence == NULL || sequence->matchIndex == NULL) {
+        return false;
+    }
+    return needleOrNull == NULL || wcscmp(sequence->matchIndex->needle, needleOrNull) == 0;
+}
+
+ReturnCode extendMatchIndex(Sequence *sequence, Size budget) {
+    if (!hasMatchIndex(sequence, NULL) || budget <= 0) {
+        ERR_PRINT("extendMatchIndex called without match index or budget.\n");
+        return -1;
+    }
+    MatchIndex *index = sequence->matchIndex;
+    Position totalSize = (Position)getCurrentTotalSize(sequence);
+    if (index->scannedUpTo >= totalSize) {
+        return 1;
+    }
+
+    Position to = totalSize - index->scannedUpTo > budget ? index->scannedUpTo + budget : totalSize;
+    MatchCollector collector = {index, NULL, spanOf(index->root), false};
+    if (forEachNeedleMatch(sequence, index->utf8Needle, index->needleLength, index->scannedUpTo, to, appendMatch, &collector) == -1 ||
+        collector.failed) {
+        ERR_PRINT("Scanning for the match index failed.\n");
+        freeTree(index, collector.tree);
+        return -1;
+    }
+    // The collected gaps already continue after the last indexed match
+    index->root = mergeTrees(index->root, collector.tree);
+    index->scannedUpTo = to;
+    return to == totalSize ? 1 : 0;
+}
+
+bool isMatchIndexComplete(Sequence *sequence) {
+    return hasMatchIndex(sequence, NULL) && sequence->matchIndex->scannedUpTo >= (Position)getCurrentTotalSize(sequence);
+}
+
+double getMatchIndexProgress(Sequence *sequence) {
+    if (!hasMatchIndex(sequence, NULL)) {
+        return 0.0;
+    }
+    Position totalSize = (Position)getCurrentTotalSize(sequence);
+    return totalSize > 0 && sequence->matchIndex->scannedUpTo < totalSize ? (double)sequence->matchIndex->scannedUpTo / (double)totalSize : 1.0;
+}
+
+long getIndexedMatchCount(Sequence *sequence) {
+    return hasMatchIndex(sequence, NULL) ? (long)countOf(sequence->matchIndex->root) : -1;
+}
+
+long getIndexedMatchRank(Sequence *sequence, Position position) {
+    if (!hasMatchIndex(sequence, NULL)) {
+        return -1;
+    }
+    long rank = 0;
+    Position base = 0;
+    MatchNode *node = sequence->matchIndex->root;
+    while (node != NULL) {
+        Position nodePosition = base + spanOf(node->left) + node->gap;
+        if (nodePosition < position) {
+            rank += (long)countOf(node->left) + 1;
+            base = nodePosition;
+            node = node->right;
+        } else {
+            node = node->left;
+        }
+    }
+    return rank;
+}
+
+/**
+ * Returns the position of the match with the given rank (starting from 0), the rank has to be smaller than the match count.
+ */
+static Position positionOfRank(MatchNode *node, long rank) {
+    Position base = 0;
+    while (node != NULL) {
+        long leftCount = (long)countOf(node->left);
+        if (rank < leftCount) {
+            node = node->left;
+        } else if (rank == leftCount) {
+            return base + spanOf(node->left) + node->gap;
+        } else {
+            base += spanOf(node->left) + node->gap;
+            rank -= leftCount + 1;
+            node = node->right;
+        }
+    }
+    return -1;
+}
+
+Position findIndexedMatch(Sequence *sequence, Position position, bool backward) {
+    if (!isMatchIndexComplete(sequence)) {
+        ERR_PRINT("findIndexedMatch called without complete match index.\n");
+        return -1;
+    }
+    MatchNode *root = sequence->matchIndex->root;
+    long count = (long)countOf(root);
+    if (count == 0) {
+        return -1;
+    }
+    long rank = getIndexedMatchRank(sequence, position); // matches before the position
+    if (backward) {
+        return positionOfRank(root, rank > 0 ? rank - 1 : count - 1);
+    }
+    return positionOfRank(root, rank < count ? rank : 0);
+}
+
+/*
+======================
+  Maintenance
+======================
+*/
+
+void matchIndexTextChanged(Sequence *sequence, Position position, Size removedLength, Size insertedLength) {
+    if (!hasMatchIndex(sequence, NULL) || (removedLength == 0 && insertedLength == 0)) {
+        return;
+    }
+    MatchIndex *index = sequence->matchIndex;
+    Position needleLength = (Position)index->needleLength;
+
+    // Matches overlapping the replaced atomics start in (position - needleLength, position + removedLength)
+    Position removeFrom = position - needleLength + 1 > 0 ? position - needleLength + 1 : 0;
+    MatchNode *before, *rest, *removed, *after;
+    splitTree(index->root, removeFrom, &before, &rest);
+    Position base = spanOf(before); // position of the last match before (0 if none)
+    splitTree(rest, position + removedLength - base, &removed, &after);
+    Position removedSpan = spanOf(removed);
+    freeTree(index, removed);
+
+    // Indexed part of the new text
+    Position delta = insertedLength - removedLength;
+    if (index->scannedUpTo > position) {
+        index->scannedUpTo = index->scannedUpTo >= position + removedLength ? index->scannedUpTo + delta : position + insertedLength;
+    }
+
+    // Only the matches overlapping the new atomics have to be searched again
+    MatchCollector collector = {index, before, base, false};
+    Position rescanTo = position + insertedLength < index->scannedUpTo ? position + insertedLength : index->scannedUpTo;
+    if (removeFrom < rescanTo &&
+        (forEachNeedleMatch(sequence, index->utf8Needle, index->needleLength, removeFrom, rescanTo, appendMatch, &collector) == -1 ||
+         collector.failed)) {
+        ERR_PRINT("Match index update failed, dropping the index.\n");
+        clearMatchIndex(sequence); // Frees all nodes at once
+        return;
+    }
+
+    // The matches after the change continued from the removed ones, now they continue from the last rescanned match
+    shiftTree(after, base + removedSpan + delta - collector.lastPosition);
+    index->root = mergeTrees(collector.tree, after);
+}
+
+void replaceTrackedRange(Sequence *sequence, DescriptorNode *first, DescriptorNode *last, DescriptorNode *newNext, DescriptorNode *newPrev) {
+    if (!hasMatchIndex(sequence, NULL)) {
+        pieceTreeReplaceRange(&sequence->pieceTable, first, last, newNext, newPrev);
+        return;
+    }
+    Position rangeStart = pieceTreePositionOf(&sequence->pieceTable, first) + (Position)first->size;
+    Size removedLength = pieceTreePositionOf(&sequence->pieceTable, last) - rangeStart;
+    pieceTreeReplaceRange(&sequence->pieceTable, first, last, newNext, newPrev);
+    Size insertedLength = pieceTreePositionOf(&sequence->pieceTable, last) - rangeStart;
+    matchIndexTextChanged(sequence, rangeStart, removedLength, insertedLength);
+}
@@ -0,0 +1,77 @@
+#ifndef MATCHINDEX_H
+#define MATCHINDEX_H
+
+#include "textStructure.h"
+
+/*
+Sorted index of all occurrences of one needle (the text searched last) in a sequence.
+The matches are kept in a treap with implicit keys: every node stores the distance to the previous match, so an edit
+only removes and rescans the matches around the edited range, all following matches are shifted by changing one distance.
+The index is built in slices (see extendMatchIndex()) which the editor runs while it waits for input, every text
+change is reported to it by replaceTrackedRange() / matchIndexTextChanged().
+*/
+
+#define MATCH_INDEX_SLICE_SIZE (32 * 1024 * 1024) /* atomics scanned per slice while the editor is idle */
+
+/**
+ * Starts indexing the occurrences of the needle (nullterminated string of wide chars).
+ * Keeps the current index if it already belongs to the same needle, otherwise the old one is dropped.
+ * Returns -1 on error (e.g. empty needle).
+ */
+ReturnCode setMatchIndexNeedle(Sequence *sequence, const wchar_t *needle);
+
+/**
+ * Drops the match index of the sequence (if any).
+ */
+void clearMatchIndex(Sequence *sequence);
+
+/**
+ * Returns true if the sequence has a match index for the given needle (NULL: any needle).
+ */
+bool hasMatchIndex(Sequence *sequence, const wchar_t *needleOrNull);
+
+/**
+ * Scans up to budget further atomics for the index.
+ * Returns 1 once the whole text is indexed, 0 if there is text left to scan and -1 on error.
+ */
+ReturnCode extendMatchIndex(Sequence *sequence, Size budget);
+
+/**
+ * Returns true if the whole text is indexed.
+ */
+bool isMatchIndexComplete(Sequence *sequence);
+
+/**
+ * Returns the share of the text which is already indexed (0.0 to 1.0).
+ */
+double getMatchIndexProgress(Sequence *sequence);
+
+/**
+ * Returns the amount of indexed matches, -1 if there is no index.
+ */
+long getIndexedMatchCount(Sequence *sequence);
+
+/**
+ * Returns the amount of indexed matches which start before the position in O(log n), -1 if there is no index.
+ */
+long getIndexedMatchRank(Sequence *sequence, Position position);
+
+/**
+ * Returns the first indexed match at or after the position (backward: the last match before it) in O(log n),
+ * wrapping around at the end (start) of the text. Returns -1 if there is no match or no complete index.
+ */
+Position findIndexedMatch(Sequence *sequence, Position position, bool backward);
+
+/**
+ * Splices the piece table like pieceTreeReplaceRange() and reports the changed text to the match index.
+ * Every splice which changes the text (not only its pieces) has to use this function.
+ */
+void replaceTrackedRange(Sequence *sequence, DescriptorNode *first, DescriptorNode *last, DescriptorNode *newNext, DescriptorNode *newPrev);
+
+/**
+ * Updates the match index after the removedLength atomics at the position were replaced by insertedLength new ones.
+ * Only needed for text changes which do not use replaceTrackedRange() (pieces resized in place).
+ */
+void matchIndexTextChanged(Sequence *sequence, Position position, Size removedLength, Size insertedLength);
+
+#endif
@@ -0,0 +1,401 @@
+#include "multiSearch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debugUtil.h"
+#include "searchKernel.h" // Byte class search to skip text while no pattern has started
+
+/*------ Data structures for internal use ------*/
+struct PatternSet {
+    int patternCount;
+    char **patterns;          // UTF-8, nullterminated
+    Size *patternLengths;     // in atomics
+    Size maxPatternLength;
+    uint8_t byteClasses[256]; // DFA column of every byte, 0 for bytes which occur in no pattern
+    int classCount;
+    int stateCount;           // state 0 is the start state (empty prefix)
+    int32_t *transitions;     // stateCount x classCount
+    int32_t *ownPattern;      // pattern which ends exactly in the state, -1 if none
+    int32_t *longestPattern;  // longest pattern which is a suffix of the state, -1 if none
+    int32_t *outputLink;      // next shorter suffix state with an own pattern, -1 if none
+    ByteClass firstBytes;     // bytes with which a pattern can start
+};
+
+/* What to do with the matches found while scanning, see scanPatterns() */
+typedef struct {
+    Position to;              // matches have to start before to
+    bool leftmostOnly;
+    Position bestStart;       // leftmostOnly: leftmost (longest) match so far, -1 if none
+    int bestPattern;
+    void (*onMatch)(Position position, int patternIndex, void *context);
+    void *context;
+    long amount;
+} ScanTarget;
+
+/*
+======================
+  Compilation
+======================
+*/
+
+/**
+ * Builds the Aho-Corasick DFA for UTF-8 patterns (takes ownership of the pattern strings).
+ */
+static PatternSet *compileUtf8Patterns(char **patterns, int patternCount) {
+    PatternSet *set = calloc(1, sizeof(PatternSet));
+    if (set == NULL) {
+        for (int i = 0; i < patternCount; i++) {
+            free(patterns[i]);
+        }
+        free(patterns);
+        return NULL;
+    }
+    set->patterns = patterns;
+    set->patternCount = patternCount;
+    set->patternLengths = malloc(patternCount * sizeof(Size));
+    if (set->patternLengths == NULL) {
+        freePatternSet(set);
+        return NULL;
+    }
+
+    // Columns only for bytes which occur in a pattern
+    long totalLength = 0;
+    for (int i = 0; i < patternCount; i++) {
+        set->patternLengths[i] = (Size)strlen(patterns[i]);
+        if (set->patternLengths[i] == 0) {
+            ERR_PRINT("Empty pattern in pattern list.\n");
+            freePatternSet(set);
+            return NULL;
+        }
+        totalLength += set->patternLengths[i];
+        if (set->patternLengths[i] > set->maxPatternLength) {
+            set->maxPatternLength = set->patternLengths[i];
+        }
+        for (Size j = 0; j < set->patternLengths[i]; j++) {
+            set->byteClasses[(uint8_t)patterns[i][j]] = 1;
+        }
+    }
+    if (totalLength + 1 > MULTI_SEARCH_MAX_STATES) {
+        ERR_PRINT("Pattern list is too long (%ld atomics).\n", totalLength);
+        freePatternSet(set);
+        return NULL;
+    }
+    set->classCount = 1;
+    for (int byte = 0; byte < 256; byte++) {
+        if (set->byteClasses[byte]) {
+            set->byteClasses[byte] = (uint8_t)set->classCount++;
+        }
+    }
+
+    int capacity = (int)totalLength + 1;
+    int classCount = set->classCount;
+    set->transitions = malloc((size_t)capacity * classCount * sizeof(int32_t));
+    set->ownPattern = malloc(capacity * sizeof(int32_t));
+    set->longestPattern = malloc(capacity * sizeof(int32_t));
+    set->outputLink = malloc(capacity * sizeof(int32_t));
+    int32_t *fail = malloc(capacity * sizeof(int32_t));
+    int32_t *queue = malloc(capacity * sizeof(int32_t));
+    if (set->transitions == NULL || set->ownPattern == NULL || set->longestPattern == NULL || set->outputLink == NULL
+        || fail == NULL || queue == NULL) {
+        ERR_PRINT("Memory allocation failed for pattern automaton.\n");
+        free(fail);
+        free(queue);
+        freePatternSet(set);
+        return NULL;
+    }
+
+    // Trie of the patterns (-1: no edge yet)
+    memset(set->transitions, 0xFF, (size_t)capacity * classCount * sizeof(int32_t));
+    set->ownPattern[0] = -1;
+    set->stateCount = 1;
+    for (int i = 0; i < patternCount; i++) {
+        int32_t state = 0;
+        for (Size j = 0; j < set->patternLengths[i]; j++) {
+            int32_t *edge = &set->transitions[state * classCount + set->byteClasses[(uint8_t)patterns[i][j]]];
+            if (*edge == -1) {
+                *edge = set->stateCount;
+                set->ownPattern[set->stateCount] = -1;
+                set->stateCount++;
+            }
+            state = *edge;
+        }
+        if (set->ownPattern[state] == -1) {
+            set->ownPattern[state] = i; // Duplicates keep the first index
+        }
+    }
+
+    // Breadth first: failure links and missing edges (taken from the failure state, which is less deep)
+    int queueStart = 0, queueEnd = 0;
+    fail[0] = 0;
+    set->longestPattern[0] = -1;
+    set->outputLink[0] = -1;
+    for (int column = 0; column < classCount; column++) {
+        int32_t *edge = &set->transitions[column];
+        if (*edge == -1) {
+            *edge = 0;
+        } else {
+            fail[*edge] = 0;
+            queue[queueEnd++] = *edge;
+        }
+    }
+    while (queueStart < queueEnd) {
+        int32_t state = queue[queueStart++];
+        set->longestPattern[state] = set->ownPattern[state] != -1 ? set->ownPattern[state] : set->longestPattern[fail[state]];
+        set->outputLink[state] = set->ownPattern[fail[state]] != -1 ? fail[state] : set->outputLink[fail[state]];
+        for (int column = 0; column < classCount; column++) {
+            int32_t *edge = &set->transitions[state * classCount + column];
+            int32_t fallback = set->transitions[fail[state] * classCount + column];
+            if (*edge == -1) {
+                *edge = fallback;
+            } else {
+                fail[*edge] = fallback;
+                queue[queueEnd++] = *edge;
+            }
+        }
+    }
+    free(fail);
+    free(queue);
+
+    uint8_t firstBytes[256] = {0};
+    for (int byte = 0; byte < 256; byte++) {
+        firstBytes[byte] = set->byteClasses[byte] != 0 && set->transitions[set->byteClasses[byte]] != 0;
+    }
+    initByteClass(&set->firstBytes, firstBytes);
+    DEBG_PRINT("Compiled %d patterns into %d states and %d byte classes.\n", patternCount, set->stateCount, classCount);
+    return set;
+}
+
+PatternSet *compilePatternSet(const wchar_t *const *patterns, int patternCount) {
+    if (patterns == NULL || patternCount <= 0) {
+        ERR_PRINT("compilePatternSet called without patterns.\n");
+        return NULL;
+    }
+    char **utf8Patterns = calloc(patternCount, sizeof(char *));
+    if (utf8Patterns == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < patternCount; i++) {
+        size_t length = wcstombs(NULL, patterns[i], 0);
+        utf8Patterns[i] = length != (size_t)-1 ? malloc(length + 1) : NULL;
+        if (utf8Patterns[i] == NULL) {
+            ERR_PRINT("Pattern %d could not be converted to UTF-8.\n", i);
+            for (int j = 0; j <= i; j++) {
+                free(utf8Patterns[j]);
+            }
+            free(utf8Patterns);
+            return NULL;
+        }
+        wcstombs(utf8Patterns[i], patterns[i], length + 1);
+    }
+    return compileUtf8Patterns(utf8Patterns, patternCount);
+}
+
+PatternSet *loadPatternSet(const char *filePath) {
+    FILE *file = fopen(filePath, "r");
+    if (file == NULL) {
+        ERR_PRINT("Pattern file %s could not be opened.\n", filePath);
+        return NULL;
+    }
+    int patternCount = 0, capacity = 16;
+    char **patterns = malloc(capacity * sizeof(char *));
+    char *line = NULL;
+    size_t lineCapacity = 0;
+    ssize_t length;
+    while (patterns != NULL && (length = getline(&line, &lineCapacity, file)) != -1) {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+            line[--length] = '\0';
+        }
+        if (length == 0) {
+            continue;
+        }
+        if (patternCount == capacity) {
+            capacity *= 2;
+            char **grown = realloc(patterns, capacity * sizeof(char *));
+            if (grown == NULL) {
+                break;
+            }
+            patterns = grown;
+        }
+        patterns[patternCount] = strdup(line);
+        if (patterns[patternCount] == NULL) {
+            break;
+        }
+        patternCount++;
+    }
+    free(line);
+    fclose(file);
+
+    if (patterns == NULL || patternCount == 0) {
+        ERR_PRINT("Pattern file %s contains no pattern.\n", filePath);
+        free(patterns);
+        return NULL;
+    }
+    return compileUtf8Patterns(patterns, patternCount);
+}
+
+void freePatternSet(PatternSet *patternSet) {
+    if (patternSet == NULL) {
+        return;
+    }
+    if (patternSet->patterns != NULL) {
+        for (int i = 0; i < patternSet->patternCount; i++) {
+            free(patternSet->patterns[i]);
+        }
+        free(patternSet->patterns);
+    }
+    free(patternSet->patternLengths);
+    free(patternSet->transitions);
+    free(patternSet->ownPattern);
+    free(patternSet->longestPattern);
+    free(patternSet->outputLink);
+    free(patternSet);
+}
+
+int getPatternCount(PatternSet *patternSet) {
+    return patternSet != NULL ? patternSet->patternCount : 0;
+}
+
+const char *getPatternText(PatternSet *patternSet, int patternIndex) {
+    if (patternSet == NULL || patternIndex < 0 || patternIndex >= patternSet->patternCount) {
+        return NULL;
+    }
+    return patternSet->patterns[patternIndex];
+}
+
+/*
+======================
+  Search
+======================
+*/
+
+/**
+ * Handles the matches ending right before matchEnd in the given state, may lower the scan limit.
+ */
+static void reportMatches(PatternSet *set, int32_t state, Position matchEnd, ScanTarget *target, Position *limit) {
+    if (target->leftmostOnly) {
+        // The longest pattern starts leftmost, shorter suffixes can not beat it
+        int pattern = set->longestPattern[state];
+        Position start = matchEnd - set->patternLengths[pattern];
+        if (start < target->to && (target->bestStart == -1 || start < target->bestStart
+            || (start == target->bestStart && set->patternLengths[pattern] > set->patternLengths[target->bestPattern]))) {
+            target->bestStart = start;
+            target->bestPattern = pattern;
+            if (start + set->maxPatternLength < *limit) {
+                *limit = start + set->maxPatternLength; // Later matches can not start further left
+            }
+        }
+        return;
+    }
+
+    for (int32_t output = set->ownPattern[state] != -1 ? state : set->outputLink[state]; output != -1; output = set->outputLink[output]) {
+        int pattern = set->ownPattern[output];
+        Position start = matchEnd - set->patternLengths[pattern];
+        if (start < target->to) {
+            target->onMatch(start, pattern, target->context);
+            target->amount++;
+        }
+    }
+}
+
+/**
+ * Runs the DFA over [from, limit) block by block and reports the matches to the target.
+ * Returns -1 if the text could not be read.
+ */
+static ReturnCode scanPatterns(Sequence *sequence, PatternSet *set, Position from, Position limit, ScanTarget *target) {
+    BlockIterator iterator;
+    if (initBlockIterator(&iterator, sequence, from) == -1) {
+        return -1;
+    }
+    const int32_t *transitions = set->transitions;
+    const int classCount = set->classCount;
+    int32_t state = 0;
+    Position blockStart = from;
+    Atomic *block;
+    Size blockSize = getCurrentBlock(&iterator, &block);
+
+    while (blockStart < limit && blockSize > 0) {
+        const Atomic *current = block;
+        const Atomic *end = block + (blockSize < limit - blockStart ? blockSize : limit - blockStart);
+        while (current < end) {
+            if (state == 0 && !set->firstBytes.contains[*current]) {
+                // No pattern started yet: skip to the next atomic with which one can start
+                long skip = findByteOfClass(current, (size_t)(end - current), &set->firstBytes);
+                if (skip == -1) {
+                    current = end;
+                    break;
+                }
+                current += skip;
+            }
+            state = transitions[state * classCount + set->byteClasses[*current]];
+            current++;
+            if (set->longestPattern[state] != -1) {
+                reportMatches(set, state, blockStart + (current - block), target, &limit);
+                if (limit - blockStart < end - block) {
+                    end = limit > blockStart + (current - block) ? block + (limit - blockStart) : current;
+                }
+            }
+        }
+        blockStart += blockSize;
+        blockSize = getNextBlock(&iterator, &block);
+    }
+    return 1;
+}
+
+/**
+ * Reports the occurrences which start in [from, to), scanning up to the end of the longest possible occurrence.
+ */
+static ReturnCode scanPatternRange(Sequence *sequence, PatternSet *set, Position from, Position to, ScanTarget *target) {
+    Position totalSize = (Position)getCurrentTotalSize(sequence);
+    if (to > totalSize) {
+        to = totalSize;
+    }
+    if (from >= to) {
+        return 1;
+    }
+    target->to = to;
+    Position limit = to + set->maxPatternLength - 1 < totalSize ? to + set->maxPatternLength - 1 : totalSize;
+    return scanPatterns(sequence, set, from, limit, target);
+}
+
+SearchResult findAnyPattern(Sequence *sequence, PatternSet *patternSet, Position startPosition, int *patternIndexOrNull) {
+    SearchResult result = {-1, -1};
+    Position totalSize = sequence != NULL ? (Position)getCurrentTotalSize(sequence) : 0;
+    if (sequence == NULL || patternSet == NULL || startPosition < 0 || startPosition > totalSize) {
+        ERR_PRINT("findAnyPattern called with invalid sequence, pattern set or startPosition.\n");
+        return result;
+    }
+
+    ScanTarget target = {.leftmostOnly = true, .bestStart = -1, .bestPattern = -1};
+    if (scanPatternRange(sequence, patternSet, startPosition, totalSize, &target) == -1) {
+        return result;
+    }
+    if (target.bestStart == -1 && startPosition > 0) {
+        DEBG_PRINT("findAnyPattern has reached the end of the piece table, going back to start.\n");
+        if (scanPatternRange(sequence, patternSet, 0, startPosition, &target) == -1) {
+            return result;
+        }
+    }
+
+    if (target.bestStart != -1) {
+        result.foundPosition = target.bestStart;
+        result.lineNumber = getLineNumber(sequence, target.bestStart);
+        if (patternIndexOrNull != NULL) {
+            *patternIndexOrNull = target.bestPattern;
+        }
+    }
+    return result;
+}
+
+long forEachPatternMatch(Sequence *sequence, PatternSet *patternSet, Position from, Position to,
+                         void (*onMatch)(Position position, int patternIndex, void *context), void *context) {
+    if (sequence == NULL || patternSet == NULL || onMatch == NULL || from < 0) {
+        ERR_PRINT("forEachPatternMatch called with invalid sequence, pattern set, callback or range.\n");
+        return -1;
+    }
+    ScanTarget target = {.leftmostOnly = false, .bestStart = -1, .onMatch = onMatch, .context = context};
+    if (scanPatternRange(sequence, patternSet, from, to, &target) == -1) {
+        return -1;
+    }
+    return target.amount;
+}
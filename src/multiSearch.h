@@ -0,0 +1,53 @@
+#ifndef MULTISEARCH_H
+#define MULTISEARCH_H
+
+#include "textStructure.h"
+
+/*
+Search for many texts (patterns) at once with an Aho-Corasick automaton.
+The automaton is compiled to a DFA over byte classes (only bytes which occur in a pattern get their own column),
+so every atomic of the text costs one table lookup, independent of the amount of patterns.
+While the DFA is in its start state, atomics which cannot start any pattern are skipped with a vectorized
+byte class search (see findByteOfClass()). The DFA state is carried from block to block, the text is never copied.
+*/
+
+#define MULTI_SEARCH_MAX_STATES (1 << 20) /* limit for the summed length of all patterns */
+
+typedef struct PatternSet PatternSet;
+
+/**
+ * Compiles a list of patterns (nullterminated strings of wide chars), duplicates keep the first index.
+ * Returns NULL if the list is empty, contains an empty pattern or is too long.
+ */
+PatternSet *compilePatternSet(const wchar_t *const *patterns, int patternCount);
+
+/**
+ * Reads the patterns from a UTF-8 file, one pattern per line (empty lines are skipped).
+ * Returns NULL if the file can not be read or contains no pattern.
+ */
+PatternSet *loadPatternSet(const char *filePath);
+
+void freePatternSet(PatternSet *patternSet);
+
+int getPatternCount(PatternSet *patternSet);
+
+/**
+ * Returns the pattern with the given index as UTF-8 text (nullterminated), NULL if the index is invalid.
+ */
+const char *getPatternText(PatternSet *patternSet, int patternIndex);
+
+/**
+ * Returns the SearchResult for the leftmost occurrence of any pattern at or after startPosition (the longest pattern
+ * if several start there), wrapping around to the beginning of the sequence. Returns -1 if no pattern was found.
+ * The index of the found pattern is written to patternIndexOrNull.
+ */
+SearchResult findAnyPattern(Sequence *sequence, PatternSet *patternSet, Position startPosition, int *patternIndexOrNull);
+
+/**
+ * Calls onMatch for every occurrence of every pattern which starts in [from, to), ordered by the end of the occurrence
+ * (occurrences may overlap). Returns the amount of occurrences or -1 on error.
+ */
+long forEachPatternMatch(Sequence *sequence, PatternSet *patternSet, Position from, Position to,
+                         void (*onMatch)(Position position, int patternIndex, void *context), void *context);
+
+#endif
@@ -0,0 +1,289 @@
+#include "pieceTree.h"
+#include "debugUtil.h"
+
+/*------ Variables for internal use ------*/
+static uint32_t _priorityState = 0x9E3779B9; // Seed of the xorshift generator used for the treap priorities
+
+/*
+======================
+  Internal Utilities
+======================
+*/
+
+static uint32_t nextPriority() {
+    _priorityState ^= _priorityState << 13;
+    _priorityState ^= _priorityState >> 17;
+    _priorityState ^= _priorityState << 5;
+    return _priorityState;
+}
+
+static inline unsigned long subtreeSizeOf(DescriptorNode *node) {
+    return node != NULL ? node->subtreeSize : 0;
+}
+
+static inline unsigned long subtreeLineBreaksOf(DescriptorNode *node) {
+    return node != NULL ? node->subtreeLineBreaks : 0;
+}
+
+/**
+ * Recomputes the aggregated values of a node from its children.
+ */
+static inline void pull(DescriptorNode *node) {
+    node->subtreeSize = subtreeSizeOf(node->left) + node->size + subtreeSizeOf(node->right);
+    node->subtreeLineBreaks = subtreeLineBreaksOf(node->left) + node->lineBreaks + subtreeLineBreaksOf(node->right);
+}
+
+/**
+ * Recomputes the aggregated values from the given node up to the root.
+ */
+static void pullToRoot(DescriptorNode *node) {
+    while (node != NULL) {
+        pull(node);
+        node = node->parent;
+    }
+}
+
+/**
+ * Rotates the node above its parent, keeping the in-order sequence unchanged.
+ */
+static void rotateUp(PieceTable *pieceTable, DescriptorNode *node) {
+    DescriptorNode *parent = node->parent;
+    DescriptorNode *grandParent = parent->parent;
+
+    if (parent->left == node) {
+        parent->left = node->right;
+        if (node->right != NULL) {
+            node->right->parent = parent;
+        }
+        node->right = parent;
+    } else {
+        parent->right = node->left;
+        if (node->left != NULL) {
+            node->left->parent = parent;
+        }
+        node->left = parent;
+    }
+    parent->parent = node;
+    node->parent = grandParent;
+
+    if (grandParent == NULL) {
+        pieceTable->root = node;
+    } else if (grandParent->left == parent) {
+        grandParent->left = node;
+    } else {
+        grandParent->right = node;
+    }
+
+    // Only the two rotated nodes change, the content of the grand parent's subtree stays the same
+    pull(parent);
+    pull(node);
+}
+
+/**
+ * Adds the node to the index directly after prev (in-order), or as the very first node if prev is NULL.
+ */
+static void insertAfter(PieceTable *pieceTable, DescriptorNode *prev, DescriptorNode *node) {
+    node->left = NULL;
+    node->right = NULL;
+    node->parent = NULL;
+    node->priority = nextPriority();
+    node->subtreeSize = node->size;
+    node->subtreeLineBreaks = node->lineBreaks;
+
+    if (pieceTable->root == NULL) {
+        pieceTable->root = node;
+        return;
+    }
+
+    DescriptorNode *attachTo;
+    if (prev == NULL) {
+        attachTo = pieceTable->root;
+        while (attachTo->left != NULL) {
+            attachTo = attachTo->left;
+        }
+        attachTo->left = node;
+    } else if (prev->right == NULL) {
+        attachTo = prev;
+        attachTo->right = node;
+    } else {
+        attachTo = prev->right;
+        while (attachTo->left != NULL) {
+            attachTo = attachTo->left;
+        }
+        attachTo->left = node;
+    }
+    node->parent = attachTo;
+    pullToRoot(attachTo);
+
+    // Restore the heap property of the priorities
+    while (node->parent != NULL && node->parent->priority < node->priority) {
+        rotateUp(pieceTable, node);
+    }
+}
+
+/**
+ * Removes the node from the index (its list pointers are not touched).
+ */
+static void removeNode(PieceTable *pieceTable, DescriptorNode *node) {
+    // Rotate the node down until it is a leaf
+    while (node->left != NULL || node->right != NULL) {
+        DescriptorNode *child;
+        if (node->right == NULL || (node->left != NULL && node->left->priority > node->right->priority)) {
+            child = node->left;
+        } else {
+            child = node->right;
+        }
+        rotateUp(pieceTable, child);
+    }
+
+    DescriptorNode *parent = node->parent;
+    if (parent == NULL) {
+        pieceTable->root = NULL;
+    } else if (parent->left == node) {
+        parent->left = NULL;
+    } else {
+        parent->right = NULL;
+    }
+    node->parent = NULL;
+    pullToRoot(parent);
+}
+
+/*
+======================
+  Index Operations
+======================
+*/
+
+void pieceTreeInit(PieceTable *pieceTable) {
+    pieceTable->root = NULL;
+    insertAfter(pieceTable, NULL, pieceTable->first);
+    insertAfter(pieceTable, pieceTable->first, pieceTable->last);
+}
+
+DescriptorNode *pieceTreeFind(PieceTable *pieceTable, Position position, Position *nodeStart, unsigned long *lineBreaksBefore) {
+    DescriptorNode *curr = pieceTable->root;
+    unsigned long remaining = (unsigned long)position;
+    unsigned long base = 0;
+    unsigned long breaks = 0;
+
+    if (position < 0) {
+        return NULL;
+    }
+
+    while (curr != NULL) {
+        unsigned long leftSize = subtreeSizeOf(curr->left);
+        if (remaining < leftSize) {
+            curr = curr->left;
+        } else if (remaining < leftSize + curr->size) {
+            if (nodeStart != NULL) {
+                *nodeStart = (Position)(base + leftSize);
+            }
+            if (lineBreaksBefore != NULL) {
+                *lineBreaksBefore = breaks + subtreeLineBreaksOf(curr->left);
+            }
+            return curr;
+        } else {
+            remaining -= leftSize + curr->size;
+            base += leftSize + curr->size;
+            breaks += subtreeLineBreaksOf(curr->left) + curr->lineBreaks;
+            curr = curr->right;
+        }
+    }
+
+    return NULL;
+}
+
+DescriptorNode *pieceTreeFindLineBreak(PieceTable *pieceTable, unsigned long n, Position *nodeStart, unsigned long *lineBreaksBefore) {
+    DescriptorNode *curr = pieceTable->root;
+    unsigned long remaining = n;
+    unsigned long base = 0;
+    unsigned long breaks = 0;
+
+    if (n == 0) {
+        return NULL;
+    }
+
+    while (curr != NULL) {
+        unsigned long leftBreaks = subtreeLineBreaksOf(curr->left);
+        if (remaining <= leftBreaks) {
+            curr = curr->left;
+        } else if (remaining <= leftBreaks + curr->lineBreaks) {
+            if (nodeStart != NULL) {
+                *nodeStart = (Position)(base + subtreeSizeOf(curr->left));
+            }
+            if (lineBreaksBefore != NULL) {
+                *lineBreaksBefore = breaks + leftBreaks;
+            }
+            return curr;
+        } else {
+            remaining -= leftBreaks + curr->lineBreaks;
+            breaks += leftBreaks + curr->lineBreaks;
+            base += subtreeSizeOf(curr->left) + curr->size;
+            curr = curr->right;
+        }
+    }
+
+    return NULL;
+}
+
+Position pieceTreePositionOf(PieceTable *pieceTable, DescriptorNode *node) {
+    if (node == NULL) {
+        ERR_PRINT("pieceTreePositionOf called with NULL node.\n");
+        return -1;
+    }
+
+    unsigned long position = subtreeSizeOf(node->left);
+    while (node->parent != NULL) {
+        if (node->parent->right == node) {
+            position += subtreeSizeOf(node->parent->left) + node->parent->size;
+        }
+        node = node->parent;
+    }
+    if (node != pieceTable->root) {
+        ERR_PRINT("pieceTreePositionOf called with node which is not part of the index.\n");
+        return -1;
+    }
+
+    return (Position)position;
+}
+
+size_t pieceTreeTotalSize(PieceTable *pieceTable) {
+    return (size_t)subtreeSizeOf(pieceTable->root);
+}
+
+unsigned long pieceTreeTotalLineBreaks(PieceTable *pieceTable) {
+    return subtreeLineBreaksOf(pieceTable->root);
+}
+
+void pieceTreeUpdate(PieceTable *pieceTable, DescriptorNode *node) {
+    (void)pieceTable;
+    pullToRoot(node);
+}
+
+void pieceTreeReplaceRange(PieceTable *pieceTable, DescriptorNode *first, DescriptorNode *last, DescriptorNode *newNext, DescriptorNode *newPrev) {
+    // Detach the nodes currently in the range from the index
+    DescriptorNode *curr = first->next_ptr;
+    while (curr != NULL && curr != last) {
+        DescriptorNode *next = curr->next_ptr;
+        removeNode(pieceTable, curr);
+        curr = next;
+    }
+
+    // Relink the list
+    first->next_ptr = newNext;
+    last->prev_ptr = newPrev;
+    if (newNext == last) {
+        return; // Range is empty now
+    }
+    newNext->prev_ptr = first;
+    newPrev->next_ptr = last;
+
+    // Add the new segment to the index
+    DescriptorNode *prev = first;
+    curr = newNext;
+    while (curr != NULL && curr != last) {
+        insertAfter(pieceTable, prev, curr);
+        prev = curr;
+        curr = curr->next_ptr;
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef PIECETREE_H
+#define PIECETREE_H
+
+#include "textStructure.h"
+
+/*
+Balanced index (treap with implicit keys) over the linked list of DescriptorNodes.
+The in-order traversal of the index is always identical to the list from pieceTable.first to pieceTable.last
+(sentinels included), every node stores the summed byte size and line breaks of its subtree.
+This allows position and line lookups, splits and splices in O(log n) instead of walking the whole list.
+*/
+
+/**
+ * Initializes the index for a piece table which only consists of its two linked sentinel nodes.
+ */
+void pieceTreeInit(PieceTable *pieceTable);
+
+/**
+ * Returns the node which contains the atomic at the given position and writes the position of its first atomic to nodeStart.
+ * The amount of line breaks in all nodes before it is written to lineBreaksBefore (both out parameters may be NULL).
+ * Nodes of size 0 (sentinels) are never returned, NULL is returned if the position is not inside the text.
+ */
+DescriptorNode *pieceTreeFind(PieceTable *pieceTable, Position position, Position *nodeStart, unsigned long *lineBreaksBefore);
+
+/**
+ * Returns the node which contains the n-th (starting from 1) line break of the text, or NULL if there are less line breaks.
+ * The out parameters are the same as for pieceTreeFind().
+ */
+DescriptorNode *pieceTreeFindLineBreak(PieceTable *pieceTable, unsigned long n, Position *nodeStart, unsigned long *lineBreaksBefore);
+
+/**
+ * Returns the position of the first atomic of the given (linked) node.
+ */
+Position pieceTreePositionOf(PieceTable *pieceTable, DescriptorNode *node);
+
+/**
+ * Returns the total amount of atomics referenced by the piece table.
+ */
+size_t pieceTreeTotalSize(PieceTable *pieceTable);
+
+/**
+ * Returns the total amount of line breaks in the text.
+ */
+unsigned long pieceTreeTotalLineBreaks(PieceTable *pieceTable);
+
+/**
+ * Has to be called after the size or line breaks of a linked node were changed in place, updates the sums of all its ancestors.
+ */
+void pieceTreeUpdate(PieceTable *pieceTable, DescriptorNode *node);
+
+/**
+ * Replaces the nodes between first and last (both exclusive) with the segment newNext ... newPrev, in the list and the index.
+ * The segment has to be linked internally (via next_ptr) already, if newNext == last the range simply becomes empty.
+ * Afterwards first->next_ptr == newNext and last->prev_ptr == newPrev, which is exactly the relinking used by undo/redo.
+ */
+void pieceTreeReplaceRange(PieceTable *pieceTable, DescriptorNode *first, DescriptorNode *last, DescriptorNode *newNext, DescriptorNode *newPrev);
+
+#endif
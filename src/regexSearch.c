@@ -0,0 +1,1459 @@
+#include "regexSearch.h"
+#include <limits.h>
+#include <string.h>
+
+#include "debugUtil.h"
+
+/*------ Definitions for internal use ------*/
+#define REGEX_MAX_PROGRAM 20000 /* instructions of a compiled pattern (bounds counted repetitions) */
+#define REGEX_MAX_REPEAT 1000   /* largest count allowed in {n,m} */
+#ifndef DFA_MAX_STATES
+#define DFA_MAX_STATES 2048     /* cached states of one DFA before its cache is flushed (lowered by the regexTest target) */
+#endif
+#define DFA_MAX_FLUSHES 8       /* flushes during one search before falling back to the Pike VM */
+#define DFA_HASH_SIZE 4096      /* buckets of the DFA state cache */
+#define NO_ATOMIC (-1)          /* stands for the start or the end of the text when looking at neighbouring atomics */
+
+/*------ Data structures for internal use ------*/
+typedef struct {
+    uint32_t bits[8];
+} ByteSet;
+
+typedef enum {
+    NODE_BYTES,      // one atomic out of a byte set
+    NODE_CONCAT,
+    NODE_ALTERNATE,  // left is preferred
+    NODE_REPEAT,
+    NODE_GROUP,
+    NODE_LINE_START,
+    NODE_LINE_END
+} NodeType;
+
+/* Node of the parsed pattern, children are indices into the node array */
+typedef struct {
+    NodeType type;
+    int left;
+    int right;
+    int set;      // NODE_BYTES: index of the byte set
+    int min;      // NODE_REPEAT: minimum amount
+    int max;      // NODE_REPEAT: maximum amount, -1 for unbounded
+    bool greedy;  // NODE_REPEAT
+    int group;    // NODE_GROUP: capture group, 0 for non-capturing
+} AstNode;
+
+typedef enum {
+    INSTR_BYTES,      // consume one atomic out of a byte set
+    INSTR_SPLIT,      // continue at out (preferred) and out2
+    INSTR_JUMP,
+    INSTR_SAVE,       // store the current position in a capture slot
+    INSTR_LINE_START, // only continue if the previous atomic ends a line
+    INSTR_LINE_END,   // only continue if the next atomic ends a line
+    INSTR_MATCH
+} InstructionType;
+
+typedef struct {
+    InstructionType type;
+    int out;
+    int out2;
+    int argument; // byte set (INSTR_BYTES) or capture slot (INSTR_SAVE)
+} Instruction;
+
+typedef struct {
+    Instruction *code;
+    int length;
+    int capacity;
+} Program;
+
+/* State of a lazily built DFA: an ordered list of NFA instructions (before their epsilon closure) */
+typedef struct DfaState DfaState;
+struct DfaState {
+    int *instructions;     // ordered by priority
+    int amount;
+    bool afterLineStart;   // the atomic scanned last allows a line start assertion
+    int8_t matches[2];     // match before the next atomic, [1]: next atomic allows a line end assertion (-1: unknown)
+    DfaState *next[256];   // cached transitions
+    DfaState *hashNext;
+};
+
+typedef struct {
+    Program *program;
+    bool reverse;      // scans from the end to the start (program of the reversed pattern)
+    bool injectStart;  // a new match may start at every atomic (unanchored search)
+    bool longest;      // keep going after a match instead of dropping all lower priority threads
+    DfaState *table[DFA_HASH_SIZE];
+    int stateAmount;
+    int flushes;       // flushes during the current search
+} Dfa;
+
+/* Threads of the Pike VM at one position, in priority order */
+typedef struct {
+    int *instructions;
+    Position *captures; // REGEX_MAX_GROUPS * 2 slots per thread
+    int amount;
+} ThreadList;
+
+struct Regex {
+    Program forward;  // SAVE 0, pattern, SAVE 1, MATCH
+    Program reverse;  // reversed pattern, MATCH (no captures)
+    ByteSet *sets;
+    int setAmount;
+    int groups;       // including group 0
+    Atomic lineBreak;       // line break identifier
+    Atomic lineEndPrefix;   // atomic which may precede the line break ('\r' for MSDOS)
+    Dfa forwardDfa[2];      // [0]: unanchored, [1]: anchored
+    Dfa reverseDfa;
+
+    // Scratch memory of the simulations
+    unsigned int *marks; // generation in which an instruction was visited
+    unsigned int generation;
+    int *stack;
+    int *closure;
+    ThreadList threads[2];
+};
+
+/* Recursive descent parser for a pattern */
+typedef struct {
+    const wchar_t *pattern;
+    size_t position;
+    AstNode *nodes;
+    int amount;
+    int capacity;
+    Regex *regex; // receives the byte sets
+    int setCapacity;
+    bool failed;
+} Parser;
+
+/* Forward reader over the atomics of a sequence with one atomic lookahead */
+typedef struct {
+    Sequence *sequence;
+    BlockIterator iterator;
+    Atomic *block;
+    Size blockSize;
+    Size index;
+    Position position;
+    Position totalSize;
+} AtomicReader;
+
+/*
+======================
+  Byte Sets
+======================
+*/
+
+static inline bool setContains(const ByteSet *set, int byte) {
+    return (set->bits[byte >> 5] >> (byte & 31)) & 1;
+}
+
+static inline void setAdd(ByteSet *set, int byte) {
+    set->bits[byte >> 5] |= (uint32_t)1 << (byte & 31);
+}
+
+static void setAddRange(ByteSet *set, int low, int high) {
+    for (int byte = low; byte <= high; byte++) {
+        setAdd(set, byte);
+    }
+}
+
+/**
+ * Adds the ASCII part of a class escape (\d, \w, \s), returns false for other characters.
+ */
+static bool setAddClassEscape(ByteSet *set, wchar_t escape) {
+    switch (escape) {
+        case L'd':
+            setAddRange(set, '0', '9');
+            return true;
+        case L'w':
+            setAddRange(set, '0', '9');
+            setAddRange(set, 'A', 'Z');
+            setAddRange(set, 'a', 'z');
+            setAdd(set, '_');
+            return true;
+        case L's':
+            setAdd(set, ' ');
+            setAddRange(set, '\t', '\r');
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*
+======================
+  Parser
+======================
+*/
+
+static int newNode(Parser *parser, NodeType type, int left, int right) {
+    if (parser->amount == parser->capacity) {
+        int newCapacity = parser->capacity == 0 ? 64 : parser->capacity * 2;
+        AstNode *grown = realloc(parser->nodes, newCapacity * sizeof(AstNode));
+        if (grown == NULL) {
+            parser->failed = true;
+            return -1;
+        }
+        parser->nodes = grown;
+        parser->capacity = newCapacity;
+    }
+    parser->nodes[parser->amount] = (AstNode){type, left, right, -1, 0, 0, true, 0};
+    return parser->amount++;
+}
+
+static int newSetNode(Parser *parser, const ByteSet *set) {
+    Regex *regex = parser->regex;
+    if (regex->setAmount == parser->setCapacity) {
+        int newCapacity = parser->setCapacity == 0 ? 16 : parser->setCapacity * 2;
+        ByteSet *grown = realloc(regex->sets, newCapacity * sizeof(ByteSet));
+        if (grown == NULL) {
+            parser->failed = true;
+            return -1;
+        }
+        regex->sets = grown;
+        parser->setCapacity = newCapacity;
+    }
+    regex->sets[regex->setAmount] = *set;
+    int node = newNode(parser, NODE_BYTES, -1, -1);
+    if (node != -1) {
+        parser->nodes[node].set = regex->setAmount++;
+    }
+    return node;
+}
+
+static int newByteRangeNode(Parser *parser, int low, int high) {
+    ByteSet set = {{0}};
+    setAddRange(&set, low, high);
+    return newSetNode(parser, &set);
+}
+
+/**
+ * Concatenation which tolerates a missing (-1) left part.
+ */
+static int concatNodes(Parser *parser, int left, int right) {
+    if (left == -1) {
+        return right;
+    }
+    return newNode(parser, NODE_CONCAT, left, right);
+}
+
+/**
+ * Node for the UTF-8 encoding of a single (non ASCII) character.
+ */
+static int newCharacterNode(Parser *parser, wchar_t character) {
+    Atomic encoded[4];
+    int length;
+    uint32_t codepoint = (uint32_t)character;
+    if (codepoint < 0x80) {
+        encoded[0] = (Atomic)codepoint;
+        length = 1;
+    } else if (codepoint < 0x800) {
+        encoded[0] = 0xC0 | (codepoint >> 6);
+        encoded[1] = 0x80 | (codepoint & 0x3F);
+        length = 2;
+    } else if (codepoint < 0x10000) {
+        encoded[0] = 0xE0 | (codepoint >> 12);
+        encoded[1] = 0x80 | ((codepoint >> 6) & 0x3F);
+        encoded[2] = 0x80 | (codepoint & 0x3F);
+        length = 3;
+    } else {
+        encoded[0] = 0xF0 | (codepoint >> 18);
+        encoded[1] = 0x80 | ((codepoint >> 12) & 0x3F);
+        encoded[2] = 0x80 | ((codepoint >> 6) & 0x3F);
+        encoded[3] = 0x80 | (codepoint & 0x3F);
+        length = 4;
+    }
+
+    int node = -1;
+    for (int i = 0; i < length; i++) {
+        node = concatNodes(parser, node, newByteRangeNode(parser, encoded[i], encoded[i]));
+    }
+    return node;
+}
+
+/**
+ * Node for any character encoded with more than one atomic.
+ */
+static int newMultibyteNode(Parser *parser) {
+    int two = concatNodes(parser, newByteRangeNode(parser, 0xC0, 0xDF), newByteRangeNode(parser, 0x80, 0xBF));
+    int three = newByteRangeNode(parser, 0xE0, 0xEF);
+    int four = newByteRangeNode(parser, 0xF0, 0xF7);
+    for (int i = 0; i < 2; i++) {
+        three = concatNodes(parser, three, newByteRangeNode(parser, 0x80, 0xBF));
+    }
+    for (int i = 0; i < 3; i++) {
+        four = concatNodes(parser, four, newByteRangeNode(parser, 0x80, 0xBF));
+    }
+    return newNode(parser, NODE_ALTERNATE, two, newNode(parser, NODE_ALTERNATE, three, four));
+}
+
+/**
+ * Node for an ASCII set, optionally complemented: the complement never contains a line break but every multibyte character.
+ */
+static int newClassNode(Parser *parser, ByteSet *asciiSet, bool negated) {
+    if (!negated) {
+        return newSetNode(parser, asciiSet);
+    }
+    ByteSet complement = {{0}};
+    for (int byte = 0; byte < 0x80; byte++) {
+        if (!setContains(asciiSet, byte) && byte != parser->regex->lineBreak && byte != parser->regex->lineEndPrefix) {
+            setAdd(&complement, byte);
+        }
+    }
+    return newNode(parser, NODE_ALTERNATE, newSetNode(parser, &complement), newMultibyteNode(parser));
+}
+
+static void parseError(Parser *parser, const char *message) {
+    if (!parser->failed) {
+        ERR_PRINT("Invalid regex at %zu: %s\n", parser->position, message);
+    }
+    parser->failed = true;
+}
+
+static inline wchar_t peekChar(Parser *parser) {
+    return parser->pattern[parser->position];
+}
+
+static int parseAlternation(Parser *parser);
+
+/**
+ * Parses a [...] class (the opening bracket is already consumed).
+ */
+static int parseClass(Parser *parser) {
+    bool negated = false;
+    if (peekChar(parser) == L'^') {
+        negated = true;
+        parser->position++;
+    }
+
+    ByteSet set = {{0}};
+    int multibyte = -1; // alternation of the non ASCII members
+    bool first = true;
+    while (peekChar(parser) != L']' || first) {
+        wchar_t low = peekChar(parser);
+        if (low == L'\0') {
+            parseError(parser, "missing ]");
+            return -1;
+        }
+        parser->position++;
+        first = false;
+
+        if (low == L'\\') {
+            wchar_t escape = peekChar(parser);
+            if (escape == L'\0') {
+                parseError(parser, "trailing backslash");
+                return -1;
+            }
+            parser->position++;
+            if (setAddClassEscape(&set, escape)) {
+                continue;
+            }
+            low = escape == L't' ? L'\t' : escape == L'n' ? L'\n' : escape == L'r' ? L'\r' : escape;
+        }
+
+        wchar_t high = low;
+        if (peekChar(parser) == L'-' && parser->pattern[parser->position + 1] != L']' && parser->pattern[parser->position + 1] != L'\0') {
+            parser->position++;
+            high = peekChar(parser);
+            parser->position++;
+            if (high == L'\\') {
+                high = peekChar(parser);
+                if (high == L'\0') {
+                    parseError(parser, "trailing backslash");
+                    return -1;
+                }
+                parser->position++;
+            }
+            if (high < low) {
+                parseError(parser, "invalid class range");
+                return -1;
+            }
+        }
+
+        if (high < 0x80) {
+            setAddRange(&set, low, high);
+        } else if (low == high && !negated) {
+            int character = newCharacterNode(parser, low);
+            multibyte = multibyte == -1 ? character : newNode(parser, NODE_ALTERNATE, multibyte, character);
+        } else {
+            parseError(parser, "non ASCII ranges and negated non ASCII characters are not supported in classes");
+            return -1;
+        }
+    }
+    parser->position++; // ']'
+
+    int node = newClassNode(parser, &set, negated);
+    return multibyte == -1 ? node : newNode(parser, NODE_ALTERNATE, node, multibyte);
+}
+
+/**
+ * Parses a {n}, {n,} or {n,m} quantifier (the opening brace is already consumed).
+ */
+static bool parseCount(Parser *parser, int *min, int *max) {
+    long values[2] = {-1, -1};
+    int index = 0;
+    while (true) {
+        wchar_t character = peekChar(parser);
+        if (character >= L'0' && character <= L'9') {
+            values[index] = (values[index] < 0 ? 0 : values[index] * 10) + (character - L'0');
+            if (values[index] > REGEX_MAX_REPEAT) {
+                parseError(parser, "repetition count too large");
+                return false;
+            }
+        } else if (character == L',' && index == 0) {
+            index = 1;
+        } else if (character == L'}') {
+            parser->position++;
+            break;
+        } else {
+            parseError(parser, "invalid repetition count");
+            return false;
+        }
+        parser->position++;
+    }
+
+    if (values[0] < 0 || (index == 1 && values[1] >= 0 && values[1] < values[0])) {
+        parseError(parser, "invalid repetition count");
+        return false;
+    }
+    *min = (int)values[0];
+    *max = index == 0 ? (int)values[0] : (int)values[1]; // {n,} leaves max at -1
+    return true;
+}
+
+static int parseAtom(Parser *parser) {
+    wchar_t character = peekChar(parser);
+    parser->position++;
+    Regex *regex = parser->regex;
+
+    switch (character) {
+        case L'(': {
+            int group = 0;
+            if (peekChar(parser) == L'?') {
+                if (parser->pattern[parser->position + 1] != L':') {
+                    parseError(parser, "unsupported group type");
+                    return -1;
+                }
+                parser->position += 2;
+            } else {
+                if (regex->groups == REGEX_MAX_GROUPS) {
+                    parseError(parser, "too many capture groups");
+                    return -1;
+                }
+                group = regex->groups++;
+            }
+            int inner = parseAlternation(parser);
+            if (peekChar(parser) != L')') {
+                parseError(parser, "missing )");
+                return -1;
+            }
+            parser->position++;
+            int node = newNode(parser, NODE_GROUP, inner, -1);
+            if (node != -1) {
+                parser->nodes[node].group = group;
+            }
+            return node;
+        }
+        case L'[':
+            return parseClass(parser);
+        case L'.': {
+            ByteSet none = {{0}};
+            return newClassNode(parser, &none, true);
+        }
+        case L'^':
+            return newNode(parser, NODE_LINE_START, -1, -1);
+        case L'$':
+            return newNode(parser, NODE_LINE_END, -1, -1);
+        case L'\\': {
+            wchar_t escape = peekChar(parser);
+            if (escape == L'\0') {
+                parseError(parser, "trailing backslash");
+                return -1;
+            }
+            parser->position++;
+            ByteSet set = {{0}};
+            if (setAddClassEscape(&set, escape)) {
+                return newSetNode(parser, &set);
+            }
+            if (escape == L'D' || escape == L'W' || escape == L'S') {
+                setAddClassEscape(&set, escape - L'A' + L'a');
+                return newClassNode(parser, &set, true);
+            }
+            if (escape == L't' || escape == L'n' || escape == L'r') {
+                character = escape == L't' ? L'\t' : escape == L'n' ? L'\n' : L'\r';
+            } else if ((escape >= L'a' && escape <= L'z') || (escape >= L'A' && escape <= L'Z') || (escape >= L'0' && escape <= L'9')) {
+                parseError(parser, "unsupported escape sequence");
+                return -1;
+            } else {
+                character = escape;
+            }
+            return newCharacterNode(parser, character);
+        }
+        case L'*':
+        case L'+':
+        case L'?':
+        case L'{':
+            parseError(parser, "quantifier without preceding expression");
+            return -1;
+        default:
+            return newCharacterNode(parser, character);
+    }
+}
+
+static int parseRepeat(Parser *parser) {
+    int node = parseAtom(parser);
+    while (!parser->failed) {
+        wchar_t character = peekChar(parser);
+        int min, max;
+        if (character == L'*') {
+            min = 0;
+            max = -1;
+        } else if (character == L'+') {
+            min = 1;
+            max = -1;
+        } else if (character == L'?') {
+            min = 0;
+            max = 1;
+        } else if (character == L'{') {
+            parser->position++;
+            if (!parseCount(parser, &min, &max)) {
+                return -1;
+            }
+            parser->position--; // The brace is consumed below like the other quantifiers
+        } else {
+            break;
+        }
+        parser->position++;
+
+        int repeat = newNode(parser, NODE_REPEAT, node, -1);
+        if (repeat == -1) {
+            return -1;
+        }
+        parser->nodes[repeat].min = min;
+        parser->nodes[repeat].max = max;
+        if (peekChar(parser) == L'?') {
+            parser->nodes[repeat].greedy = false;
+            parser->position++;
+        }
+        node = repeat;
+    }
+    return node;
+}
+
+static int parseConcat(Parser *parser) {
+    int node = -1;
+    while (!parser->failed && peekChar(parser) != L'\0' && peekChar(parser) != L'|' && peekChar(parser) != L')') {
+        node = concatNodes(parser, node, parseRepeat(parser));
+    }
+    if (node == -1 && !parser->failed) {
+        parseError(parser, "empty expression");
+    }
+    return node;
+}
+
+static int parseAlternation(Parser *parser) {
+    int node = parseConcat(parser);
+    while (!parser->failed && peekChar(parser) == L'|') {
+        parser->position++;
+        node = newNode(parser, NODE_ALTERNATE, node, parseConcat(parser));
+    }
+    return node;
+}
+
+/**
+ * Returns true if the node can match empty text (assertions count as empty).
+ */
+static bool isNullable(Parser *parser, int node) {
+    AstNode *ast = &parser->nodes[node];
+    switch (ast->type) {
+        case NODE_BYTES:
+            return false;
+        case NODE_CONCAT:
+            return isNullable(parser, ast->left) && isNullable(parser, ast->right);
+        case NODE_ALTERNATE:
+            return isNullable(parser, ast->left) || isNullable(parser, ast->right);
+        case NODE_REPEAT:
+            return ast->min == 0 || isNullable(parser, ast->left);
+        case NODE_GROUP:
+            return isNullable(parser, ast->left);
+        default:
+            return true;
+    }
+}
+
+/*
+======================
+  Compiler
+======================
+*/
+
+static int emit(Program *program, InstructionType type, int argument) {
+    if (program->length == REGEX_MAX_PROGRAM) {
+        return -1;
+    }
+    if (program->length == program->capacity) {
+        int newCapacity = program->capacity == 0 ? 64 : program->capacity * 2;
+        Instruction *grown = realloc(program->code, newCapacity * sizeof(Instruction));
+        if (grown == NULL) {
+            return -1;
+        }
+        program->code = grown;
+        program->capacity = newCapacity;
+    }
+    program->code[program->length] = (Instruction){type, program->length + 1, -1, argument};
+    return program->length++;
+}
+
+/**
+ * Appends the instructions for a node, with reverse the pattern is compiled to match the text from back to front.
+ * Returns false if the program got too large.
+ */
+static bool compileNode(Parser *parser, Program *program, int node, bool reverse) {
+    AstNode *ast = &parser->nodes[node];
+    switch (ast->type) {
+        case NODE_BYTES:
+            return emit(program, INSTR_BYTES, ast->set) != -1;
+
+        case NODE_CONCAT:
+            return compileNode(parser, program, reverse ? ast->right : ast->left, reverse) &&
+                   compileNode(parser, program, reverse ? ast->left : ast->right, reverse);
+
+        case NODE_ALTERNATE: {
+            int split = emit(program, INSTR_SPLIT, 0);
+            if (split == -1 || !compileNode(parser, program, ast->left, reverse)) {
+                return false;
+            }
+            int jump = emit(program, INSTR_JUMP, 0);
+            if (jump == -1) {
+                return false;
+            }
+            program->code[split].out2 = program->length;
+            if (!compileNode(parser, program, ast->right, reverse)) {
+                return false;
+            }
+            program->code[jump].out = program->length;
+            return true;
+        }
+
+        case NODE_GROUP:
+            if (reverse || ast->group == 0) {
+                return compileNode(parser, program, ast->left, reverse);
+            }
+            return emit(program, INSTR_SAVE, 2 * ast->group) != -1 && compileNode(parser, program, ast->left, reverse) &&
+                   emit(program, INSTR_SAVE, 2 * ast->group + 1) != -1;
+
+        case NODE_LINE_START:
+            return emit(program, reverse ? INSTR_LINE_END : INSTR_LINE_START, 0) != -1;
+
+        case NODE_LINE_END:
+            return emit(program, reverse ? INSTR_LINE_START : INSTR_LINE_END, 0) != -1;
+
+        case NODE_REPEAT: {
+            int min = ast->min, max = ast->max, child = ast->left;
+            bool greedy = ast->greedy;
+            for (int i = 0; i < min; i++) {
+                if (!compileNode(parser, program, child, reverse)) {
+                    return false;
+                }
+            }
+
+            if (max == -1) {
+                // Loop: split into the body or out, the preferred branch depends on greediness
+                int split = emit(program, INSTR_SPLIT, 0);
+                if (split == -1 || !compileNode(parser, program, child, reverse)) {
+                    return false;
+                }
+                int jump = emit(program, INSTR_JUMP, 0);
+                if (jump == -1) {
+                    return false;
+                }
+                program->code[jump].out = split;
+                program->code[split].out = greedy ? split + 1 : program->length;
+                program->code[split].out2 = greedy ? program->length : split + 1;
+                return true;
+            }
+
+            // Optional copies x(x(x)?)?, every skip leaves the whole repetition
+            int firstSplit = program->length;
+            for (int i = min; i < max; i++) {
+                if (emit(program, INSTR_SPLIT, 0) == -1 || !compileNode(parser, program, child, reverse)) {
+                    return false;
+                }
+            }
+            for (int pc = firstSplit; pc < program->length; pc++) {
+                Instruction *instruction = &program->code[pc];
+                if (instruction->type == INSTR_SPLIT && instruction->out2 == -1) {
+                    instruction->out2 = greedy ? program->length : pc + 1;
+                    instruction->out = greedy ? pc + 1 : program->length;
+                }
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+Regex *compileRegex(const wchar_t *pattern) {
+    if (pattern == NULL || pattern[0] == L'\0') {
+        ERR_PRINT("compileRegex called with empty pattern.\n");
+        return NULL;
+    }
+    Regex *regex = calloc(1, sizeof(Regex));
+    if (regex == NULL) {
+        ERR_PRINT("Fatal malloc fail at regex compilation!\n");
+        return NULL;
+    }
+    regex->groups = 1;
+    regex->lineBreak = getCurrentLineBidentifier() != NONE_ID ? (Atomic)getCurrentLineBidentifier() : '\n';
+    regex->lineEndPrefix = getCurrentLineBstd() == MSDOS ? '\r' : regex->lineBreak;
+
+    Parser parser = {pattern, 0, NULL, 0, 0, regex, 0, false};
+    int root = parseAlternation(&parser);
+    if (!parser.failed && peekChar(&parser) != L'\0') {
+        parseError(&parser, "unmatched )");
+    }
+    if (!parser.failed && isNullable(&parser, root)) {
+        parseError(&parser, "pattern can match empty text");
+    }
+
+    // Nested (single instruction) split patches in compileNode() rely on out2 == -1 of fresh splits
+    bool compiled = !parser.failed && emit(&regex->forward, INSTR_SAVE, 0) != -1 && compileNode(&parser, &regex->forward, root, false) &&
+                    emit(&regex->forward, INSTR_SAVE, 1) != -1 && emit(&regex->forward, INSTR_MATCH, 0) != -1 &&
+                    compileNode(&parser, &regex->reverse, root, true) && emit(&regex->reverse, INSTR_MATCH, 0) != -1;
+    free(parser.nodes);
+    if (!compiled) {
+        if (!parser.failed) {
+            ERR_PRINT("Regex is too large.\n");
+        }
+        freeRegex(regex);
+        return NULL;
+    }
+
+    // Scratch memory, sized for the larger program
+    int length = regex->forward.length > regex->reverse.length ? regex->forward.length : regex->reverse.length;
+    regex->marks = calloc(length, sizeof(unsigned int));
+    regex->stack = malloc(length * 2 * sizeof(int));
+    regex->closure = malloc(length * sizeof(int));
+    for (int i = 0; i < 2; i++) {
+        regex->threads[i].instructions = malloc(length * sizeof(int));
+        regex->threads[i].captures = malloc((size_t)length * REGEX_MAX_GROUPS * 2 * sizeof(Position));
+    }
+    if (regex->marks == NULL || regex->stack == NULL || regex->closure == NULL || regex->threads[0].instructions == NULL ||
+        regex->threads[0].captures == NULL || regex->threads[1].instructions == NULL || regex->threads[1].captures == NULL) {
+        ERR_PRINT("Fatal malloc fail at regex compilation!\n");
+        freeRegex(regex);
+        return NULL;
+    }
+
+    regex->forwardDfa[0] = (Dfa){&regex->forward, false, true, false, {NULL}, 0, 0};
+    regex->forwardDfa[1] = (Dfa){&regex->forward, false, false, false, {NULL}, 0, 0};
+    regex->reverseDfa = (Dfa){&regex->reverse, true, false, true, {NULL}, 0, 0};
+    return regex;
+}
+
+/*
+======================
+  Lazy DFA
+======================
+*/
+
+static void flushDfa(Dfa *dfa) {
+    for (int i = 0; i < DFA_HASH_SIZE; i++) {
+        DfaState *state = dfa->table[i];
+        while (state != NULL) {
+            DfaState *next = state->hashNext;
+            free(state->instructions);
+            free(state);
+            state = next;
+        }
+        dfa->table[i] = NULL;
+    }
+    dfa->stateAmount = 0;
+}
+
+void freeRegex(Regex *regex) {
+    if (regex == NULL) {
+        return;
+    }
+    flushDfa(&regex->forwardDfa[0]);
+    flushDfa(&regex->forwardDfa[1]);
+    flushDfa(&regex->reverseDfa);
+    free(regex->forward.code);
+    free(regex->reverse.code);
+    free(regex->sets);
+    free(regex->marks);
+    free(regex->stack);
+    free(regex->closure);
+    for (int i = 0; i < 2; i++) {
+        free(regex->threads[i].instructions);
+        free(regex->threads[i].captures);
+    }
+    free(regex);
+}
+
+static inline unsigned int nextGeneration(Regex *regex, int programLength) {
+    if (++regex->generation == 0) {
+        memset(regex->marks, 0, programLength * sizeof(unsigned int));
+        regex->generation = 1;
+    }
+    return regex->generation;
+}
+
+/**
+ * Whether a line start assertion holds after the given atomic (NO_ATOMIC: start of the text).
+ */
+static inline bool startsLineAfter(Regex *regex, int atomic) {
+    return atomic == NO_ATOMIC || atomic == regex->lineBreak;
+}
+
+/**
+ * Whether a line end assertion holds in front of the given atomic (NO_ATOMIC: end of the text).
+ */
+static inline bool endsLineBefore(Regex *regex, int atomic) {
+    return atomic == NO_ATOMIC || atomic == regex->lineBreak || atomic == regex->lineEndPrefix;
+}
+
+/**
+ * Flags of the assertions around a scanned atomic. In reverse the roles of the previous and the next atomic swap.
+ */
+static inline bool afterLineStartFlag(Regex *regex, Dfa *dfa, int scannedAtomic) {
+    return dfa->reverse ? endsLineBefore(regex, scannedAtomic) : startsLineAfter(regex, scannedAtomic);
+}
+
+static inline bool beforeLineEndFlag(Regex *regex, Dfa *dfa, int nextAtomic) {
+    return dfa->reverse ? startsLineAfter(regex, nextAtomic) : endsLineBefore(regex, nextAtomic);
+}
+
+/**
+ * Computes the ordered epsilon closure of a state into regex->closure, returns its length.
+ * matched reports whether the closure reaches the match instruction; without longest all lower priority threads are dropped then.
+ */
+static int computeClosure(Regex *regex, Dfa *dfa, DfaState *state, bool beforeLineEnd, bool *matched) {
+    Program *program = dfa->program;
+    unsigned int generation = nextGeneration(regex, program->length);
+    int amount = 0;
+    *matched = false;
+
+    for (int i = 0; i < state->amount; i++) {
+        int stackSize = 0;
+        regex->stack[stackSize++] = state->instructions[i];
+        while (stackSize > 0) {
+            int pc = regex->stack[--stackSize];
+            if (regex->marks[pc] == generation) {
+                continue;
+            }
+            regex->marks[pc] = generation;
+            Instruction *instruction = &program->code[pc];
+            switch (instruction->type) {
+                case INSTR_BYTES:
+                    regex->closure[amount++] = pc;
+                    break;
+                case INSTR_SPLIT:
+                    regex->stack[stackSize++] = instruction->out2;
+                    regex->stack[stackSize++] = instruction->out;
+                    break;
+                case INSTR_JUMP:
+                case INSTR_SAVE:
+                    regex->stack[stackSize++] = instruction->out;
+                    break;
+                case INSTR_LINE_START:
+                    if (state->afterLineStart) {
+                        regex->stack[stackSize++] = instruction->out;
+                    }
+                    break;
+                case INSTR_LINE_END:
+                    if (beforeLineEnd) {
+                        regex->stack[stackSize++] = instruction->out;
+                    }
+                    break;
+                case INSTR_MATCH:
+                    *matched = true;
+                    if (!dfa->longest) {
+                        return amount; // Lower priority threads can not win anymore
+                    }
+                    break;
+            }
+        }
+    }
+    return amount;
+}
+
+static unsigned int hashState(const int *instructions, int amount, bool afterLineStart) {
+    unsigned int hash = 2166136261u ^ (unsigned int)afterLineStart;
+    for (int i = 0; i < amount; i++) {
+        hash = (hash ^ (unsigned int)instructions[i]) * 16777619u;
+    }
+    return hash % DFA_HASH_SIZE;
+}
+
+/**
+ * Returns the cached state for the instruction list or creates it. Returns NULL if the cache had to be flushed too often.
+ */
+static DfaState *lookupState(Dfa *dfa, const int *instructions, int amount, bool afterLineStart) {
+    unsigned int hash = hashState(instructions, amount, afterLineStart);
+    for (DfaState *state = dfa->table[hash]; state != NULL; state = state->hashNext) {
+        if (state->amount == amount && state->afterLineStart == afterLineStart &&
+            memcmp(state->instructions, instructions, amount * sizeof(int)) == 0) {
+            return state;
+        }
+    }
+
+    if (dfa->stateAmount >= DFA_MAX_STATES) {
+        if (++dfa->flushes > DFA_MAX_FLUSHES) {
+            return NULL;
+        }
+        DEBG_PRINT("Regex DFA cache full, flushing it.\n");
+        flushDfa(dfa);
+    }
+    DfaState *state = malloc(sizeof(DfaState));
+    int *copy = malloc((amount > 0 ? amount : 1) * sizeof(int));
+    if (state == NULL || copy == NULL) {
+        free(state);
+        free(copy);
+        return NULL;
+    }
+    memcpy(copy, instructions, amount * sizeof(int));
+    state->instructions = copy;
+    state->amount = amount;
+    state->afterLineStart = afterLineStart;
+    state->matches[0] = -1;
+    state->matches[1] = -1;
+    memset(state->next, 0, sizeof(state->next));
+    state->hashNext = dfa->table[hash];
+    dfa->table[hash] = state;
+    dfa->stateAmount++;
+    return state;
+}
+
+/**
+ * State of the given state in another DFA of the same program, optionally without the injected start instruction.
+ * The instructions are copied first since the lookup may flush the cache owning the given state.
+ */
+static DfaState *convertState(Regex *regex, Dfa *dfa, DfaState *state, bool removeStart) {
+    int amount = 0;
+    for (int i = 0; i < state->amount; i++) {
+        if (!removeStart || state->instructions[i] != 0) {
+            regex->closure[amount++] = state->instructions[i];
+        }
+    }
+    return lookupState(dfa, regex->closure, amount, state->afterLineStart);
+}
+
+/**
+ * Returns whether the state matches directly in front of an atomic (NO_ATOMIC: at the border of the text).
+ */
+static bool stateMatches(Regex *regex, Dfa *dfa, DfaState *state, int nextAtomic) {
+    int context = beforeLineEndFlag(regex, dfa, nextAtomic);
+    if (state->matches[context] == -1) {
+        bool matched;
+        computeClosure(regex, dfa, state, context, &matched);
+        state->matches[context] = matched;
+    }
+    return state->matches[context];
+}
+
+/**
+ * Moves the DFA over one atomic. matched reports a match right in front of the atomic.
+ * Returns NULL if the DFA gave up (cache flushed too often).
+ */
+static DfaState *dfaTransition(Regex *regex, Dfa *dfa, DfaState *state, Atomic atomic, bool *matched) {
+    int context = beforeLineEndFlag(regex, dfa, atomic);
+    if (state->next[atomic] != NULL) {
+        *matched = state->matches[context];
+        return state->next[atomic];
+    }
+
+    int amount = computeClosure(regex, dfa, state, context, matched);
+    state->matches[context] = *matched;
+
+    // Step all byte instructions over the atomic, keeping their priority order
+    Program *program = dfa->program;
+    unsigned int generation = nextGeneration(regex, program->length);
+    int stepped = 0;
+    for (int i = 0; i < amount; i++) {
+        Instruction *instruction = &program->code[regex->closure[i]];
+        if (setContains(&regex->sets[instruction->argument], atomic) && regex->marks[instruction->out] != generation) {
+            regex->marks[instruction->out] = generation;
+            regex->closure[stepped++] = instruction->out; // stepped <= i, the closure can be reused in place
+        }
+    }
+    if (dfa->injectStart && regex->marks[0] != generation) {
+        regex->closure[stepped++] = 0; // A new match may start after the atomic (lowest priority)
+    }
+
+    int flushes = dfa->flushes;
+    DfaState *next = lookupState(dfa, regex->closure, stepped, afterLineStartFlag(regex, dfa, atomic));
+    if (next != NULL && flushes == dfa->flushes && next->amount > 0) {
+        // Only link if the lookup did not flush (and free) the given state, dead states always take the slow path
+        state->next[atomic] = next;
+    }
+    return next;
+}
+
+/*
+======================
+  Text Access
+======================
+*/
+
+static int atomicAt(Sequence *sequence, Position position) {
+    Atomic *block;
+    if (position < 0 || position >= (Position)getCurrentTotalSize(sequence) || getItemBlock(sequence, position, &block) <= 0) {
+        return NO_ATOMIC;
+    }
+    return *block;
+}
+
+static bool initReader(AtomicReader *reader, Sequence *sequence, Position position) {
+    reader->sequence = sequence;
+    reader->position = position;
+    reader->totalSize = (Position)getCurrentTotalSize(sequence);
+    reader->index = 0;
+    if (initBlockIterator(&reader->iterator, sequence, position) == -1) {
+        return false;
+    }
+    reader->blockSize = getCurrentBlock(&reader->iterator, &reader->block);
+    return reader->blockSize > 0;
+}
+
+/**
+ * Returns the atomic at the reader's position, NO_ATOMIC at the end of the text.
+ */
+static inline int peekAtomic(AtomicReader *reader) {
+    if (reader->position >= reader->totalSize) {
+        return NO_ATOMIC;
+    }
+    if (reader->index == reader->blockSize) {
+        reader->blockSize = getNextBlock(&reader->iterator, &reader->block);
+        reader->index = 0;
+        if (reader->blockSize <= 0) {
+            return NO_ATOMIC;
+        }
+    }
+    return reader->block[reader->index];
+}
+
+static inline void advanceReader(AtomicReader *reader) {
+    reader->index++;
+    reader->position++;
+}
+
+/*
+======================
+  Search
+======================
+*/
+
+/**
+ * Runs the forward DFA from from and finds the end of the leftmost-first match starting in [from, startLimit].
+ * Returns 1 and writes matchEnd if there is one, 0 if not and -1 if the DFA gave up.
+ */
+static int dfaFindEnd(Regex *regex, Sequence *sequence, Position from, Position startLimit, Position *matchEnd) {
+    Dfa *dfa = &regex->forwardDfa[from < startLimit ? 0 : 1];
+    regex->forwardDfa[0].flushes = 0;
+    regex->forwardDfa[1].flushes = 0;
+    int start = 0;
+    DfaState *state = lookupState(dfa, &start, 1, startsLineAfter(regex, atomicAt(sequence, from - 1)));
+    BlockIterator iterator;
+    if (state == NULL || initBlockIterator(&iterator, sequence, from) == -1) {
+        return -1;
+    }
+
+    Position totalSize = (Position)getCurrentTotalSize(sequence);
+    Position lastEnd = -1;
+    Position position = from;
+    Atomic *block;
+    Size blockSize = getCurrentBlock(&iterator, &block);
+    bool dead = false;
+    while (position < totalSize && blockSize > 0 && !dead) {
+        Atomic *blockEnd = block + (blockSize < totalSize - position ? blockSize : totalSize - position);
+        for (Atomic *current = block; current < blockEnd; current++, position++) {
+            // Fast path: cached transition without a match in front of the atomic
+            DfaState *next = state->next[*current];
+            if (next != NULL && !state->matches[endsLineBefore(regex, *current)] && (position < startLimit || dfa != &regex->forwardDfa[0])) {
+                state = next;
+                continue;
+            }
+
+            if (dfa == &regex->forwardDfa[0] && position >= startLimit) {
+                // Matches may not start after startLimit, continue without new starts
+                dfa = &regex->forwardDfa[1];
+                state = convertState(regex, dfa, state, position > startLimit);
+                if (state == NULL) {
+                    return -1;
+                }
+            }
+
+            bool matched;
+            state = dfaTransition(regex, dfa, state, *current, &matched);
+            if (state == NULL) {
+                return -1;
+            }
+            if (matched) {
+                lastEnd = position;
+                if (dfa == &regex->forwardDfa[0]) {
+                    // The leftmost match is found, only threads of higher priority may still extend it
+                    dfa = &regex->forwardDfa[1];
+                    state = convertState(regex, dfa, state, true);
+                    if (state == NULL) {
+                        return -1;
+                    }
+                }
+            }
+            if (state->amount == 0 && dfa == &regex->forwardDfa[1]) {
+                dead = true; // No thread left
+                break;
+            }
+        }
+        blockSize = getNextBlock(&iterator, &block);
+    }
+
+    if (!dead && position == totalSize && stateMatches(regex, dfa, state, NO_ATOMIC)) {
+        lastEnd = position;
+    }
+    *matchEnd = lastEnd;
+    return lastEnd != -1;
+}
+
+/**
+ * Runs the reverse DFA backwards from matchEnd and returns the smallest start >= from of a match ending there.
+ * Returns -1 if the DFA gave up.
+ */
+static Position dfaFindStart(Regex *regex, Sequence *sequence, Position from, Position matchEnd) {
+    Dfa *dfa = &regex->reverseDfa;
+    dfa->flushes = 0;
+    int start = 0;
+    DfaState *state = lookupState(dfa, &start, 1, endsLineBefore(regex, atomicAt(sequence, matchEnd)));
+    BlockIterator iterator;
+    if (state == NULL || initBlockIterator(&iterator, sequence, matchEnd) == -1) {
+        return -1;
+    }
+
+    Position lastStart = -1;
+    Position position = matchEnd;
+    Atomic *block;
+    while (position > from && state->amount > 0) {
+        if (getPreviousBlock(&iterator, &block) <= 0) {
+            return -1;
+        }
+        Position blockStart = getBlockIteratorPosition(&iterator);
+        while (position > blockStart && position > from && state->amount > 0) {
+            bool matched;
+            state = dfaTransition(regex, dfa, state, block[position - 1 - blockStart], &matched);
+            if (state == NULL) {
+                return -1;
+            }
+            if (matched) {
+                lastStart = position;
+            }
+            position--;
+        }
+    }
+
+    if (state->amount > 0 && position == from && stateMatches(regex, dfa, state, atomicAt(sequence, from - 1))) {
+        lastStart = from;
+    }
+    return lastStart;
+}
+
+/**
+ * Adds a thread and its epsilon closure to the list (in priority order), the captures are copied.
+ */
+static void addThread(Regex *regex, ThreadList *list, int pc, Position *captures, Position position, bool afterLineStart, bool beforeLineEnd) {
+    if (regex->marks[pc] == regex->generation) {
+        return;
+    }
+    regex->marks[pc] = regex->generation;
+    Instruction *instruction = &regex->forward.code[pc];
+    switch (instruction->type) {
+        case INSTR_SPLIT:
+            addThread(regex, list, instruction->out, captures, position, afterLineStart, beforeLineEnd);
+            addThread(regex, list, instruction->out2, captures, position, afterLineStart, beforeLineEnd);
+            break;
+        case INSTR_JUMP:
+            addThread(regex, list, instruction->out, captures, position, afterLineStart, beforeLineEnd);
+            break;
+        case INSTR_SAVE: {
+            Position saved = captures[instruction->argument];
+            captures[instruction->argument] = position;
+            addThread(regex, list, instruction->out, captures, position, afterLineStart, beforeLineEnd);
+            captures[instruction->argument] = saved;
+            break;
+        }
+        case INSTR_LINE_START:
+            if (afterLineStart) {
+                addThread(regex, list, instruction->out, captures, position, afterLineStart, beforeLineEnd);
+            }
+            break;
+        case INSTR_LINE_END:
+            if (beforeLineEnd) {
+                addThread(regex, list, instruction->out, captures, position, afterLineStart, beforeLineEnd);
+            }
+            break;
+        default: // INSTR_BYTES & INSTR_MATCH wait in the list
+            list->instructions[list->amount] = pc;
+            memcpy(list->captures + (size_t)list->amount * REGEX_MAX_GROUPS * 2, captures, sizeof(Position) * REGEX_MAX_GROUPS * 2);
+            list->amount++;
+            break;
+    }
+}
+
+/**
+ * Simulates the NFA (Pike VM) from from, matches may start in [from, startLimit] and end at stopAt at the latest.
+ * Returns true and writes the capture slots of the leftmost-first match if there is one.
+ */
+static bool pikeSearch(Regex *regex, Sequence *sequence, Position from, Position startLimit, Position stopAt, Position *captures) {
+    AtomicReader reader;
+    if (!initReader(&reader, sequence, from)) {
+        return false;
+    }
+    Position initial[REGEX_MAX_GROUPS * 2];
+    for (int i = 0; i < REGEX_MAX_GROUPS * 2; i++) {
+        initial[i] = -1;
+    }
+
+    ThreadList *current = &regex->threads[0];
+    ThreadList *next = &regex->threads[1];
+    current->amount = 0;
+    bool matched = false;
+    int atomic = peekAtomic(&reader);
+    nextGeneration(regex, regex->forward.length);
+    addThread(regex, current, 0, initial, from, startsLineAfter(regex, atomicAt(sequence, from - 1)), endsLineBefore(regex, atomic));
+
+    while (true) {
+        bool step = atomic != NO_ATOMIC && reader.position < stopAt;
+        int following = NO_ATOMIC;
+        if (step) {
+            advanceReader(&reader);
+            following = peekAtomic(&reader);
+        }
+
+        nextGeneration(regex, regex->forward.length);
+        next->amount = 0;
+        for (int i = 0; i < current->amount; i++) {
+            Instruction *instruction = &regex->forward.code[current->instructions[i]];
+            Position *threadCaptures = current->captures + (size_t)i * REGEX_MAX_GROUPS * 2;
+            if (instruction->type == INSTR_MATCH) {
+                matched = true;
+                memcpy(captures, threadCaptures, sizeof(Position) * REGEX_MAX_GROUPS * 2);
+                break; // Lower priority threads can not win anymore
+            }
+            if (step && setContains(&regex->sets[instruction->argument], atomic)) {
+                addThread(regex, next, instruction->out, threadCaptures, reader.position, startsLineAfter(regex, atomic), endsLineBefore(regex, following));
+            }
+        }
+        if (!step) {
+            break;
+        }
+        if (!matched && reader.position <= startLimit) {
+            addThread(regex, next, 0, initial, reader.position, startsLineAfter(regex, atomic), endsLineBefore(regex, following));
+        }
+
+        ThreadList *swap = current;
+        current = next;
+        next = swap;
+        atomic = following;
+        if (current->amount == 0 && (matched || reader.position > startLimit)) {
+            break; // No thread left and no new one may start
+        }
+    }
+    return matched;
+}
+
+/**
+ * Finds the leftmost-first match starting in [from, startLimit].
+ */
+static bool searchRegex(Regex *regex, Sequence *sequence, Position from, Position startLimit, RegexMatch *match) {
+    Position captures[REGEX_MAX_GROUPS * 2];
+    Position totalSize = (Position)getCurrentTotalSize(sequence);
+    Position matchEnd;
+    bool found;
+
+    int result = dfaFindEnd(regex, sequence, from, startLimit, &matchEnd);
+    Position matchStart = result == 1 ? dfaFindStart(regex, sequence, from, matchEnd) : -1;
+    if (result == 1 && matchStart != -1) {
+        // Only the match itself is run through the NFA to resolve the groups
+        found = pikeSearch(regex, sequence, matchStart, matchStart, matchEnd, captures);
+    } else if (result == 0) {
+        found = false;
+    } else {
+        DEBG_PRINT("Regex DFA gave up, falling back to the NFA simulation.\n");
+        found = pikeSearch(regex, sequence, from, startLimit, totalSize, captures);
+    }
+
+    if (found) {
+        match->groups = regex->groups;
+        for (int i = 0; i < REGEX_MAX_GROUPS; i++) {
+            bool valid = i < regex->groups && captures[2 * i] != -1 && captures[2 * i + 1] != -1;
+            match->groupStart[i] = valid ? captures[2 * i] : -1;
+            match->groupEnd[i] = valid ? captures[2 * i + 1] : -1;
+        }
+    }
+    return found;
+}
+
+/*
+======================
+  Replacement
+======================
+*/
+
+static bool appendBytes(Atomic **buffer, size_t *length, size_t *capacity, const Atomic *bytes, size_t amount) {
+    if (*length + amount > *capacity) {
+        size_t newCapacity = (*length + amount) * 2;
+        Atomic *grown = realloc(*buffer, newCapacity);
+        if (grown == NULL) {
+            return false;
+        }
+        *buffer = grown;
+        *capacity = newCapacity;
+    }
+    memcpy(*buffer + *length, bytes, amount);
+    *length += amount;
+    return true;
+}
+
+/**
+ * Builds the UTF-8 replacement text for a match, resolving group references. Returns NULL on error.
+ */
+static Atomic *buildReplacement(Sequence *sequence, const wchar_t *replacement, RegexMatch *match, size_t *length) {
+    size_t capacity = 64;
+    Atomic *buffer = malloc(capacity);
+    *length = 0;
+    bool success = buffer != NULL;
+
+    for (size_t i = 0; success && replacement[i] != L'\0'; i++) {
+        wchar_t character = replacement[i];
+        if (character == L'\\' && replacement[i + 1] != L'\0') {
+            character = replacement[++i];
+            if (character >= L'0' && character <= L'9') {
+                // Copy the group out of the text
+                int group = character - L'0';
+                if (group >= match->groups || match->groupStart[group] == -1) {
+                    continue; // Group did not take part in the match
+                }
+                BlockIterator iterator;
+                Atomic *block;
+                Position position = match->groupStart[group];
+                success = initBlockIterator(&iterator, sequence, position) == 1;
+                Size blockSize = success ? getCurrentBlock(&iterator, &block) : -1;
+                while (success && position < match->groupEnd[group] && blockSize > 0) {
+                    Size amount = blockSize < match->groupEnd[group] - position ? blockSize : match->groupEnd[group] - position;
+                    success = appendBytes(&buffer, length, &capacity, block, (size_t)amount);
+                    position += amount;
+                    blockSize = getNextBlock(&iterator, &block);
+                }
+                continue;
+            }
+            if (character == L'n') {
+                LineBstd lineBstd = getCurrentLineBstd();
+                const char *lineBreak = lineBstd == MSDOS ? "\r\n" : lineBstd == MAC ? "\r" : "\n";
+                success = appendBytes(&buffer, length, &capacity, (const Atomic *)lineBreak, strlen(lineBreak));
+                continue;
+            }
+            if (character == L't') {
+                character = L'\t';
+            }
+        }
+
+        char encoded[MB_LEN_MAX];
+        mbstate_t state = {0};
+        size_t encodedLength = wcrtomb(encoded, character, &state);
+        success = encodedLength != (size_t)-1 && appendBytes(&buffer, length, &capacity, (const Atomic *)encoded, encodedLength);
+    }
+
+    if (!success) {
+        ERR_PRINT("Building the regex replacement failed.\n");
+        free(buffer);
+        return NULL;
+    }
+    return buffer;
+}
+
+/*
+======================
+  Public API
+======================
+*/
+
+SearchResult findRegex(Sequence *sequence, Regex *regex, Position startPosition, RegexMatch *matchOrNull) {
+    SearchResult result = {-1, -1};
+    if (sequence == NULL || regex == NULL || startPosition < 0 || startPosition > (Position)getCurrentTotalSize(sequence)) {
+        ERR_PRINT("findRegex called with invalid sequence, regex or startPosition.\n");
+        return result;
+    }
+
+    RegexMatch match;
+    Position totalSize = (Position)getCurrentTotalSize(sequence);
+    bool found = searchRegex(regex, sequence, startPosition, totalSize, &match);
+    if (!found && startPosition > 0) {
+        DEBG_PRINT("Regex search has reached the end of the piece table, going back to start.\n");
+        found = searchRegex(regex, sequence, 0, startPosition - 1, &match);
+    }
+    if (found) {
+        result.foundPosition = match.groupStart[0];
+        result.lineNumber = getLineNumber(sequence, result.foundPosition);
+        if (matchOrNull != NULL) {
+            *matchOrNull = match;
+        }
+    }
+    return result;
+}
+
+SearchResult findAndReplaceRegex(Sequence *sequence, Regex *regex, const wchar_t *replacement, Position startPosition) {
+    RegexMatch match;
+    SearchResult result = replacement != NULL ? findRegex(sequence, regex, startPosition, &match) : (SearchResult){-1, -1};
+    if (result.foundPosition == -1) {
+        return result;
+    }
+
+    size_t length;
+    Atomic *text = buildReplacement(sequence, replacement, &match, &length);
+    if (text == NULL || replaceUtf8(sequence, match.groupStart[0], match.groupEnd[0] - 1, text, length) == -1) {
+        ERR_PRINT("Replace failed after regex find.\n");
+        result.foundPosition = -1;
+        result.lineNumber = -1;
+    }
+    free(text);
+    return result;
+}
+
+SearchResult findAndReplaceAllRegex(Sequence *sequence, Regex *regex, const wchar_t *replacement, Position startPosition) {
+    SearchResult result = {-1, -1};
+    if (sequence == NULL || regex == NULL || replacement == NULL || startPosition < 0 || beginEdit(sequence) == -1) {
+        ERR_PRINT("findAndReplaceAllRegex called with invalid sequence, regex, replacement or startPosition.\n");
+        return result;
+    }
+
+    // Matches are searched in the unchanged text and replaced together by one transaction
+    Position totalSize = (Position)getCurrentTotalSize(sequence);
+    Position position = 0;
+    Position shift = 0; // Size change by the replacements in front of the current match
+    RegexMatch match;
+    while (position < totalSize && searchRegex(regex, sequence, position, totalSize, &match)) {
+        size_t length;
+        Atomic *text = buildReplacement(sequence, replacement, &match, &length);
+        Size matchLength = match.groupEnd[0] - match.groupStart[0];
+        if (text == NULL || queueEdit(sequence, match.groupStart[0], matchLength, text, length) == -1) {
+            ERR_PRINT("findAndReplaceAllRegex failed to queue a replacement.\n");
+            free(text);
+            abortEdit(sequence);
+            return (SearchResult){-1, -1};
+        }
+        free(text);
+
+        if (result.foundPosition == -1 && match.groupStart[0] >= startPosition) {
+            result.foundPosition = match.groupStart[0] + shift;
+        }
+        shift += (Position)length - matchLength;
+        position = match.groupEnd[0];
+    }
+
+    if (commitEdit(sequence) == -1) {
+        ERR_PRINT("Replace failed after regex find.\n");
+        return (SearchResult){-1, -1};
+    }
+    if (result.foundPosition != -1) {
+        // A replacement with an empty text can end up directly at the end of the text, which belongs to the last line
+        result.lineNumber = result.foundPosition < (Position)getCurrentTotalSize(sequence) ? getLineNumber(sequence, result.foundPosition)
+                                                                                           : getCurrentLineCount(sequence);
+    }
+    return result;
+}
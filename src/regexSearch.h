@@ -0,0 +1,59 @@
+#ifndef REGEXSEARCH_H
+#define REGEXSEARCH_H
+
+#include "textStructure.h"
+
+/*
+Regular expression search over the piece table.
+Patterns are compiled to a Thompson NFA which is simulated by lazily built DFAs: a forward DFA finds the end
+of the leftmost match, a reverse DFA its start and only the match itself is run through the NFA (Pike VM) to
+resolve capture groups. If the DFA cache keeps overflowing, the search falls back to the Pike VM alone.
+Both simulations need constant work per atomic, so every search is linear in the size of the scanned text.
+The text is read block by block (see BlockIterator), it is never copied into a contiguous buffer.
+
+Supported syntax (matches are leftmost-first like in Perl, i.e. alternatives are tried from left to right):
+  literals, .  (any character except a line break), [abc] [a-z] [^abc], \d \w \s \D \W \S,
+  (...) capturing groups (up to 9), (?:...), |, * + ? {n} {n,} {n,m} (append ? for lazy),
+  ^ $ (start / end of a line), \t \n \r and \ to escape any other character.
+Patterns which can match empty text are rejected.
+In replacements \0 inserts the whole match, \1 ... \9 a group, \n a line break, \t a tab and \\ a backslash.
+*/
+
+#define REGEX_MAX_GROUPS 10 /* group 0 (whole match) and up to 9 capturing groups */
+
+typedef struct Regex Regex;
+
+/* Position of a match and its groups */
+typedef struct {
+    Position groupStart[REGEX_MAX_GROUPS]; // first atomic of the group, -1 if it did not take part in the match
+    Position groupEnd[REGEX_MAX_GROUPS];   // atomic after the group
+    int groups;                            // amount of groups including group 0
+} RegexMatch;
+
+/**
+ * Compiles a pattern (nullterminated string of wide chars), uses the line break of the currently open file.
+ * Returns NULL if the pattern is invalid.
+ */
+Regex *compileRegex(const wchar_t *pattern);
+
+void freeRegex(Regex *regex);
+
+/**
+ * Regex version of find(): searches from startPosition (inclusive) and wraps around to the beginning of the sequence.
+ * If matchOrNull is given, the positions of the match and its groups are written to it.
+ * Returns the SearchResult for the first character of the match, or -1 if no match was found.
+ */
+SearchResult findRegex(Sequence *sequence, Regex *regex, Position startPosition, RegexMatch *matchOrNull);
+
+/**
+ * Regex version of findAndReplace(), group references in the replacement are resolved per match.
+ */
+SearchResult findAndReplaceRegex(Sequence *sequence, Regex *regex, const wchar_t *replacement, Position startPosition);
+
+/**
+ * Regex version of findAndReplaceAll(), all matches are replaced in one transaction (single undo entry).
+ * Returns the SearchResult for the first replacement after startPosition (inclusive), or -1 if no match was found.
+ */
+SearchResult findAndReplaceAllRegex(Sequence *sequence, Regex *regex, const wchar_t *replacement, Position startPosition);
+
+#endif
@@ -0,0 +1,809 @@
+#include "searchKernel.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h> // pthread_once() for the kernel selection, find calls the kernels from worker threads
+#include <wctype.h> // towlower() & towupper() to build the case folding table
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h> // SSE2 & AVX2 intrinsics
+#define SEARCH_KERNEL_X86
+#endif
+
+typedef long (*SearchFunction)(const uint8_t *, size_t, const uint8_t *, size_t);
+typedef long (*FoldedSearchFunction)(const uint8_t *, size_t, const FoldedNeedle *, size_t *);
+typedef long (*ByteClassFunction)(const uint8_t *, size_t, const ByteClass *);
+
+#define MAX_LEAD_BYTES 4 /* lead bytes compared per vector for non-ASCII needles, more fall back to the table scan */
+
+struct FoldedNeedle {
+    bool isAscii;
+    uint8_t *bytes;            // ASCII needle with folded letters (lower case)
+    size_t length;             // length of the needle in bytes
+    uint32_t *codePoints;      // folded characters of the needle
+    size_t codePointCount;
+    size_t minMatchLength;     // bounds for the byte length of a matching text
+    size_t maxMatchLength;
+    size_t fixedPrefixLength;  // byte length of the leading characters which only have variants of their own length
+    size_t fixedPrefixCount;   // number of these characters (0 if even the first one has longer variants, e.g. U+023F)
+    uint8_t leadBytes[MAX_LEAD_BYTES]; // first bytes of all variants of the first character
+    int leadByteCount;         // MAX_LEAD_BYTES + 1: too many, use isLeadByte
+    bool isLeadByte[256];
+    uint8_t lastBytes[MAX_LEAD_BYTES]; // last bytes of all variants of the last character of the fixed prefix
+    int lastByteCount;
+    bool isLastByte[256];
+};
+
+/*
+======================
+  Kernels
+======================
+*/
+
+/**
+ * Fallback without vector instructions, glibc implements memmem() with the Two-Way algorithm.
+ */
+static long searchScalar(const uint8_t *haystack, size_t haystackLength, const uint8_t *needle, size_t needleLength) {
+    const uint8_t *match = memmem(haystack, haystackLength, needle, needleLength);
+    return match != NULL ? (long)(match - haystack) : -1;
+}
+
+/**
+ * Reverse fallback: jumps from one occurrence of the first needle byte to the previous one (memrchr()) and verifies it.
+ */
+static long searchReverseScalar(const uint8_t *haystack, size_t haystackLength, const uint8_t *needle, size_t needleLength) {
+    if (needleLength > haystackLength) {
+        return -1;
+    }
+    size_t candidates = haystackLength - needleLength + 1; // starts in [0, candidates) are left to check
+    while (candidates > 0) {
+        const uint8_t *candidate = memrchr(haystack, needle[0], candidates);
+        if (candidate == NULL) {
+            return -1;
+        }
+        if (memcmp(candidate + 1, needle + 1, needleLength - 1) == 0) {
+            return (long)(candidate - haystack);
+        }
+        candidates = (size_t)(candidate - haystack);
+    }
+    return -1;
+}
+
+#ifdef SEARCH_KERNEL_X86
+/**
+ * Checks the candidates of one vector (bit i set: first and last needle byte match at offset + i).
+ */
+static inline long verifyCandidates(uint32_t candidates, const uint8_t *haystack, size_t offset, const uint8_t *needle, size_t needleLength) {
+    while (candidates != 0) {
+        size_t candidate = offset + (size_t)__builtin_ctz(candidates);
+        // First and last byte are already known to match
+        if (needleLength <= 2 || memcmp(haystack + candidate + 1, needle + 1, needleLength - 2) == 0) {
+            return (long)candidate;
+        }
+        candidates &= candidates - 1; // Clear the lowest candidate
+    }
+    return -1;
+}
+
+/**
+ * Reverse version of verifyCandidates(), the highest candidate is checked first.
+ */
+static inline long verifyCandidatesReverse(uint32_t candidates, const uint8_t *haystack, size_t offset, const uint8_t *needle, size_t needleLength) {
+    while (candidates != 0) {
+        int highest = 31 - __builtin_clz(candidates);
+        size_t candidate = offset + (size_t)highest;
+        if (needleLength <= 2 || memcmp(haystack + candidate + 1, needle + 1, needleLength - 2) == 0) {
+            return (long)candidate;
+        }
+        candidates &= ~(1u << highest); // Clear the highest candidate
+    }
+    return -1;
+}
+
+__attribute__((target("sse2")))
+static long searchSse2(const uint8_t *haystack, size_t haystackLength, const uint8_t *needle, size_t needleLength) {
+    if (needleLength > haystackLength) {
+        return -1;
+    }
+    size_t lastStart = haystackLength - needleLength; // last offset at which a match can start
+    const __m128i first = _mm_set1_epi8((char)needle[0]);
+    const __m128i last = _mm_set1_epi8((char)needle[needleLength - 1]);
+
+    size_t offset = 0;
+    for (; offset + 16 <= lastStart + 1; offset += 16) {
+        __m128i blockFirst = _mm_loadu_si128((const __m128i *)(haystack + offset));
+        __m128i blockLast = _mm_loadu_si128((const __m128i *)(haystack + offset + needleLength - 1));
+        __m128i equal = _mm_and_si128(_mm_cmpeq_epi8(first, blockFirst), _mm_cmpeq_epi8(last, blockLast));
+        long found = verifyCandidates((uint32_t)_mm_movemask_epi8(equal), haystack, offset, needle, needleLength);
+        if (found != -1) {
+            return found;
+        }
+    }
+
+    // Remaining starts which do not fill a whole vector
+    long found = searchScalar(haystack + offset, haystackLength - offset, needle, needleLength);
+    return found != -1 ? (long)offset + found : -1;
+}
+
+__attribute__((target("avx2")))
+static long searchAvx2(const uint8_t *haystack, size_t haystackLength, const uint8_t *needle, size_t needleLength) {
+    if (needleLength > haystackLength) {
+        return -1;
+    }
+    size_t lastStart = haystackLength - needleLength;
+    const __m256i first = _mm256_set1_epi8((char)needle[0]);
+    const __m256i last = _mm256_set1_epi8((char)needle[needleLength - 1]);
+
+    size_t offset = 0;
+    for (; offset + 32 <= lastStart + 1; offset += 32) {
+        __m256i blockFirst = _mm256_loadu_si256((const __m256i *)(haystack + offset));
+        __m256i blockLast = _mm256_loadu_si256((const __m256i *)(haystack + offset + needleLength - 1));
+        __m256i equal = _mm256_and_si256(_mm256_cmpeq_epi8(first, blockFirst), _mm256_cmpeq_epi8(last, blockLast));
+        long found = verifyCandidates((uint32_t)_mm256_movemask_epi8(equal), haystack, offset, needle, needleLength);
+        if (found != -1) {
+            return found;
+        }
+    }
+
+    long found = searchSse2(haystack + offset, haystackLength - offset, needle, needleLength);
+    return found != -1 ? (long)offset + found : -1;
+}
+
+__attribute__((target("sse2")))
+static long searchReverseSse2(const uint8_t *haystack, size_t haystackLength, const uint8_t *needle, size_t needleLength) {
+    if (needleLength > haystackLength) {
+        return -1;
+    }
+    const __m128i first = _mm_set1_epi8((char)needle[0]);
+    const __m128i last = _mm_set1_epi8((char)needle[needleLength - 1]);
+
+    // Vectors of 16 starts, walking from the last possible start towards the beginning
+    size_t starts = haystackLength - needleLength + 1;
+    while (starts >= 16) {
+        size_t offset = starts - 16;
+        __m128i blockFirst = _mm_loadu_si128((const __m128i *)(haystack + offset));
+        __m128i blockLast = _mm_loadu_si128((const __m128i *)(haystack + offset + needleLength - 1));
+        __m128i equal = _mm_and_si128(_mm_cmpeq_epi8(first, blockFirst), _mm_cmpeq_epi8(last, blockLast));
+        long found = verifyCandidatesReverse((uint32_t)_mm_movemask_epi8(equal), haystack, offset, needle, needleLength);
+        if (found != -1) {
+            return found;
+        }
+        starts = offset;
+    }
+
+    // Remaining starts at the beginning which do not fill a whole vector
+    return searchReverseScalar(haystack, starts + needleLength - 1, needle, needleLength);
+}
+
+__attribute__((target("avx2")))
+static long searchReverseAvx2(const uint8_t *haystack, size_t haystackLength, const uint8_t *needle, size_t needleLength) {
+    if (needleLength > haystackLength) {
+        return -1;
+    }
+    const __m256i first = _mm256_set1_epi8((char)needle[0]);
+    const __m256i last = _mm256_set1_epi8((char)needle[needleLength - 1]);
+
+    size_t starts = haystackLength - needleLength + 1;
+    while (starts >= 32) {
+        size_t offset = starts - 32;
+        __m256i blockFirst = _mm256_loadu_si256((const __m256i *)(haystack + offset));
+        __m256i blockLast = _mm256_loadu_si256((const __m256i *)(haystack + offset + needleLength - 1));
+        __m256i equal = _mm256_and_si256(_mm256_cmpeq_epi8(first, blockFirst), _mm256_cmpeq_epi8(last, blockLast));
+        long found = verifyCandidatesReverse((uint32_t)_mm256_movemask_epi8(equal), haystack, offset, needle, needleLength);
+        if (found != -1) {
+            return found;
+        }
+        starts = offset;
+    }
+
+    return searchReverseSse2(haystack, starts + needleLength - 1, needle, needleLength);
+}
+#endif
+
+/*
+======================
+  Case folding
+======================
+*/
+
+static uint32_t foldTable[0x10000]; // simple case folding of the BMP, built on first use
+static bool foldLengthVaries[0x10000]; // characters with variants of another UTF-8 length than the folded one
+static pthread_once_t foldTableBuilt = PTHREAD_ONCE_INIT;
+
+static const uint8_t asciiFold[256] = {
+#define F4(c) (c), (c) + 1, (c) + 2, (c) + 3
+#define F16(c) F4(c), F4((c) + 4), F4((c) + 8), F4((c) + 12)
+    F16(0x00), F16(0x10), F16(0x20), F16(0x30),
+    0x40, F4(0x61), F4(0x65), F4(0x69), F4(0x6d), F4(0x71), F4(0x75), 0x79, 0x7a, 0x5b, 0x5c, 0x5d, 0x5e, 0x5f, // A-Z => a-z
+    F16(0x60), F16(0x70), F16(0x80), F16(0x90), F16(0xa0), F16(0xb0), F16(0xc0), F16(0xd0), F16(0xe0), F16(0xf0)
+#undef F16
+#undef F4
+};
+
+/**
+ * Maps upper, lower and title case forms to one character (lower case of the upper case, e.g. final sigma => sigma).
+ */
+static uint32_t computeFold(uint32_t codePoint) {
+    if (codePoint < 0x80) {
+        return asciiFold[codePoint];
+    }
+    if (codePoint >= 0xD800 && codePoint <= 0xDFFF) {
+        return codePoint;
+    }
+    uint32_t folded = (uint32_t)towlower(towupper((wint_t)codePoint));
+    return folded < 0x80 ? codePoint : folded; // non-ASCII characters must not fold to ASCII (ASCII fast path)
+}
+
+static inline size_t utf8Length(uint32_t codePoint) {
+    return codePoint < 0x80 ? 1 : codePoint < 0x800 ? 2 : codePoint < 0x10000 ? 3 : 4;
+}
+
+static void buildFoldTable() {
+    for (uint32_t codePoint = 0; codePoint < 0x10000; codePoint++) {
+        foldTable[codePoint] = computeFold(codePoint);
+    }
+    // Cased characters outside the BMP all lie in plane 1
+    for (uint32_t codePoint = 0; codePoint < 0x20000; codePoint++) {
+        uint32_t folded = codePoint < 0x10000 ? foldTable[codePoint] : computeFold(codePoint);
+        if (folded < 0x10000 && utf8Length(folded) != utf8Length(codePoint)) {
+            foldLengthVaries[folded] = true;
+        }
+    }
+}
+
+static inline uint32_t foldCodePoint(uint32_t codePoint) {
+    return codePoint < 0x10000 ? foldTable[codePoint] : computeFold(codePoint);
+}
+
+/**
+ * Decodes one UTF-8 character, returns its length or 0 if it is invalid or incomplete.
+ */
+static inline size_t decodeUtf8(const uint8_t *text, size_t available, uint32_t *codePoint) {
+    uint8_t lead = text[0];
+    size_t length;
+    if (lead < 0x80) {
+        *codePoint = lead;
+        return 1;
+    } else if ((lead & 0xE0) == 0xC0) {
+        length = 2;
+        *codePoint = lead & 0x1F;
+    } else if ((lead & 0xF0) == 0xE0) {
+        length = 3;
+        *codePoint = lead & 0x0F;
+    } else if ((lead & 0xF8) == 0xF0) {
+        length = 4;
+        *codePoint = lead & 0x07;
+    } else {
+        return 0; // Continuation byte or invalid lead byte
+    }
+    if (length > available) {
+        return 0;
+    }
+    for (size_t i = 1; i < length; i++) {
+        if ((text[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+        *codePoint = (*codePoint << 6) | (text[i] & 0x3F);
+    }
+    return length;
+}
+
+static size_t encodeUtf8(uint32_t codePoint, uint8_t *out) {
+    if (codePoint < 0x80) {
+        out[0] = (uint8_t)codePoint;
+        return 1;
+    } else if (codePoint < 0x800) {
+        out[0] = (uint8_t)(0xC0 | (codePoint >> 6));
+        out[1] = (uint8_t)(0x80 | (codePoint & 0x3F));
+        return 2;
+    } else if (codePoint < 0x10000) {
+        out[0] = (uint8_t)(0xE0 | (codePoint >> 12));
+        out[1] = (uint8_t)(0x80 | ((codePoint >> 6) & 0x3F));
+        out[2] = (uint8_t)(0x80 | (codePoint & 0x3F));
+        return 3;
+    }
+    out[0] = (uint8_t)(0xF0 | (codePoint >> 18));
+    out[1] = (uint8_t)(0x80 | ((codePoint >> 12) & 0x3F));
+    out[2] = (uint8_t)(0x80 | ((codePoint >> 6) & 0x3F));
+    out[3] = (uint8_t)(0x80 | (codePoint & 0x3F));
+    return 4;
+}
+
+static void addVariantByte(uint8_t byte, uint8_t bytes[MAX_LEAD_BYTES], int *byteCount, bool isVariantByte[256]) {
+    if (isVariantByte[byte]) {
+        return;
+    }
+    isVariantByte[byte] = true;
+    if (*byteCount < MAX_LEAD_BYTES) {
+        bytes[*byteCount] = byte;
+    }
+    (*byteCount)++;
+}
+
+static void addVariant(FoldedNeedle *needle, uint32_t codePoint, bool isFirst, bool isLast) {
+    uint8_t encoded[4];
+    size_t length = encodeUtf8(codePoint, encoded);
+    if (isFirst) {
+        addVariantByte(encoded[0], needle->leadBytes, &needle->leadByteCount, needle->isLeadByte);
+    }
+    if (isLast) {
+        addVariantByte(encoded[length - 1], needle->lastBytes, &needle->lastByteCount, needle->isLastByte);
+    }
+}
+
+FoldedNeedle *prepareFoldedNeedle(const uint8_t *needleText, size_t needleLength) {
+    if (needleLength == 0) {
+        return NULL;
+    }
+    pthread_once(&foldTableBuilt, buildFoldTable);
+    FoldedNeedle *needle = calloc(1, sizeof(FoldedNeedle));
+    if (needle == NULL) {
+        return NULL;
+    }
+    needle->bytes = malloc(needleLength);
+    needle->codePoints = malloc(needleLength * sizeof(uint32_t));
+    if (needle->bytes == NULL || needle->codePoints == NULL) {
+        freeFoldedNeedle(needle);
+        return NULL;
+    }
+    needle->length = needleLength;
+    needle->isAscii = true;
+    bool fixedPrefix = true;
+
+    for (size_t offset = 0; offset < needleLength;) {
+        uint32_t codePoint;
+        size_t length = decodeUtf8(needleText + offset, needleLength - offset, &codePoint);
+        if (length == 0) {
+            freeFoldedNeedle(needle);
+            return NULL;
+        }
+        uint32_t folded = foldCodePoint(codePoint);
+        needle->codePoints[needle->codePointCount++] = folded;
+        // Variants of ASCII characters are ASCII, all others take 2 (or more) bytes
+        needle->minMatchLength += folded < 0x80 ? 1 : 2;
+        needle->maxMatchLength += folded < 0x80 ? 1 : (folded < 0x10000 ? 3 : 4);
+        fixedPrefix = fixedPrefix && folded < 0x10000 && !foldLengthVaries[folded];
+        if (fixedPrefix) {
+            needle->fixedPrefixLength += utf8Length(folded);
+            needle->fixedPrefixCount++;
+        }
+        if (codePoint >= 0x80) {
+            needle->isAscii = false;
+        } else {
+            needle->bytes[offset] = asciiFold[codePoint];
+        }
+        offset += length;
+    }
+
+
+    // Lead bytes of every character which folds to the first one, last bytes of those which fold to the last one
+    // of the fixed prefix (these lie at a known distance from the lead byte)
+    uint32_t first = needle->codePoints[0];
+    bool hasLast = needle->fixedPrefixCount > 0;
+    uint32_t last = hasLast ? needle->codePoints[needle->fixedPrefixCount - 1] : 0;
+    if (first < 0x10000) {
+        for (uint32_t codePoint = 0; codePoint < 0x10000; codePoint++) {
+            bool isLast = hasLast && foldTable[codePoint] == last;
+            if (foldTable[codePoint] == first || isLast) {
+                addVariant(needle, codePoint, foldTable[codePoint] == first, isLast);
+            }
+        }
+    } else {
+        addVariant(needle, first, true, false);
+        addVariant(needle, (uint32_t)towupper((wint_t)first), true, false);
+    }
+    return needle;
+}
+
+void freeFoldedNeedle(FoldedNeedle *needle) {
+    if (needle == NULL) {
+        return;
+    }
+    free(needle->bytes);
+    free(needle->codePoints);
+    free(needle);
+}
+
+size_t getFoldedNeedleMaxMatchLength(const FoldedNeedle *needle) {
+    return needle->maxMatchLength;
+}
+
+/**
+ * Compares the text at the start of haystack with the needle after folding both.
+ * Returns the length of the matching text or 0 if it does not match.
+ */
+static inline size_t matchFoldedAt(const uint8_t *haystack, size_t available, const FoldedNeedle *needle) {
+    size_t position = 0;
+    for (size_t i = 0; i < needle->codePointCount; i++) {
+        if (position >= available) {
+            return 0;
+        }
+        uint32_t codePoint;
+        size_t length;
+        if (haystack[position] < 0x80) {
+            codePoint = asciiFold[haystack[position]];
+            length = 1;
+        } else {
+            length = decodeUtf8(haystack + position, available - position, &codePoint);
+            if (length == 0) {
+                return 0;
+            }
+            codePoint = foldCodePoint(codePoint);
+        }
+        if (codePoint != needle->codePoints[i]) {
+            return 0;
+        }
+        position += length;
+    }
+    return position;
+}
+
+/**
+ * Compares the bytes between first and last needle byte of an ASCII needle, letters case-insensitive.
+ */
+static inline bool middleMatchesFolded(const uint8_t *candidate, const FoldedNeedle *needle) {
+    for (size_t i = 1; i + 1 < needle->length; i++) {
+        if (asciiFold[candidate[i]] != needle->bytes[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * OR mask which folds the haystack byte if the needle byte is a letter (0x20 maps A-Z onto a-z and nothing else onto it).
+ */
+static inline uint8_t foldMask(uint8_t foldedByte) {
+    return foldedByte >= 'a' && foldedByte <= 'z' ? 0x20 : 0x00;
+}
+
+static long searchFoldedAsciiScalar(const uint8_t *haystack, size_t haystackLength, const FoldedNeedle *needle, size_t *matchLength) {
+    size_t needleLength = needle->length;
+    uint8_t first = needle->bytes[0], last = needle->bytes[needleLength - 1];
+    uint8_t firstMask = foldMask(first), lastMask = foldMask(last);
+    for (size_t offset = 0; offset + needleLength <= haystackLength; offset++) {
+        if ((haystack[offset] | firstMask) == first && (haystack[offset + needleLength - 1] | lastMask) == last
+            && middleMatchesFolded(haystack + offset, needle)) {
+            *matchLength = needleLength;
+            return (long)offset;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Scans for candidates with isLeadByte and verifies them, used for non-ASCII needles without vector support.
+ */
+static long searchFoldedScalar(const uint8_t *haystack, size_t haystackLength, const FoldedNeedle *needle, size_t *matchLength) {
+    for (size_t offset = 0; offset + needle->minMatchLength <= haystackLength; offset++) {
+        if (needle->isLeadByte[haystack[offset]]) {
+            size_t length = matchFoldedAt(haystack + offset, haystackLength - offset, needle);
+            if (length != 0) {
+                *matchLength = length;
+                return (long)offset;
+            }
+        }
+    }
+    return -1;
+}
+
+#ifdef SEARCH_KERNEL_X86
+__attribute__((target("sse2")))
+static long searchFoldedAsciiSse2(const uint8_t *haystack, size_t haystackLength, const FoldedNeedle *needle, size_t *matchLength) {
+    size_t needleLength = needle->length;
+    if (needleLength > haystackLength) {
+        return -1;
+    }
+    size_t lastStart = haystackLength - needleLength;
+    const __m128i first = _mm_set1_epi8((char)needle->bytes[0]);
+    const __m128i last = _mm_set1_epi8((char)needle->bytes[needleLength - 1]);
+    const __m128i firstMask = _mm_set1_epi8((char)foldMask(needle->bytes[0]));
+    const __m128i lastMask = _mm_set1_epi8((char)foldMask(needle->bytes[needleLength - 1]));
+
+    size_t offset = 0;
+    for (; offset + 16 <= lastStart + 1; offset += 16) {
+        __m128i blockFirst = _mm_or_si128(_mm_loadu_si128((const __m128i *)(haystack + offset)), firstMask);
+        __m128i blockLast = _mm_or_si128(_mm_loadu_si128((const __m128i *)(haystack + offset + needleLength - 1)), lastMask);
+        uint32_t candidates = (uint32_t)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, blockFirst), _mm_cmpeq_epi8(last, blockLast)));
+        while (candidates != 0) {
+            size_t candidate = offset + (size_t)__builtin_ctz(candidates);
+            if (middleMatchesFolded(haystack + candidate, needle)) {
+                *matchLength = needleLength;
+                return (long)candidate;
+            }
+            candidates &= candidates - 1;
+        }
+    }
+
+    long found = searchFoldedAsciiScalar(haystack + offset, haystackLength - offset, needle, matchLength);
+    return found != -1 ? (long)offset + found : -1;
+}
+
+__attribute__((target("avx2")))
+static long searchFoldedAsciiAvx2(const uint8_t *haystack, size_t haystackLength, const FoldedNeedle *needle, size_t *matchLength) {
+    size_t needleLength = needle->length;
+    if (needleLength > haystackLength) {
+        return -1;
+    }
+    size_t lastStart = haystackLength - needleLength;
+    const __m256i first = _mm256_set1_epi8((char)needle->bytes[0]);
+    const __m256i last = _mm256_set1_epi8((char)needle->bytes[needleLength - 1]);
+    const __m256i firstMask = _mm256_set1_epi8((char)foldMask(needle->bytes[0]));
+    const __m256i lastMask = _mm256_set1_epi8((char)foldMask(needle->bytes[needleLength - 1]));
+
+    size_t offset = 0;
+    for (; offset + 32 <= lastStart + 1; offset += 32) {
+        __m256i blockFirst = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(haystack + offset)), firstMask);
+        __m256i blockLast = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(haystack + offset + needleLength - 1)), lastMask);
+        uint32_t candidates = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, blockFirst), _mm256_cmpeq_epi8(last, blockLast)));
+        while (candidates != 0) {
+            size_t candidate = offset + (size_t)__builtin_ctz(candidates);
+            if (middleMatchesFolded(haystack + candidate, needle)) {
+                *matchLength = needleLength;
+                return (long)candidate;
+            }
+            candidates &= candidates - 1;
+        }
+    }
+
+    long found = searchFoldedAsciiSse2(haystack + offset, haystackLength - offset, needle, matchLength);
+    return found != -1 ? (long)offset + found : -1;
+}
+
+/**
+ * Marks the bytes of the block which equal one of the first count variant bytes.
+ */
+__attribute__((target("sse2")))
+static inline __m128i equalsVariantSse2(__m128i block, const __m128i *variants, int count) {
+    __m128i equal = _mm_cmpeq_epi8(block, variants[0]);
+    for (int i = 1; i < count; i++) {
+        equal = _mm_or_si128(equal, _mm_cmpeq_epi8(block, variants[i]));
+    }
+    return equal;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i equalsVariantAvx2(__m256i block, const __m256i *variants, int count) {
+    __m256i equal = _mm256_cmpeq_epi8(block, variants[0]);
+    for (int i = 1; i < count; i++) {
+        equal = _mm256_or_si256(equal, _mm256_cmpeq_epi8(block, variants[i]));
+    }
+    return equal;
+}
+
+__attribute__((target("sse2")))
+static long searchFoldedSse2(const uint8_t *haystack, size_t haystackLength, const FoldedNeedle *needle, size_t *matchLength) {
+    if (needle->leadByteCount > MAX_LEAD_BYTES) {
+        return searchFoldedScalar(haystack, haystackLength, needle, matchLength);
+    }
+    // Candidates also need a last byte at the end of the fixed prefix, without one the lead bytes are compared twice
+    bool checkLast = needle->fixedPrefixCount > 0 && needle->lastByteCount <= MAX_LEAD_BYTES;
+    size_t lastOffset = checkLast ? needle->fixedPrefixLength - 1 : 0;
+    const uint8_t *lastBytes = checkLast ? needle->lastBytes : needle->leadBytes;
+    int lastByteCount = checkLast ? needle->lastByteCount : needle->leadByteCount;
+    __m128i lead[MAX_LEAD_BYTES], last[MAX_LEAD_BYTES];
+    for (int i = 0; i < MAX_LEAD_BYTES; i++) {
+        lead[i] = _mm_set1_epi8((char)needle->leadBytes[i]);
+        last[i] = _mm_set1_epi8((char)lastBytes[i]);
+    }
+
+    size_t offset = 0;
+    for (; offset + lastOffset + 16 <= haystackLength; offset += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(haystack + offset));
+        __m128i blockLast = _mm_loadu_si128((const __m128i *)(haystack + offset + lastOffset));
+        __m128i equal = _mm_and_si128(equalsVariantSse2(block, lead, needle->leadByteCount),
+                                      equalsVariantSse2(blockLast, last, lastByteCount));
+        uint32_t candidates = (uint32_t)_mm_movemask_epi8(equal);
+        while (candidates != 0) {
+            size_t candidate = offset + (size_t)__builtin_ctz(candidates);
+            size_t length = matchFoldedAt(haystack + candidate, haystackLength - candidate, needle);
+            if (length != 0) {
+                *matchLength = length;
+                return (long)candidate;
+            }
+            candidates &= candidates - 1;
+        }
+    }
+
+    long found = searchFoldedScalar(haystack + offset, haystackLength - offset, needle, matchLength);
+    return found != -1 ? (long)offset + found : -1;
+}
+
+__attribute__((target("avx2")))
+static long searchFoldedAvx2(const uint8_t *haystack, size_t haystackLength, const FoldedNeedle *needle, size_t *matchLength) {
+    if (needle->leadByteCount > MAX_LEAD_BYTES) {
+        return searchFoldedScalar(haystack, haystackLength, needle, matchLength);
+    }
+    bool checkLast = needle->fixedPrefixCount > 0 && needle->lastByteCount <= MAX_LEAD_BYTES;
+    size_t lastOffset = checkLast ? needle->fixedPrefixLength - 1 : 0;
+    const uint8_t *lastBytes = checkLast ? needle->lastBytes : needle->leadBytes;
+    int lastByteCount = checkLast ? needle->lastByteCount : needle->leadByteCount;
+    __m256i lead[MAX_LEAD_BYTES], last[MAX_LEAD_BYTES];
+    for (int i = 0; i < MAX_LEAD_BYTES; i++) {
+        lead[i] = _mm256_set1_epi8((char)needle->leadBytes[i]);
+        last[i] = _mm256_set1_epi8((char)lastBytes[i]);
+    }
+
+    size_t offset = 0;
+    for (; offset + lastOffset + 32 <= haystackLength; offset += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(haystack + offset));
+        __m256i blockLast = _mm256_loadu_si256((const __m256i *)(haystack + offset + lastOffset));
+        __m256i equal = _mm256_and_si256(equalsVariantAvx2(block, lead, needle->leadByteCount),
+                                         equalsVariantAvx2(blockLast, last, lastByteCount));
+        uint32_t candidates = (uint32_t)_mm256_movemask_epi8(equal);
+        while (candidates != 0) {
+            size_t candidate = offset + (size_t)__builtin_ctz(candidates);
+            size_t length = matchFoldedAt(haystack + candidate, haystackLength - candidate, needle);
+            if (length != 0) {
+                *matchLength = length;
+                return (long)candidate;
+            }
+            candidates &= candidates - 1;
+        }
+    }
+
+    long found = searchFoldedSse2(haystack + offset, haystackLength - offset, needle, matchLength);
+    return found != -1 ? (long)offset + found : -1;
+}
+#endif
+
+/*
+======================
+  Byte classes
+======================
+*/
+
+void initByteClass(ByteClass *byteClass, const uint8_t members[256]) {
+    memset(byteClass, 0, sizeof(ByteClass));
+    for (int byte = 0; byte < 256; byte++) {
+        if (members[byte]) {
+            // Bytes share a bucket if their high nibbles are equal modulo 8, which keeps ASCII bytes exact
+            uint8_t bucket = (uint8_t)(1u << ((byte >> 4) & 7));
+            byteClass->lowNibbleBuckets[byte & 0x0F] |= bucket;
+            byteClass->highNibbleBuckets[byte >> 4] |= bucket;
+            byteClass->contains[byte] = 1;
+        }
+    }
+}
+
+static long findByteOfClassScalar(const uint8_t *haystack, size_t haystackLength, const ByteClass *byteClass) {
+    for (size_t offset = 0; offset < haystackLength; offset++) {
+        if (byteClass->contains[haystack[offset]]) {
+            return (long)offset;
+        }
+    }
+    return -1;
+}
+
+#ifdef SEARCH_KERNEL_X86
+__attribute__((target("ssse3")))
+static long findByteOfClassSsse3(const uint8_t *haystack, size_t haystackLength, const ByteClass *byteClass) {
+    const __m128i lowTable = _mm_loadu_si128((const __m128i *)byteClass->lowNibbleBuckets);
+    const __m128i highTable = _mm_loadu_si128((const __m128i *)byteClass->highNibbleBuckets);
+    const __m128i nibbleMask = _mm_set1_epi8(0x0F);
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t offset = 0;
+    for (; offset + 16 <= haystackLength; offset += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(haystack + offset));
+        __m128i low = _mm_shuffle_epi8(lowTable, _mm_and_si128(block, nibbleMask));
+        __m128i high = _mm_shuffle_epi8(highTable, _mm_and_si128(_mm_srli_epi16(block, 4), nibbleMask));
+        uint32_t candidates = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(low, high), zero)) ^ 0xFFFF;
+        while (candidates != 0) {
+            size_t candidate = offset + (size_t)__builtin_ctz(candidates);
+            if (byteClass->contains[haystack[candidate]]) {
+                return (long)candidate;
+            }
+            candidates &= candidates - 1;
+        }
+    }
+
+    long found = findByteOfClassScalar(haystack + offset, haystackLength - offset, byteClass);
+    return found != -1 ? (long)offset + found : -1;
+}
+
+__attribute__((target("avx2")))
+static long findByteOfClassAvx2(const uint8_t *haystack, size_t haystackLength, const ByteClass *byteClass) {
+    const __m256i lowTable = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)byteClass->lowNibbleBuckets));
+    const __m256i highTable = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)byteClass->highNibbleBuckets));
+    const __m256i nibbleMask = _mm256_set1_epi8(0x0F);
+    const __m256i zero = _mm256_setzero_si256();
+
+    size_t offset = 0;
+    for (; offset + 32 <= haystackLength; offset += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(haystack + offset));
+        __m256i low = _mm256_shuffle_epi8(lowTable, _mm256_and_si256(block, nibbleMask));
+        __m256i high = _mm256_shuffle_epi8(highTable, _mm256_and_si256(_mm256_srli_epi16(block, 4), nibbleMask));
+        uint32_t candidates = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(low, high), zero));
+        while (candidates != 0) {
+            size_t candidate = offset + (size_t)__builtin_ctz(candidates);
+            if (byteClass->contains[haystack[candidate]]) {
+                return (long)candidate;
+            }
+            candidates &= candidates - 1;
+        }
+    }
+
+    long found = findByteOfClassSsse3(haystack + offset, haystackLength - offset, byteClass);
+    return found != -1 ? (long)offset + found : -1;
+}
+#endif
+
+/*
+======================
+  Dispatch
+======================
+*/
+
+static pthread_once_t kernelsSelected = PTHREAD_ONCE_INIT;
+static SearchFunction searchKernel;
+static SearchFunction searchReverseKernel;
+static FoldedSearchFunction searchFoldedAsciiKernel;
+static FoldedSearchFunction searchFoldedKernel;
+static ByteClassFunction findByteOfClassKernel;
+
+/**
+ * Picks the best kernels supported by the running CPU. Runs exactly once (pthread_once()), as the search workers of
+ * find may be the first callers.
+ */
+static void selectKernels() {
+    searchKernel = searchScalar;
+    searchReverseKernel = searchReverseScalar;
+    searchFoldedAsciiKernel = searchFoldedAsciiScalar;
+    searchFoldedKernel = searchFoldedScalar;
+    findByteOfClassKernel = findByteOfClassScalar;
+#ifdef SEARCH_KERNEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        searchKernel = searchAvx2;
+        searchReverseKernel = searchReverseAvx2;
+        searchFoldedAsciiKernel = searchFoldedAsciiAvx2;
+        searchFoldedKernel = searchFoldedAvx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        searchKernel = searchSse2;
+        searchReverseKernel = searchReverseSse2;
+        searchFoldedAsciiKernel = searchFoldedAsciiSse2;
+        searchFoldedKernel = searchFoldedSse2;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        findByteOfClassKernel = findByteOfClassAvx2;
+    } else if (__builtin_cpu_supports("ssse3")) {
+        findByteOfClassKernel = findByteOfClassSsse3;
+    }
+#endif
+}
+
+long searchBlock(const uint8_t *haystack, size_t haystackLength, const uint8_t *needle, size_t needleLength) {
+    if (needleLength == 0 || needleLength > haystackLength) {
+        return -1;
+    }
+    pthread_once(&kernelsSelected, selectKernels);
+    return searchKernel(haystack, haystackLength, needle, needleLength);
+}
+
+long searchBlockReverse(const uint8_t *haystack, size_t haystackLength, const uint8_t *needle, size_t needleLength) {
+    if (needleLength == 0 || needleLength > haystackLength) {
+        return -1;
+    }
+    pthread_once(&kernelsSelected, selectKernels);
+    return searchReverseKernel(haystack, haystackLength, needle, needleLength);
+}
+
+long searchBlockFolded(const uint8_t *haystack, size_t haystackLength, const FoldedNeedle *needle, size_t *matchLengthOrNull) {
+    if (needle->minMatchLength > haystackLength) {
+        return -1;
+    }
+    pthread_once(&kernelsSelected, selectKernels);
+    size_t matchLength = 0;
+    long found = needle->isAscii ? searchFoldedAsciiKernel(haystack, haystackLength, needle, &matchLength)
+                                 : searchFoldedKernel(haystack, haystackLength, needle, &matchLength);
+    if (found != -1 && matchLengthOrNull != NULL) {
+        *matchLengthOrNull = matchLength;
+    }
+    return found;
+}
+
+long findByteOfClass(const uint8_t *haystack, size_t haystackLength, const ByteClass *byteClass) {
+    pthread_once(&kernelsSelected, selectKernels);
+    return findByteOfClassKernel(haystack, haystackLength, byteClass);
+}
@@ -0,0 +1,76 @@
+#ifndef SEARCHKERNEL_H
+#define SEARCHKERNEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+Substring search inside one contiguous block of memory (e.g. the part of a piece), used by find() and findPrevious().
+Candidates are filtered by comparing the first and last needle byte against 16 (SSE2) or 32 (AVX2)
+positions at once and only then verified, the implementation is chosen once at runtime.
+On other architectures the (Two-Way based) memmem() of the C library is used.
+*/
+
+/**
+ * Returns the offset of the first occurrence of the needle which lies completely inside haystack[0, haystackLength),
+ * or -1 if there is none. An empty needle never matches.
+ */
+long searchBlock(const uint8_t *haystack, size_t haystackLength, const uint8_t *needle, size_t needleLength);
+
+/**
+ * Returns the offset of the last occurrence of the needle which lies completely inside haystack[0, haystackLength),
+ * or -1 if there is none. The block is scanned from its end, so a match near the end is found without reading the rest.
+ */
+long searchBlockReverse(const uint8_t *haystack, size_t haystackLength, const uint8_t *needle, size_t needleLength);
+
+/*
+Case-insensitive search: the needle is prepared once (prepareFoldedNeedle()) and compared against the UTF-8 text
+character by character after simple case folding, the text is never converted to wide chars.
+Needles made of ASCII only use a vectorized compare of the case folded bytes. Other needles filter candidates by the
+lead bytes of all variants of their first character and the last bytes of the character which ends the leading run of
+characters without variants of another length, then fold the candidates with a table built once for the BMP.
+Non-ASCII characters never fold to ASCII (e.g. the Kelvin sign does not match k), so both ways agree.
+Matches can differ in byte length from the needle (e.g. U+023F and its upper case U+2C7E).
+*/
+
+typedef struct FoldedNeedle FoldedNeedle;
+
+/**
+ * Prepares a UTF-8 needle for case-insensitive search, returns NULL if it is empty or not valid UTF-8.
+ */
+FoldedNeedle *prepareFoldedNeedle(const uint8_t *needle, size_t needleLength);
+
+void freeFoldedNeedle(FoldedNeedle *needle);
+
+/**
+ * Returns the maximum length (in bytes) of a text which matches the needle.
+ */
+size_t getFoldedNeedleMaxMatchLength(const FoldedNeedle *needle);
+
+/**
+ * Case-insensitive version of searchBlock(): returns the offset of the first match which lies completely inside
+ * haystack[0, haystackLength), or -1. The length of the match is written to matchLengthOrNull.
+ */
+long searchBlockFolded(const uint8_t *haystack, size_t haystackLength, const FoldedNeedle *needle, size_t *matchLengthOrNull);
+
+/**
+ * Set of bytes which can be searched for at once (e.g. all bytes a multi-pattern search can start with).
+ * The vector kernels look both nibbles of a byte up in 16 entry tables (bucket bits), candidates are confirmed with contains.
+ */
+typedef struct {
+    uint8_t lowNibbleBuckets[16];
+    uint8_t highNibbleBuckets[16];
+    uint8_t contains[256];
+} ByteClass;
+
+/**
+ * Fills the tables of the byte class from the members (members[b] != 0: b belongs to the class).
+ */
+void initByteClass(ByteClass *byteClass, const uint8_t members[256]);
+
+/**
+ * Returns the offset of the first byte in haystack[0, haystackLength) which belongs to the class, or -1.
+ */
+long findByteOfClass(const uint8_t *haystack, size_t haystackLength, const ByteClass *byteClass);
+
+#endif
@@ -0,0 +1,88 @@
+#include "slabAllocator.h"
+#include "debugUtil.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Header in front of the objects of every slab */
+struct Slab {
+    Slab *next;
+};
+
+/* Size of the slab header, padded so that the first object is aligned */
+#define SLAB_HEADER_SIZE (((sizeof(Slab) + SLAB_ALIGNMENT - 1) / SLAB_ALIGNMENT) * SLAB_ALIGNMENT)
+
+void slabInit(SlabAllocator *allocator, size_t objectSize, size_t objectsPerSlab) {
+    if (objectSize < sizeof(void *)) {
+        objectSize = sizeof(void *); // Freed objects have to hold the free list pointer
+    }
+    allocator->objectSize = ((objectSize + SLAB_ALIGNMENT - 1) / SLAB_ALIGNMENT) * SLAB_ALIGNMENT;
+    allocator->objectsPerSlab = objectsPerSlab > 0 ? objectsPerSlab : 1;
+    allocator->slabs = NULL;
+    allocator->freeList = NULL;
+    allocator->unusedInSlab = 0;
+    allocator->stats = (SlabStats){0, 0, 0, 0, 0, 0};
+}
+
+void *slabAlloc(SlabAllocator *allocator) {
+    void *object;
+
+    if (allocator->freeList != NULL) {
+        // Reuse a freed object first
+        object = allocator->freeList;
+        allocator->freeList = *(void **)object;
+    } else {
+        if (allocator->unusedInSlab == 0) {
+            size_t slabSize = SLAB_HEADER_SIZE + allocator->objectSize * allocator->objectsPerSlab;
+            Slab *slab = (Slab *)malloc(slabSize);
+            if (slab == NULL) {
+                ERR_PRINT("Failed to allocate new slab of %zu bytes.\n", slabSize);
+                return NULL;
+            }
+            slab->next = allocator->slabs;
+            allocator->slabs = slab;
+            allocator->unusedInSlab = allocator->objectsPerSlab;
+            allocator->stats.slabs++;
+            allocator->stats.reservedBytes += slabSize;
+        }
+        // Hand out the objects of the newest slab from front to back
+        size_t index = allocator->objectsPerSlab - allocator->unusedInSlab;
+        object = (uint8_t *)allocator->slabs + SLAB_HEADER_SIZE + index * allocator->objectSize;
+        allocator->unusedInSlab--;
+    }
+
+    allocator->stats.allocations++;
+    allocator->stats.liveObjects++;
+    if (allocator->stats.liveObjects > allocator->stats.peakLiveObjects) {
+        allocator->stats.peakLiveObjects = allocator->stats.liveObjects;
+    }
+    return object;
+}
+
+void slabFree(SlabAllocator *allocator, void *object) {
+    if (object == NULL) {
+        return;
+    }
+    *(void **)object = allocator->freeList;
+    allocator->freeList = object;
+    allocator->stats.frees++;
+    allocator->stats.liveObjects--;
+}
+
+void slabFreeAll(SlabAllocator *allocator) {
+    Slab *curr = allocator->slabs;
+    while (curr != NULL) {
+        Slab *next = curr->next;
+        free(curr);
+        curr = next;
+    }
+    allocator->slabs = NULL;
+    allocator->freeList = NULL;
+    allocator->unusedInSlab = 0;
+    allocator->stats.liveObjects = 0;
+    allocator->stats.slabs = 0;
+    allocator->stats.reservedBytes = 0;
+}
+
+SlabStats slabGetStats(SlabAllocator *allocator) {
+    return allocator->stats;
+}
@@ -0,0 +1,58 @@
+#ifndef SLABALLOCATOR_H
+#define SLABALLOCATOR_H
+
+#include <stddef.h>
+
+/*
+Simple slab allocator for fixed size objects (e.g. DescriptorNodes and Operations).
+Objects are carved out of larger slabs which keeps them close together in memory,
+freed objects are kept in a free list for reuse and all slabs can be released in one shot.
+*/
+
+#define SLAB_ALIGNMENT 16 /* alignment of every handed out object */
+
+/* Allocation statistics of a single allocator */
+typedef struct {
+    size_t allocations;     // total calls of slabAlloc()
+    size_t frees;           // total calls of slabFree()
+    size_t liveObjects;     // objects currently in use
+    size_t peakLiveObjects; // maximum of liveObjects so far
+    size_t slabs;           // amount of slabs (i.e. actual malloc calls)
+    size_t reservedBytes;   // memory held by all slabs
+} SlabStats;
+
+typedef struct Slab Slab;
+
+typedef struct {
+    size_t objectSize;     // size of one object (rounded up to SLAB_ALIGNMENT)
+    size_t objectsPerSlab; // amount of objects per slab
+    Slab *slabs;           // all slabs, newest first
+    void *freeList;        // freed objects, linked through their first bytes
+    size_t unusedInSlab;   // objects of the newest slab which were never handed out
+    SlabStats stats;
+} SlabAllocator;
+
+/**
+ * Initializes an empty allocator, no memory is reserved until the first allocation.
+ */
+void slabInit(SlabAllocator *allocator, size_t objectSize, size_t objectsPerSlab);
+
+/**
+ * Returns memory for one object or NULL if no new slab could be allocated.
+ */
+void *slabAlloc(SlabAllocator *allocator);
+
+/**
+ * Gives an object back to the allocator for reuse (NULL is ignored).
+ */
+void slabFree(SlabAllocator *allocator, void *object);
+
+/**
+ * Releases all slabs at once, every object handed out by the allocator becomes invalid.
+ * The allocator can be used again afterwards.
+ */
+void slabFreeAll(SlabAllocator *allocator);
+
+SlabStats slabGetStats(SlabAllocator *allocator);
+
+#endif
@@ -1,8 +1,141 @@
 #include "statistics.h"
+#include <pthread.h> // Worker threads counting a freshly opened file
+#include <unistd.h>
 #include <wchar.h>
 #include "debugUtil.h"
 
-#include "debugUtil.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h> // SSE2 & AVX2 intrinsics
+#define STATS_KERNEL_X86
+#endif
+
+#define STATS_MAX_WORKERS 64                                /* upper limit of threads counting one buffer */
+#define STATS_MIN_BYTES_PER_WORKER ((size_t)1 << 24)        /* smaller parts are not worth a thread (16 MiB) */
+
+typedef long (*CountFunction)(const Atomic *, size_t, bool *, Atomic, long *);
+
+/*
+=========================
+  Counting Kernels
+=========================
+*/
+
+/*
+All kernels count the line breaks and word starts (atomics which are no separator following a separator) of a block.
+The vector kernels classify 64 atomics at once into a bitmask of separators (line break, space, tab), a word starts
+where a bit of the inverted mask is set but not the bit before it. The last bit is carried into the next 64 atomics.
+*/
+
+static long countScalar(const Atomic *data, size_t length, bool *previousWasSeparator, Atomic lineBreak, long *lineBreaks) {
+    long wordStarts = 0;
+    long breaks = 0;
+    bool separator = *previousWasSeparator;
+    for (size_t i = 0; i < length; i++) {
+        bool isBreak = data[i] == lineBreak;
+        bool isSeparator = isBreak || data[i] == ' ' || data[i] == '\t';
+        breaks += isBreak;
+        wordStarts += separator && !isSeparator;
+        separator = isSeparator;
+    }
+    *previousWasSeparator = separator;
+    *lineBreaks += breaks;
+    return wordStarts;
+}
+
+#ifdef STATS_KERNEL_X86
+/**
+ * Counts the word starts of 64 atomics from their separator mask, lastWasWord carries the state between calls.
+ */
+static inline long countWordStartsOfMask(uint64_t separators, uint64_t *lastWasWord) {
+    uint64_t words = ~separators;
+    uint64_t starts = words & ~((words << 1) | *lastWasWord);
+    *lastWasWord = words >> 63;
+    return __builtin_popcountll(starts);
+}
+
+__attribute__((target("sse2,popcnt")))
+static long countSse2(const Atomic *data, size_t length, bool *previousWasSeparator, Atomic lineBreak, long *lineBreaks) {
+    const __m128i breakVector = _mm_set1_epi8((char)lineBreak);
+    const __m128i spaceVector = _mm_set1_epi8(' ');
+    const __m128i tabVector = _mm_set1_epi8('\t');
+    uint64_t lastWasWord = *previousWasSeparator ? 0 : 1;
+    long wordStarts = 0;
+    long breaks = 0;
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64) {
+        uint64_t breakMask = 0;
+        uint64_t separatorMask = 0;
+        for (int part = 0; part < 4; part++) {
+            __m128i block = _mm_loadu_si128((const __m128i *)(data + i + part * 16));
+            __m128i isBreak = _mm_cmpeq_epi8(block, breakVector);
+            __m128i isSeparator = _mm_or_si128(isBreak, _mm_or_si128(_mm_cmpeq_epi8(block, spaceVector), _mm_cmpeq_epi8(block, tabVector)));
+            breakMask |= (uint64_t)(uint16_t)_mm_movemask_epi8(isBreak) << (part * 16);
+            separatorMask |= (uint64_t)(uint16_t)_mm_movemask_epi8(isSeparator) << (part * 16);
+        }
+        breaks += __builtin_popcountll(breakMask);
+        wordStarts += countWordStartsOfMask(separatorMask, &lastWasWord);
+    }
+    *previousWasSeparator = lastWasWord == 0;
+    *lineBreaks += breaks;
+    return wordStarts + countScalar(data + i, length - i, previousWasSeparator, lineBreak, lineBreaks);
+}
+
+__attribute__((target("avx2,popcnt")))
+static long countAvx2(const Atomic *data, size_t length, bool *previousWasSeparator, Atomic lineBreak, long *lineBreaks) {
+    const __m256i breakVector = _mm256_set1_epi8((char)lineBreak);
+    const __m256i spaceVector = _mm256_set1_epi8(' ');
+    const __m256i tabVector = _mm256_set1_epi8('\t');
+    uint64_t lastWasWord = *previousWasSeparator ? 0 : 1;
+    long wordStarts = 0;
+    long breaks = 0;
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64) {
+        __m256i low = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i high = _mm256_loadu_si256((const __m256i *)(data + i + 32));
+        __m256i lowBreak = _mm256_cmpeq_epi8(low, breakVector);
+        __m256i highBreak = _mm256_cmpeq_epi8(high, breakVector);
+        __m256i lowSeparator = _mm256_or_si256(lowBreak, _mm256_or_si256(_mm256_cmpeq_epi8(low, spaceVector), _mm256_cmpeq_epi8(low, tabVector)));
+        __m256i highSeparator = _mm256_or_si256(highBreak, _mm256_or_si256(_mm256_cmpeq_epi8(high, spaceVector), _mm256_cmpeq_epi8(high, tabVector)));
+        uint64_t breakMask = (uint32_t)_mm256_movemask_epi8(lowBreak) | ((uint64_t)(uint32_t)_mm256_movemask_epi8(highBreak) << 32);
+        uint64_t separatorMask = (uint32_t)_mm256_movemask_epi8(lowSeparator) | ((uint64_t)(uint32_t)_mm256_movemask_epi8(highSeparator) << 32);
+        breaks += __builtin_popcountll(breakMask);
+        wordStarts += countWordStartsOfMask(separatorMask, &lastWasWord);
+    }
+    *previousWasSeparator = lastWasWord == 0;
+    *lineBreaks += breaks;
+    return wordStarts + countScalar(data + i, length - i, previousWasSeparator, lineBreak, lineBreaks);
+}
+#endif
+
+/**
+ * Counts the word starts of data[0, length) and adds its line breaks to lineBreaks, see countWordStarts().
+ * The kernel is chosen once for the running CPU.
+ */
+static long countBlock(const Atomic *data, size_t length, bool *previousWasSeparator, Atomic lineBreak, long *lineBreaks) {
+    static CountFunction count = NULL;
+    if (count == NULL) {
+        count = countScalar;
+#ifdef STATS_KERNEL_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+            count = countAvx2;
+        } else if (__builtin_cpu_supports("sse2") && __builtin_cpu_supports("popcnt")) {
+            count = countSse2;
+        }
+#endif
+    }
+    return count(data, length, previousWasSeparator, lineBreak, lineBreaks);
+}
+
+static inline bool isSeparator(Atomic atomic, Atomic lineBreak) {
+    return atomic == lineBreak || atomic == ' ' || atomic == '\t';
+}
+
+/*
+=========================
+  Statistics
+=========================
+*/
 
 /**
  * Counts the number of line breaks and words caused by the data between two DescriptorNodes in a given sequence.
@@ -11,8 +144,8 @@
  * Words are counted based on spaces and tabs.
  * Lines are counted based on the specified line break identifier.
  */
-TextStatistics calculateStatsEffect(Sequence *sequence, DescriptorNode *startNode, int startOffset, 
-    DescriptorNode *endNode, int endOffset, LineBidentifier lineBreakIdentifier) {
+TextStatistics calculateStatsEffect(Sequence *sequence, DescriptorNode *startNode, long startOffset, 
+    DescriptorNode *endNode, long endOffset, LineBidentifier lineBreakIdentifier) {
 
     TextStatistics stats = {0, 0}; // Empty statistics as default -> no effect
     if (sequence == NULL || startNode == NULL || endNode == NULL || startOffset < 0 || endOffset < 0) {
@@ -21,29 +154,30 @@ TextStatistics calculateStatsEffect(Sequence *sequence, DescriptorNode *startNod
     }
 
     DescriptorNode *currentNode = startNode;
-    int previousWasSpace = 1; // True for line breaks, spaces and tabs. Start with true to count the first word correctly.
-    char *currentData; // Address of the current node's data
-    int currentOffset = startOffset; // Offset within the current node's data
+    bool previousWasSpace = true; // True for line breaks, spaces and tabs. Start with true to count the first word correctly.
+    Atomic *currentData; // Address of the current node's data
+    long currentOffset = startOffset; // Offset within the current node's data
     
-    // Iterate through the nodes from startNode to endNode and count line breaks & words
+    // Iterate through the nodes from startNode to endNode and count line breaks & words (the state carries over)
     while (currentNode != endNode->next_ptr) {
         currentData = currentNode->isInFileBuffer ? sequence->fileBuffer.data + currentNode->offset : sequence->addBuffer.data + currentNode->offset;
 
-        // Count words & line breaks in the node's data
-        int maximumOffset = currentNode == endNode ? endOffset + 1 : currentNode->size; // If it's the end node, limit to endOffset
-        while (currentOffset < maximumOffset) {
-            if (*(currentData + currentOffset) == lineBreakIdentifier) {
-                stats.totalLineBreaks++;
-                previousWasSpace = 1; // Reset for the next line
-            } else if (*(currentData + currentOffset) == ' ' || *(currentData + currentOffset) == '\t') {
-                previousWasSpace = 1; // Space or tab, not part of a word
-            } else {
-                if (previousWasSpace) {
-                    stats.totalWords++; // Count a new word
-                }
-                previousWasSpace = 0; // Current character is part of a word
-            }
-            currentOffset++;
+        // Count words & line breaks in the node's data, large parts are counted with the line index of the buffer
+        // (only the atomics up to the next checkpoint are scanned), so deleting a large span does not read it again
+        long maximumOffset = currentNode == endNode ? endOffset + 1 : (long)currentNode->size; // If it's the end node, limit to endOffset
+        long wordStarts = maximumOffset - currentOffset > 2 * LINE_INDEX_BLOCK_SIZE
+                              ? countWordStartsInPiece(sequence, currentNode, currentOffset, maximumOffset) : -1;
+        if (wordStarts >= 0) {
+            // Counted as if a separator was in front, the first atomic continues a word of the previous node otherwise
+            bool firstIsSeparator = isSeparator(currentData[currentOffset], (Atomic)lineBreakIdentifier);
+            stats.totalWords += wordStarts - (!previousWasSpace && !firstIsSeparator ? 1 : 0);
+            stats.totalLineBreaks += currentOffset == 0 && maximumOffset == (long)currentNode->size
+                                         ? (long)currentNode->lineBreaks // Whole piece, already counted
+                                         : (long)countLineBreaksInPiece(sequence, currentNode, currentOffset, maximumOffset);
+            previousWasSpace = isSeparator(currentData[maximumOffset - 1], (Atomic)lineBreakIdentifier);
+        } else if (currentOffset < maximumOffset) {
+            stats.totalWords += countBlock(currentData + currentOffset, maximumOffset - currentOffset, &previousWasSpace,
+                                           (Atomic)lineBreakIdentifier, &stats.totalLineBreaks);
         }
 
         currentNode = currentNode->next_ptr; // Move to the next node
@@ -77,7 +211,7 @@ TextStatistics calculateStatsEffect(Sequence *sequence, DescriptorNode *startNod
 
     // Check if the character after the endOffset is a line break, space or tab
     int rightIsSpace;
-    if (endOffset < endNode->size - 1) {
+    if (endOffset < (long)endNode->size - 1) {
         // Look in the current node
         char rightChar = (endNode->isInFileBuffer ? sequence->fileBuffer.data : sequence->addBuffer.data)[endNode->offset + endOffset + 1];
         rightIsSpace = (rightChar == lineBreakIdentifier || rightChar == ' ' || rightChar == '\t') ? 1 : 0;
@@ -111,6 +245,11 @@ TextStatistics calculateStatsEffect(Sequence *sequence, DescriptorNode *startNod
     return stats;
 }
 
+
+long countWordStarts(const Atomic *data, size_t length, bool *previousWasSeparator, LineBidentifier lineBreakIdentifier) {
+    long lineBreaks = 0; // Not needed here
+    return countBlock(data, length, previousWasSeparator, (Atomic)lineBreakIdentifier, &lineBreaks);
+}
     
 /**
  * Finds the lineBstd to use for new opening, by checking the file buffer for most common occurrence.
@@ -156,4 +295,383 @@ LineBstd findMostLikelyLineBreakStd(Sequence *sequence){
     } else{
         return NO_INIT;
     }
-}
\ No newline at end of file
+}
+
+/* Work of one counting thread, see indexAndCountBuffer() */
+typedef struct {
+    const Atomic *data;
+    size_t from;                  // multiple of LINE_INDEX_BLOCK_SIZE
+    size_t to;
+    Atomic lineBreak;
+    unsigned long *checkpoints;   // line breaks of block i are stored at i + 1 (summed up afterwards)
+    unsigned long *wordCheckpoints; // same for the word starts
+    long words;
+    CountProgress *progress;      // NULL if not reported
+} CountJob;
+
+static void *countWorker(void *argument) {
+    CountJob *job = (CountJob *)argument;
+    // Look at the atomic in front of the part instead of merging the word state of neighbouring parts afterwards
+    Atomic previous = job->from > 0 ? job->data[job->from - 1] : ' ';
+    bool previousWasSeparator = isSeparator(previous, job->lineBreak);
+    for (size_t blockStart = job->from; blockStart < job->to; blockStart += LINE_INDEX_BLOCK_SIZE) {
+        size_t blockEnd = blockStart + LINE_INDEX_BLOCK_SIZE < job->to ? blockStart + LINE_INDEX_BLOCK_SIZE : job->to;
+        long lineBreaks = 0;
+        long words = countBlock(job->data + blockStart, blockEnd - blockStart, &previousWasSeparator, job->lineBreak, &lineBreaks);
+        job->words += words;
+        job->checkpoints[blockStart / LINE_INDEX_BLOCK_SIZE + 1] = (unsigned long)lineBreaks;
+        job->wordCheckpoints[blockStart / LINE_INDEX_BLOCK_SIZE + 1] = (unsigned long)words;
+        if (job->progress != NULL) {
+            __atomic_add_fetch(&job->progress->countedSize, blockEnd - blockStart, __ATOMIC_RELAXED);
+            if (__atomic_load_n(&job->progress->stopRequested, __ATOMIC_RELAXED)) {
+                return NULL;
+            }
+        }
+    }
+    return NULL;
+}
+
+ReturnCode indexAndCountBuffer(LineIndex *index, const Atomic *data, size_t size, LineBidentifier lineBreakIdentifier, int workers, TextStatistics *statistics, CountProgress *progress) {
+    if (index == NULL || statistics == NULL || index->amount != 0 || (data == NULL && size > 0)) {
+        ERR_PRINT("Invalid parameters for indexAndCountBuffer.\n");
+        return -1;
+    }
+    size_t blocks = (size + LINE_INDEX_BLOCK_SIZE - 1) / LINE_INDEX_BLOCK_SIZE;
+    unsigned long *checkpoints = malloc((blocks + 1) * sizeof(unsigned long));
+    unsigned long *wordCheckpoints = malloc((blocks + 1) * sizeof(unsigned long));
+    if (checkpoints == NULL || wordCheckpoints == NULL) {
+        ERR_PRINT("Memory allocation failed for line index.\n");
+        free(checkpoints);
+        free(wordCheckpoints);
+        return -1;
+    }
+    checkpoints[0] = 0;
+    wordCheckpoints[0] = 0;
+
+    long threads = workers > 0 ? workers : sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > STATS_MAX_WORKERS) {
+        threads = STATS_MAX_WORKERS;
+    }
+    if ((long)(size / STATS_MIN_BYTES_PER_WORKER) < threads) {
+        threads = (long)(size / STATS_MIN_BYTES_PER_WORKER);
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    // Consecutive parts of whole index blocks (which are page aligned), the calling thread takes the first one
+    pthread_t threadIds[STATS_MAX_WORKERS];
+    CountJob jobs[STATS_MAX_WORKERS];
+    bool started[STATS_MAX_WORKERS];
+    size_t blocksPerPart = (blocks + threads - 1) / threads;
+    for (long i = 0; i < threads; i++) {
+        size_t from = i * blocksPerPart * LINE_INDEX_BLOCK_SIZE;
+        size_t to = from + blocksPerPart * LINE_INDEX_BLOCK_SIZE;
+        jobs[i] = (CountJob){data, from < size ? from : size, to < size ? to : size, (Atomic)lineBreakIdentifier, checkpoints, wordCheckpoints, 0, progress};
+        started[i] = i > 0 && pthread_create(&threadIds[i], NULL, countWorker, &jobs[i]) == 0;
+        if (i > 0 && !started[i]) {
+            countWorker(&jobs[i]); // No thread available, count the part right away
+        }
+    }
+    countWorker(&jobs[0]);
+
+    // Merge the parts in order
+    statistics->totalWords = 0;
+    for (long i = 0; i < threads; i++) {
+        if (started[i]) {
+            pthread_join(threadIds[i], NULL);
+        }
+        statistics->totalWords += jobs[i].words;
+    }
+    if (progress != NULL && __atomic_load_n(&progress->stopRequested, __ATOMIC_RELAXED)) {
+        free(checkpoints);
+        free(wordCheckpoints);
+        return -1; // Stopped, the counts are incomplete
+    }
+    for (size_t block = 0; block < blocks; block++) {
+        checkpoints[block + 1] += checkpoints[block];
+        wordCheckpoints[block + 1] += wordCheckpoints[block];
+    }
+    statistics->totalLineBreaks = (long)checkpoints[blocks];
+
+    index->checkpoints = checkpoints;
+    index->wordCheckpoints = wordCheckpoints;
+    index->capacity = blocks + 1;
+    index->amount = size / LINE_INDEX_BLOCK_SIZE + 1; // The last checkpoint is only valid for a full block
+    index->indexedSize = size;
+    index->indexedLineBreaks = checkpoints[blocks];
+    index->indexedWordStarts = wordCheckpoints[blocks];
+    return 1;
+}
+
+/* Count of a file buffer running in the background, see startFileCount() */
+struct FileCount {
+    pthread_t thread;
+    const Atomic *data;
+    size_t size;
+    LineBidentifier lineBreakIdentifier;
+    int workers;
+    CountProgress progress;
+    LineIndex index;           // results, valid once done is set
+    TextStatistics statistics;
+    ReturnCode result;
+    int done;
+};
+
+static void *fileCountThread(void *argument) {
+    FileCount *count = (FileCount *)argument;
+    count->result = indexAndCountBuffer(&count->index, count->data, count->size, count->lineBreakIdentifier,
+                                        count->workers, &count->statistics, &count->progress);
+    __atomic_store_n(&count->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+FileCount *startFileCount(const Atomic *data, size_t size, LineBidentifier lineBreakIdentifier, int workers) {
+    FileCount *count = calloc(1, sizeof(FileCount));
+    if (count == NULL) {
+        ERR_PRINT("Memory allocation failed for background count.\n");
+        return NULL;
+    }
+    count->data = data;
+    count->size = size;
+    count->lineBreakIdentifier = lineBreakIdentifier;
+    count->workers = workers;
+    if (pthread_create(&count->thread, NULL, fileCountThread, count) != 0) {
+        ERR_PRINT("Background count thread could not be started.\n");
+        free(count);
+        return NULL;
+    }
+    return count;
+}
+
+int getFileCountProgress(FileCount *count) {
+    size_t counted = __atomic_load_n(&count->progress.countedSize, __ATOMIC_RELAXED);
+    return count->size > 0 ? (int)(counted * 100 / count->size) : 100;
+}
+
+bool isFileCountDone(FileCount *count) {
+    return __atomic_load_n(&count->done, __ATOMIC_ACQUIRE);
+}
+
+ReturnCode finishFileCount(FileCount *count, LineIndex *index, TextStatistics *statistics) {
+    pthread_join(count->thread, NULL);
+    ReturnCode result = count->result;
+    if (result == 1) {
+        *index = count->index;
+        *statistics = count->statistics;
+    }
+    free(count);
+    return result;
+}
+
+void cancelFileCount(FileCount *count) {
+    if (count == NULL) {
+        return;
+    }
+    __atomic_store_n(&count->progress.stopRequested, 1, __ATOMIC_RELAXED);
+    pthread_join(count->thread, NULL);
+    freeLineIndex(&count->index);
+    free(count);
+}
+
+/*
+=========================
+  Line Index
+=========================
+*/
+
+/**
+ * Counts the occurrences of the line break identifier in data[from, to) (simple loop which the compiler can vectorize).
+ */
+static unsigned long countLineBreaksLinear(const Atomic *data, size_t from, size_t to, LineBidentifier lineBreakIdentifier) {
+    unsigned long count = 0;
+    for (size_t i = from; i < to; i++) {
+        count += (data[i] == (Atomic)lineBreakIdentifier);
+    }
+    return count;
+}
+
+ReturnCode extendLineIndex(LineIndex *index, const Atomic *data, size_t newSize, LineBidentifier lineBreakIdentifier) {
+    if (index == NULL || (data == NULL && newSize > 0)) {
+        ERR_PRINT("Invalid parameters for extendLineIndex.\n");
+        return -1;
+    }
+
+    // Make sure there is space for all checkpoints up to the new size
+    size_t requiredAmount = newSize / LINE_INDEX_BLOCK_SIZE + 1;
+    if (requiredAmount > index->capacity) {
+        size_t newCapacity = (index->capacity == 0) ? 16 : index->capacity;
+        while (newCapacity < requiredAmount) {
+            newCapacity *= 2;
+        }
+        unsigned long *newCheckpoints = realloc(index->checkpoints, newCapacity * sizeof(unsigned long));
+        if (newCheckpoints == NULL) {
+            ERR_PRINT("Memory allocation failed while extending line index.\n");
+            return -1;
+        }
+        index->checkpoints = newCheckpoints;
+        unsigned long *newWordCheckpoints = realloc(index->wordCheckpoints, newCapacity * sizeof(unsigned long));
+        if (newWordCheckpoints == NULL) {
+            ERR_PRINT("Memory allocation failed while extending line index.\n");
+            return -1;
+        }
+        index->wordCheckpoints = newWordCheckpoints;
+        index->capacity = newCapacity;
+    }
+    if (index->amount == 0) {
+        index->checkpoints[0] = 0;
+        index->wordCheckpoints[0] = 0;
+        index->amount = 1;
+    }
+
+    // Scan the new atomics block by block and add a checkpoint at every block border
+    bool previousWasSeparator = index->indexedSize == 0 || isSeparator(data[index->indexedSize - 1], (Atomic)lineBreakIdentifier);
+    while (index->indexedSize < newSize) {
+        size_t blockEnd = (index->indexedSize / LINE_INDEX_BLOCK_SIZE + 1) * LINE_INDEX_BLOCK_SIZE;
+        size_t scanEnd = (blockEnd < newSize) ? blockEnd : newSize;
+        long lineBreaks = 0;
+        index->indexedWordStarts += countBlock(data + index->indexedSize, scanEnd - index->indexedSize, &previousWasSeparator, (Atomic)lineBreakIdentifier, &lineBreaks);
+        index->indexedLineBreaks += lineBreaks;
+        index->indexedSize = scanEnd;
+        if (scanEnd == blockEnd) {
+            index->wordCheckpoints[index->amount] = index->indexedWordStarts;
+            index->checkpoints[index->amount++] = index->indexedLineBreaks;
+        }
+    }
+
+    return 1;
+}
+
+void freeLineIndex(LineIndex *index) {
+    if (index == NULL) {
+        return;
+    }
+    free(index->checkpoints);
+    free(index->wordCheckpoints);
+    index->checkpoints = NULL;
+    index->wordCheckpoints = NULL;
+    index->indexedWordStarts = 0;
+    index->amount = 0;
+    index->capacity = 0;
+    index->indexedSize = 0;
+    index->indexedLineBreaks = 0;
+}
+
+/**
+ * Amount of line breaks before the given offset of an indexed buffer.
+ */
+static unsigned long lineBreaksBefore(LineIndex *index, const Atomic *data, size_t offset, LineBidentifier lineBreakIdentifier) {
+    size_t block = offset / LINE_INDEX_BLOCK_SIZE;
+    if (block >= index->amount) {
+        block = index->amount - 1;
+    }
+    return index->checkpoints[block] + countLineBreaksLinear(data, block * LINE_INDEX_BLOCK_SIZE, offset, lineBreakIdentifier);
+}
+
+unsigned long countLineBreaksInRange(LineIndex *index, const Atomic *data, size_t from, size_t to, LineBidentifier lineBreakIdentifier) {
+    if (from >= to) {
+        return 0;
+    }
+    if (index == NULL || index->amount == 0 || to > index->indexedSize) {
+        ERR_PRINT("Line index does not cover the requested range [%zu, %zu).\n", from, to);
+        return 0;
+    }
+    // Scan directly if the range is small, otherwise use the checkpoints
+    if (to - from <= LINE_INDEX_BLOCK_SIZE) {
+        return countLineBreaksLinear(data, from, to, lineBreakIdentifier);
+    }
+    return lineBreaksBefore(index, data, to, lineBreakIdentifier) - lineBreaksBefore(index, data, from, lineBreakIdentifier);
+}
+
+/**
+ * Returns the amount of word starts before the offset of an indexed buffer (uses the closest checkpoint in front).
+ */
+static unsigned long wordStartsBefore(LineIndex *index, const Atomic *data, size_t offset, LineBidentifier lineBreakIdentifier) {
+    size_t block = offset / LINE_INDEX_BLOCK_SIZE;
+    if (block >= index->amount) {
+        block = index->amount - 1;
+    }
+    size_t blockStart = block * LINE_INDEX_BLOCK_SIZE;
+    bool previousWasSeparator = blockStart == 0 || isSeparator(data[blockStart - 1], (Atomic)lineBreakIdentifier);
+    long lineBreaks = 0;
+    return index->wordCheckpoints[block] + countBlock(data + blockStart, offset - blockStart, &previousWasSeparator,
+                                                      (Atomic)lineBreakIdentifier, &lineBreaks);
+}
+
+long findLineBreakInRange(LineIndex *index, const Atomic *data, size_t from, size_t to, unsigned long n, LineBidentifier lineBreakIdentifier) {
+    if (index == NULL || index->amount == 0 || to > index->indexedSize || n == 0) {
+        ERR_PRINT("Invalid parameters for findLineBreakInRange.\n");
+        return -1;
+    }
+
+    // Absolute number of the requested line break within the whole buffer
+    unsigned long target = lineBreaksBefore(index, data, from, lineBreakIdentifier) + n;
+
+    // Binary search for the last checkpoint which lies before the target line break
+    size_t low = from / LINE_INDEX_BLOCK_SIZE;
+    size_t high = (to - 1) / LINE_INDEX_BLOCK_SIZE;
+    if (high >= index->amount) {
+        high = index->amount - 1;
+    }
+    while (low < high) {
+        size_t middle = low + (high - low + 1) / 2;
+        if (index->checkpoints[middle] < target) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    // Scan from there
+    size_t start = low * LINE_INDEX_BLOCK_SIZE;
+    unsigned long counted = index->checkpoints[low];
+    if (start < from) {
+        start = from;
+        counted = target - n;
+    }
+    for (size_t i = start; i < to; i++) {
+        if (data[i] == (Atomic)lineBreakIdentifier && ++counted == target) {
+            return (long)i;
+        }
+    }
+
+    return -1;
+}
+
+unsigned long countLineBreaksInPiece(Sequence *sequence, DescriptorNode *node, unsigned long from, unsigned long to) {
+    if (sequence == NULL || node == NULL || to > node->size) {
+        ERR_PRINT("Invalid parameters for countLineBreaksInPiece.\n");
+        return 0;
+    }
+    if (node->isInFileBuffer && sequence->fileCount != NULL) {
+        return 0; // Line breaks of the file are not known before its count is done, see finishBackgroundCount()
+    }
+    LineIndex *index = node->isInFileBuffer ? &sequence->fileLineIndex : &sequence->addLineIndex;
+    Atomic *data = node->isInFileBuffer ? sequence->fileBuffer.data : sequence->addBuffer.data;
+    return countLineBreaksInRange(index, data, node->offset + from, node->offset + to, getCurrentLineBidentifier());
+}
+
+long countWordStartsInPiece(Sequence *sequence, DescriptorNode *node, unsigned long from, unsigned long to) {
+    if (sequence == NULL || node == NULL || from >= to || to > node->size) {
+        ERR_PRINT("Invalid parameters for countWordStartsInPiece.\n");
+        return -1;
+    }
+    if (node->isInFileBuffer && sequence->fileCount != NULL) {
+        return -1; // The file is still counted, see finishBackgroundCount()
+    }
+    LineIndex *index = node->isInFileBuffer ? &sequence->fileLineIndex : &sequence->addLineIndex;
+    Atomic *data = node->isInFileBuffer ? sequence->fileBuffer.data : sequence->addBuffer.data;
+    LineBidentifier lineBreakIdentifier = getCurrentLineBidentifier();
+    size_t start = node->offset + from;
+    size_t end = node->offset + to;
+    if (index->amount == 0 || index->wordCheckpoints == NULL || end > index->indexedSize) {
+        return -1;
+    }
+
+    // The checkpoints count a word start at start only if the atomic in front is a separator
+    unsigned long wordStarts = wordStartsBefore(index, data, end, lineBreakIdentifier) - wordStartsBefore(index, data, start, lineBreakIdentifier);
+    if (start > 0 && !isSeparator(data[start - 1], (Atomic)lineBreakIdentifier) && !isSeparator(data[start], (Atomic)lineBreakIdentifier)) {
+        wordStarts++;
+    }
+    return (long)wordStarts;
+}
@@ -5,8 +5,8 @@
 #include "wchar.h"
 
 typedef struct {
-    int totalLineBreaks; // Total number of line breaks in the text
-    int totalWords; // Total number of words in the text
+    long totalLineBreaks; // Total number of line breaks in the text
+    long totalWords; // Total number of words in the text
 } TextStatistics;
 
 /**
@@ -16,9 +16,97 @@ typedef struct {
  * Words are counted based on spaces and tabs.
  * Lines are counted based on the specified line break identifier.
  */
-TextStatistics calculateStatsEffect(Sequence *sequence, DescriptorNode *startNode, int startOffset, 
-    DescriptorNode *endNode, int endOffset, LineBidentifier lineBreakIdentifier);
+TextStatistics calculateStatsEffect(Sequence *sequence, DescriptorNode *startNode, long startOffset, 
+    DescriptorNode *endNode, long endOffset, LineBidentifier lineBreakIdentifier);
+
+/**
+ * Counts the words starting inside data[0, length), with the same separators as calculateStatsEffect().
+ * previousWasSeparator describes the atomic in front of the data (true at the beginning of the text)
+ * and is updated to describe the last atomic of the data, so consecutive spans can be counted piece by piece.
+ */
+long countWordStarts(const Atomic *data, size_t length, bool *previousWasSeparator, LineBidentifier lineBreakIdentifier);
 
 LineBstd findMostLikelyLineBreakStd(Sequence *sequence);
 
+/* Progress of indexAndCountBuffer(), shared with the counting threads */
+typedef struct {
+    size_t countedSize; // atomics counted so far
+    int stopRequested;  // set to stop the count early
+} CountProgress;
+
+/**
+ * Builds the line index of a whole buffer (has to be empty) and counts its words and line breaks in the same pass.
+ * The buffer is split into consecutive parts of whole index blocks, which are counted by worker threads
+ * (workers: 0 means one per online CPU) and merged in order.
+ * The progress is reported if given, returns -1 if it was stopped (or on error).
+ */
+ReturnCode indexAndCountBuffer(LineIndex *index, const Atomic *data, size_t size, LineBidentifier lineBreakIdentifier, int workers, TextStatistics *statistics, CountProgress *progress);
+
+/*
+Large files are counted in the background (see generateStructureForFileContent()), the buffer must not change or be
+unmapped before the count is finished or cancelled.
+*/
+
+/**
+ * Starts indexAndCountBuffer() for the buffer on a background thread, returns NULL on error.
+ */
+FileCount *startFileCount(const Atomic *data, size_t size, LineBidentifier lineBreakIdentifier, int workers);
+
+/**
+ * Percentage of the buffer counted so far.
+ */
+int getFileCountProgress(FileCount *count);
+
+bool isFileCountDone(FileCount *count);
+
+/**
+ * Waits for the count, moves the line index and the totals to the given structures and frees the count.
+ * Returns -1 if the count failed (nothing is moved then).
+ */
+ReturnCode finishFileCount(FileCount *count, LineIndex *index, TextStatistics *statistics);
+
+/**
+ * Stops the count and frees it.
+ */
+void cancelFileCount(FileCount *count);
+
+/*
+=========================
+  Line Index
+=========================
+*/
+
+/**
+ * Extends the line index of a buffer so that it covers all atomics up to newSize.
+ * Has to be called every time data was appended to the indexed buffer.
+ */
+ReturnCode extendLineIndex(LineIndex *index, const Atomic *data, size_t newSize, LineBidentifier lineBreakIdentifier);
+
+/**
+ * Frees the checkpoints of a line index and resets it to an empty index.
+ */
+void freeLineIndex(LineIndex *index);
+
+/**
+ * Counts the line breaks of an indexed buffer in the range [from, to).
+ */
+unsigned long countLineBreaksInRange(LineIndex *index, const Atomic *data, size_t from, size_t to, LineBidentifier lineBreakIdentifier);
+
+/**
+ * Returns the offset of the n-th (starting from 1) line break of an indexed buffer in the range [from, to), or -1 if there are less line breaks.
+ */
+long findLineBreakInRange(LineIndex *index, const Atomic *data, size_t from, size_t to, unsigned long n, LineBidentifier lineBreakIdentifier);
+
+/**
+ * Counts the line breaks in [from, to) of the piece described by the node (offsets relative to the piece).
+ */
+unsigned long countLineBreaksInPiece(Sequence *sequence, DescriptorNode *node, unsigned long from, unsigned long to);
+
+/**
+ * Counts the word starts in [from, to) of the piece described by the node (offsets relative to the piece) with the
+ * line index of its buffer, as if a separator was in front of from. Only the atomics up to the next checkpoints are read.
+ * Returns -1 if the buffer is not indexed (yet), the range has to be scanned then.
+ */
+long countWordStartsInPiece(Sequence *sequence, DescriptorNode *node, unsigned long from, unsigned long to);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,261 @@
+#include "statsCache.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "debugUtil.h"
+
+/*------ Definitions for internal use ------*/
+#define STATS_CACHE_MAGIC 0x3154415453545854ULL /* "TXTSTAT1" */
+#define STATS_CACHE_DIRECTORY "text-terminal"   /* inside $XDG_CACHE_HOME */
+
+/* Header of a cache entry, the fields up to lineBstd identify the file (and the layout of the line index) */
+typedef struct {
+    uint64_t magic;
+    uint64_t fileSize;
+    uint64_t device;
+    uint64_t inode;
+    int64_t modifiedSeconds;
+    int64_t modifiedNanoseconds;
+    uint64_t sampleHash;
+    uint64_t blockSize;
+    int64_t lineBstd;
+    int64_t words;
+    int64_t lineBreaks;
+    uint64_t checkpointCount; // entries of each checkpoint table following the header
+} CacheHeader;
+
+struct StatsCache {
+    char *path;
+    CacheHeader identity; // of the opened file
+    CacheHeader stored;   // header of its entry, valid if found
+    bool found;
+};
+
+/**
+ * FNV-1a hash over STATS_CACHE_SAMPLES slices spread evenly across the buffer (the first and the last included).
+ */
+static uint64_t hashSamples(const Atomic *data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t sampleSize = size < STATS_CACHE_SAMPLE_SIZE ? size : STATS_CACHE_SAMPLE_SIZE;
+    for (size_t sample = 0; sample < STATS_CACHE_SAMPLES; sample++) {
+        size_t start = (size - sampleSize) / (STATS_CACHE_SAMPLES - 1) * sample;
+        if (sample == STATS_CACHE_SAMPLES - 1) {
+            start = size - sampleSize;
+        }
+        for (size_t i = start; i < start + sampleSize; i++) {
+            hash = (hash ^ data[i]) * 0x100000001b3ULL;
+        }
+    }
+    return hash;
+}
+
+/**
+ * Returns the (malloced) path of the cache entry of the file, NULL on error.
+ */
+static char *entryPath(const struct stat *fileStat) {
+    char *path = NULL;
+    const char *cacheHome = getenv("XDG_CACHE_HOME");
+    if (cacheHome != NULL && cacheHome[0] == '/') { // Relative paths are to be ignored
+        size_t length = strlen(cacheHome) + sizeof(STATS_CACHE_DIRECTORY) + 64;
+        path = malloc(length);
+        if (path != NULL) {
+            snprintf(path, length, "%s/%s", cacheHome, STATS_CACHE_DIRECTORY);
+            if (mkdir(path, S_IRWXU) < 0 && errno != EEXIST) {
+                DEBG_PRINT("Statistics cache directory %s could not be created.\n", path);
+                free(path);
+                return NULL;
+            }
+            snprintf(path, length, "%s/%s/stats-%llu-%llu", cacheHome, STATS_CACHE_DIRECTORY,
+                     (unsigned long long)fileStat->st_dev, (unsigned long long)fileStat->st_ino);
+        }
+    } else {
+        path = malloc(96);
+        if (path != NULL) {
+            snprintf(path, 96, "/tmp/TxTinternal-stats-%u-%llu-%llu", (unsigned)geteuid(),
+                     (unsigned long long)fileStat->st_dev, (unsigned long long)fileStat->st_ino);
+        }
+    }
+    return path;
+}
+
+/**
+ * Opens the cache entry for reading, only if it belongs to the user (the directory may be shared, see /tmp).
+ */
+static FILE *openEntry(const char *path) {
+    int fd = open(path, O_RDONLY | O_NOFOLLOW);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat entryStat;
+    if (fstat(fd, &entryStat) < 0 || entryStat.st_uid != geteuid() || !S_ISREG(entryStat.st_mode)) {
+        close(fd);
+        return NULL;
+    }
+    FILE *file = fdopen(fd, "rb");
+    if (file == NULL) {
+        close(fd);
+    }
+    return file;
+}
+
+ReturnCode openStatsCache(Sequence *sequence, const char *filePath) {
+    if (sequence == NULL || filePath == NULL) {
+        ERR_PRINT("Invalid parameters for openStatsCache.\n");
+        return -1;
+    }
+    struct stat fileStat;
+    if (!STATS_CACHE_ENABLED || sequence->fileBuffer.size < STATS_CACHE_MIN_FILE_SIZE || stat(filePath, &fileStat) < 0) {
+        return 1;
+    }
+    StatsCache *cache = calloc(1, sizeof(StatsCache));
+    if (cache == NULL) {
+        ERR_PRINT("Memory allocation failed for statistics cache.\n");
+        return -1;
+    }
+    cache->path = entryPath(&fileStat);
+    if (cache->path == NULL) {
+        free(cache);
+        return -1;
+    }
+    cache->identity.magic = STATS_CACHE_MAGIC;
+    cache->identity.fileSize = sequence->fileBuffer.size;
+    cache->identity.device = (uint64_t)fileStat.st_dev;
+    cache->identity.inode = (uint64_t)fileStat.st_ino;
+    cache->identity.modifiedSeconds = (int64_t)fileStat.st_mtim.tv_sec;
+    cache->identity.modifiedNanoseconds = (int64_t)fileStat.st_mtim.tv_nsec;
+    cache->identity.sampleHash = hashSamples(sequence->fileBuffer.data, sequence->fileBuffer.size);
+    cache->identity.blockSize = LINE_INDEX_BLOCK_SIZE;
+
+    FILE *file = openEntry(cache->path);
+    if (file != NULL) {
+        cache->found = fread(&cache->stored, sizeof(CacheHeader), 1, file) == 1
+                       && memcmp(&cache->stored, &cache->identity, offsetof(CacheHeader, lineBstd)) == 0;
+        fclose(file);
+    }
+    DEBG_PRINT("Statistics cache %s: %s.\n", cache->path, cache->found ? "found" : "no valid entry");
+    sequence->statsCache = cache;
+    return 1;
+}
+
+LineBstd getCachedLineBstd(Sequence *sequence) {
+    StatsCache *cache = sequence != NULL ? sequence->statsCache : NULL;
+    if (cache == NULL || !cache->found || cache->stored.lineBstd < LINUX || cache->stored.lineBstd >= NO_INIT) {
+        return NO_INIT;
+    }
+    return (LineBstd)cache->stored.lineBstd;
+}
+
+ReturnCode loadCachedStatistics(Sequence *sequence, TextStatistics *statistics) {
+    StatsCache *cache = sequence != NULL ? sequence->statsCache : NULL;
+    if (cache == NULL || !cache->found || cache->stored.lineBstd != (int64_t)getCurrentLineBstd()) {
+        return -1;
+    }
+    size_t size = sequence->fileBuffer.size;
+    size_t count = (size + LINE_INDEX_BLOCK_SIZE - 1) / LINE_INDEX_BLOCK_SIZE + 1;
+    if (cache->stored.checkpointCount != count) {
+        return -1;
+    }
+    FILE *file = openEntry(cache->path);
+    if (file == NULL) {
+        return -1;
+    }
+    unsigned long *checkpoints = malloc(count * sizeof(unsigned long));
+    unsigned long *wordCheckpoints = malloc(count * sizeof(unsigned long));
+    bool valid = checkpoints != NULL && wordCheckpoints != NULL
+                 && fseek(file, sizeof(CacheHeader), SEEK_SET) == 0
+                 && fread(checkpoints, sizeof(unsigned long), count, file) == count
+                 && fread(wordCheckpoints, sizeof(unsigned long), count, file) == count;
+    fclose(file);
+
+    // The checkpoints have to add up to the stored totals
+    for (size_t i = 1; valid && i < count; i++) {
+        valid = checkpoints[i] >= checkpoints[i - 1] && wordCheckpoints[i] >= wordCheckpoints[i - 1];
+    }
+    valid = valid && checkpoints[0] == 0 && wordCheckpoints[0] == 0
+            && checkpoints[count - 1] == (unsigned long)cache->stored.lineBreaks
+            && wordCheckpoints[count - 1] == (unsigned long)cache->stored.words;
+    if (!valid) {
+        DEBG_PRINT("Statistics cache %s is damaged, counting the file.\n", cache->path);
+        free(checkpoints);
+        free(wordCheckpoints);
+        cache->found = false;
+        return -1;
+    }
+
+    LineIndex *index = &sequence->fileLineIndex;
+    freeLineIndex(index);
+    index->checkpoints = checkpoints;
+    index->wordCheckpoints = wordCheckpoints;
+    index->capacity = count;
+    index->amount = size / LINE_INDEX_BLOCK_SIZE + 1; // The last checkpoint is only valid for a full block
+    index->indexedSize = size;
+    index->indexedLineBreaks = checkpoints[count - 1];
+    index->indexedWordStarts = wordCheckpoints[count - 1];
+    statistics->totalLineBreaks = (long)cache->stored.lineBreaks;
+    statistics->totalWords = (long)cache->stored.words;
+    return 1;
+}
+
+void storeStatsCache(Sequence *sequence, TextStatistics statistics) {
+    StatsCache *cache = sequence != NULL ? sequence->statsCache : NULL;
+    if (cache == NULL || (cache->found && cache->stored.lineBstd == (int64_t)getCurrentLineBstd())) {
+        return;
+    }
+    LineIndex *index = &sequence->fileLineIndex;
+    size_t count = (sequence->fileBuffer.size + LINE_INDEX_BLOCK_SIZE - 1) / LINE_INDEX_BLOCK_SIZE + 1;
+    if (index->indexedSize != sequence->fileBuffer.size || index->capacity < count || index->wordCheckpoints == NULL) {
+        return;
+    }
+
+    CacheHeader header = cache->identity;
+    header.lineBstd = (int64_t)getCurrentLineBstd();
+    header.words = statistics.totalWords;
+    header.lineBreaks = statistics.totalLineBreaks;
+    header.checkpointCount = count;
+
+    // Written to a temp file which replaces the entry, a concurrent open never reads a partial entry
+    size_t length = strlen(cache->path) + 8;
+    char *tempPath = malloc(length);
+    if (tempPath == NULL) {
+        ERR_PRINT("Memory allocation failed for statistics cache.\n");
+        return;
+    }
+    snprintf(tempPath, length, "%s.XXXXXX", cache->path);
+    int fd = mkstemp(tempPath);
+    FILE *file = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (file == NULL) {
+        DEBG_PRINT("Statistics cache could not be stored at %s.\n", cache->path);
+        if (fd >= 0) {
+            close(fd);
+            remove(tempPath);
+        }
+        free(tempPath);
+        return;
+    }
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1
+                   && fwrite(index->checkpoints, sizeof(unsigned long), count, file) == count
+                   && fwrite(index->wordCheckpoints, sizeof(unsigned long), count, file) == count;
+    if (fclose(file) != 0 || !written || rename(tempPath, cache->path) < 0) {
+        ERR_PRINT("Writing the statistics cache to %s failed.\n", cache->path);
+        remove(tempPath);
+    } else {
+        cache->stored = header;
+        cache->found = true;
+    }
+    free(tempPath);
+}
+
+void freeStatsCache(Sequence *sequence) {
+    if (sequence == NULL || sequence->statsCache == NULL) {
+        return;
+    }
+    free(sequence->statsCache->path);
+    free(sequence->statsCache);
+    sequence->statsCache = NULL;
+}
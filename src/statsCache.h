@@ -0,0 +1,45 @@
+#ifndef STATSCACHE_H
+#define STATSCACHE_H
+
+#include "textStructure.h"
+#include "statistics.h"
+
+/*
+Cache of the statistics of opened files: word and line totals, the line break standard and the checkpoints of the
+line index of the file buffer. Reopening an unchanged file takes them from the cache instead of counting the file again.
+A cache entry is identified by the device and inode of the file, its size, its modification time and a hash over
+samples spread across the file buffer. Entries are stored in $XDG_CACHE_HOME/text-terminal or (if it is not set)
+next to the other internal temp files (/tmp/TxTinternal-stats-...), they can be deleted at any time.
+*/
+
+#define STATS_CACHE_ENABLED true                      /* store and reuse the statistics of large files */
+#define STATS_CACHE_MIN_FILE_SIZE (16L * 1024 * 1024) /* smaller files are counted faster than the cache is read */
+#define STATS_CACHE_SAMPLES 64                        /* slices of the file buffer hashed to recognize the content */
+#define STATS_CACHE_SAMPLE_SIZE 4096                  /* atomics per slice */
+
+/**
+ * Identifies the freshly mapped file buffer and looks up its cache entry (only the header is read).
+ * Does nothing for files smaller than STATS_CACHE_MIN_FILE_SIZE. Returns -1 on error.
+ */
+ReturnCode openStatsCache(Sequence *sequence, const char *filePath);
+
+/**
+ * Returns the line break standard the file was opened with last time, NO_INIT if there is no cache entry.
+ */
+LineBstd getCachedLineBstd(Sequence *sequence);
+
+/**
+ * Installs the cached line index of the file buffer and returns the statistics of the whole file.
+ * Returns -1 if there is no valid entry for the current line break standard, the file has to be counted then.
+ */
+ReturnCode loadCachedStatistics(Sequence *sequence, TextStatistics *statistics);
+
+/**
+ * Stores the line index of the file buffer and the statistics of the whole file (as counted at the open).
+ * Nothing is stored if the file was not identified by openStatsCache() or the entry is still valid.
+ */
+void storeStatsCache(Sequence *sequence, TextStatistics statistics);
+
+void freeStatsCache(Sequence *sequence);
+
+#endif
@@ -0,0 +1,245 @@
+/*
+Checks transactions (beginEdit() / queueEdit() / commitEdit()): batches of unsorted, adjacent, pure insert and pure
+delete edits are applied to a file that is split into many pieces, next to a flat copy of the text which is edited
+the simple way. After every commit the text has to equal the copy and the word and line totals have to equal a full
+recount, a single undo has to restore the text and the totals from before the batch and redo has to repeat it.
+*/
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../statistics.h"
+#include "../textStructure.h"
+#include "../undoRedoUtilities.h"
+
+#define COMMIT_TEST_ROUNDS 3000
+#define COMMIT_TEST_FILE_LENGTH 4000
+#define COMMIT_TEST_MAX_LENGTH (64 * 1024)
+
+/* Edit of a batch, positions refer to the text before the batch */
+typedef struct {
+    Position position;
+    Size deleteLength;
+    char text[16];
+    size_t length;
+} TestEdit;
+
+static int failures = 0;
+static char copy[COMMIT_TEST_MAX_LENGTH], saved[COMMIT_TEST_MAX_LENGTH], text[COMMIT_TEST_MAX_LENGTH];
+static size_t copyLength, savedLength;
+
+/**
+ * Random words, spaces, tabs, line breaks and two byte characters, returns the length.
+ */
+static size_t randomText(char *out, size_t maximumLength) {
+    static const char *const tokens[] = {"word", "a", " ", "  ", "\t", "\n", "\xC3\xA9t\xC3\xA9", "x.y", "\n\n"};
+    size_t length = 0;
+    while (true) {
+        const char *token = tokens[rand() % 9];
+        size_t tokenLength = strlen(token);
+        if (length + tokenLength > maximumLength) {
+            return length;
+        }
+        memcpy(out + length, token, tokenLength);
+        length += tokenLength;
+    }
+}
+
+/**
+ * Moves the position back to the start of its UTF-8 character.
+ */
+static Position characterStart(Position position) {
+    while (position > 0 && position < (Position)copyLength && (copy[position] & 0xC0) == 0x80) {
+        position--;
+    }
+    return position;
+}
+
+static size_t readText(Sequence *sequence) {
+    size_t size = getCurrentTotalSize(sequence);
+    size_t copied = 0;
+    BlockIterator iterator;
+    Atomic *block;
+    if (size > 0 && size <= COMMIT_TEST_MAX_LENGTH && initBlockIterator(&iterator, sequence, 0) == 1) {
+        for (Size blockSize = getCurrentBlock(&iterator, &block); blockSize > 0 && copied < size; blockSize = getNextBlock(&iterator, &block)) {
+            size_t part = (size_t)blockSize < size - copied ? (size_t)blockSize : size - copied;
+            memcpy(text + copied, block, part);
+            copied += part;
+        }
+    }
+    return copied;
+}
+
+/**
+ * Compares text and totals of the sequence with the expected text and a full recount of it.
+ */
+static bool expectState(Sequence *sequence, const char *expected, size_t expectedLength, const char *step, int round) {
+    size_t length = readText(sequence);
+    bool separator = true;
+    long words = countWordStarts((const Atomic *)expected, expectedLength, &separator, getCurrentLineBidentifier());
+    long lines = expectedLength > 0 ? 1 : 0;
+    for (size_t i = 0; i < expectedLength; i++) {
+        lines += expected[i] == '\n';
+    }
+    if (length != expectedLength || memcmp(text, expected, length) != 0) {
+        printf("FAIL round %d (%s): text differs (%zu atomics, expected %zu)\n", round, step, length, expectedLength);
+        failures++;
+        return false;
+    }
+    if (getCurrentWordCount(sequence) != words || getCurrentLineCount(sequence) != lines) {
+        printf("FAIL round %d (%s): %ld words and %ld lines, recount %ld words and %ld lines\n", round, step,
+               getCurrentWordCount(sequence), getCurrentLineCount(sequence), words, lines);
+        failures++;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Builds 1 to 6 non overlapping edits (some adjacent, some pure inserts or deletes) sorted by position.
+ */
+static int randomBatch(TestEdit *edits) {
+    int amount = 1 + rand() % 6;
+    Position position = characterStart(rand() % (copyLength / 2 + 1));
+    int created = 0;
+    for (int i = 0; i < amount && position <= (Position)copyLength; i++) {
+        TestEdit *edit = &edits[created++];
+        edit->position = position;
+        Position end = characterStart(position + (rand() % 3 == 0 ? 0 : rand() % 12));
+        end = end > (Position)copyLength ? (Position)copyLength : end;
+        end = end < position ? position : end;
+        edit->deleteLength = end - position;
+        edit->length = rand() % 4 == 0 ? 0 : randomText(edit->text, 1 + rand() % 15);
+        if (edit->deleteLength == 0 && edit->length == 0) {
+            edit->length = randomText(edit->text, 4);
+        }
+        if (edit->deleteLength == 0 && edit->length == 0) {
+            created--; // Nothing to do
+            break;
+        }
+        // The next edit starts directly after this one (adjacent) or further behind, but never at the same position
+        Position gap = rand() % 2 == 0 ? 0 : rand() % 200;
+        position = characterStart(end + gap);
+        if (position <= edit->position || (position == end && edit->deleteLength == 0)) {
+            break;
+        }
+    }
+    return created;
+}
+
+/**
+ * Applies the sorted edits to the flat copy, from the back so the positions stay valid.
+ */
+static void applyToCopy(const TestEdit *edits, int amount) {
+    for (int i = amount - 1; i >= 0; i--) {
+        const TestEdit *edit = &edits[i];
+        size_t tail = copyLength - (size_t)(edit->position + edit->deleteLength);
+        memmove(copy + edit->position + edit->length, copy + edit->position + edit->deleteLength, tail);
+        memcpy(copy + edit->position, edit->text, edit->length);
+        copyLength = copyLength - (size_t)edit->deleteLength + edit->length;
+    }
+}
+
+int main() {
+    setlocale(LC_ALL, "C.UTF-8");
+    srand(1);
+    char directory[] = "/tmp/commitEditTest-XXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        printf("FAIL temp directory could not be created\n");
+        return 1;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "%s/text.txt", directory);
+    copyLength = randomText(copy, COMMIT_TEST_FILE_LENGTH);
+    FILE *file = fopen(path, "wb");
+    fwrite(copy, 1, copyLength, file);
+    fclose(file);
+
+    Sequence *sequence = loadOrCreateNewFile(path, LINUX);
+    expectState(sequence, copy, copyLength, "load", 0);
+    for (int round = 1; round <= COMMIT_TEST_ROUNDS; round++) {
+        if (rand() % 3 == 0) {
+            // Split the pieces further with a plain insert
+            char insertText[8];
+            size_t length = randomText(insertText, 1 + rand() % 7);
+            Position position = characterStart(rand() % (copyLength + 1));
+            insertUtf8(sequence, position, (const Atomic *)insertText, length);
+            memmove(copy + position + length, copy + position, copyLength - (size_t)position);
+            memcpy(copy + position, insertText, length);
+            copyLength += length;
+            if (!expectState(sequence, copy, copyLength, "insert", round)) {
+                break;
+            }
+        }
+        TestEdit edits[6];
+        int amount = randomBatch(edits);
+        if (amount == 0 || copyLength + 6 * 16 > COMMIT_TEST_MAX_LENGTH) {
+            continue;
+        }
+        memcpy(saved, copy, copyLength);
+        savedLength = copyLength;
+        long savedWords = getCurrentWordCount(sequence), savedLines = getCurrentLineCount(sequence);
+
+        // Queue in random order
+        int order[6] = {0, 1, 2, 3, 4, 5};
+        for (int i = amount - 1; i > 0; i--) {
+            int j = rand() % (i + 1);
+            int swap = order[i];
+            order[i] = order[j];
+            order[j] = swap;
+        }
+        beginEdit(sequence);
+        for (int i = 0; i < amount; i++) {
+            TestEdit *edit = &edits[order[i]];
+            queueEdit(sequence, edit->position, edit->deleteLength, (const Atomic *)edit->text, edit->length);
+        }
+        if (commitEdit(sequence) != 1) {
+            printf("FAIL round %d: commit of %d valid edits failed\n", round, amount);
+            failures++;
+            break;
+        }
+        applyToCopy(edits, amount);
+        if (!expectState(sequence, copy, copyLength, "commit", round)) {
+            break;
+        }
+
+        // One undo restores the text before the batch (with its totals), redo applies it again
+        if (rand() % 2 == 0) {
+            undo(sequence);
+            if (!expectState(sequence, saved, savedLength, "undo", round)) {
+                break;
+            }
+            if (getCurrentWordCount(sequence) != savedWords || getCurrentLineCount(sequence) != savedLines) {
+                printf("FAIL round %d: undo restored other totals\n", round);
+                failures++;
+                break;
+            }
+            redo(sequence);
+            if (!expectState(sequence, copy, copyLength, "redo", round)) {
+                break;
+            }
+        }
+    }
+
+    // Overlapping edits are rejected without changing anything
+    memcpy(saved, copy, copyLength);
+    savedLength = copyLength;
+    beginEdit(sequence);
+    queueEdit(sequence, 10, 5, (const Atomic *)"x", 1);
+    queueEdit(sequence, 12, 0, (const Atomic *)"y", 1);
+    if (commitEdit(sequence) != -1) {
+        printf("FAIL overlapping edits were committed\n");
+        failures++;
+    }
+    expectState(sequence, saved, savedLength, "rejected batch", 0);
+
+    closeSequence(sequence, true);
+    remove(path);
+    remove(directory);
+    if (failures == 0) {
+        printf("ok   %d random batches, undo and redo\n", COMMIT_TEST_ROUNDS);
+    }
+    printf("%s\n", failures == 0 ? "ok" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,271 @@
+/*
+Correctness check and benchmark of the case-insensitive search (see searchKernel.h and findIgnoringCase()).
+The texts are built from letters whose upper and lower case have the same UTF-8 length (ASCII and e.g. é/É, д/Д, σ/Σ),
+so a case-insensitive match in the text has to be an exact match of the lower case needle in the lower case copy
+of the text at the same offset. Afterwards the throughput of the folded kernel is compared to the exact kernel,
+it has to reach FOLDED_REQUIRED_RATIO of it for ASCII and for non-ASCII needles.
+*/
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wchar.h>
+
+#include "../searchKernel.h"
+#include "../textStructure.h"
+
+#define FOLDED_RANDOM_CASES 20000
+#define FOLDED_SEQUENCE_CASES 500
+#define FOLDED_BENCHMARK_SIZE ((size_t)128 << 20) /* atomics searched per benchmark round */
+#define FOLDED_BENCHMARK_ROUNDS 10
+#define FOLDED_REQUIRED_RATIO 0.8
+
+/* Lower and upper case of the letters the texts are made of, same length in UTF-8 */
+static const char *const letters[][2] = {
+    {"a", "A"}, {"e", "E"}, {"k", "K"}, {"r", "R"}, {"s", "S"}, {"z", "Z"},
+    {"\xC3\xA9", "\xC3\x89"}, /* é É */
+    {"\xC3\xA4", "\xC3\x84"}, /* ä Ä */
+    {"\xD0\xB4", "\xD0\x94"}, /* д Д */
+    {"\xCF\x83", "\xCE\xA3"}, /* σ Σ */
+    {"\xC5\x82", "\xC5\x81"}, /* ł Ł */
+    {" ", " "}, {"\n", "\n"}, {"1", "1"},
+};
+#define LETTER_COUNT (sizeof(letters) / sizeof(letters[0]))
+#define ASCII_LETTER_COUNT 6
+
+static int failures = 0;
+
+static double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/**
+ * Writes random letters (in random case) to text and their lower case to lower, returns the length in atomics.
+ * Only the first letterCount letters are used.
+ */
+static size_t randomText(uint8_t *text, uint8_t *lower, size_t maximumLength, size_t letterCount) {
+    size_t length = 0;
+    while (true) {
+        size_t letter = rand() % letterCount;
+        const char *cased = letters[letter][rand() % 2];
+        size_t letterLength = strlen(cased);
+        if (length + letterLength > maximumLength) {
+            return length;
+        }
+        memcpy(text + length, cased, letterLength);
+        memcpy(lower + length, letters[letter][0], letterLength);
+        length += letterLength;
+    }
+}
+
+/**
+ * Returns the length of the UTF-8 character starting with the lead byte.
+ */
+static size_t characterLength(uint8_t lead) {
+    return lead < 0x80 ? 1 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4;
+}
+
+/**
+ * Copies the characters [from, to) of the text in random case (looked up in the letter table).
+ */
+static void randomCase(const uint8_t *lower, size_t length, uint8_t *out) {
+    for (size_t offset = 0; offset < length;) {
+        size_t letterLength = characterLength(lower[offset]);
+        for (size_t letter = 0; letter < LETTER_COUNT; letter++) {
+            if (strncmp((const char *)lower + offset, letters[letter][0], letterLength) == 0 && strlen(letters[letter][0]) == letterLength) {
+                memcpy(out + offset, letters[letter][rand() % 2], letterLength);
+                break;
+            }
+        }
+        offset += letterLength;
+    }
+}
+
+static void checkKernel() {
+    static uint8_t text[2048], lower[2048], needle[32], lowerNeedle[32];
+    for (int i = 0; i < FOLDED_RANDOM_CASES; i++) {
+        bool ascii = rand() % 2;
+        size_t length = randomText(text, lower, 1 + rand() % sizeof(text), ascii ? ASCII_LETTER_COUNT : LETTER_COUNT);
+
+        // Needle: a piece of the text (matches at least once) or random letters
+        size_t needleLength;
+        if (length > 0 && rand() % 3 != 0) {
+            size_t start = rand() % length;
+            while (start > 0 && (lower[start] & 0xC0) == 0x80) {
+                start--;
+            }
+            needleLength = 0;
+            while (start + needleLength < length && needleLength < 12) {
+                needleLength += characterLength(lower[start + needleLength]);
+            }
+            memcpy(lowerNeedle, lower + start, needleLength);
+            randomCase(lowerNeedle, needleLength, needle);
+        } else {
+            needleLength = randomText(needle, lowerNeedle, 1 + rand() % 12, ascii ? ASCII_LETTER_COUNT : LETTER_COUNT);
+        }
+        if (needleLength == 0) {
+            continue;
+        }
+
+        FoldedNeedle *folded = prepareFoldedNeedle(needle, needleLength);
+        size_t matchLength = 0;
+        long found = searchBlockFolded(text, length, folded, &matchLength);
+        long expected = searchBlock(lower, length, lowerNeedle, needleLength);
+        if (found != expected || (found != -1 && matchLength != needleLength)) {
+            printf("FAIL folded kernel (%s needle of %zu atomics in %zu atomics): %ld (length %zu), expected %ld\n",
+                   ascii ? "ASCII" : "non-ASCII", needleLength, length, found, matchLength, expected);
+            failures++;
+        }
+        freeFoldedNeedle(folded);
+    }
+    printf("folded kernel checked against the exact kernel\n");
+
+    // Letters which only fold within their script: the Kelvin sign is no k, ȿ matches its longer upper case Ȿ
+    const uint8_t kelvin[] = "the \xE2\x84\xAA of k";
+    FoldedNeedle *k = prepareFoldedNeedle((const uint8_t *)"K", 1);
+    long found = searchBlockFolded(kelvin, sizeof(kelvin) - 1, k, NULL);
+    freeFoldedNeedle(k);
+    if (found != 11) {
+        printf("FAIL Kelvin sign matched k (%ld)\n", found);
+        failures++;
+    }
+    const uint8_t longer[] = "xx\xE2\xB1\xBEyy";
+    FoldedNeedle *swashS = prepareFoldedNeedle((const uint8_t *)"\xC8\xBF", 2);
+    size_t matchLength = 0;
+    found = searchBlockFolded(longer, sizeof(longer) - 1, swashS, &matchLength);
+    freeFoldedNeedle(swashS);
+    if (found != 2 || matchLength != 3) {
+        printf("FAIL U+023F did not match U+2C7E (%ld, length %zu)\n", found, matchLength);
+        failures++;
+    }
+}
+
+/**
+ * Reference for findIgnoringCase() / findPreviousIgnoringCase() on the flat lower case copy, with wrap around.
+ */
+static Position referenceFind(const uint8_t *lower, size_t length, const uint8_t *needle, size_t needleLength, Position origin, bool backward) {
+    Position last = (Position)length - (Position)needleLength;
+    for (Position step = 0; step <= (Position)length; step++) {
+        Position position = backward ? origin - 1 - step : origin + step;
+        position = ((position % ((Position)length + 1)) + (Position)length + 1) % ((Position)length + 1);
+        if (position <= last && memcmp(lower + position, needle, needleLength) == 0) {
+            return position;
+        }
+    }
+    return -1;
+}
+
+static void checkSequence() {
+    // The text is inserted in many small pieces, matches cross piece boundaries
+    static uint8_t text[64 * 1024], lower[64 * 1024];
+    size_t length = randomText(text, lower, sizeof(text), LETTER_COUNT);
+    Sequence *sequence = empty();
+    Position inserted = 0;
+    while ((size_t)inserted < length) {
+        size_t part = 1 + rand() % 40;
+        while ((size_t)inserted + part < length && (text[inserted + part] & 0xC0) == 0x80) {
+            part++; // Only whole characters
+        }
+        part = (size_t)inserted + part < length ? part : length - (size_t)inserted;
+        insertUtf8(sequence, inserted, text + inserted, part);
+        inserted += (Position)part;
+    }
+
+    uint8_t needle[32], lowerNeedle[32];
+    for (int i = 0; i < FOLDED_SEQUENCE_CASES; i++) {
+        size_t start = rand() % length;
+        while (start > 0 && (lower[start] & 0xC0) == 0x80) {
+            start--;
+        }
+        size_t needleLength = 0;
+        size_t wanted = 1 + rand() % 6;
+        for (size_t characters = 0; characters < wanted && start + needleLength < length; characters++) {
+            needleLength += characterLength(lower[start + needleLength]);
+        }
+        memcpy(lowerNeedle, lower + start, needleLength);
+        randomCase(lowerNeedle, needleLength, needle);
+        needle[needleLength] = '\0';
+        wchar_t wideNeedle[32];
+        mbstowcs(wideNeedle, (const char *)needle, 32);
+
+        Position origin = rand() % (length + 1);
+        bool backward = rand() % 2;
+        Position found = backward ? findPreviousIgnoringCase(sequence, wideNeedle, origin).foundPosition
+                                  : findIgnoringCase(sequence, wideNeedle, origin).foundPosition;
+        Position expected = referenceFind(lower, length, lowerNeedle, needleLength, origin, backward);
+        if (found != expected) {
+            printf("FAIL %s from %lld ('%s'): %lld, expected %lld\n", backward ? "findPreviousIgnoringCase" : "findIgnoringCase",
+                   (long long)origin, needle, (long long)found, (long long)expected);
+            failures++;
+        }
+    }
+    closeSequence(sequence, true);
+    printf("findIgnoringCase() and findPreviousIgnoringCase() checked on a fragmented text\n");
+}
+
+/**
+ * Returns the throughput in GB/s of one search which does not find the needle.
+ */
+static double measure(const uint8_t *text, const uint8_t *needle, size_t needleLength, const FoldedNeedle *foldedNeedle) {
+    double start = now();
+    long found = foldedNeedle != NULL ? searchBlockFolded(text, FOLDED_BENCHMARK_SIZE, foldedNeedle, NULL)
+                                      : searchBlock(text, FOLDED_BENCHMARK_SIZE, needle, needleLength);
+    double seconds = now() - start;
+    if (found != -1) {
+        printf("FAIL benchmark needle found at %ld\n", found);
+        failures++;
+    }
+    return FOLDED_BENCHMARK_SIZE / seconds / 1e9;
+}
+
+/**
+ * Compares the best of FOLDED_BENCHMARK_ROUNDS of the exact and the folded search, the rounds alternate so both
+ * searches run under the same conditions.
+ */
+static void benchmarkNeedle(const char *description, const uint8_t *text, const char *lowerNeedle, const char *mixedNeedle) {
+    FoldedNeedle *foldedNeedle = prepareFoldedNeedle((const uint8_t *)mixedNeedle, strlen(mixedNeedle));
+    double exact = 0, folded = 0;
+    for (int round = 0; round < FOLDED_BENCHMARK_ROUNDS; round++) {
+        double throughput = measure(text, (const uint8_t *)lowerNeedle, strlen(lowerNeedle), NULL);
+        exact = throughput > exact ? throughput : exact;
+        throughput = measure(text, NULL, 0, foldedNeedle);
+        folded = throughput > folded ? throughput : folded;
+    }
+    freeFoldedNeedle(foldedNeedle);
+    printf("%s needle: exact %.2f GB/s, folded %.2f GB/s (%.0f%%)\n", description, exact, folded, folded / exact * 100);
+    if (folded < FOLDED_REQUIRED_RATIO * exact) {
+        printf("FAIL folded search reaches less than %.0f%% of the exact search\n", FOLDED_REQUIRED_RATIO * 100);
+        failures++;
+    }
+}
+
+int main() {
+    setlocale(LC_ALL, "C.UTF-8");
+    srand(1);
+    checkKernel();
+    checkSequence();
+
+    // Benchmark text: prose like lower case words with some capitals and a few non-ASCII letters
+    uint8_t *text = malloc(FOLDED_BENCHMARK_SIZE);
+    if (text == NULL) {
+        printf("FAIL benchmark buffer could not be allocated\n");
+        return 1;
+    }
+    static const char *const words[] = {"the ", "Search ", "index ", "of ", "pieces ", "caf\xC3\xA9 ", "and ", "Text\n", "d\xD0\xB0 "};
+    size_t length = 0;
+    while (length < FOLDED_BENCHMARK_SIZE) {
+        const char *word = words[rand() % (sizeof(words) / sizeof(words[0]))];
+        for (size_t i = 0; word[i] != '\0' && length < FOLDED_BENCHMARK_SIZE; i++) {
+            text[length++] = (uint8_t)word[i];
+        }
+    }
+    benchmarkNeedle("ASCII", text, "terminal window", "Terminal WINDOW");
+    benchmarkNeedle("non-ASCII", text, "\xC3\xA9t\xC3\xA9 \xD0\xB4\xD0\xB0", "\xC3\x89T\xC3\xA9 \xD0\x94\xD0\xB0");
+    free(text);
+
+    printf("%s\n", failures == 0 ? "ok" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
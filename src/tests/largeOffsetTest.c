@@ -0,0 +1,221 @@
+/*
+Checks the text structure with positions beyond INT32_MAX (and UINT32_MAX): a sparse file of LARGE_FILE_SIZE atomics
+(zeros except for two marked lines) is opened, then insert, delete, undo, find and the line lookups are used far
+behind 2 GiB and the result is saved and read back. The times of these steps are printed. The sparse file only
+occupies a few pages on disk until it is saved (then LARGE_FILE_SIZE twice: the file and the copy of its original
+state), everything is removed at the end.
+*/
+#include <dirent.h>
+#include <fcntl.h>
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../textStructure.h"
+#include "../undoRedoUtilities.h"
+
+#define GiB ((Position)1 << 30)
+#define LARGE_FILE_SIZE (6 * GiB)
+#define FIRST_MARKER_AT (3 * GiB)     /* "\nFIRST marker\n" */
+#define SECOND_MARKER_AT (5 * GiB + 7) /* "\nSECOND marker\n" */
+#define INSERT_AT (4 * GiB + 3)
+
+static int failures = 0;
+
+static double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static void expect(const char *what, long long value, long long expected) {
+    if (value != expected) {
+        printf("FAIL %s: %lld, expected %lld\n", what, value, expected);
+        failures++;
+    } else {
+        printf("ok   %s: %lld\n", what, value);
+    }
+}
+
+/**
+ * Compares the text at position with the expected bytes (may span several blocks).
+ */
+static void expectText(const char *what, Sequence *sequence, Position position, const char *expected) {
+    BlockIterator iterator;
+    Atomic *block = NULL;
+    size_t length = strlen(expected);
+    size_t compared = 0;
+    initBlockIterator(&iterator, sequence, position);
+    for (Size size = getCurrentBlock(&iterator, &block); size > 0 && compared < length; size = getNextBlock(&iterator, &block)) {
+        size_t part = (size_t)size < length - compared ? (size_t)size : length - compared;
+        if (memcmp(block, expected + compared, part) != 0) {
+            break;
+        }
+        compared += part;
+    }
+    if (compared != length) {
+        printf("FAIL %s: text at %lld differs\n", what, (long long)position);
+        failures++;
+    } else {
+        printf("ok   %s\n", what);
+    }
+}
+
+/**
+ * Compares the bytes of the file at offset with the expected bytes.
+ */
+static void expectFileText(const char *what, int fd, off_t offset, const char *expected) {
+    char read[64];
+    size_t length = strlen(expected);
+    if (pread(fd, read, length, offset) != (ssize_t)length || memcmp(read, expected, length) != 0) {
+        printf("FAIL %s: bytes at %lld differ\n", what, (long long)offset);
+        failures++;
+    } else {
+        printf("ok   %s\n", what);
+    }
+}
+
+static ReturnCode writeSparseFile(const char *path) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return -1;
+    }
+    bool written = fseeko(file, FIRST_MARKER_AT, SEEK_SET) == 0 && fputs("\nFIRST marker\n", file) >= 0
+                   && fseeko(file, SECOND_MARKER_AT, SEEK_SET) == 0 && fputs("\nSECOND marker\n", file) >= 0
+                   && ftruncate(fileno(file), LARGE_FILE_SIZE) == 0;
+    return fclose(file) == 0 && written ? 1 : -1;
+}
+
+static void removeDirectory(const char *path) {
+    DIR *directory = opendir(path);
+    struct dirent *entry;
+    char entryPath[512];
+    while (directory != NULL && (entry = readdir(directory)) != NULL) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+            snprintf(entryPath, sizeof(entryPath), "%s/%s", path, entry->d_name);
+            removeDirectory(entryPath);
+            remove(entryPath);
+        }
+    }
+    if (directory != NULL) {
+        closedir(directory);
+    }
+    remove(path);
+}
+
+int main() {
+    setlocale(LC_ALL, "C.UTF-8");
+    char directory[] = "/tmp/largeOffsetTest-XXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        printf("FAIL temp directory could not be created\n");
+        return 1;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "%s/sparse.txt", directory);
+    setenv("XDG_CACHE_HOME", directory, 1); // Keep the statistics cache entry inside the temp directory
+    if (writeSparseFile(path) == -1) {
+        printf("FAIL sparse file could not be written\n");
+        removeDirectory(directory);
+        return 1;
+    }
+
+    double start = now();
+    Sequence *sequence = loadOrCreateNewFile(path, LINUX);
+    double openTime = now() - start;
+    expect("size", (long long)getCurrentTotalSize(sequence), LARGE_FILE_SIZE);
+    Position first = FIRST_MARKER_AT + 1;
+    Position second = SECOND_MARKER_AT + 1;
+
+    // Line lookups do not wait for the background count of the file, they are unknown until it is taken over
+    if (getBackgroundCountProgress(sequence) != -1) {
+        expect("line number during the count", getLineNumber(sequence, second), -1);
+        expect("start of the line during the count", backtrackToFirstAtomicInLine(sequence, second + 5), second);
+    }
+    start = now();
+    finishBackgroundCount(sequence, true);
+    double countTime = now() - start;
+    start = now();
+    long line = getLineNumber(sequence, second);
+    Position lineStart = getFirstAtomicOfLine(sequence, 4);
+    double lineLookupTime = now() - start;
+    expect("line of the second marker", line, 4);
+    expect("first atomic of line 4", lineStart, second);
+    expect("start of the line of a position", backtrackToFirstAtomicInLine(sequence, second + 5), second);
+    expect("line count", getCurrentLineCount(sequence), 5);
+
+    // Find forward and backward
+    start = now();
+    SearchResult found = find(sequence, L"FIRST marker", 0);
+    double findTime = now() - start;
+    expect("find first marker", found.foundPosition, first);
+    expect("line of the find result", find(sequence, L"SECOND marker", first).lineNumber, 4);
+    start = now();
+    found = findPrevious(sequence, L"FIRST marker", LARGE_FILE_SIZE - 1);
+    double findPreviousTime = now() - start;
+    expect("find previous", found.foundPosition, first);
+
+    // Insert behind 4 GiB
+    start = now();
+    insertUtf8(sequence, INSERT_AT, (const Atomic *)"inserted\nline\n", 14);
+    double insertTime = now() - start;
+    expect("size after insert", (long long)getCurrentTotalSize(sequence), LARGE_FILE_SIZE + 14);
+    expectText("inserted text", sequence, INSERT_AT, "inserted\nline\n");
+    expect("find inserted text", find(sequence, L"inserted", first).foundPosition, INSERT_AT);
+    expect("second marker moved", find(sequence, L"SECOND marker", 0).foundPosition, second + 14);
+    expect("line of the moved marker", getLineNumber(sequence, second + 14), 6);
+    expect("line count after insert", getCurrentLineCount(sequence), 7);
+
+    // Delete the inserted text again (both positions inclusive)
+    delete(sequence, INSERT_AT, INSERT_AT + 13);
+    expect("size after delete", (long long)getCurrentTotalSize(sequence), LARGE_FILE_SIZE);
+    expect("second marker back", find(sequence, L"SECOND marker", 0).foundPosition, second);
+
+    // Delete across 2 GiB and 4 GiB (removes the first marker)
+    Position from = 2 * GiB - 10;
+    Position to = 4 * GiB + 10;
+    delete(sequence, from, to);
+    expect("size after large delete", (long long)getCurrentTotalSize(sequence), LARGE_FILE_SIZE - (to - from + 1));
+    expect("first marker deleted", find(sequence, L"FIRST marker", 0).foundPosition, -1);
+    expect("second marker after large delete", find(sequence, L"SECOND marker", 0).foundPosition, second - (to - from + 1));
+    expect("line count after large delete", getCurrentLineCount(sequence), 3);
+
+    // Undo both deletes
+    undo(sequence);
+    undo(sequence);
+    expect("size after undo", (long long)getCurrentTotalSize(sequence), LARGE_FILE_SIZE + 14);
+    expectText("text after undo", sequence, FIRST_MARKER_AT, "\nFIRST marker\n");
+    expect("line count after undo", getCurrentLineCount(sequence), 7);
+    expect("line of the first marker after undo", getLineNumber(sequence, first), 2);
+
+    // Save (writes the whole file) and read the edited part back from the file
+    start = now();
+    expect("save", saveSequence(sequence), 1);
+    double saveTime = now() - start;
+    expectText("text after save", sequence, INSERT_AT, "inserted\nline\n");
+    int fd = open(path, O_RDONLY);
+    struct stat saved;
+    expect("size of the saved file", fd >= 0 && fstat(fd, &saved) == 0 ? (long long)saved.st_size : -1, LARGE_FILE_SIZE + 14);
+    expectFileText("saved inserted text", fd, INSERT_AT, "inserted\nline\n");
+    expectFileText("saved first marker", fd, FIRST_MARKER_AT, "\nFIRST marker\n");
+    expectFileText("saved second marker", fd, SECOND_MARKER_AT + 14, "\nSECOND marker\n");
+    char before = 1;
+    expect("saved byte before the insert", pread(fd, &before, 1, INSERT_AT - 1) == 1 ? before : -1, 0);
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    printf("open: %.3f s, background count: %.3f s\n", openTime, countTime);
+    printf("line lookups: %.1f us, insert: %.1f us\n", lineLookupTime * 1e6, insertTime * 1e6);
+    printf("find: %.3f s (%.2f GB/s), find previous: %.3f s (%.2f GB/s)\n", findTime, first / findTime / 1e9,
+           findPreviousTime, (LARGE_FILE_SIZE - first) / findPreviousTime / 1e9);
+    printf("save: %.3f s (%.2f GB/s)\n", saveTime, (LARGE_FILE_SIZE + 14) / saveTime / 1e9);
+
+    closeSequence(sequence, true);
+    removeDirectory(directory);
+    printf("%s\n", failures == 0 ? "ok" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
@@ -80,7 +80,7 @@ ReturnCode print_items_after(Position firstAtomic, int nbrOfLines){
         int nbrOfUtf8CharsNoControlChars = 0;// If we want to ignore line breaks etc.
 
         while((currLineBcount < nbrOfLines) && !requestNextBlock){
-            DEBG_PRINT("handling atomic at index: %d, is : '%c' \n", (firstAtomic + currentSectionStart + offsetCounter), currentItemBlock[currentSectionStart + offsetCounter]);
+            DEBG_PRINT("handling atomic at index: %ld, is : '%c' \n", (firstAtomic + currentSectionStart + offsetCounter), currentItemBlock[currentSectionStart + offsetCounter]);
 
             if( (currentItemBlock[currentSectionStart + offsetCounter] & 0xC0) != 0x80 ){
                 // adds +1, if current atomic not == 10xxxxxx (see utf-8 specs):
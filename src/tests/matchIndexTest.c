@@ -0,0 +1,218 @@
+/*
+Checks the maintenance of the match index (see matchIndex.h) under random edits: inserts (also typing at the end of
+the previous insert, which grows a piece in place), deletes, transactions, undo, redo and compaction are applied while
+the index is complete or still partly built. After every step the matches in the treap have to equal a fresh
+forEachNeedleMatch() scan of the indexed part of the text and the sums of every node have to be consistent.
+matchIndex.c is compiled as part of this test to read the treap (see the Makefile target matchIndexTest).
+*/
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../matchIndex.c"
+#include "../undoRedoUtilities.h"
+
+#define MATCH_TEST_STEPS 4000
+#define MATCH_TEST_TEXT_LENGTH 3000
+#define MATCH_TEST_MAX_MATCHES 100000
+
+/* Matches found by a scan, see collectScanned() */
+typedef struct {
+    Position positions[MATCH_TEST_MAX_MATCHES];
+    size_t count;
+} MatchList;
+
+static int failures = 0;
+static MatchList indexed, scanned;
+
+static void collectScanned(Position position, void *context) {
+    MatchList *list = (MatchList *)context;
+    if (list->count < MATCH_TEST_MAX_MATCHES) {
+        list->positions[list->count++] = position;
+    }
+}
+
+/**
+ * Appends the matches of the subtree in order, returns false if the span or count of a node is wrong.
+ */
+static bool collectIndexed(MatchNode *node, Position *position, MatchList *list) {
+    if (node == NULL) {
+        return true;
+    }
+    bool consistent = node->span == spanOf(node->left) + node->gap + spanOf(node->right)
+                      && node->count == countOf(node->left) + 1 + countOf(node->right) && node->gap >= 0;
+    consistent = collectIndexed(node->left, position, list) && consistent;
+    *position += node->gap;
+    if (list->count < MATCH_TEST_MAX_MATCHES) {
+        list->positions[list->count++] = *position;
+    }
+    return collectIndexed(node->right, position, list) && consistent;
+}
+
+/**
+ * Compares the index with a fresh scan of the indexed part, returns false (and reports it) on a difference.
+ */
+static bool checkIndex(Sequence *sequence, const char *step, int stepNumber) {
+    MatchIndex *index = sequence->matchIndex;
+    Position totalSize = (Position)getCurrentTotalSize(sequence);
+    Position scannedUpTo = index->scannedUpTo < totalSize ? index->scannedUpTo : totalSize;
+
+    indexed.count = 0;
+    Position position = 0;
+    bool consistent = collectIndexed(index->root, &position, &indexed);
+    scanned.count = 0;
+    forEachNeedleMatch(sequence, index->utf8Needle, index->needleLength, 0, scannedUpTo, collectScanned, &scanned);
+
+    bool equal = consistent && indexed.count == scanned.count
+                 && memcmp(indexed.positions, scanned.positions, indexed.count * sizeof(Position)) == 0;
+    // The rank lookup has to agree with the scan as well
+    Position probe = totalSize > 0 ? rand() % totalSize : 0;
+    size_t expectedRank = 0;
+    while (expectedRank < scanned.count && scanned.positions[expectedRank] < probe) {
+        expectedRank++;
+    }
+    equal = equal && getIndexedMatchRank(sequence, probe) == (long)expectedRank;
+    if (!equal) {
+        printf("FAIL after step %d (%s): %zu indexed matches, %zu scanned up to %lld of %lld%s\n", stepNumber, step, indexed.count,
+               scanned.count, (long long)scannedUpTo, (long long)totalSize, consistent ? "" : ", inconsistent sums");
+        for (size_t i = 0; i < indexed.count || i < scanned.count; i++) {
+            Position a = i < indexed.count ? indexed.positions[i] : -1, b = i < scanned.count ? scanned.positions[i] : -1;
+            if (a != b) {
+                printf("     first difference at match %zu: indexed %lld, scanned %lld\n", i, (long long)a, (long long)b);
+                break;
+            }
+        }
+        failures++;
+    }
+    return equal;
+}
+
+/**
+ * Random text of the needle's letters (many overlapping matches), returns its length.
+ */
+static size_t randomText(char *text, size_t maximumLength) {
+    static const char *const tokens[] = {"ab", "a", "b", "c", "\n", "aba", "abab"};
+    size_t length = 0;
+    while (true) {
+        const char *token = tokens[rand() % 7];
+        size_t tokenLength = strlen(token);
+        if (length + tokenLength > maximumLength) {
+            return length;
+        }
+        memcpy(text + length, token, tokenLength);
+        length += tokenLength;
+    }
+}
+
+/**
+ * Queues 1 to 4 non overlapping (possibly adjacent or pure) edits in random order and commits them.
+ */
+static void randomTransaction(Sequence *sequence, Position totalSize) {
+    Position starts[4];
+    int amount = 1 + rand() % 4;
+    for (int i = 0; i < amount; i++) {
+        starts[i] = rand() % (totalSize + 1);
+    }
+    for (int i = 1; i < amount; i++) { // Sort the starts
+        for (int j = i; j > 0 && starts[j - 1] > starts[j]; j--) {
+            Position swap = starts[j];
+            starts[j] = starts[j - 1];
+            starts[j - 1] = swap;
+        }
+    }
+    int order[4] = {0, 1, 2, 3};
+    for (int i = amount - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+    beginEdit(sequence);
+    for (int i = 0; i < amount; i++) {
+        int edit = order[i];
+        Position limit = edit + 1 < amount ? starts[edit + 1] : totalSize;
+        if (edit + 1 < amount && starts[edit] == starts[edit + 1]) {
+            continue; // Two edits at the same position would overlap
+        }
+        Size deleteLength = limit > starts[edit] ? rand() % (limit - starts[edit] + 1) : 0;
+        deleteLength = deleteLength < 6 ? deleteLength : 6;
+        char text[8];
+        size_t length = randomText(text, rand() % 6);
+        queueEdit(sequence, starts[edit], deleteLength, (const Atomic *)text, length);
+    }
+    commitEdit(sequence);
+}
+
+static void runSequence(const wchar_t *needle) {
+    static char text[MATCH_TEST_TEXT_LENGTH];
+    Sequence *sequence = empty();
+    size_t length = randomText(text, MATCH_TEST_TEXT_LENGTH);
+    // Back to front in small pieces
+    for (size_t end = length; end > 0;) {
+        size_t part = 1 + rand() % 20;
+        part = part < end ? part : end;
+        insertUtf8(sequence, 0, (const Atomic *)text + end - part, part);
+        end -= part;
+    }
+    setMatchIndexNeedle(sequence, needle);
+
+    Position lastInsertEnd = 0;
+    int failuresBefore = failures;
+    for (int step = 0; step < MATCH_TEST_STEPS; step++) {
+        Position totalSize = (Position)getCurrentTotalSize(sequence);
+        const char *name;
+        int operation = rand() % 10;
+        char insertText[16];
+        if (operation <= 1 || totalSize == 0) {
+            // Insert somewhere or continue typing at the end of the previous insert (grows the piece in place)
+            Position position = operation == 1 && lastInsertEnd <= totalSize ? lastInsertEnd : rand() % (totalSize + 1);
+            size_t insertLength = randomText(insertText, 1 + rand() % 8);
+            insertUtf8(sequence, position, (const Atomic *)insertText, insertLength);
+            lastInsertEnd = position + (Position)insertLength;
+            name = operation == 1 ? "typing" : "insert";
+        } else if (operation == 2) {
+            Position begin = rand() % totalSize;
+            Position end = begin + rand() % 8;
+            delete(sequence, begin, end < totalSize ? end : totalSize - 1);
+            name = "delete";
+        } else if (operation == 3) {
+            randomTransaction(sequence, totalSize);
+            name = "transaction";
+        } else if (operation == 4) {
+            undo(sequence);
+            name = "undo";
+        } else if (operation == 5) {
+            redo(sequence);
+            name = "redo";
+        } else if (operation == 6) {
+            compactPieces(sequence);
+            name = "compaction";
+        } else if (operation == 7 && rand() % 10 == 0) {
+            // Start over with a partly built index
+            clearMatchIndex(sequence);
+            setMatchIndexNeedle(sequence, needle);
+            name = "new index";
+        } else {
+            extendMatchIndex(sequence, 1 + rand() % 300);
+            name = "extend";
+        }
+        if (!checkIndex(sequence, name, step)) {
+            break;
+        }
+    }
+    if (failures == failuresBefore) {
+        printf("ok   %d random steps with the needle \"%ls\"\n", MATCH_TEST_STEPS, needle);
+    }
+    closeSequence(sequence, true);
+}
+
+int main() {
+    setlocale(LC_ALL, "C.UTF-8");
+    srand(1);
+    runSequence(L"aba");
+    runSequence(L"b\nab");
+    runSequence(L"c");
+    printf("%s\n", failures == 0 ? "ok" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,273 @@
+/*
+Checks of the regular expression search (see regexSearch.h): matches and capture groups of directed patterns,
+^ and $ with CR LF line breaks, replacements and the DFA fallback. Every text is inserted in small pieces so
+matches cross piece borders. regexSearch.c is compiled as part of this test to reach dfaFindEnd(), the Makefile
+target regexTest builds it twice, the second time with DFA_MAX_STATES lowered so that the lazy DFA gives up and
+the Pike VM alone finds the matches (with the same expected results).
+*/
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../regexSearch.c"
+#include "../undoRedoUtilities.h"
+
+#define REGEX_RANDOM_CASES 300
+#define REGEX_RANDOM_TEXT_LENGTH 2000
+
+/* Pattern, text, start position and the expected match (-1: none) with its first group (-1: did not take part) */
+typedef struct {
+    const wchar_t *pattern;
+    const char *text;
+    Position start;
+    Position matchStart, matchEnd;
+    Position groupStart, groupEnd;
+} RegexCase;
+
+static const RegexCase cases[] = {
+    {L"foo", "xxfooyy", 0, 2, 5, -1, -1},
+    {L"(\\w+)@(\\w+)\\.com", "mail: joe@example.com!", 0, 6, 21, 6, 9},
+    {L"^b", "ab\nbc", 0, 3, 4, -1, -1},
+    {L"c$", "abc\nd", 0, 2, 3, -1, -1},
+    {L"d$", "abc\nd", 0, 4, 5, -1, -1},
+    {L"a{2,3}", "caaaab", 0, 1, 4, -1, -1},
+    {L"a{3}", "aab aaab", 0, 4, 7, -1, -1},
+    {L"ba{2,}", "ba baaaa", 0, 3, 8, -1, -1},
+    {L"a+?", "aaa", 0, 0, 1, -1, -1},
+    {L"(a|ab)(c|bcd)", "abcd", 0, 0, 4, 0, 1},
+    {L"(a|b)*c", "xabbac", 0, 1, 6, 4, 5},
+    {L"[^a-c]+", "abcdefa", 0, 3, 6, -1, -1},
+    {L"[\\d-]+", "tel 12-34 x", 0, 4, 9, -1, -1},
+    {L"café+", "le caf\xC3\xA9\xC3\xA9!", 0, 3, 10, -1, -1},
+    {L"a.c", "a\nc abc", 0, 4, 7, -1, -1},
+    {L"(?:ab)+(x)?", "xababx", 0, 1, 6, 5, 6},
+    {L"(?:ab)+(y)?", "xababx", 0, 1, 5, -1, -1},
+    {L"\\s\\S", "ab  c", 0, 3, 5, -1, -1},
+    {L"ab", "ab..ab", 3, 4, 6, -1, -1},
+    {L"ab", "ab..ab", 5, 0, 2, -1, -1}, // wraps around
+    {L"zz", "ab..ab", 0, -1, -1, -1, -1},
+};
+
+static int failures = 0;
+
+/**
+ * Creates a sequence with the text, inserted back to front in pieces of 1 to 3 characters (never merged into one piece).
+ */
+static Sequence *fragmentedSequence(const char *text, size_t length) {
+    Sequence *sequence = empty();
+    size_t end = length;
+    while (end > 0) {
+        size_t part = 1 + rand() % 3;
+        part = part < end ? part : end;
+        while (part < end && (text[end - part] & 0xC0) == 0x80) {
+            part++; // Only whole characters can be inserted
+        }
+        insertUtf8(sequence, 0, (const Atomic *)text + end - part, part);
+        end -= part;
+    }
+    return sequence;
+}
+
+/**
+ * Returns the whole text of the sequence (nullterminated, to be freed).
+ */
+static char *readText(Sequence *sequence) {
+    size_t size = getCurrentTotalSize(sequence);
+    char *text = malloc(size + 1);
+    size_t copied = 0;
+    BlockIterator iterator;
+    Atomic *block;
+    if (size > 0 && initBlockIterator(&iterator, sequence, 0) == 1) {
+        for (Size blockSize = getCurrentBlock(&iterator, &block); blockSize > 0 && copied < size; blockSize = getNextBlock(&iterator, &block)) {
+            size_t part = (size_t)blockSize < size - copied ? (size_t)blockSize : size - copied;
+            memcpy(text + copied, block, part);
+            copied += part;
+        }
+    }
+    text[copied] = '\0';
+    return text;
+}
+
+static void expectText(const char *what, Sequence *sequence, const char *expected) {
+    char *text = readText(sequence);
+    if (strcmp(text, expected) != 0) {
+        printf("FAIL %s: \"%s\", expected \"%s\"\n", what, text, expected);
+        failures++;
+    } else {
+        printf("ok   %s\n", what);
+    }
+    free(text);
+}
+
+static void checkCases() {
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        const RegexCase *c = &cases[i];
+        Sequence *sequence = fragmentedSequence(c->text, strlen(c->text));
+        Regex *regex = compileRegex(c->pattern);
+        RegexMatch match = {{-1}, {-1}, 0};
+        SearchResult result = regex != NULL ? findRegex(sequence, regex, c->start, &match) : (SearchResult){-1, -1};
+        bool found = result.foundPosition != -1;
+        Position groupStart = found && match.groups > 1 ? match.groupStart[1] : -1;
+        Position groupEnd = found && match.groups > 1 ? match.groupEnd[1] : -1;
+        if (regex == NULL || result.foundPosition != c->matchStart || (found && match.groupEnd[0] != c->matchEnd)
+            || groupStart != c->groupStart || groupEnd != c->groupEnd) {
+            printf("FAIL /%ls/ in \"%s\" from %lld: match %lld-%lld group %lld-%lld, expected %lld-%lld group %lld-%lld\n", c->pattern,
+                   c->text, (long long)c->start, (long long)result.foundPosition, (long long)(found ? match.groupEnd[0] : -1),
+                   (long long)groupStart, (long long)groupEnd, (long long)c->matchStart, (long long)c->matchEnd,
+                   (long long)c->groupStart, (long long)c->groupEnd);
+            failures++;
+        }
+        freeRegex(regex);
+        closeSequence(sequence, true);
+    }
+    printf("ok   %zu directed patterns checked\n", sizeof(cases) / sizeof(cases[0]));
+
+    // Invalid patterns are rejected (also a backslash at the end of a class)
+    const wchar_t *invalid[] = {L"[a\\", L"[a-\\", L"(ab", L"a{3,2}", L"a*", L"x\\"};
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        Regex *regex = compileRegex(invalid[i]);
+        if (regex != NULL) {
+            printf("FAIL invalid pattern /%ls/ compiled\n", invalid[i]);
+            failures++;
+            freeRegex(regex);
+        }
+    }
+    printf("ok   invalid patterns rejected\n");
+}
+
+/**
+ * Random a/b texts searched for (a|b)*a(a|b)(a|b)(a|b) (its DFA needs 16 states, more than the lowered cache holds).
+ * The match starts at 0 and ends 4 atomics after the last 'a' which is followed by 3 more atomics.
+ */
+static void checkRandom() {
+    Regex *regex = compileRegex(L"(a|b)*a(a|b)(a|b)(a|b)");
+    static char text[REGEX_RANDOM_TEXT_LENGTH];
+    int dfaGaveUp = 0;
+    for (int i = 0; i < REGEX_RANDOM_CASES; i++) {
+        size_t length = 4 + rand() % REGEX_RANDOM_TEXT_LENGTH;
+        for (size_t j = 0; j < length; j++) {
+            text[j] = rand() % 4 == 0 ? 'a' : 'b';
+        }
+        Position lastA = -1;
+        for (Position j = 0; j + 4 <= (Position)length; j++) {
+            lastA = text[j] == 'a' ? j : lastA;
+        }
+        Sequence *sequence = fragmentedSequence(text, length);
+        Position dfaEnd;
+        dfaGaveUp += dfaFindEnd(regex, sequence, 0, (Position)length, &dfaEnd) == -1;
+
+        RegexMatch match;
+        SearchResult result = findRegex(sequence, regex, 0, &match);
+        Position expectedGroup = lastA > 0 ? lastA - 1 : -1;
+        if (result.foundPosition != (lastA != -1 ? 0 : -1)
+            || (lastA != -1 && (match.groupEnd[0] != lastA + 4 || match.groupStart[1] != expectedGroup || match.groupStart[4] != lastA + 3))) {
+            printf("FAIL random text of %zu atomics: match %lld-%lld groups %lld %lld, expected 0-%lld groups %lld %lld\n", length,
+                   (long long)result.foundPosition, (long long)match.groupEnd[0], (long long)match.groupStart[1],
+                   (long long)match.groupStart[4], (long long)lastA + 4, (long long)expectedGroup, (long long)lastA + 3);
+            failures++;
+        }
+        closeSequence(sequence, true);
+    }
+    freeRegex(regex);
+
+    // Make sure the intended path was taken: the lowered cache must overflow, the default one must not
+#if DFA_MAX_STATES < 16
+    bool expectGiveUp = true;
+#else
+    bool expectGiveUp = false;
+#endif
+    if ((dfaGaveUp > 0) != expectGiveUp) {
+        printf("FAIL the DFA gave up in %d of %d searches (DFA_MAX_STATES %d)\n", dfaGaveUp, REGEX_RANDOM_CASES, DFA_MAX_STATES);
+        failures++;
+    } else {
+        printf("ok   %d random texts checked (%s)\n", REGEX_RANDOM_CASES, expectGiveUp ? "Pike VM fallback" : "lazy DFA");
+    }
+}
+
+static void checkReplace() {
+    // Replace all with group references is one transaction: a single undo restores the text
+    const char *original = "x=1, y=22, zz=333";
+    Sequence *sequence = fragmentedSequence(original, strlen(original));
+    Regex *regex = compileRegex(L"(\\w+)=(\\d+)");
+    SearchResult result = findAndReplaceAllRegex(sequence, regex, L"\\2:\\1", 3);
+    expectText("replace all with \\1 and \\2", sequence, "1:x, 22:y, 333:zz");
+    if (result.foundPosition != 5) {
+        printf("FAIL first replacement after the start at %lld, expected 5\n", (long long)result.foundPosition);
+        failures++;
+    }
+    undo(sequence);
+    expectText("single undo of replace all", sequence, original);
+    redo(sequence);
+    expectText("redo of replace all", sequence, "1:x, 22:y, 333:zz");
+    freeRegex(regex);
+
+    // Single replacement with \0 and a tab
+    regex = compileRegex(L"\\d+");
+    findAndReplaceRegex(sequence, regex, L"<\\0>\\t", 2);
+    expectText("replace with \\0 and \\t", sequence, "1:x, <22>\t:y, 333:zz");
+    freeRegex(regex);
+    closeSequence(sequence, true);
+}
+
+/**
+ * ^ and $ with CR LF line breaks, \n in replacements writes CR LF (needs a file opened as MSDOS).
+ */
+static void checkMsdos() {
+    char directory[] = "/tmp/regexTest-XXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        printf("FAIL temp directory could not be created\n");
+        failures++;
+        return;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "%s/crlf.txt", directory);
+    FILE *file = fopen(path, "wb");
+    fputs("one\r\ntwo\r\nthree\r\n", file);
+    fclose(file);
+
+    Sequence *sequence = loadOrCreateNewFile(path, MSDOS);
+    Regex *regex = compileRegex(L"o$");
+    SearchResult result = findRegex(sequence, regex, 3, NULL);
+    freeRegex(regex);
+    if (result.foundPosition != 7) {
+        printf("FAIL o$ with CR LF found at %lld, expected 7\n", (long long)result.foundPosition);
+        failures++;
+    }
+    regex = compileRegex(L"^t\\w+$");
+    RegexMatch match;
+    result = findRegex(sequence, regex, 0, &match);
+    if (result.foundPosition != 5 || match.groupEnd[0] != 8) {
+        printf("FAIL ^t\\w+$ with CR LF: %lld-%lld, expected 5-8\n", (long long)result.foundPosition, (long long)match.groupEnd[0]);
+        failures++;
+    }
+    freeRegex(regex);
+    regex = compileRegex(L"[^x]e");
+    result = findRegex(sequence, regex, 0, &match); // The class must not match the CR or LF in front of the e
+    if (result.foundPosition != 1) {
+        printf("FAIL [^x]e with CR LF found at %lld, expected 1\n", (long long)result.foundPosition);
+        failures++;
+    }
+    freeRegex(regex);
+    regex = compileRegex(L"(t)wo");
+    findAndReplaceAllRegex(sequence, regex, L"\\1\\nwo", 0);
+    expectText("\\n in a replacement writes CR LF", sequence, "one\r\nt\r\nwo\r\nthree\r\n");
+    freeRegex(regex);
+    printf("ok   CR LF line ends checked\n");
+
+    closeSequence(sequence, true);
+    remove(path);
+    remove(directory);
+}
+
+int main() {
+    setlocale(LC_ALL, "C.UTF-8");
+    srand(1);
+    checkCases();
+    checkRandom();
+    checkReplace();
+    checkMsdos();
+    printf("%s\n", failures == 0 ? "ok" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,177 @@
+/*
+Correctness check and micro benchmark of the line break & word counting kernels (see statistics.c).
+The kernels are static, so statistics.c is compiled as part of this test (see the Makefile target statisticsTest).
+Every vector kernel the CPU supports is compared against the scalar kernel, then the fastest one has to be at least
+STATS_REQUIRED_SPEEDUP times faster than the scalar kernel.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../statistics.c"
+
+#define STATS_RANDOM_CASES 20000
+#define STATS_BENCHMARK_SIZE ((size_t)64 << 20) /* atomics counted per benchmark round */
+#define STATS_BENCHMARK_ROUNDS 5
+#define STATS_REQUIRED_SPEEDUP 5.0
+
+typedef struct {
+    const char *name;
+    CountFunction count;
+} Kernel;
+
+static int failures = 0;
+
+static double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/**
+ * Counts data with the kernel in parts of the given lengths (the word state carries over) and compares the result
+ * to a single call of the scalar kernel.
+ */
+static void compareKernel(const Kernel *kernel, const Atomic *data, size_t length, size_t partLength, Atomic lineBreak,
+                          bool startsAfterSeparator, const char *description) {
+    bool expectedState = startsAfterSeparator;
+    long expectedLineBreaks = 0;
+    long expectedWords = countScalar(data, length, &expectedState, lineBreak, &expectedLineBreaks);
+
+    bool state = startsAfterSeparator;
+    long lineBreaks = 0;
+    long words = 0;
+    for (size_t offset = 0; offset < length; offset += partLength) {
+        size_t part = length - offset < partLength ? length - offset : partLength;
+        words += kernel->count(data + offset, part, &state, lineBreak, &lineBreaks);
+    }
+    if (words != expectedWords || lineBreaks != expectedLineBreaks || state != expectedState) {
+        printf("FAIL %s (%s, %zu atomics in parts of %zu): words %ld/%ld, line breaks %ld/%ld, state %d/%d\n", kernel->name,
+               description, length, partLength, words, expectedWords, lineBreaks, expectedLineBreaks, state, expectedState);
+        failures++;
+    }
+}
+
+/**
+ * Fills data with text of the given alphabet (multi byte sequences are copied as a whole).
+ */
+static void fillText(Atomic *data, size_t length, const char *const *alphabet, size_t alphabetSize) {
+    size_t offset = 0;
+    while (offset < length) {
+        const char *token = alphabet[rand() % alphabetSize];
+        size_t tokenLength = strlen(token);
+        for (size_t i = 0; i < tokenLength && offset < length; i++) {
+            data[offset++] = (Atomic)token[i];
+        }
+    }
+}
+
+static void checkKernel(const Kernel *kernel) {
+    static const char *const plain[] = {"a", "b", "z", " ", "\t", "\n", "word"};
+    static const char *const crlf[] = {"ab", "c", " ", "\r\n", "\r", "\n", "\t"};
+    // Multi byte whitespace is no separator (no space, tab or line break), bytes >= 0x80 must not be taken as such
+    static const char *const multiByte[] = {"a", " ", "\n", "\xC2\xA0", "\xE3\x80\x80", "\xE2\x80\x83", "\xC3\xA9", "\xF0\x9F\x9B\xB8", "\xFF"};
+    Atomic buffer[1024];
+
+    // Short blocks and tails shorter than 64 atomics, from both word states
+    for (size_t length = 0; length <= 200; length++) {
+        fillText(buffer, length, plain, 7);
+        compareKernel(kernel, buffer, length, length > 0 ? length : 1, '\n', true, "tail");
+        compareKernel(kernel, buffer, length, length > 0 ? length : 1, '\n', false, "tail after word");
+    }
+
+    // CR LF pairs split by the 64 atomic boundary (the CR last of one vector, the LF first of the next)
+    for (size_t split = 60; split < 70; split++) {
+        memset(buffer, 'x', 192);
+        buffer[split - 1] = '\r';
+        buffer[split] = '\n';
+        buffer[split + 64 - 1] = '\r';
+        buffer[split + 64] = '\n';
+        compareKernel(kernel, buffer, 192, 192, '\n', true, "CR LF at the vector boundary (LF)");
+        compareKernel(kernel, buffer, 192, 192, '\r', true, "CR LF at the vector boundary (CR)");
+        compareKernel(kernel, buffer, 192, split, '\n', true, "CR LF at a block boundary");
+    }
+
+    // Random text, lengths and part lengths
+    for (int i = 0; i < STATS_RANDOM_CASES; i++) {
+        size_t length = rand() % sizeof(buffer);
+        size_t partLength = 1 + rand() % (length + 1);
+        int kind = rand() % 3;
+        Atomic lineBreak = kind == 1 && rand() % 2 ? '\r' : '\n';
+        if (kind == 0) {
+            fillText(buffer, length, plain, 7);
+        } else if (kind == 1) {
+            fillText(buffer, length, crlf, 7);
+        } else {
+            fillText(buffer, length, multiByte, 9);
+        }
+        compareKernel(kernel, buffer, length, partLength, lineBreak, rand() % 2, kind == 0 ? "random" : kind == 1 ? "random CR LF" : "random multi byte");
+    }
+}
+
+/**
+ * Returns the throughput of the kernel in GB/s (best of STATS_BENCHMARK_ROUNDS).
+ */
+static double benchmarkKernel(const Kernel *kernel, const Atomic *data, long *checksum) {
+    double best = 0;
+    for (int round = 0; round < STATS_BENCHMARK_ROUNDS; round++) {
+        bool state = true;
+        long lineBreaks = 0;
+        double start = now();
+        long words = kernel->count(data, STATS_BENCHMARK_SIZE, &state, '\n', &lineBreaks);
+        double seconds = now() - start;
+        *checksum += words + lineBreaks;
+        double throughput = STATS_BENCHMARK_SIZE / seconds / 1e9;
+        best = throughput > best ? throughput : best;
+    }
+    return best;
+}
+
+int main() {
+    srand(1);
+    Kernel kernels[3] = {{"scalar", countScalar}};
+    int kernelCount = 1;
+#ifdef STATS_KERNEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2") && __builtin_cpu_supports("popcnt")) {
+        kernels[kernelCount++] = (Kernel){"sse2", countSse2};
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        kernels[kernelCount++] = (Kernel){"avx2", countAvx2};
+    }
+#endif
+
+    for (int i = 1; i < kernelCount; i++) {
+        checkKernel(&kernels[i]);
+        printf("%s kernel checked against the scalar kernel\n", kernels[i].name);
+    }
+
+    // Benchmark on text with words of 1 to 8 atomics and a line break every 60 atomics on average
+    Atomic *data = malloc(STATS_BENCHMARK_SIZE);
+    if (data == NULL) {
+        printf("FAIL benchmark buffer could not be allocated\n");
+        return 1;
+    }
+    for (size_t i = 0; i < STATS_BENCHMARK_SIZE; i++) {
+        int r = rand() % 60;
+        data[i] = r == 0 ? '\n' : r < 9 ? ' ' : (Atomic)('a' + r % 26);
+    }
+    long checksum = 0;
+    double scalar = benchmarkKernel(&kernels[0], data, &checksum);
+    printf("scalar: %.2f GB/s\n", scalar);
+    double fastest = scalar;
+    for (int i = 1; i < kernelCount; i++) {
+        double throughput = benchmarkKernel(&kernels[i], data, &checksum);
+        printf("%s: %.2f GB/s (%.1fx)\n", kernels[i].name, throughput, throughput / scalar);
+        fastest = throughput > fastest ? throughput : fastest;
+    }
+    free(data);
+    if (kernelCount > 1 && fastest < STATS_REQUIRED_SPEEDUP * scalar) {
+        printf("FAIL the fastest kernel is only %.1fx faster than the scalar one (required: %.0fx)\n", fastest / scalar, STATS_REQUIRED_SPEEDUP);
+        failures++;
+    }
+
+    printf("%s (checksum %ld)\n", failures == 0 ? "ok" : "FAILED", checksum);
+    return failures == 0 ? 0 : 1;
+}
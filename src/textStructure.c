@@ -3,12 +3,30 @@
 #include "undoRedoUtilities.h"
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>  // Worker threads of find
+#include <sys/mman.h> // Address space reservation for the add buffer
 #include <unistd.h>
 #include <wchar.h>
 
 #include "debugUtil.h"
 #include "fileManager.h" // Handles all file operations
+#include "pieceTree.h"   // Balanced index over the piece table
+#include "searchKernel.h" // Vectorized search inside a piece
 #include "statistics.h"  // For counting words and lines
+#include "matchIndex.h"  // Keeps the matches of the last search in sync with edits
+#include "trigramIndex.h" // Narrows down the file buffer regions find has to scan
+#include "statsCache.h"  // Statistics of files opened before
+
+/*------ Definitions for internal use ------*/
+#define NODES_PER_SLAB 512      /* DescriptorNodes per slab of a sequence's node allocator */
+#define OPERATIONS_PER_SLAB 256 /* Operations per slab of a sequence's operation allocator */
+#define ADD_BUFFER_CHUNK_SIZE ((size_t)1 << 20)      /* the add buffer grows by committing chunks of this size */
+#define ADD_BUFFER_MAX_RESERVATION ((size_t)1 << 36) /* address space reserved for the add buffer (64 GiB, shrunk if unavailable) */
+#define SEARCH_MAX_WORKERS 64                        /* upper limit of threads used by a single find */
+#define SEARCH_MIN_BYTES_PER_WORKER ((Position)1 << 24) /* smaller ranges are not worth a thread (16 MiB) */
+#define SEARCH_STEP_SIZE ((unsigned long)1 << 20)    /* search threads check for an earlier match after this many atomics */
+#define BACKGROUND_COUNT_MIN_FILE_SIZE ((size_t)64 << 20) /* larger files are counted while the editor already runs (64 MiB) */
+#define FOLDED_WINDOW_SIZE ((unsigned long)1 << 16)  /* backward case-insensitive search scans windows of this size from the end */
 
 /*------ Data structures for internal use ------*/
 typedef struct {
@@ -16,24 +34,57 @@ typedef struct {
     Position startPosition; // position of the block's first character
 } NodeResult;
 
+/* Resumable left to right scan for non overlapping matches, see nextNeedleMatch() */
+typedef struct {
+    DescriptorNode *node;       // piece of the next atomic to check
+    unsigned long offsetInNode; // offset of that atomic inside the piece
+    Position position;          // its position in the sequence
+} MatchScanner;
+
+/* Progress of commitEdit() through the old pieces and the newly built segment */
+typedef struct {
+    DescriptorNode *node;          // old piece at the cursor
+    unsigned long offsetInNode;    // cursor offset inside that piece
+    Position position;             // cursor position in the text at beginEdit()
+    DescriptorNode *segmentFirst;  // new segment built so far (linked via next_ptr)
+    DescriptorNode *segmentLast;
+    bool lastWasSeparator;         // word state after the new segment built so far
+    bool deletedWasSeparator;      // word state while skipping deleted atomics
+    long deletedWordStarts;        // words starting in the skipped atomics
+} CommitCursor;
+
 /*------ Variables for internal use ------*/
 static LineBstd _currLineB = NO_INIT;
 static LineBidentifier _currLineBidentifier = NONE_ID;
 static bool currentlySaved = true;
 static Atomic endOfTextSignal = END_OF_TEXT_CHAR;
+static size_t _addBufferSpillThreshold = 0; // 0: add buffer never spills to a temp file
+static int _searchWorkers = 0;              // 0: one search (and counting) thread per online CPU
 
 /*------ Declarations ------ */
 ReturnCode generateStructureForFileContent(Sequence *sequence);
 NodeResult getNodeForPosition(Sequence *sequence, Position position);
-int isContinuationByte(Sequence *sequence, DescriptorNode *node, int offsetInBlock);
-int amountOfContinuationBytes(Sequence *sequence, DescriptorNode *node, int offsetInBlock);
+int isContinuationByte(Sequence *sequence, DescriptorNode *node, long offsetInBlock);
+int amountOfContinuationBytes(Sequence *sequence, DescriptorNode *node, long offsetInBlock);
 size_t getUtf8ByteSize(const wchar_t *wstr);
-ReturnCode writeToAddBuffer(Sequence *sequence, wchar_t *textToInsert, int *sizeOfCharOrNull);
-int textMatchesBuffer(Sequence *sequence, DescriptorNode *node, int offset, Atomic *needle, size_t needleSize);
-int getLineNumber(Sequence *sequence, Position position);
+ReturnCode reserveAddBuffer(Sequence *sequence, size_t byteLength);
+Position writeToAddBuffer(Sequence *sequence, wchar_t *textToInsert, Size *sizeOfCharOrNull);
+Position writeUtf8ToAddBuffer(Sequence *sequence, const Atomic *text, size_t byteLength);
+bool isCompleteUtf8(const Atomic *text, size_t byteLength);
+int textMatchesBuffer(Sequence *sequence, DescriptorNode *node, unsigned long offset, Atomic *needle, size_t needleSize);
 ReturnCode insertUndoOption(Sequence *sequence, Position position, wchar_t *textToInsert, Operation *previousOperation);
+ReturnCode insertUtf8UndoOption(Sequence *sequence, Position position, const Atomic *textToInsert, size_t byteLength, Operation *previousOperation);
+ReturnCode insertWrittenUndoOption(Sequence *sequence, Position position, Position bufferOffset, size_t byteLength, Operation *previousOperation);
 ReturnCode deleteUndoOption(Sequence *sequence, Position beginPosition, Position endPosition, Operation *previousOperation);
 ReturnCode replaceUndoOption(Sequence *sequence, wchar_t *textToReplace, Position startPosition, Position endPosition, Operation *previousOperation);
+ReturnCode replaceUtf8UndoOption(Sequence *sequence, const Atomic *textToReplace, size_t byteLength, Position startPosition, Position endPosition, Operation *previousOperation);
+ReturnCode queueWrittenEdit(Sequence *sequence, Position position, Size deleteLength, Position bufferOffset, Size byteLength);
+Position findNeedle(Sequence *sequence, Atomic *needle, size_t needleLength, Position startPosition, bool wrapAround);
+static Position findNeedleInRangeParallel(Sequence *sequence, Atomic *needle, size_t needleLength, Position from, Position to);
+static Position findNeedleInRangeIndexed(Sequence *sequence, Atomic *needle, size_t needleLength, Position from, Position to, const uint64_t *candidates);
+Position findNeedleBackward(Sequence *sequence, Atomic *needle, size_t needleLength, Position startPosition, bool wrapAround);
+static Position findNeedleInRangeBackward(Sequence *sequence, Atomic *needle, size_t needleLength, Position from, Position to);
+static SearchResult findFolded(Sequence *sequence, wchar_t *textToFind, Position startPosition, bool backward);
 
 /*
 =========================
@@ -48,6 +99,14 @@ LineBidentifier getCurrentLineBidentifier(){
   return _currLineBidentifier;
 }
 
+void setAddBufferSpillThreshold(size_t thresholdBytes) {
+    _addBufferSpillThreshold = thresholdBytes;
+}
+
+void setSearchWorkers(int workers) {
+    _searchWorkers = workers > 0 ? workers : 0;
+}
+
 Sequence *empty() {
     Sequence *newSeq = (Sequence *)malloc(sizeof(Sequence));
     if (newSeq == NULL) {
@@ -55,32 +114,41 @@ Sequence *empty() {
         return NULL; // Error
     }
 
+    // Initialize the allocators for nodes and operations
+    slabInit(&newSeq->nodeAllocator, sizeof(DescriptorNode), NODES_PER_SLAB);
+    slabInit(&newSeq->operationAllocator, sizeof(Operation), OPERATIONS_PER_SLAB);
+
     // Initialize undo and redo stacks
-    newSeq->undoStack = createOperationStack();
-    newSeq->redoStack = createOperationStack();
+    newSeq->undoStack = createOperationStack(&newSeq->operationAllocator);
+    newSeq->redoStack = createOperationStack(&newSeq->operationAllocator);
     if (newSeq->undoStack == NULL || newSeq->redoStack == NULL) {
         ERR_PRINT("Fatal malloc fail at empty sequence creation!\n");
+        freeOperationStack(newSeq->undoStack);
+        freeOperationStack(newSeq->redoStack);
         free(newSeq);
         return NULL;
     }
     newSeq->wordCount = 0;
     newSeq->lineCount = 0;
-    newSeq->lastLineResult.foundPosition = -1;
-    newSeq->lastLineResult.lineNumber = -1;
+    newSeq->editsSinceCompaction = 0;
     newSeq->lastInsert.lastAtomicPos = -1;
     newSeq->lastInsert.lastCharSize = -1;
     newSeq->lastInsert.lastWritePos = -1;
+    newSeq->transaction = (EditTransaction){NULL, 0, 0, false};
+    newSeq->matchIndex = NULL;
+    newSeq->trigramIndex = NULL;
+    newSeq->fileCount = NULL;
+    newSeq->statsCache = NULL;
 
     // Create sentinel nodes for the piece table
-    DescriptorNode *firstNode = (DescriptorNode *)malloc(sizeof(DescriptorNode));
-    DescriptorNode *lastNode = (DescriptorNode *)malloc(sizeof(DescriptorNode));
+    DescriptorNode *firstNode = (DescriptorNode *)slabAlloc(&newSeq->nodeAllocator);
+    DescriptorNode *lastNode = (DescriptorNode *)slabAlloc(&newSeq->nodeAllocator);
     if (firstNode == NULL || lastNode == NULL) {
         ERR_PRINT("Fatal malloc fail at empty sequence creation!\n");
         freeOperationStack(newSeq->undoStack);
         freeOperationStack(newSeq->redoStack);
+        slabFreeAll(&newSeq->nodeAllocator);
         free(newSeq);
-        free(firstNode);
-        free(lastNode);
         return NULL;
     }
     // Set values for the sentinel nodes
@@ -89,21 +157,28 @@ Sequence *empty() {
     firstNode->isInFileBuffer = false;
     firstNode->offset = 0;
     firstNode->size = 0;
+    firstNode->lineBreaks = 0;
     lastNode->next_ptr = NULL;
     lastNode->prev_ptr = firstNode;
     lastNode->isInFileBuffer = false;
     lastNode->offset = 0;
     lastNode->size = 0;
+    lastNode->lineBreaks = 0;
 
     // Set values for the piece table and buffers
     newSeq->pieceTable.first = firstNode;
     newSeq->pieceTable.last = lastNode;
+    pieceTreeInit(&newSeq->pieceTable);
     newSeq->fileBuffer.data = NULL;
     newSeq->fileBuffer.size = 0;
     newSeq->fileBuffer.capacity = 0;
-    newSeq->addBuffer.data = NULL;
+    newSeq->fileBuffer.reserved = 0;
+    newSeq->addBuffer.data = NULL; // Reserved at the first insert
     newSeq->addBuffer.size = 0;
     newSeq->addBuffer.capacity = 0;
+    newSeq->addBuffer.reserved = 0;
+    newSeq->fileLineIndex = (LineIndex){NULL, 0, 0, 0, 0, NULL, 0};
+    newSeq->addLineIndex = (LineIndex){NULL, 0, 0, 0, 0, NULL, 0};
 
     return newSeq;
 }
@@ -111,6 +186,10 @@ Sequence *empty() {
 Sequence *loadOrCreateNewFile(char *filePath, LineBstd stdIfNewCreation) {
     Sequence *newSeq = empty();
     _currLineB = initSequenceFromOpenOrCreate(filePath, newSeq, stdIfNewCreation);
+    openStatsCache(newSeq, filePath);
+    if (_currLineB == NO_INIT) {
+        _currLineB = getCachedLineBstd(newSeq); // No line break found at the start, use the standard of the last open
+    }
 
     if (_currLineB == NO_INIT) {
         ERR_PRINT("Fatal error at file open or create, stoping now.\n");
@@ -136,6 +215,7 @@ Sequence *loadOrCreateNewFile(char *filePath, LineBstd stdIfNewCreation) {
     }
 
     generateStructureForFileContent(newSeq);
+    createTrigramIndex(newSeq, filePath); // Built on the first search
 
     return newSeq;
 }
@@ -151,21 +231,29 @@ ReturnCode closeSequence(Sequence *sequence, bool forceFlag) {
         return -1;
     }
     if (sequence != NULL) {
+        freeTrigramIndex(sequence); // Its thread reads the file buffer
+        cancelFileCount(sequence->fileCount);
+        sequence->fileCount = NULL;
+        freeStatsCache(sequence);
         freeOperationStack(sequence->undoStack);
         freeOperationStack(sequence->redoStack);
-        DescriptorNode *curr = sequence->pieceTable.first;
-        while (curr != NULL) {
-            DescriptorNode *next = curr->next_ptr;
-            free(curr);
-            curr = next;
-        }
+
+        // All nodes and operations (also the ones only referenced by undo/redo) live in the slabs
+        slabFreeAll(&sequence->nodeAllocator);
+        slabFreeAll(&sequence->operationAllocator);
 
         closeAllFileResources(sequence);
 
         _currLineB = NO_INIT;
         _currLineBidentifier = NONE_ID;
 
-        free(sequence->addBuffer.data);
+        if (sequence->addBuffer.data != NULL) {
+            munmap(sequence->addBuffer.data, sequence->addBuffer.reserved);
+        }
+        freeLineIndex(&sequence->fileLineIndex);
+        freeLineIndex(&sequence->addLineIndex);
+        free(sequence->transaction.edits);
+        clearMatchIndex(sequence);
         free(sequence);
         sequence = NULL;
         return 1;
@@ -174,6 +262,8 @@ ReturnCode closeSequence(Sequence *sequence, bool forceFlag) {
 }
 
 ReturnCode saveSequence(Sequence *sequence) {
+    suspendTrigramIndex(sequence); // Saving may replace the mapping of the file buffer
+    finishBackgroundCount(sequence, true);
     return saveSequenceToOpenFile(sequence);
 }
 
@@ -199,7 +289,7 @@ ReturnCode generateStructureForFileContent(Sequence *sequence) {
     }
 
     // Adaptation of a similar code section at insert() -> case: at existing piece table split.
-    DescriptorNode *newInsert = (DescriptorNode *)malloc(sizeof(DescriptorNode));
+    DescriptorNode *newInsert = (DescriptorNode *)slabAlloc(&sequence->nodeAllocator);
     if (newInsert == NULL) {
         ERR_PRINT("Fatal malloc fail at insert operation!\n");
         return -1;
@@ -209,7 +299,27 @@ ReturnCode generateStructureForFileContent(Sequence *sequence) {
     newInsert->offset = 0;
     newInsert->size = sequence->fileBuffer.size;
 
-    DEBG_PRINT("Creating new file buffer node, buffer pointer:%p, offset%d, size:%d", sequence->fileBuffer.data, newInsert->offset, newInsert->size);
+    // Index the line breaks of the whole file once (later splits only have to count inside single blocks),
+    // the words are counted in the same parallel pass. Large files are counted in the background, until then
+    // the pieces of the file have no line breaks and the totals only contain the effect of the edits.
+    // An unchanged file opened before is not counted at all, its index and totals come from the cache.
+    TextStatistics stats = {0, 0};
+    if (loadCachedStatistics(sequence, &stats) == 1) {
+        DEBG_PRINT("Statistics of the file taken from the cache.\n");
+    } else if (sequence->fileBuffer.size >= BACKGROUND_COUNT_MIN_FILE_SIZE) {
+        sequence->fileCount = startFileCount(sequence->fileBuffer.data, sequence->fileBuffer.size, getCurrentLineBidentifier(), _searchWorkers);
+    }
+    if (sequence->fileCount == NULL && sequence->fileLineIndex.amount == 0) {
+        if (indexAndCountBuffer(&sequence->fileLineIndex, sequence->fileBuffer.data, sequence->fileBuffer.size, getCurrentLineBidentifier(), _searchWorkers, &stats, NULL) == -1) {
+            ERR_PRINT("Failed to index the line breaks of the file buffer.\n");
+            slabFree(&sequence->nodeAllocator, newInsert);
+            return -1;
+        }
+        storeStatsCache(sequence, stats);
+    }
+    newInsert->lineBreaks = sequence->fileLineIndex.indexedLineBreaks;
+
+    DEBG_PRINT("Creating new file buffer node, buffer pointer:%p, offset%lu, size:%lu", sequence->fileBuffer.data, newInsert->offset, newInsert->size);
 
     NodeResult nodeResult = getNodeForPosition(sequence, 0);
     /*
@@ -228,13 +338,13 @@ ReturnCode generateStructureForFileContent(Sequence *sequence) {
         DescriptorNode *next = nodeResult.node;
         if (next == NULL) {
             ERR_PRINT("Fatal error: next node is NULL!\n");
-            free(newInsert);
+            slabFree(&sequence->nodeAllocator, newInsert);
             return -1; // Error: Invalid state
         }
         DescriptorNode *prev = next->prev_ptr;
         if (prev == NULL) {
             ERR_PRINT("Fatal error: previous node is NULL!\n");
-            free(newInsert);
+            slabFree(&sequence->nodeAllocator, newInsert);
             return -1; // Error: Invalid state
         }
 
@@ -265,17 +375,14 @@ ReturnCode generateStructureForFileContent(Sequence *sequence) {
         }
 
         // Reset the redo stack
-        freeOperationStack(sequence->redoStack);
-        sequence->redoStack = createOperationStack();
+        clearOperationStack(sequence->redoStack);
         */
         // Update the piece table
-        prev->next_ptr = newInsert;
         newInsert->next_ptr = next;
         newInsert->prev_ptr = prev;
-        next->prev_ptr = newInsert;
+        pieceTreeReplaceRange(&sequence->pieceTable, prev, next, newInsert, newInsert);
 
-        // Update statistics
-        TextStatistics stats = calculateStatsEffect(sequence, newInsert, 0, newInsert, newInsert->size - 1, getCurrentLineBidentifier());
+        // Update statistics (the file is the whole text, no neighbours to merge words with)
         sequence->wordCount += stats.totalWords;
         sequence->lineCount += stats.totalLineBreaks + 1;
 
@@ -299,21 +406,14 @@ NodeResult getNodeForPosition(Sequence *sequence, Position position) {
         return result; // Error
     }
 
-    DescriptorNode *curr = sequence->pieceTable.first->next_ptr; // Skip sentinel node
-    int i = 0;
-    while (curr != sequence->pieceTable.last) {
-        i += curr->size;
-        if (i > position) {
-            result.node = curr;
-            result.startPosition = i - curr->size;
-            break;
-        }
-        curr = curr->next_ptr;
-    }
-
-    if (position == i) {
+    Position startPosition = -1;
+    DescriptorNode *node = pieceTreeFind(&sequence->pieceTable, position, &startPosition, NULL);
+    if (node != NULL) {
+        result.node = node;
+        result.startPosition = startPosition;
+    } else if (position == (Position)pieceTreeTotalSize(&sequence->pieceTable)) {
         result.node = sequence->pieceTable.last; // Special case: Position at end of the sequence requested
-        result.startPosition = i;
+        result.startPosition = position;
     }
 
     return result;
@@ -324,7 +424,7 @@ NodeResult getNodeForPosition(Sequence *sequence, Position position) {
  * A continuation byte in UTF-8 is a byte that starts with the bits 10xxxxxx.
  * Returns 1 if it is a continuation byte, 0 if not, and -1 on error.
  */
-int isContinuationByte(Sequence *sequence, DescriptorNode *node, int offsetInBlock) {
+int isContinuationByte(Sequence *sequence, DescriptorNode *node, long offsetInBlock) {
     if (node == NULL || offsetInBlock < 0) {
         ERR_PRINT("isContinuationByte called with invalid node or offset.\n");
         return -1; // Error
@@ -344,7 +444,7 @@ int isContinuationByte(Sequence *sequence, DescriptorNode *node, int offsetInBlo
  * Reads the byte at a given offset in the node and computes the corresponding number of continuation bytes.
  * If the byte itself is a continuation byte, it determines the number of continuation bytes that follow it.
  */
-int amountOfContinuationBytes(Sequence *sequence, DescriptorNode *node, int offsetInBlock) {
+int amountOfContinuationBytes(Sequence *sequence, DescriptorNode *node, long offsetInBlock) {
     if (node == NULL || offsetInBlock < 0) {
         ERR_PRINT("amountOfContinuationBytes called with invalid node or offset.\n");
         return -1; // Error
@@ -365,7 +465,7 @@ int amountOfContinuationBytes(Sequence *sequence, DescriptorNode *node, int offs
     } else if (byte >= 128) { // continuation byte (10xxxxxx)
         int amount = 0;
         // Read until the end of the node or until a non-continuation byte is found
-        for (int i = offsetInBlock + 1; i < node->size; i++) {
+        for (long i = offsetInBlock + 1; i < (long)node->size; i++) {
             int result = isContinuationByte(sequence, node, i);
             if (result == -1) {
                 ERR_PRINT("Call of isContinuationByte failed.\n");
@@ -386,8 +486,77 @@ size_t getUtf8ByteSize(const wchar_t *wstr) {
     return wcsrtombs(NULL, &wstr, 0, &state);
 }
 
+/**
+ * Makes sure that byteLength more atomics fit into the add buffer.
+ * The add buffer lives in a reserved range of address space in which chunks are committed on demand,
+ * so growing it never copies data and pointers into it stay valid for the lifetime of the sequence.
+ */
+ReturnCode reserveAddBuffer(Sequence *sequence, size_t byteLength) {
+    Buffer *addBuffer = &sequence->addBuffer;
+
+    if (addBuffer->data == NULL) {
+        // Reserve the address space once (without backing memory), smaller if the system does not allow as much
+        size_t reservation = ADD_BUFFER_MAX_RESERVATION;
+        void *region = MAP_FAILED;
+        while (region == MAP_FAILED && reservation >= ADD_BUFFER_CHUNK_SIZE) {
+            region = mmap(NULL, reservation, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (region == MAP_FAILED) {
+                reservation /= 4;
+            }
+        }
+        if (region == MAP_FAILED) {
+            ERR_PRINT("Failed to reserve address space for the add buffer.\n");
+            return -1;
+        }
+        addBuffer->data = (Atomic *)region;
+        addBuffer->capacity = 0;
+        addBuffer->reserved = reservation;
+        DEBG_PRINT("Reserved %zu bytes of address space for the add buffer.\n", reservation);
+    }
+
+    size_t requiredSize = addBuffer->size + byteLength;
+    if (requiredSize > addBuffer->reserved) {
+        ERR_PRINT("Add buffer exhausted, %zu bytes requested but only %zu reserved.\n", requiredSize, addBuffer->reserved);
+        return -1;
+    }
+
+    // Commit the missing chunks behind the already committed ones
+    if (requiredSize > addBuffer->capacity) {
+        size_t newCapacity = ((requiredSize + ADD_BUFFER_CHUNK_SIZE - 1) / ADD_BUFFER_CHUNK_SIZE) * ADD_BUFFER_CHUNK_SIZE;
+        if (newCapacity > addBuffer->reserved) {
+            newCapacity = addBuffer->reserved;
+        }
+
+        // Chunks below the spill threshold are anonymous memory, the ones above it are backed by a temp file
+        size_t spillStart = addBuffer->reserved;
+        if (_addBufferSpillThreshold > 0) {
+            spillStart = ((_addBufferSpillThreshold + ADD_BUFFER_CHUNK_SIZE - 1) / ADD_BUFFER_CHUNK_SIZE) * ADD_BUFFER_CHUNK_SIZE;
+        }
+        size_t anonymousEnd = (newCapacity < spillStart) ? newCapacity : spillStart;
+        if (anonymousEnd > addBuffer->capacity &&
+            mprotect(addBuffer->data + addBuffer->capacity, anonymousEnd - addBuffer->capacity, PROT_READ | PROT_WRITE) != 0) {
+            ERR_PRINT("Failed to commit memory for the add buffer.\n");
+            return -1;
+        }
+        if (newCapacity > spillStart) {
+            size_t spillFrom = (addBuffer->capacity > spillStart) ? addBuffer->capacity : spillStart;
+            if (mapAddBufferSpill(sequence, spillStart, spillFrom, newCapacity) == -1) {
+                // Fall back to anonymous memory, a failed MAP_FIXED may already have replaced the reservation
+                ERR_PRINT("Add buffer spill failed, using anonymous memory instead.\n");
+                if (mmap(addBuffer->data + spillFrom, newCapacity - spillFrom, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+                    ERR_PRINT("Failed to commit memory for the add buffer.\n");
+                    return -1;
+                }
+            }
+        }
+        addBuffer->capacity = newCapacity;
+    }
+
+    return 1;
+}
+
 /* Appends the textToInsert to the add buffer, returns the (offset) Position */
-Position writeToAddBuffer(Sequence *sequence, wchar_t *textToInsert, int *sizeOfCharOrNull) {
+Position writeToAddBuffer(Sequence *sequence, wchar_t *textToInsert, Size *sizeOfCharOrNull) {
     if (sequence == NULL || textToInsert == NULL) {
         ERR_PRINT("writeToAddBuffer called with invalid sequence or text.\n");
         return -1; // Error: Invalid input
@@ -395,47 +564,80 @@ Position writeToAddBuffer(Sequence *sequence, wchar_t *textToInsert, int *sizeOf
 
     // Get the length of the text's UTF-8 representation in bytes
     size_t byteLength = getUtf8ByteSize(textToInsert);
+    if (byteLength == (size_t)-1) {
+        ERR_PRINT("Text to insert can not be represented as UTF-8.\n");
+        return -1;
+    }
 
     // If call requested this stat, give it here...
     if (sizeOfCharOrNull != NULL) {
         *sizeOfCharOrNull = byteLength;
     }
 
-    // Double the buffer's capacity if necessary
-    if (sequence->addBuffer.capacity < sequence->addBuffer.size + byteLength) {
-        size_t newCapacity = (sequence->addBuffer.capacity == 0) ? byteLength : sequence->addBuffer.capacity * 2;
-        while (newCapacity < sequence->addBuffer.size + byteLength) {
-            newCapacity *= 2;
-        }
-
-        char *newData = realloc(sequence->addBuffer.data, newCapacity);
-        if (newData == NULL) {
-            ERR_PRINT("Memory allocation failed while resizing add buffer.\n");
-            return -1;
-        }
-
-        sequence->addBuffer.data = newData;
-        sequence->addBuffer.capacity = newCapacity;
+    if (reserveAddBuffer(sequence, byteLength) == -1) {
+        return -1;
     }
 
     // Write the UTF-8 string to the end of the add buffer
-    int offset = (int)sequence->addBuffer.size;
+    Position offset = (Position)sequence->addBuffer.size;
     wcstombs(sequence->addBuffer.data + sequence->addBuffer.size, textToInsert, byteLength);
     sequence->addBuffer.size += byteLength;
+    extendLineIndex(&sequence->addLineIndex, sequence->addBuffer.data, sequence->addBuffer.size, getCurrentLineBidentifier());
+
+    return offset;
+}
+
+/* Appends already UTF-8 encoded text to the add buffer with a single copy, returns the (offset) Position */
+Position writeUtf8ToAddBuffer(Sequence *sequence, const Atomic *text, size_t byteLength) {
+    if (sequence == NULL || (text == NULL && byteLength > 0)) {
+        ERR_PRINT("writeUtf8ToAddBuffer called with invalid sequence or text.\n");
+        return -1; // Error: Invalid input
+    }
+
+    if (reserveAddBuffer(sequence, byteLength) == -1) {
+        return -1;
+    }
+
+    Position offset = (Position)sequence->addBuffer.size;
+    memcpy(sequence->addBuffer.data + sequence->addBuffer.size, text, byteLength);
+    sequence->addBuffer.size += byteLength;
+    extendLineIndex(&sequence->addLineIndex, sequence->addBuffer.data, sequence->addBuffer.size, getCurrentLineBidentifier());
+
+    return offset;
+}
 
-    return (Position)offset;
+/**
+ * Checks that the text does not start or end in the middle of a UTF-8 character, since pieces must only be split at character borders.
+ * Only the borders are checked, the content itself is taken as is.
+ */
+bool isCompleteUtf8(const Atomic *text, size_t byteLength) {
+    if (byteLength == 0) {
+        return true;
+    }
+    if ((text[0] & 0xC0) == 0x80) {
+        return false; // Starts with a continuation byte
+    }
+
+    // Find the start of the last character and compare its announced length with the remaining bytes
+    size_t lastStart = byteLength - 1;
+    while (lastStart > 0 && (text[lastStart] & 0xC0) == 0x80 && byteLength - lastStart < 4) {
+        lastStart--;
+    }
+    Atomic lead = text[lastStart];
+    size_t expectedLength = (lead >= 240) ? 4 : (lead >= 224) ? 3 : (lead >= 192) ? 2 : 1;
+    return byteLength - lastStart == expectedLength;
 }
 
 /**
  * Compares the given text (needle) with the text starting at a given node and offset inside the node.
  * Returns 1 if the text matches, 0 if it does not match.
  */
-int textMatchesBuffer(Sequence *sequence, DescriptorNode *node, int offset, Atomic *needle, size_t needleSize) {
+int textMatchesBuffer(Sequence *sequence, DescriptorNode *node, unsigned long offset, Atomic *needle, size_t needleSize) {
     DescriptorNode *currNode = node;
-    int currentOffset = offset;
+    unsigned long currentOffset = offset;
     Atomic *buffer = currNode->isInFileBuffer ? sequence->fileBuffer.data : sequence->addBuffer.data;
 
-    for (int i = 0; i < needleSize; i++) {
+    for (size_t i = 0; i < needleSize; i++) {
         // Get the correct node and data for the i-th character
         while (currentOffset >= currNode->size) {
             currNode = currNode->next_ptr;
@@ -456,63 +658,6 @@ int textMatchesBuffer(Sequence *sequence, DescriptorNode *node, int offset, Atom
     return 1; // All characters matched
 }
 
-/**
- * Returns the line number for a given position in the sequence.
- * If there is a line break at the position, the line break itself is allocated to the next line
- * (e.g. a call for position 5 in "Hello\nWorld" will return 2, not 1).
- * If the position is invalid, returns -1.
- */
-int getLineNumber(Sequence *sequence, Position position) {
-    if (sequence == NULL || position < 0) {
-        ERR_PRINT("getLineNumber called with invalid sequence or position.\n");
-        return -1;
-    }
-
-    int lineNumber = 1;
-    int stepsAmount = position + 1; // Number of characters to traverse
-    DescriptorNode *currNode = sequence->pieceTable.first;
-    int offsetInNode = 0;
-
-    // If the position comes after the position of the last known line result, we can start from there
-    Position lastPosition = sequence->lastLineResult.foundPosition;
-    if (lastPosition != -1 && lastPosition <= position) {
-        DEBG_PRINT("Using cached last line result for position %d.\n", lastPosition);
-        NodeResult nodeResult = getNodeForPosition(sequence, lastPosition);
-        if (nodeResult.node == NULL) {
-            ERR_PRINT("Position %d out of bounds when accessing lastLineResult.\n", lastPosition);
-            return -1;
-        }
-        lineNumber = sequence->lastLineResult.lineNumber;
-        stepsAmount = position - lastPosition;
-        currNode = nodeResult.node;
-        offsetInNode = lastPosition - nodeResult.startPosition;
-    }
-
-    Atomic *buffer = currNode->isInFileBuffer ? sequence->fileBuffer.data : sequence->addBuffer.data;
-    LineBidentifier lineBreakId = getCurrentLineBidentifier();
-
-    for (int i = 0; i < stepsAmount; i++) {
-        // Get the correct node and data for the i-th character
-        while (offsetInNode >= currNode->size) {
-            currNode = currNode->next_ptr;
-            if (currNode == sequence->pieceTable.last || currNode == NULL) {
-                ERR_PRINT("Position %d out of bounds in getLineNumber.\n", position);
-                return -1; // Position out of bounds
-            }
-            offsetInNode = 0;
-            buffer = currNode->isInFileBuffer ? sequence->fileBuffer.data : sequence->addBuffer.data;
-        }
-
-        if (buffer[currNode->offset + offsetInNode] == lineBreakId) {
-            lineNumber++; // Count a line break
-        }
-
-        offsetInNode++;
-    }
-
-    return lineNumber;
-}
-
 /*
 =========================
   Read
@@ -536,7 +681,7 @@ Size getItemBlock(Sequence *sequence, Position position, Atomic **returnedItemBl
 
     DescriptorNode *node = nodeResult.node;
     if (node != NULL) {
-        int offset = node->offset + (position - nodeResult.startPosition);
+        unsigned long offset = node->offset + (position - nodeResult.startPosition);
         size = node->size - (position - nodeResult.startPosition);
 
         if (node->isInFileBuffer) {
@@ -549,17 +694,174 @@ Size getItemBlock(Sequence *sequence, Position position, Atomic **returnedItemBl
     return size;
 }
 
+ReturnCode initBlockIterator(BlockIterator *iterator, Sequence *sequence, Position position) {
+    if (iterator == NULL || sequence == NULL || position < 0) {
+        ERR_PRINT("initBlockIterator called with invalid iterator, sequence or position.\n");
+        return -1;
+    }
+
+    NodeResult nodeResult = getNodeForPosition(sequence, position);
+    if (nodeResult.node == NULL) {
+        ERR_PRINT("Position %ld out of bounds in initBlockIterator.\n", position);
+        return -1;
+    }
+    iterator->sequence = sequence;
+    iterator->node = nodeResult.node;
+    iterator->offsetInNode = position - nodeResult.startPosition;
+    iterator->blockStart = position;
+    return 1;
+}
+
+Size getCurrentBlock(BlockIterator *iterator, Atomic **returnedItemBlock) {
+    if (iterator == NULL || iterator->node == NULL || returnedItemBlock == NULL) {
+        ERR_PRINT("getCurrentBlock called with invalid iterator or returnedItemBlock.\n");
+        return -1;
+    }
+
+    Sequence *sequence = iterator->sequence;
+    DescriptorNode *node = iterator->node;
+    if (node == sequence->pieceTable.last) {
+        // Special case: Iterator at the end of the sequence
+        *returnedItemBlock = &endOfTextSignal;
+        return 1;
+    }
+
+    Atomic *data = node->isInFileBuffer ? sequence->fileBuffer.data : sequence->addBuffer.data;
+    *returnedItemBlock = data + node->offset + iterator->offsetInNode;
+    return (Size)(node->size - iterator->offsetInNode);
+}
+
+Size getNextBlock(BlockIterator *iterator, Atomic **returnedItemBlock) {
+    if (iterator == NULL || iterator->node == NULL) {
+        ERR_PRINT("getNextBlock called with invalid iterator.\n");
+        return -1;
+    }
+    if (iterator->node == iterator->sequence->pieceTable.last) {
+        return -1; // Already at the end of the sequence
+    }
+
+    iterator->blockStart += iterator->node->size - iterator->offsetInNode;
+    iterator->node = iterator->node->next_ptr;
+    iterator->offsetInNode = 0;
+    return getCurrentBlock(iterator, returnedItemBlock);
+}
+
+Size getPreviousBlock(BlockIterator *iterator, Atomic **returnedItemBlock) {
+    if (iterator == NULL || iterator->node == NULL) {
+        ERR_PRINT("getPreviousBlock called with invalid iterator.\n");
+        return -1;
+    }
+    if (iterator->offsetInNode > 0) {
+        // The atomics of the current piece in front of the block come first
+        iterator->blockStart -= iterator->offsetInNode;
+        iterator->offsetInNode = 0;
+        return getCurrentBlock(iterator, returnedItemBlock);
+    }
+    DescriptorNode *prev = iterator->node->prev_ptr;
+    if (prev == NULL || prev == iterator->sequence->pieceTable.first) {
+        return -1; // Already at the first block
+    }
+
+    iterator->blockStart -= prev->size;
+    iterator->node = prev;
+    return getCurrentBlock(iterator, returnedItemBlock);
+}
+
+Position getBlockIteratorPosition(BlockIterator *iterator) {
+    return iterator != NULL ? iterator->blockStart : -1;
+}
+
 /*
 =========================
   Query internals
 =========================
 */
 
-int getCurrentWordCount(Sequence *sequence) {
+/* State of finishBackgroundCount() for the visited operations */
+typedef struct {
+    Sequence *sequence;
+    long fileWords;
+} FileCountFixup;
+
+/**
+ * Counts the line breaks of a piece of the file buffer again (the pieces of the add buffer are always correct),
+ * the sums of the piece index are updated if the piece is linked.
+ */
+static void fixFileLineBreaks(Sequence *sequence, DescriptorNode *node, PieceTable *linkedIn) {
+    if (node == NULL || !node->isInFileBuffer) {
+        return;
+    }
+    node->lineBreaks = countLineBreaksInPiece(sequence, node, 0, node->size);
+    if (linkedIn != NULL) {
+        pieceTreeUpdate(linkedIn, node);
+    }
+}
+
+/* Adds the totals of the file to the statistics saved by an operation, see finishBackgroundCount() */
+static void addFileCountToOperation(Operation *operation, void *context) {
+    Sequence *sequence = ((FileCountFixup *)context)->sequence;
+    operation->wordCount += ((FileCountFixup *)context)->fileWords;
+    operation->lineCount = -1; // Counted again from the pieces when the operation is undone
+    if (operation->optimizedCase) {
+        fixFileLineBreaks(sequence, operation->first, NULL);
+        return;
+    }
+    // The pieces the operation relinks (oldNext up to oldPrev, empty if oldNext is the last node)
+    for (DescriptorNode *node = operation->oldNext; node != NULL && node != operation->last; node = node->next_ptr) {
+        fixFileLineBreaks(sequence, node, NULL);
+        if (node == operation->oldPrev) {
+            break;
+        }
+    }
+}
+
+ReturnCode finishBackgroundCount(Sequence *sequence, bool wait) {
+    if (sequence == NULL || sequence->fileCount == NULL) {
+        return 1;
+    }
+    if (!wait && !isFileCountDone(sequence->fileCount)) {
+        return 0;
+    }
+    LineIndex index;
+    TextStatistics stats;
+    ReturnCode result = finishFileCount(sequence->fileCount, &index, &stats);
+    sequence->fileCount = NULL;
+    if (result == -1) {
+        // The pieces of the file must not keep 0 line breaks, count the file right away instead
+        ERR_PRINT("Background count of the file failed, counting it now.\n");
+        index = (LineIndex){NULL, 0, 0, 0, 0, NULL, 0};
+        if (indexAndCountBuffer(&index, sequence->fileBuffer.data, sequence->fileBuffer.size, getCurrentLineBidentifier(), _searchWorkers, &stats, NULL) == -1) {
+            ERR_PRINT("Failed to index the line breaks of the file buffer.\n");
+            return -1;
+        }
+    }
+    sequence->fileLineIndex = index;
+    storeStatsCache(sequence, stats);
+
+    // Edits only changed the totals by their effect, the words of the file can simply be added.
+    // The line breaks of the file pieces were treated as 0, so they are counted now and the lines are summed up again.
+    for (DescriptorNode *node = sequence->pieceTable.first->next_ptr; node != sequence->pieceTable.last; node = node->next_ptr) {
+        fixFileLineBreaks(sequence, node, &sequence->pieceTable);
+    }
+    FileCountFixup fixup = {sequence, stats.totalWords};
+    forEachOperation(sequence->undoStack, addFileCountToOperation, &fixup);
+    forEachOperation(sequence->redoStack, addFileCountToOperation, &fixup);
+    sequence->wordCount += stats.totalWords;
+    bool isEmpty = sequence->pieceTable.first->next_ptr == sequence->pieceTable.last;
+    sequence->lineCount = isEmpty ? 0 : (long)pieceTreeTotalLineBreaks(&sequence->pieceTable) + 1;
+    DEBG_PRINT("Background count done: %ld words, %ld lines.\n", sequence->wordCount, sequence->lineCount);
+    return 1;
+}
+
+int getBackgroundCountProgress(Sequence *sequence) {
+    return sequence != NULL && sequence->fileCount != NULL ? getFileCountProgress(sequence->fileCount) : -1;
+}
+
+long getCurrentWordCount(Sequence *sequence) {
     return sequence != NULL ? sequence->wordCount : 0; // Return 0 if sequence is NULL since only used by GUI and no backend
 }
 
-int getCurrentLineCount(Sequence *sequence) {
+long getCurrentLineCount(Sequence *sequence) {
     return sequence != NULL ? sequence->lineCount : 0; // Return 0 if sequence is NULL since only used by GUI and no backend
 }
 
@@ -567,20 +869,83 @@ int getCurrentLineCount(Sequence *sequence) {
  * Query the total amount of atomics used in current sequence state, from both the add and the file buffer.
  */
 size_t getCurrentTotalSize(Sequence *sequence) {
-    NodeResult result = {NULL, -1};
-
     if (sequence == NULL) {
         return -1; // Error
     }
 
-    DescriptorNode *curr = sequence->pieceTable.first->next_ptr; // Skip sentinel node
-    size_t i = 0;
-    while (curr != sequence->pieceTable.last) {
-        i += curr->size;
-        curr = curr->next_ptr;
+    return pieceTreeTotalSize(&sequence->pieceTable);
+}
+
+long getLineNumber(Sequence *sequence, Position position) {
+    if (sequence == NULL || position < 0 || position >= (Position)getCurrentTotalSize(sequence)) {
+        ERR_PRINT("getLineNumber called with invalid sequence or position.\n");
+        return -1;
+    }
+    if (sequence->fileCount != NULL) {
+        return -1; // Line breaks of the file are only known once it is counted, never wait for it here
+    }
+
+    // Line breaks before the node come from the index, only the part inside the node has to be counted
+    Position nodeStart = 0;
+    unsigned long lineBreaksBefore = 0;
+    DescriptorNode *node = pieceTreeFind(&sequence->pieceTable, position, &nodeStart, &lineBreaksBefore);
+    if (node == NULL) {
+        ERR_PRINT("Position %ld out of bounds in getLineNumber.\n", position);
+        return -1;
+    }
+
+    return 1 + (long)(lineBreaksBefore + countLineBreaksInPiece(sequence, node, 0, position - nodeStart + 1));
+}
+
+Position getFirstAtomicOfLine(Sequence *sequence, long lineNumber) {
+    if (sequence == NULL || lineNumber < 1) {
+        ERR_PRINT("getFirstAtomicOfLine called with invalid sequence or line number.\n");
+        return -1;
+    }
+    if (lineNumber == 1) {
+        return 0;
+    }
+    if (sequence->fileCount != NULL) {
+        return -1; // Line breaks of the file are only known once it is counted, never wait for it here
+    }
+
+    // The line starts right after the (lineNumber - 1)-th line break
+    Position nodeStart = 0;
+    unsigned long lineBreaksBefore = 0;
+    DescriptorNode *node = pieceTreeFindLineBreak(&sequence->pieceTable, (unsigned long)lineNumber - 1, &nodeStart, &lineBreaksBefore);
+    if (node == NULL) {
+        return -1; // Line does not exist
+    }
+    LineIndex *index = node->isInFileBuffer ? &sequence->fileLineIndex : &sequence->addLineIndex;
+    Atomic *data = node->isInFileBuffer ? sequence->fileBuffer.data : sequence->addBuffer.data;
+    long offset = findLineBreakInRange(index, data, node->offset, node->offset + node->size, (unsigned long)lineNumber - 1 - lineBreaksBefore, getCurrentLineBidentifier());
+    if (offset == -1) {
+        ERR_PRINT("Line index and piece index disagree in getFirstAtomicOfLine.\n");
+        return -1;
     }
 
-    return i;
+    return nodeStart + (Position)(offset - node->offset) + 1;
+}
+
+/**
+ * Returns the position after the last line break before position by reading the pieces backwards.
+ */
+static Position scanBackToLineStart(Sequence *sequence, Position position) {
+    Position nodeStart = 0;
+    DescriptorNode *node = pieceTreeFind(&sequence->pieceTable, position - 1, &nodeStart, NULL);
+    unsigned long end = (unsigned long)(position - nodeStart); // atomics of the node before position
+    Atomic lineBreak = (Atomic)getCurrentLineBidentifier();
+    while (node != NULL && node != sequence->pieceTable.first) {
+        Atomic *data = (node->isInFileBuffer ? sequence->fileBuffer.data : sequence->addBuffer.data) + node->offset;
+        const Atomic *found = memrchr(data, lineBreak, end);
+        if (found != NULL) {
+            return nodeStart + (found - data) + 1;
+        }
+        node = node->prev_ptr;
+        end = node->size;
+        nodeStart -= (Position)node->size;
+    }
+    return 0;
 }
 
 Position backtrackToFirstAtomicInLine(Sequence *sequence, Position position) {
@@ -591,36 +956,22 @@ Position backtrackToFirstAtomicInLine(Sequence *sequence, Position position) {
         return 0; // Postion is already at the start of the (non-empty) sequence
     }
 
-    NodeResult nodeResult = getNodeForPosition(sequence, position - 1);
-    DescriptorNode *currNode = nodeResult.node;
-    int offsetInNode = position - 1 - nodeResult.startPosition;
-
-    if (currNode == NULL || currNode == sequence->pieceTable.last || (currNode->next_ptr == sequence->pieceTable.last && offsetInNode == currNode->size - 1)) {
-        ERR_PRINT("Position %d out of bounds in backtrackToFirstAtomicInLine.\n", position);
+    if (position >= (Position)getCurrentTotalSize(sequence)) {
+        ERR_PRINT("Position %ld out of bounds in backtrackToFirstAtomicInLine.\n", position);
         return -1;
     }
 
-    Position currentPosition = position; // This is always one before the current offsetInNode
-    Atomic *buffer = currNode->isInFileBuffer ? sequence->fileBuffer.data : sequence->addBuffer.data;
-    LineBidentifier lineBreakId = getCurrentLineBidentifier();
-
-    while (currNode != sequence->pieceTable.first) {
-        // Iterate over the characters in the current node backwards
-        while (offsetInNode >= 0) {
-            if (buffer[currNode->offset + offsetInNode] == lineBreakId) {
-                return currentPosition; // Found the start of the line
-            }
-            offsetInNode--;
-            currentPosition--;
-        }
-
-        // Move to the previous node
-        currNode = currNode->prev_ptr;
-        offsetInNode = currNode->size - 1;
-        buffer = currNode->isInFileBuffer ? sequence->fileBuffer.data : sequence->addBuffer.data;
+    // While the file is counted its line breaks are not indexed yet, scan backwards instead of waiting for the count
+    if (sequence->fileCount != NULL) {
+        return scanBackToLineStart(sequence, position);
     }
 
-    return 0; // If we reach this, we are at the first node, so return 0
+    // The line of the position starts after the last line break before it
+    long lineNumber = getLineNumber(sequence, position - 1);
+    if (lineNumber == -1) {
+        return -1;
+    }
+    return getFirstAtomicOfLine(sequence, lineNumber);
 }
 
 /*
@@ -633,34 +984,69 @@ ReturnCode insert(Sequence *sequence, Position position, wchar_t *textToInsert)
     return insertUndoOption(sequence, position, textToInsert, NULL);
 }
 
+ReturnCode insertUtf8(Sequence *sequence, Position position, const Atomic *textToInsert, size_t byteLength) {
+    return insertUtf8UndoOption(sequence, position, textToInsert, byteLength, NULL);
+}
+
 /**
  * Insertion with the option to link to a previous operation for bundled undo.
  */
 ReturnCode insertUndoOption(Sequence *sequence, Position position, wchar_t *textToInsert, Operation *previousOperation) {
-    DEBG_PRINT("[Trace]: Inserting at atomic:%d\n", position);
+    DEBG_PRINT("[Trace]: Inserting at atomic:%ld\n", position);
     if (sequence == NULL || textToInsert == NULL || position < 0) {
         ERR_PRINT("Insert with invalid sequence, textToInsert, or position.\n");
         return -1;
     }
 
-    int atomicSizeOfInsertion = -1;
+    Size atomicSizeOfInsertion = -1;
+
+    // Write the text to the add buffer and get the offset
+    Position newlyWrittenBufferOffset = writeToAddBuffer(sequence, textToInsert, &atomicSizeOfInsertion);
+    if (newlyWrittenBufferOffset == -1) {
+        ERR_PRINT("Insert failed at write to add buffer.\n");
+        return -1;
+    }
+
+    return insertWrittenUndoOption(sequence, position, newlyWrittenBufferOffset, atomicSizeOfInsertion, previousOperation);
+}
+
+/**
+ * UTF-8 insertion with the option to link to a previous operation for bundled undo.
+ */
+ReturnCode insertUtf8UndoOption(Sequence *sequence, Position position, const Atomic *textToInsert, size_t byteLength, Operation *previousOperation) {
+    DEBG_PRINT("[Trace]: Inserting %zu UTF-8 atomics at atomic:%ld\n", byteLength, position);
+    if (sequence == NULL || textToInsert == NULL || position < 0) {
+        ERR_PRINT("Insert with invalid sequence, textToInsert, or position.\n");
+        return -1;
+    }
+    if (!isCompleteUtf8(textToInsert, byteLength)) {
+        ERR_PRINT("Insert failed: Text starts or ends in the middle of a UTF-8 character!\n");
+        return -1;
+    }
 
     // Write the text to the add buffer and get the offset
-    int newlyWrittenBufferOffset = writeToAddBuffer(sequence, textToInsert, &atomicSizeOfInsertion);
+    Position newlyWrittenBufferOffset = writeUtf8ToAddBuffer(sequence, textToInsert, byteLength);
     if (newlyWrittenBufferOffset == -1) {
         ERR_PRINT("Insert failed at write to add buffer.\n");
         return -1;
     }
 
-    // Make cache invalid if necessary
-    if (position <= sequence->lastLineResult.foundPosition) {
-        sequence->lastLineResult.foundPosition = -1;
-        sequence->lastLineResult.lineNumber = -1;
+    return insertWrittenUndoOption(sequence, position, newlyWrittenBufferOffset, byteLength, previousOperation);
+}
+
+/**
+ * Links the text which was just appended to the add buffer (at bufferOffset) into the piece table at the given position.
+ */
+ReturnCode insertWrittenUndoOption(Sequence *sequence, Position position, Position bufferOffset, size_t byteLength, Operation *previousOperation) {
+    if (byteLength == 0) {
+        return 1; // Nothing to insert (e.g. replacement with an empty text), avoids empty pieces
     }
+    Size atomicSizeOfInsertion = (Size)byteLength;
+    Position newlyWrittenBufferOffset = bufferOffset;
 
     // Store previous statistics for undo
-    int prevWordCount = sequence->wordCount;
-    int prevLineCount = sequence->lineCount;
+    long prevWordCount = sequence->wordCount;
+    long prevLineCount = sequence->lineCount;
 
     // Increase the line count if the sequence was empty
     if (position == 0 && sequence->pieceTable.first->next_ptr == sequence->pieceTable.last) {
@@ -676,9 +1062,12 @@ ReturnCode insertUndoOption(Sequence *sequence, Position position, wchar_t *text
     if (toExtend.node != NULL){
       DEBG_PRINT("Insert now in optimized case.\n");
       // Simply increase the valid range of the node to now also encompass the new insertion as well:
-      unsigned long byteSize = (unsigned long) getUtf8ByteSize(textToInsert);
-      DEBG_PRINT("Insert got byte size %d\n", byteSize);
+      unsigned long byteSize = (unsigned long) byteLength;
+      DEBG_PRINT("Insert got byte size %lu\n", byteSize);
       toExtend.node->size += byteSize;
+      toExtend.node->lineBreaks += countLineBreaksInPiece(sequence, toExtend.node, toExtend.node->size - byteSize, toExtend.node->size);
+      pieceTreeUpdate(&sequence->pieceTable, toExtend.node);
+      matchIndexTextChanged(sequence, position, 0, atomicSizeOfInsertion);
 
             // Update statistics
             TextStatistics stats = calculateStatsEffect(sequence, toExtend.node, toExtend.node->size - byteSize, toExtend.node, toExtend.node->size - 1, getCurrentLineBidentifier());
@@ -686,7 +1075,7 @@ ReturnCode insertUndoOption(Sequence *sequence, Position position, wchar_t *text
             sequence->lineCount += stats.totalLineBreaks;
 
             // Save the operation for undo
-            Operation *operation = (Operation *)malloc(sizeof(Operation));
+            Operation *operation = (Operation *)slabAlloc(&sequence->operationAllocator);
             if (operation == NULL) {
                 ERR_PRINT("Fatal malloc fail at insert operation!\n");
                 return -1; // Error
@@ -702,7 +1091,7 @@ ReturnCode insertUndoOption(Sequence *sequence, Position position, wchar_t *text
             operation->oldPrev = NULL;
             if (previousOperation == NULL && pushOperation(sequence->undoStack, operation) == 0) {
                 ERR_PRINT("Failed to push insert operation onto undo stack.\n");
-                free(operation);
+                slabFree(&sequence->operationAllocator, operation);
                 return -1; // Error
             }
 
@@ -715,15 +1104,16 @@ ReturnCode insertUndoOption(Sequence *sequence, Position position, wchar_t *text
     }
 
   // Otherwise create a new node for the inserted text
-  DescriptorNode* newInsert = (DescriptorNode*) malloc(sizeof(DescriptorNode));
+  DescriptorNode* newInsert = (DescriptorNode*) slabAlloc(&sequence->nodeAllocator);
   if(newInsert == NULL){
     ERR_PRINT("Fatal malloc fail at insert operation!\n");
     return -1;
   }
   newInsert->isInFileBuffer = false;
   newInsert->offset = newlyWrittenBufferOffset;
-  newInsert->size = (long int) getUtf8ByteSize(textToInsert);
-  DEBG_PRINT("Insert got byte size %d\n", newInsert->size);
+  newInsert->size = (unsigned long) byteLength;
+  newInsert->lineBreaks = countLineBreaksInPiece(sequence, newInsert, 0, newInsert->size);
+  DEBG_PRINT("Insert got byte size %lu\n", newInsert->size);
 
     // Find the node for the given position
     NodeResult nodeResult = getNodeForPosition(sequence, position);
@@ -736,21 +1126,21 @@ ReturnCode insertUndoOption(Sequence *sequence, Position position, wchar_t *text
         DescriptorNode *next = nodeResult.node;
         if (next == NULL) {
             ERR_PRINT("Next node for insert is NULL!\n");
-            free(newInsert);
+            slabFree(&sequence->nodeAllocator, newInsert);
             return -1; // Error: Invalid state
         }
         DescriptorNode *prev = next->prev_ptr;
         if (prev == NULL) {
             ERR_PRINT("Previous node for insert is NULL!\n");
-            free(newInsert);
+            slabFree(&sequence->nodeAllocator, newInsert);
             return -1; // Error: Invalid state
         }
 
         // Save state for undo
-        Operation *operation = (Operation *)malloc(sizeof(Operation));
+        Operation *operation = (Operation *)slabAlloc(&sequence->operationAllocator);
         if (operation == NULL) {
             ERR_PRINT("Fatal malloc fail at insert operation!\n");
-            free(newInsert);
+            slabFree(&sequence->nodeAllocator, newInsert);
             return -1; // Error
         }
         operation->first = prev;
@@ -764,20 +1154,19 @@ ReturnCode insertUndoOption(Sequence *sequence, Position position, wchar_t *text
         operation->optimizedCaseSize = 0;        // Not used in this case
         if (previousOperation == NULL && pushOperation(sequence->undoStack, operation) == 0) {
             ERR_PRINT("Failed to push insert operation onto undo stack.\n");
-            free(newInsert);
-            free(operation);
+            slabFree(&sequence->nodeAllocator, newInsert);
+            slabFree(&sequence->operationAllocator, operation);
             return -1; // Error
         }
 
         // Reset the redo stack
-        freeOperationStack(sequence->redoStack);
-        sequence->redoStack = createOperationStack();
+        clearOperationStack(sequence->redoStack);
 
         // Update the piece table
-        prev->next_ptr = newInsert;
         newInsert->next_ptr = next;
         newInsert->prev_ptr = prev;
-        next->prev_ptr = newInsert;
+        replaceTrackedRange(sequence, prev, next, newInsert, newInsert);
+        sequence->editsSinceCompaction++;
 
     } else {
         // Position is within an existing piece
@@ -787,30 +1176,32 @@ ReturnCode insertUndoOption(Sequence *sequence, Position position, wchar_t *text
         DescriptorNode *foundNode = nodeResult.node;
         if (foundNode == NULL) {
             ERR_PRINT("No node found for insert at given position!\n");
-            free(newInsert);
+            slabFree(&sequence->nodeAllocator, newInsert);
             return -1; // Error: Invalid state
         }
-        int distanceInBlock = position - nodeResult.startPosition;
+        long distanceInBlock = position - nodeResult.startPosition;
         if (isContinuationByte(sequence, foundNode, distanceInBlock) != 0) {
             ERR_PRINT("Insert failed: Attempted split at continuation byte!\n");
-            free(newInsert);
+            slabFree(&sequence->nodeAllocator, newInsert);
             return -1;
         }
-        DescriptorNode *firstPart = (DescriptorNode *)malloc(sizeof(DescriptorNode));
-        DescriptorNode *seccondPart = (DescriptorNode *)malloc(sizeof(DescriptorNode));
+        DescriptorNode *firstPart = (DescriptorNode *)slabAlloc(&sequence->nodeAllocator);
+        DescriptorNode *seccondPart = (DescriptorNode *)slabAlloc(&sequence->nodeAllocator);
         if (firstPart == NULL || seccondPart == NULL) {
             ERR_PRINT("Fatal malloc fail at insert operation!\n");
-            free(newInsert);
+            slabFree(&sequence->nodeAllocator, newInsert);
+            slabFree(&sequence->nodeAllocator, firstPart);
+            slabFree(&sequence->nodeAllocator, seccondPart);
             return -1;
         }
 
         // Save the original node for undo
-        Operation *operation = (Operation *)malloc(sizeof(Operation));
+        Operation *operation = (Operation *)slabAlloc(&sequence->operationAllocator);
         if (operation == NULL) {
             ERR_PRINT("Fatal malloc fail at insert operation!\n");
-            free(newInsert);
-            free(firstPart);
-            free(seccondPart);
+            slabFree(&sequence->nodeAllocator, newInsert);
+            slabFree(&sequence->nodeAllocator, firstPart);
+            slabFree(&sequence->nodeAllocator, seccondPart);
             return -1;
         }
         operation->first = foundNode->prev_ptr;
@@ -824,16 +1215,15 @@ ReturnCode insertUndoOption(Sequence *sequence, Position position, wchar_t *text
         operation->optimizedCaseSize = 0;        // Not used in this case
         if (previousOperation == NULL && pushOperation(sequence->undoStack, operation) == 0) {
             ERR_PRINT("Failed to push insert operation onto undo stack.\n");
-            free(newInsert);
-            free(firstPart);
-            free(seccondPart);
-            free(operation);
+            slabFree(&sequence->nodeAllocator, newInsert);
+            slabFree(&sequence->nodeAllocator, firstPart);
+            slabFree(&sequence->nodeAllocator, seccondPart);
+            slabFree(&sequence->operationAllocator, operation);
             return -1; // Error
         }
 
         // Reset the redo stack
-        freeOperationStack(sequence->redoStack);
-        sequence->redoStack = createOperationStack();
+        clearOperationStack(sequence->redoStack);
 
         // Set values for the new nodes
         firstPart->isInFileBuffer = foundNode->isInFileBuffer;
@@ -842,16 +1232,18 @@ ReturnCode insertUndoOption(Sequence *sequence, Position position, wchar_t *text
         seccondPart->isInFileBuffer = foundNode->isInFileBuffer;
         seccondPart->size = foundNode->size - distanceInBlock; // set size as inverse of first part.
         seccondPart->offset = foundNode->offset + distanceInBlock;
+        firstPart->lineBreaks = countLineBreaksInPiece(sequence, firstPart, 0, firstPart->size);
+        seccondPart->lineBreaks = foundNode->lineBreaks - firstPart->lineBreaks;
 
         // Update the piece table
         firstPart->next_ptr = newInsert;
         firstPart->prev_ptr = foundNode->prev_ptr;
-        foundNode->prev_ptr->next_ptr = firstPart;
         newInsert->next_ptr = seccondPart;
         newInsert->prev_ptr = firstPart;
         seccondPart->next_ptr = foundNode->next_ptr;
         seccondPart->prev_ptr = newInsert;
-        foundNode->next_ptr->prev_ptr = seccondPart;
+        replaceTrackedRange(sequence, foundNode->prev_ptr, foundNode->next_ptr, firstPart, seccondPart);
+        sequence->editsSinceCompaction++;
     }
 
     // Update statistics
@@ -889,8 +1281,8 @@ ReturnCode deleteUndoOption(Sequence *sequence, Position beginPosition, Position
         ERR_PRINT("No node found for delete at given positions!\n");
         return -1;
     }
-    int distanceInStartBlock = beginPosition - startNodeResult.startPosition;
-    int distanceInEndBlock = endPosition - endNodeResult.startPosition;
+    long distanceInStartBlock = beginPosition - startNodeResult.startPosition;
+    long distanceInEndBlock = endPosition - endNodeResult.startPosition;
     if (isContinuationByte(sequence, startNode, distanceInStartBlock) != 0 ||
         amountOfContinuationBytes(sequence, startNode, distanceInStartBlock) > endPosition - beginPosition ||
         amountOfContinuationBytes(sequence, endNode, distanceInEndBlock) > 0) {
@@ -898,11 +1290,6 @@ ReturnCode deleteUndoOption(Sequence *sequence, Position beginPosition, Position
         return -1;
     }
 
-    // Make cache invalid if necessary
-    if (beginPosition <= sequence->lastLineResult.foundPosition) {
-        sequence->lastLineResult.foundPosition = -1;
-        sequence->lastLineResult.lineNumber = -1;
-    }
     sequence->lastInsert.lastAtomicPos = -1;
     sequence->lastInsert.lastWritePos = -1;
     sequence->lastInsert.lastCharSize = -1;
@@ -911,7 +1298,7 @@ ReturnCode deleteUndoOption(Sequence *sequence, Position beginPosition, Position
     TextStatistics stats = calculateStatsEffect(sequence, startNode, distanceInStartBlock, endNode, distanceInEndBlock, getCurrentLineBidentifier());
 
     // Save the original nodes for undo
-    Operation *operation = (Operation *)malloc(sizeof(Operation));
+    Operation *operation = (Operation *)slabAlloc(&sequence->operationAllocator);
     if (operation == NULL) {
         ERR_PRINT("Fatal malloc fail at delete operation!\n");
         return -1; // Error
@@ -927,22 +1314,23 @@ ReturnCode deleteUndoOption(Sequence *sequence, Position beginPosition, Position
     operation->optimizedCaseSize = 0;        // Not used in this case
     if (previousOperation == NULL && pushOperation(sequence->undoStack, operation) == 0) {
         ERR_PRINT("Failed to push delete operation onto undo stack.\n");
-        free(operation);
+        slabFree(&sequence->operationAllocator, operation);
         return -1; // Error
     }
 
     // Reset the redo stack
-    freeOperationStack(sequence->redoStack);
-    sequence->redoStack = createOperationStack();
+    clearOperationStack(sequence->redoStack);
 
     // Determine the new start node after deletion
+    DescriptorNode *boundaryBefore = startNode->prev_ptr;
+    DescriptorNode *boundaryAfter = endNode->next_ptr;
     DescriptorNode *newStartNode;
     if (distanceInStartBlock == 0) {
         // Deletion includes the first character of the start node => use previous node instead
-        newStartNode = startNode->prev_ptr;
+        newStartNode = boundaryBefore;
     } else {
         // Create a new node which includes everything up to the beginning of the deletion
-        newStartNode = (DescriptorNode *)malloc(sizeof(DescriptorNode));
+        newStartNode = (DescriptorNode *)slabAlloc(&sequence->nodeAllocator);
         if (newStartNode == NULL) {
             ERR_PRINT("Fatal malloc fail at delete operation!\n");
             return -1;
@@ -950,19 +1338,18 @@ ReturnCode deleteUndoOption(Sequence *sequence, Position beginPosition, Position
         newStartNode->isInFileBuffer = startNode->isInFileBuffer;
         newStartNode->offset = startNode->offset;
         newStartNode->size = distanceInStartBlock;
-        newStartNode->prev_ptr = startNode->prev_ptr;
-        startNode->prev_ptr->next_ptr = newStartNode;
-        startNode = newStartNode;
+        newStartNode->lineBreaks = countLineBreaksInPiece(sequence, newStartNode, 0, newStartNode->size);
+        newStartNode->prev_ptr = boundaryBefore;
     }
 
     // Determine the new end node after deletion
     DescriptorNode *newEndNode;
     if (distanceInEndBlock + 1 == endNode->size) {
         // Deletion includes the last character of the end node => use next node instead
-        newEndNode = endNode->next_ptr;
+        newEndNode = boundaryAfter;
     } else {
         // Create a new node which includes everything after the end of the deletion
-        newEndNode = (DescriptorNode *)malloc(sizeof(DescriptorNode));
+        newEndNode = (DescriptorNode *)slabAlloc(&sequence->nodeAllocator);
         if (newEndNode == NULL) {
             ERR_PRINT("Fatal malloc fail at delete operation!\n");
             return -1;
@@ -970,12 +1357,19 @@ ReturnCode deleteUndoOption(Sequence *sequence, Position beginPosition, Position
         newEndNode->isInFileBuffer = endNode->isInFileBuffer;
         newEndNode->offset = endNode->offset + distanceInEndBlock + 1;
         newEndNode->size = endNode->size - distanceInEndBlock - 1;
-        newEndNode->next_ptr = endNode->next_ptr;
-        endNode->next_ptr->prev_ptr = newEndNode;
+        newEndNode->lineBreaks = countLineBreaksInPiece(sequence, newEndNode, 0, newEndNode->size);
+        newEndNode->next_ptr = boundaryAfter;
     }
 
-    newStartNode->next_ptr = newEndNode;
-    newEndNode->prev_ptr = newStartNode;
+    // Link the remaining parts (if any) and update the piece table
+    if (newStartNode != boundaryBefore && newEndNode != boundaryAfter) {
+        newStartNode->next_ptr = newEndNode;
+        newEndNode->prev_ptr = newStartNode;
+    }
+    DescriptorNode *segmentFirst = (newStartNode != boundaryBefore) ? newStartNode : newEndNode;
+    DescriptorNode *segmentLast = (newEndNode != boundaryAfter) ? newEndNode : newStartNode;
+    replaceTrackedRange(sequence, boundaryBefore, boundaryAfter, segmentFirst, segmentLast);
+    sequence->editsSinceCompaction++;
 
     // Update statistics
     sequence->wordCount -= stats.totalWords;
@@ -995,12 +1389,6 @@ SearchResult find(Sequence *sequence, wchar_t *textToFind, Position startPositio
         return result; // Error
     }
 
-    NodeResult startNode = getNodeForPosition(sequence, startPosition);
-    if (startNode.node == NULL || wcslen(textToFind) == 0) {
-        ERR_PRINT("Position %d out of bounds or empty search text for find.\n", startPosition);
-        return result;
-    }
-
     // Convert wcstring to UTF-8
     size_t needleLength = getUtf8ByteSize(textToFind);
     Atomic *needle = malloc(needleLength * sizeof(Atomic));
@@ -1008,59 +1396,542 @@ SearchResult find(Sequence *sequence, wchar_t *textToFind, Position startPositio
         ERR_PRINT("Error: Memory allocation failed for needle.\n");
         return result;
     }
-    wcstombs(needle, textToFind, needleLength);
+    wcstombs((char *)needle, textToFind, needleLength);
 
-    Position currentPosition = startPosition;
-    DescriptorNode *currNode = startNode.node;
-    Atomic *data = currNode->isInFileBuffer ? sequence->fileBuffer.data : sequence->addBuffer.data;
-    int offsetInNode = startPosition - startNode.startPosition;
-    int endTraversed = 0;      // Flag to indicate if the end of the piece table has been reached
-    int countedLineBreaks = 0; // Keep track of line breaks on the way
-    LineBidentifier lineBreakId = getCurrentLineBidentifier();
-
-    // Search until we are back at the start position
-    while (!endTraversed || currentPosition < startPosition) {
-        // Go back to the beginning of the piece table if the end was reached
-        if (currNode == sequence->pieceTable.last) {
-            DEBG_PRINT("Find has reached the end of the piece table, going back to start.\n");
-            endTraversed = 1;
-            currentPosition = 0;
-            countedLineBreaks = 0;
-            offsetInNode = 0;
-            currNode = sequence->pieceTable.first->next_ptr;
-            data = currNode->isInFileBuffer ? sequence->fileBuffer.data : sequence->addBuffer.data;
-            continue;
-        }
+    result.foundPosition = findNeedle(sequence, needle, needleLength, startPosition, true);
+    if (result.foundPosition != -1) {
+        result.lineNumber = getLineNumber(sequence, result.foundPosition); // Cheap thanks to the line break index
+    }
+    free(needle);
+    return result;
+}
 
-        // Check if the current node contains a match
-        while (offsetInNode < currNode->size) {
-            if (data[currNode->offset + offsetInNode] == lineBreakId) {
-                countedLineBreaks++;
-            }
-            if (textMatchesBuffer(sequence, currNode, offsetInNode, needle, needleLength)) { // Match found
-                result.foundPosition = currentPosition;
-                if (endTraversed || startPosition == 0) {
-                    result.lineNumber = countedLineBreaks + 1; // We can assume that there exists at least one line, otherwise there will be no match
-                } else {
-                    // We only have to get the line number before startPosition (which is faster to do)
-                    result.lineNumber = getLineNumber(sequence, startPosition - 1) + countedLineBreaks;
-                }
-                // Update cached last line result
-                sequence->lastLineResult.foundPosition = result.foundPosition;
-                sequence->lastLineResult.lineNumber = result.lineNumber;
-                return result;
-            }
-            currentPosition++;
-            offsetInNode++;
-        }
+/**
+ * Returns the position of the first occurrence of the UTF-8 needle at or after startPosition, or -1 if there is none.
+ * With wrapAround the search continues at the beginning of the sequence up to startPosition.
+ */
+Position findNeedle(Sequence *sequence, Atomic *needle, size_t needleLength, Position startPosition, bool wrapAround) {
+    Position totalSize = (Position)getCurrentTotalSize(sequence);
+    if (startPosition > totalSize || needleLength == 0) {
+        ERR_PRINT("Position %ld out of bounds or empty search text for find.\n", startPosition);
+        return -1;
+    }
 
-        // Otherwise move to the next node
-        currNode = currNode->next_ptr;
-        data = currNode->isInFileBuffer ? sequence->fileBuffer.data : sequence->addBuffer.data;
-        offsetInNode = 0; // Reset offset for the next node
+    requestTrigramIndex(sequence);
+    const uint64_t *candidates = getTrigramCandidates(sequence, needle, needleLength); // NULL until the index is built
+    if (candidates != NULL) {
+        Position found = findNeedleInRangeIndexed(sequence, needle, needleLength, startPosition, totalSize, candidates);
+        if (found == -1 && wrapAround && startPosition > 0) {
+            found = findNeedleInRangeIndexed(sequence, needle, needleLength, 0, startPosition, candidates);
+        }
+        return found;
     }
 
-    return result; // No match found
+    Position found = findNeedleInRangeParallel(sequence, needle, needleLength, startPosition, totalSize);
+    if (found == -1 && wrapAround && startPosition > 0) {
+        DEBG_PRINT("Find has reached the end of the piece table, going back to start.\n");
+        found = findNeedleInRangeParallel(sequence, needle, needleLength, 0, startPosition);
+    }
+    return found;
+}
+
+SearchResult findPrevious(Sequence *sequence, wchar_t *textToFind, Position startPosition) {
+    SearchResult result = {-1, -1};
+    if (sequence == NULL || textToFind == NULL || startPosition < 0) {
+        ERR_PRINT("findPrevious called with invalid sequence, textToFind, or startPosition.\n");
+        return result;
+    }
+
+    size_t needleLength = getUtf8ByteSize(textToFind);
+    Atomic *needle = malloc(needleLength * sizeof(Atomic));
+    if (needle == NULL) {
+        ERR_PRINT("Error: Memory allocation failed for needle.\n");
+        return result;
+    }
+    wcstombs((char *)needle, textToFind, needleLength);
+
+    result.foundPosition = findNeedleBackward(sequence, needle, needleLength, startPosition, true);
+    if (result.foundPosition != -1) {
+        result.lineNumber = getLineNumber(sequence, result.foundPosition);
+    }
+    free(needle);
+    return result;
+}
+
+/**
+ * Returns the position of the last occurrence of the UTF-8 needle which starts before startPosition, or -1 if there is none.
+ * With wrapAround the search continues at the end of the sequence down to startPosition.
+ */
+Position findNeedleBackward(Sequence *sequence, Atomic *needle, size_t needleLength, Position startPosition, bool wrapAround) {
+    Position totalSize = (Position)getCurrentTotalSize(sequence);
+    if (startPosition > totalSize || needleLength == 0) {
+        ERR_PRINT("Position %ld out of bounds or empty search text for findPrevious.\n", startPosition);
+        return -1;
+    }
+
+    Position found = findNeedleInRangeBackward(sequence, needle, needleLength, 0, startPosition);
+    if (found == -1 && wrapAround && startPosition < totalSize) {
+        DEBG_PRINT("findPrevious has reached the start of the piece table, going back to the end.\n");
+        found = findNeedleInRangeBackward(sequence, needle, needleLength, startPosition, totalSize);
+    }
+    return found;
+}
+
+/**
+ * Returns the last match of the needle which starts in [from, to) (it may extend beyond to), or -1.
+ * The pieces are walked backward from to (prev_ptr), so the cost only depends on the distance to the match.
+ */
+static Position findNeedleInRangeBackward(Sequence *sequence, Atomic *needle, size_t needleLength, Position from, Position to) {
+    if (from >= to) {
+        return -1;
+    }
+    NodeResult endNode = getNodeForPosition(sequence, to - 1);
+    if (endNode.node == NULL) {
+        return -1;
+    }
+    DescriptorNode *currNode = endNode.node;
+    Position nodeStart = endNode.startPosition;
+
+    while (currNode != sequence->pieceTable.first) {
+        // Starts inside this node which belong to the range: [lowOffset, highOffset)
+        unsigned long lowOffset = from > nodeStart ? (unsigned long)(from - nodeStart) : 0;
+        unsigned long highOffset = to - nodeStart < (Position)currNode->size ? (unsigned long)(to - nodeStart) : currNode->size;
+
+        // Matches crossing into the next node start behind all matches inside the node, check them first
+        unsigned long crossingStart = currNode->size >= needleLength ? currNode->size - needleLength + 1 : 0;
+        for (unsigned long offset = highOffset; offset > lowOffset && offset > crossingStart; offset--) {
+            if (textMatchesBuffer(sequence, currNode, offset - 1, needle, needleLength)) {
+                return nodeStart + (Position)(offset - 1);
+            }
+        }
+
+        if (lowOffset < crossingStart) {
+            unsigned long blockEnd = highOffset + needleLength - 1 < currNode->size ? highOffset + needleLength - 1 : currNode->size;
+            Atomic *data = currNode->isInFileBuffer ? sequence->fileBuffer.data : sequence->addBuffer.data;
+            long found = searchBlockReverse(data + currNode->offset + lowOffset, blockEnd - lowOffset, needle, needleLength);
+            if (found != -1) {
+                return nodeStart + (Position)lowOffset + found;
+            }
+        }
+
+        if (nodeStart <= from) {
+            break;
+        }
+        currNode = currNode->prev_ptr;
+        nodeStart -= (Position)currNode->size;
+    }
+
+    return -1; // No match found
+}
+
+SearchResult findIgnoringCase(Sequence *sequence, wchar_t *textToFind, Position startPosition) {
+    return findFolded(sequence, textToFind, startPosition, false);
+}
+
+SearchResult findPreviousIgnoringCase(Sequence *sequence, wchar_t *textToFind, Position startPosition) {
+    return findFolded(sequence, textToFind, startPosition, true);
+}
+
+/**
+ * Returns the first (or last) match in text[0, length) which starts before startLimit, or -1.
+ */
+static long searchFoldedStarts(const Atomic *text, size_t length, size_t startLimit, const FoldedNeedle *needle, bool last) {
+    long lastFound = -1;
+    size_t from = 0;
+    while (from < startLimit) {
+        long found = searchBlockFolded(text + from, length - from, needle, NULL);
+        if (found == -1 || from + (size_t)found >= startLimit) {
+            break;
+        }
+        if (!last) {
+            return (long)from + found;
+        }
+        lastFound = (long)from + found;
+        from = (size_t)lastFound + 1;
+    }
+    return lastFound;
+}
+
+/**
+ * Copies the node from offsetInNode on and up to followingLength atomics of the following nodes into the buffer.
+ * Returns the amount of copied atomics.
+ */
+static size_t gatherCrossingText(Sequence *sequence, DescriptorNode *node, unsigned long offsetInNode, Atomic *buffer, size_t followingLength) {
+    Atomic *data = node->isInFileBuffer ? sequence->fileBuffer.data : sequence->addBuffer.data;
+    size_t length = node->size - offsetInNode;
+    memcpy(buffer, data + node->offset + offsetInNode, length);
+    for (DescriptorNode *next = node->next_ptr; followingLength > 0 && next != sequence->pieceTable.last; next = next->next_ptr) {
+        size_t part = next->size < followingLength ? next->size : followingLength;
+        data = next->isInFileBuffer ? sequence->fileBuffer.data : sequence->addBuffer.data;
+        memcpy(buffer + length, data + next->offset, part);
+        length += part;
+        followingLength -= part;
+    }
+    return length;
+}
+
+/**
+ * Returns the offset of the first (backward: last) case-insensitive match which starts in node[lowOffset, highOffset), or -1.
+ * Matches which may cross into the following nodes are searched in a copy of the text around the boundary.
+ */
+static long findFoldedInPiece(Sequence *sequence, DescriptorNode *node, unsigned long lowOffset, unsigned long highOffset,
+                              const FoldedNeedle *needle, Atomic *crossingBuffer, bool backward) {
+    size_t maxLength = getFoldedNeedleMaxMatchLength(needle);
+    Atomic *data = (node->isInFileBuffer ? sequence->fileBuffer.data : sequence->addBuffer.data) + node->offset;
+    unsigned long crossingStart = node->size >= maxLength ? node->size - maxLength + 1 : 0;
+    if (crossingStart < lowOffset) {
+        crossingStart = lowOffset;
+    }
+
+    long crossing = -1;
+    if (crossingStart < highOffset) {
+        size_t length = gatherCrossingText(sequence, node, crossingStart, crossingBuffer, maxLength - 1);
+        crossing = searchFoldedStarts(crossingBuffer, length, highOffset - crossingStart, needle, backward);
+        if (crossing != -1) {
+            crossing += (long)crossingStart;
+        }
+    }
+
+    if (!backward) {
+        // A longer match crossing the boundary can start before a match inside the node
+        unsigned long blockEnd = highOffset + maxLength - 1 < node->size ? highOffset + maxLength - 1 : node->size;
+        long inside = searchFoldedStarts(data + lowOffset, blockEnd - lowOffset, highOffset - lowOffset, needle, false);
+        if (inside != -1 && (crossing == -1 || (long)lowOffset + inside < crossing)) {
+            return (long)lowOffset + inside;
+        }
+        return crossing;
+    }
+
+    // The copy covers all starts from crossingStart on, earlier starts are searched window by window towards lowOffset
+    if (crossing != -1) {
+        return crossing;
+    }
+    unsigned long windowHigh = highOffset < crossingStart ? highOffset : crossingStart;
+    while (windowHigh > lowOffset) {
+        unsigned long windowLow = windowHigh - lowOffset > FOLDED_WINDOW_SIZE ? windowHigh - FOLDED_WINDOW_SIZE : lowOffset;
+        unsigned long blockEnd = windowHigh + maxLength - 1 < node->size ? windowHigh + maxLength - 1 : node->size;
+        long found = searchFoldedStarts(data + windowLow, blockEnd - windowLow, windowHigh - windowLow, needle, true);
+        if (found != -1) {
+            return (long)windowLow + found;
+        }
+        windowHigh = windowLow;
+    }
+    return -1;
+}
+
+/**
+ * Returns the first (backward: last) case-insensitive match which starts in [from, to), or -1.
+ */
+static Position findFoldedInRange(Sequence *sequence, const FoldedNeedle *needle, Position from, Position to, Atomic *crossingBuffer, bool backward) {
+    if (from >= to) {
+        return -1;
+    }
+    NodeResult startNode = getNodeForPosition(sequence, backward ? to - 1 : from);
+    if (startNode.node == NULL) {
+        return -1;
+    }
+    DescriptorNode *currNode = startNode.node;
+    Position nodeStart = startNode.startPosition;
+
+    while (currNode != sequence->pieceTable.first && currNode != sequence->pieceTable.last) {
+        unsigned long lowOffset = from > nodeStart ? (unsigned long)(from - nodeStart) : 0;
+        unsigned long highOffset = to - nodeStart < (Position)currNode->size ? (unsigned long)(to - nodeStart) : currNode->size;
+        long found = findFoldedInPiece(sequence, currNode, lowOffset, highOffset, needle, crossingBuffer, backward);
+        if (found != -1) {
+            return nodeStart + (Position)found;
+        }
+
+        if (backward) {
+            if (nodeStart <= from) {
+                break;
+            }
+            currNode = currNode->prev_ptr;
+            nodeStart -= (Position)currNode->size;
+        } else {
+            nodeStart += (Position)currNode->size;
+            if (nodeStart >= to) {
+                break;
+            }
+            currNode = currNode->next_ptr;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Shared implementation of findIgnoringCase() and findPreviousIgnoringCase().
+ */
+static SearchResult findFolded(Sequence *sequence, wchar_t *textToFind, Position startPosition, bool backward) {
+    SearchResult result = {-1, -1};
+    Position totalSize = sequence != NULL ? (Position)getCurrentTotalSize(sequence) : 0;
+    if (sequence == NULL || textToFind == NULL || startPosition < 0 || startPosition > totalSize) {
+        ERR_PRINT("Case-insensitive find called with invalid sequence, textToFind, or startPosition.\n");
+        return result;
+    }
+
+    size_t needleLength = getUtf8ByteSize(textToFind);
+    Atomic *utf8Needle = malloc(needleLength * sizeof(Atomic));
+    if (utf8Needle == NULL) {
+        ERR_PRINT("Error: Memory allocation failed for needle.\n");
+        return result;
+    }
+    wcstombs((char *)utf8Needle, textToFind, needleLength);
+    FoldedNeedle *needle = prepareFoldedNeedle(utf8Needle, needleLength);
+    free(utf8Needle);
+    if (needle == NULL) {
+        ERR_PRINT("Empty or invalid search text for case-insensitive find.\n");
+        return result;
+    }
+    Atomic *crossingBuffer = malloc(2 * getFoldedNeedleMaxMatchLength(needle));
+    if (crossingBuffer == NULL) {
+        ERR_PRINT("Error: Memory allocation failed for case-insensitive find.\n");
+        freeFoldedNeedle(needle);
+        return result;
+    }
+
+    // Forward: [start, end) then [0, start), backward: [0, start) then [start, end)
+    if (backward) {
+        result.foundPosition = findFoldedInRange(sequence, needle, 0, startPosition, crossingBuffer, true);
+        if (result.foundPosition == -1) {
+            result.foundPosition = findFoldedInRange(sequence, needle, startPosition, totalSize, crossingBuffer, true);
+        }
+    } else {
+        result.foundPosition = findFoldedInRange(sequence, needle, startPosition, totalSize, crossingBuffer, false);
+        if (result.foundPosition == -1) {
+            result.foundPosition = findFoldedInRange(sequence, needle, 0, startPosition, crossingBuffer, false);
+        }
+    }
+    if (result.foundPosition != -1) {
+        result.lineNumber = getLineNumber(sequence, result.foundPosition);
+    }
+    free(crossingBuffer);
+    freeFoldedNeedle(needle);
+    return result;
+}
+
+/**
+ * Returns the first match of the needle which starts in [from, to) (it may extend beyond to), or -1.
+ * If abortBelow is given, the search stops early (returning -1) once it holds a position smaller than from.
+ */
+static Position findNeedleInRange(Sequence *sequence, Atomic *needle, size_t needleLength, Position from, Position to, Position *abortBelow) {
+    NodeResult startNode = getNodeForPosition(sequence, from);
+    if (startNode.node == NULL) {
+        return -1;
+    }
+    DescriptorNode *currNode = startNode.node;
+    unsigned long offsetInNode = from - startNode.startPosition;
+    Position currentPosition = from;
+
+    while (currentPosition < to && currNode != sequence->pieceTable.last) {
+        if (abortBelow != NULL && __atomic_load_n(abortBelow, __ATOMIC_RELAXED) < from) {
+            return -1; // A worker with an earlier range already found a match
+        }
+
+        // Search the part of the node in which matches may start (at most SEARCH_STEP_SIZE at once to check for aborts)
+        unsigned long remaining = currNode->size - offsetInNode;
+        unsigned long startsInNode = (unsigned long)(to - currentPosition) < remaining ? (unsigned long)(to - currentPosition) : remaining;
+        if (abortBelow != NULL && startsInNode > SEARCH_STEP_SIZE) {
+            startsInNode = SEARCH_STEP_SIZE;
+        }
+        unsigned long blockLength = startsInNode + needleLength - 1 < remaining ? startsInNode + needleLength - 1 : remaining;
+        Atomic *data = currNode->isInFileBuffer ? sequence->fileBuffer.data : sequence->addBuffer.data;
+        long found = searchBlock(data + currNode->offset + offsetInNode, blockLength, needle, needleLength);
+        if (found != -1) {
+            return currentPosition + found;
+        }
+
+        // Only matches crossing into the next node need the node walk
+        unsigned long crossingStart = currNode->size >= needleLength ? currNode->size - needleLength + 1 : 0;
+        for (unsigned long offset = crossingStart > offsetInNode ? crossingStart : offsetInNode; offset < offsetInNode + startsInNode; offset++) {
+            if (textMatchesBuffer(sequence, currNode, offset, needle, needleLength)) { // Match found
+                return currentPosition + (Position)(offset - offsetInNode);
+            }
+        }
+
+        currentPosition += startsInNode;
+        offsetInNode += startsInNode;
+        if (offsetInNode == currNode->size) {
+            currNode = currNode->next_ptr;
+            offsetInNode = 0;
+        }
+    }
+
+    return -1; // No match found
+}
+
+/**
+ * Same as findNeedleInRange(), but inside pieces of the file buffer only the blocks marked in candidates (see
+ * getTrigramCandidates()) are scanned. Pieces of the add buffer and matches crossing pieces are checked as usual.
+ */
+static Position findNeedleInRangeIndexed(Sequence *sequence, Atomic *needle, size_t needleLength, Position from, Position to, const uint64_t *candidates) {
+    NodeResult startNode = getNodeForPosition(sequence, from);
+    if (startNode.node == NULL) {
+        return -1;
+    }
+    DescriptorNode *currNode = startNode.node;
+    unsigned long offsetInNode = from - startNode.startPosition;
+    Position currentPosition = from;
+
+    while (currentPosition < to && currNode != sequence->pieceTable.last) {
+        unsigned long remaining = currNode->size - offsetInNode;
+        unsigned long startsInNode = (unsigned long)(to - currentPosition) < remaining ? (unsigned long)(to - currentPosition) : remaining;
+        unsigned long pieceEnd = currNode->offset + currNode->size; // in the buffer
+
+        if (currNode->isInFileBuffer) {
+            // Matches start in [first, last) of the file buffer, only scan the candidate blocks of this range
+            unsigned long first = currNode->offset + offsetInNode;
+            unsigned long last = first + startsInNode;
+            for (unsigned long block = first / TRIGRAM_BLOCK_SIZE; block * TRIGRAM_BLOCK_SIZE < last; block++) {
+                if (candidates[block / 64] == 0) {
+                    block |= 63; // Skip a whole word without candidates
+                    continue;
+                }
+                if (!(candidates[block / 64] & ((uint64_t)1 << (block % 64)))) {
+                    continue;
+                }
+                unsigned long scanStart = block * TRIGRAM_BLOCK_SIZE > first ? block * TRIGRAM_BLOCK_SIZE : first;
+                unsigned long scanStarts = ((block + 1) * TRIGRAM_BLOCK_SIZE < last ? (block + 1) * TRIGRAM_BLOCK_SIZE : last) - scanStart;
+                unsigned long scanLength = scanStart + scanStarts + needleLength - 1 < pieceEnd ? scanStarts + needleLength - 1 : pieceEnd - scanStart;
+                long found = searchBlock(sequence->fileBuffer.data + scanStart, scanLength, needle, needleLength);
+                if (found != -1) {
+                    return currentPosition + (Position)(scanStart - first) + found;
+                }
+            }
+        } else {
+            unsigned long blockLength = startsInNode + needleLength - 1 < remaining ? startsInNode + needleLength - 1 : remaining;
+            long found = searchBlock(sequence->addBuffer.data + currNode->offset + offsetInNode, blockLength, needle, needleLength);
+            if (found != -1) {
+                return currentPosition + found;
+            }
+        }
+
+        // Only matches crossing into the next node need the node walk
+        unsigned long crossingStart = currNode->size >= needleLength ? currNode->size - needleLength + 1 : 0;
+        for (unsigned long offset = crossingStart > offsetInNode ? crossingStart : offsetInNode; offset < offsetInNode + startsInNode; offset++) {
+            if (textMatchesBuffer(sequence, currNode, offset, needle, needleLength)) {
+                return currentPosition + (Position)(offset - offsetInNode);
+            }
+        }
+
+        currentPosition += startsInNode;
+        offsetInNode += startsInNode;
+        if (offsetInNode == currNode->size) {
+            currNode = currNode->next_ptr;
+            offsetInNode = 0;
+        }
+    }
+
+    return -1; // No match found
+}
+
+/**
+ * Moves the scanner forward by the given amount of atomics (stops at the end of the sequence).
+ */
+static void advanceMatchScanner(Sequence *sequence, MatchScanner *scanner, unsigned long amount) {
+    scanner->position += amount;
+    while (amount > 0 && scanner->node != sequence->pieceTable.last) {
+        unsigned long remaining = scanner->node->size - scanner->offsetInNode;
+        if (amount < remaining) {
+            scanner->offsetInNode += amount;
+            return;
+        }
+        amount -= remaining;
+        scanner->node = scanner->node->next_ptr;
+        scanner->offsetInNode = 0;
+    }
+}
+
+/**
+ * Returns the position of the next match at or after the scanner and moves the scanner right behind it, or -1 at the end.
+ * Repeated calls visit every piece only once (no lookups in the piece index), which makes replace-all a single sweep.
+ */
+static Position nextNeedleMatch(Sequence *sequence, MatchScanner *scanner, Atomic *needle, size_t needleLength) {
+    while (scanner->node != sequence->pieceTable.last) {
+        DescriptorNode *currNode = scanner->node;
+        unsigned long offsetInNode = scanner->offsetInNode;
+        Atomic *data = currNode->isInFileBuffer ? sequence->fileBuffer.data : sequence->addBuffer.data;
+
+        long found = searchBlock(data + currNode->offset + offsetInNode, currNode->size - offsetInNode, needle, needleLength);
+        if (found == -1) {
+            // Only matches crossing into the next node need the node walk
+            unsigned long crossingStart = currNode->size >= needleLength ? currNode->size - needleLength + 1 : 0;
+            for (unsigned long offset = crossingStart > offsetInNode ? crossingStart : offsetInNode; offset < currNode->size; offset++) {
+                if (textMatchesBuffer(sequence, currNode, offset, needle, needleLength)) {
+                    found = (long)(offset - offsetInNode);
+                    break;
+                }
+            }
+        }
+
+        if (found != -1) {
+            Position matchPosition = scanner->position + found;
+            advanceMatchScanner(sequence, scanner, (unsigned long)found + needleLength);
+            return matchPosition;
+        }
+        advanceMatchScanner(sequence, scanner, currNode->size - offsetInNode);
+    }
+    return -1;
+}
+
+/* Work of one search thread, see findNeedleInRangeParallel() */
+typedef struct {
+    Sequence *sequence;
+    Atomic *needle;
+    size_t needleLength;
+    Position from;
+    Position to;
+    Position *bestFound; // smallest match of all workers so far (shared)
+} SearchJob;
+
+static void *searchWorker(void *argument) {
+    SearchJob *job = (SearchJob *)argument;
+    Position found = findNeedleInRange(job->sequence, job->needle, job->needleLength, job->from, job->to, job->bestFound);
+    if (found != -1) {
+        // Keep the smallest match, later ranges can finish first
+        Position best = __atomic_load_n(job->bestFound, __ATOMIC_RELAXED);
+        while (found < best && !__atomic_compare_exchange_n(job->bestFound, &best, found, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Same as findNeedleInRange(), large ranges are split into consecutive parts which are searched by a pool of threads.
+ * Each part only contains match starts, so matches overlapping into the next part are still found.
+ */
+static Position findNeedleInRangeParallel(Sequence *sequence, Atomic *needle, size_t needleLength, Position from, Position to) {
+    long workers = _searchWorkers > 0 ? _searchWorkers : sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers > SEARCH_MAX_WORKERS) {
+        workers = SEARCH_MAX_WORKERS;
+    }
+    if ((to - from) / SEARCH_MIN_BYTES_PER_WORKER < workers) {
+        workers = (to - from) / SEARCH_MIN_BYTES_PER_WORKER;
+    }
+    if (workers <= 1) {
+        return findNeedleInRange(sequence, needle, needleLength, from, to, NULL);
+    }
+
+    pthread_t threads[SEARCH_MAX_WORKERS];
+    SearchJob jobs[SEARCH_MAX_WORKERS];
+    bool started[SEARCH_MAX_WORKERS];
+    Position bestFound = INT64_MAX;
+    Position partSize = (to - from + workers - 1) / workers;
+    for (long i = 0; i < workers; i++) {
+        Position partFrom = from + i * partSize;
+        jobs[i] = (SearchJob){sequence, needle, needleLength, partFrom, partFrom + partSize < to ? partFrom + partSize : to, &bestFound};
+        started[i] = i > 0 && pthread_create(&threads[i], NULL, searchWorker, &jobs[i]) == 0;
+        if (i > 0 && !started[i]) {
+            searchWorker(&jobs[i]); // No thread available, search the part right away
+        }
+    }
+    searchWorker(&jobs[0]); // The calling thread takes the first part
+    for (long i = 1; i < workers; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    return bestFound != INT64_MAX ? bestFound : -1;
 }
 
 SearchResult findAndReplace(Sequence *sequence, wchar_t *textToFind, wchar_t *textToReplace, Position startPosition) {
@@ -1068,7 +1939,7 @@ SearchResult findAndReplace(Sequence *sequence, wchar_t *textToFind, wchar_t *te
     
     if (result.foundPosition != -1) {
         if (replaceUndoOption(sequence, textToReplace, result.foundPosition, result.foundPosition + getUtf8ByteSize(textToFind) - 1, NULL) == 1) {
-            DEBG_PRINT("Found and replaced '%ls' with '%ls' at position %d.\n", textToFind, textToReplace, result.foundPosition);
+            DEBG_PRINT("Found and replaced '%ls' with '%ls' at position %ld.\n", textToFind, textToReplace, result.foundPosition);
             return result; // Return the search result with the found position and line number
         } else {
             ERR_PRINT("Replace failed after find.\n");
@@ -1082,46 +1953,103 @@ SearchResult findAndReplace(Sequence *sequence, wchar_t *textToFind, wchar_t *te
 SearchResult findAndReplaceAll(Sequence *sequence, wchar_t *textToFind, wchar_t *textToReplace, Position startPosition) {
     SearchResult result = {-1, -1}; // Initialize with invalid values
 
-    if (sequence == NULL || textToFind == NULL || textToReplace == NULL || startPosition < 0) {
+    if (sequence == NULL || textToFind == NULL || textToReplace == NULL || startPosition < 0 || wcslen(textToFind) == 0) {
         ERR_PRINT("findAndReplaceAll called with invalid sequence, textToFind, textToReplace, or startPosition.\n");
         return result; // Error
     }
 
-    Position currentPosition = 0;
-    SearchResult lastResult = find(sequence, textToFind, currentPosition);
-    Operation *previousOperation = NULL;
-    int shiftAmount = getUtf8ByteSize(textToReplace) - getUtf8ByteSize(textToFind); // Used for correcting old positions after replacements
-
-    // Continue replacing until we went through the whole sequence or no more matches are found (i.e. foundPosition is -1)
-    while (lastResult.foundPosition >= currentPosition) {
+    // Convert wcstring to UTF-8
+    size_t needleLength = getUtf8ByteSize(textToFind);
+    Atomic *needle = malloc(needleLength * sizeof(Atomic));
+    if (needle == NULL) {
+        ERR_PRINT("Error: Memory allocation failed for needle.\n");
+        return result;
+    }
+    wcstombs((char *)needle, textToFind, needleLength);
 
-        // Replace the found text with the new text
-        if (replaceUndoOption(sequence, textToReplace, lastResult.foundPosition, lastResult.foundPosition + getUtf8ByteSize(textToFind) - 1, previousOperation) == 1) {
-            DEBG_PRINT("Replaced '%ls' with '%ls' at position %d.\n", textToFind, textToReplace, lastResult.foundPosition);
-            currentPosition = lastResult.foundPosition + getUtf8ByteSize(textToReplace); // Move past the replaced text
-            previousOperation = getOperation(sequence->undoStack); // Get the last operation for linking to the next one
+    // The replacement is written only once, all replaced pieces reference the same atomics of the add buffer
+    Size replaceLength = 0;
+    Position replaceOffset = 0;
+    if (wcslen(textToReplace) > 0) {
+        replaceOffset = writeToAddBuffer(sequence, textToReplace, &replaceLength);
+    }
+    Position shiftAmount = replaceLength - (Position)needleLength; // Used for correcting old positions after replacements
 
-            if (result.foundPosition == -1 && lastResult.foundPosition >= startPosition) {
-                // Save result if this is the first replacement after the character at the original start position
-                result.foundPosition = lastResult.foundPosition;
-                result.lineNumber = lastResult.lineNumber; 
-            } else {
-                // Change start position because the positions have been shifted by the replacement
-                startPosition += shiftAmount;
-            }
+    // Collect all matches and apply them as one transaction, i.e. a single undo entry
+    if (replaceOffset < 0 || beginEdit(sequence) == -1) {
+        ERR_PRINT("findAndReplaceAll failed to prepare the replacement.\n");
+        free(needle);
+        return result;
+    }
 
-        } else {
-            ERR_PRINT("Replace failed after find.\n");
-            return result; // Error
+    // One sweep over the pieces collects all matches (positions in the unchanged text)
+    MatchScanner scanner = {sequence->pieceTable.first->next_ptr, 0, 0};
+    size_t replacementsBefore = 0; // Replacements in front of the result
+    Position foundPosition;
+    while ((foundPosition = nextNeedleMatch(sequence, &scanner, needle, needleLength)) != -1) {
+        if (queueWrittenEdit(sequence, foundPosition, (Size)needleLength, replaceOffset, replaceLength) == -1) {
+            ERR_PRINT("findAndReplaceAll failed to queue a replacement.\n");
+            abortEdit(sequence);
+            free(needle);
+            return result;
+        }
+        if (result.foundPosition == -1 && foundPosition >= startPosition) {
+            // Save result if this is the first replacement after the character at the original start position
+            result.foundPosition = foundPosition + (Position)replacementsBefore * shiftAmount;
+        } else if (result.foundPosition == -1) {
+            replacementsBefore++;
         }
+    }
+    free(needle);
 
-        // Find the next occurrence of the text to replace
-        lastResult = find(sequence, textToFind, currentPosition);
+    if (commitEdit(sequence) == -1) {
+        ERR_PRINT("Replace failed after find.\n");
+        result.foundPosition = -1;
+        return result; // Error
     }
-    
+    if (result.foundPosition != -1) {
+        // A replacement with an empty text can end up directly at the end of the text, which belongs to the last line
+        result.lineNumber = result.foundPosition < (Position)getCurrentTotalSize(sequence) ? getLineNumber(sequence, result.foundPosition)
+                                                                                           : getCurrentLineCount(sequence);
+    }
+    DEBG_PRINT("Replaced all '%ls' with '%ls'.\n", textToFind, textToReplace);
+
     return result;
 }
 
+Position findNeedleBetween(Sequence *sequence, const Atomic *needle, size_t needleLength, Position from, Position to) {
+    if (sequence == NULL || needle == NULL || needleLength == 0 || from < 0) {
+        ERR_PRINT("findNeedleBetween called with invalid sequence, needle or range.\n");
+        return -1;
+    }
+    Position totalSize = (Position)getCurrentTotalSize(sequence);
+    if (to > totalSize) {
+        to = totalSize;
+    }
+    return from < to ? findNeedleInRange(sequence, (Atomic *)needle, needleLength, from, to, NULL) : -1;
+}
+
+long forEachNeedleMatch(Sequence *sequence, const Atomic *needle, size_t needleLength, Position from, Position to,
+                        void (*onMatch)(Position position, void *context), void *context) {
+    if (sequence == NULL || needle == NULL || needleLength == 0 || onMatch == NULL || from < 0) {
+        ERR_PRINT("forEachNeedleMatch called with invalid sequence, needle, callback or range.\n");
+        return -1;
+    }
+    Position totalSize = (Position)getCurrentTotalSize(sequence);
+    if (to > totalSize) {
+        to = totalSize;
+    }
+
+    long amount = 0;
+    Position found;
+    while (from < to && (found = findNeedleInRange(sequence, (Atomic *)needle, needleLength, from, to, NULL)) != -1) {
+        onMatch(found, context);
+        amount++;
+        from = found + 1; // Overlapping occurrences are reported as well
+    }
+    return amount;
+}
+
 /**
  * Replace the text betweenn startPosition and endPosition with textToReplace.
  * This function is a concatenation of delete and insert operations but they are bundled together for undo.
@@ -1146,6 +2074,450 @@ ReturnCode replaceUndoOption(Sequence *sequence, wchar_t *textToReplace, Positio
     return -1; // Error
 }
 
+ReturnCode replaceUtf8(Sequence *sequence, Position beginPosition, Position endPosition, const Atomic *textToReplace, size_t byteLength) {
+    if (sequence == NULL || textToReplace == NULL || !isCompleteUtf8(textToReplace, byteLength)) {
+        ERR_PRINT("replaceUtf8 called with invalid sequence or text.\n");
+        return -1;
+    }
+    return replaceUtf8UndoOption(sequence, textToReplace, byteLength, beginPosition, endPosition, NULL);
+}
+
+/**
+ * UTF-8 version of replaceUndoOption(), the text is copied into the add buffer as is.
+ */
+ReturnCode replaceUtf8UndoOption(Sequence *sequence, const Atomic *textToReplace, size_t byteLength, Position startPosition, Position endPosition, Operation *previousOperation) {
+    ReturnCode deleteResult = deleteUndoOption(sequence, startPosition, endPosition, previousOperation);
+
+    if (deleteResult == 1) {
+        Operation *deleteOperation = getOperation(sequence->undoStack);
+        ReturnCode insertResult = insertUtf8UndoOption(sequence, startPosition, textToReplace, byteLength, deleteOperation);
+        if (insertResult == 1) {
+            return 1;
+        } else {
+            ERR_PRINT("Replace: Insert after delete failed.\n");
+            undo(sequence); // Undo the delete operation if insert fails
+        }
+    } else {
+        ERR_PRINT("Replace: Delete before insert failed.\n");
+    }
+
+    return -1; // Error
+}
+
+ReturnCode beginEdit(Sequence *sequence) {
+    if (sequence == NULL || sequence->transaction.active) {
+        ERR_PRINT("beginEdit called with invalid sequence or while a transaction is running.\n");
+        return -1;
+    }
+    sequence->transaction.amount = 0;
+    sequence->transaction.active = true;
+    return 1;
+}
+
+ReturnCode queueEdit(Sequence *sequence, Position position, Size deleteLength, const Atomic *text, size_t byteLength) {
+    if (sequence == NULL || (byteLength > 0 && text == NULL) || !isCompleteUtf8(text, byteLength)) {
+        ERR_PRINT("queueEdit called with invalid sequence or text.\n");
+        return -1;
+    }
+    Position bufferOffset = 0;
+    if (byteLength > 0) {
+        bufferOffset = writeUtf8ToAddBuffer(sequence, text, byteLength);
+        if (bufferOffset < 0) {
+            ERR_PRINT("queueEdit failed to write to the add buffer.\n");
+            return -1;
+        }
+    }
+    return queueWrittenEdit(sequence, position, deleteLength, bufferOffset, (Size)byteLength);
+}
+
+/**
+ * Queues an edit whose replacement text was already written to the add buffer (allows reusing one text for many edits).
+ */
+ReturnCode queueWrittenEdit(Sequence *sequence, Position position, Size deleteLength, Position bufferOffset, Size byteLength) {
+    EditTransaction *transaction = &sequence->transaction;
+    if (!transaction->active || position < 0 || deleteLength < 0 || byteLength < 0) {
+        ERR_PRINT("queueEdit called without transaction or with invalid position.\n");
+        return -1;
+    }
+    if (deleteLength == 0 && byteLength == 0) {
+        return 1; // Nothing to do
+    }
+
+    if (transaction->amount == transaction->capacity) {
+        size_t newCapacity = transaction->capacity == 0 ? 64 : transaction->capacity * 2;
+        PendingEdit *grown = realloc(transaction->edits, newCapacity * sizeof(PendingEdit));
+        if (grown == NULL) {
+            ERR_PRINT("Fatal malloc fail while queueing an edit!\n");
+            return -1;
+        }
+        transaction->edits = grown;
+        transaction->capacity = newCapacity;
+    }
+    transaction->edits[transaction->amount] = (PendingEdit){position, deleteLength, bufferOffset, byteLength, transaction->amount};
+    transaction->amount++;
+    return 1;
+}
+
+void abortEdit(Sequence *sequence) {
+    if (sequence != NULL) {
+        sequence->transaction.amount = 0;
+        sequence->transaction.active = false;
+    }
+}
+
+static int comparePendingEdits(const void *a, const void *b) {
+    const PendingEdit *first = (const PendingEdit *)a;
+    const PendingEdit *second = (const PendingEdit *)b;
+    if (first->position != second->position) {
+        return first->position < second->position ? -1 : 1;
+    }
+    return first->order < second->order ? -1 : (first->order > second->order);
+}
+
+static inline bool isWordSeparator(Atomic atomic) {
+    return atomic == getCurrentLineBidentifier() || atomic == ' ' || atomic == '\t';
+}
+
+/**
+ * Appends a new piece to the segment built by commitEdit(), knownLineBreaks < 0 means the line breaks still have to be counted.
+ */
+static DescriptorNode *appendCommitPiece(Sequence *sequence, CommitCursor *cursor, bool isInFileBuffer, unsigned long offset, unsigned long size, long knownLineBreaks) {
+    DescriptorNode *piece = (DescriptorNode *)slabAlloc(&sequence->nodeAllocator);
+    if (piece == NULL) {
+        ERR_PRINT("Fatal malloc fail at commitEdit!\n");
+        return NULL;
+    }
+    piece->isInFileBuffer = isInFileBuffer;
+    piece->offset = offset;
+    piece->size = size;
+    piece->lineBreaks = knownLineBreaks >= 0 ? (unsigned long)knownLineBreaks : countLineBreaksInPiece(sequence, piece, 0, size);
+    piece->next_ptr = NULL;
+    piece->prev_ptr = cursor->segmentLast;
+    if (cursor->segmentLast != NULL) {
+        cursor->segmentLast->next_ptr = piece;
+    } else {
+        cursor->segmentFirst = piece;
+    }
+    cursor->segmentLast = piece;
+
+    Atomic *data = isInFileBuffer ? sequence->fileBuffer.data : sequence->addBuffer.data;
+    cursor->lastWasSeparator = isWordSeparator(data[offset + size - 1]);
+    return piece;
+}
+
+/**
+ * Moves the cursor of commitEdit() forward to target. Passed atomics are either copied into the new segment
+ * (copy == true) or skipped as deleted, in which case only their word starts are counted.
+ */
+static ReturnCode advanceCommitCursor(Sequence *sequence, CommitCursor *cursor, Position target, bool copy) {
+    while (cursor->position < target) {
+        DescriptorNode *node = cursor->node;
+        if (node == sequence->pieceTable.last) {
+            ERR_PRINT("commitEdit ran past the end of the text.\n");
+            return -1;
+        }
+        unsigned long available = node->size - cursor->offsetInNode;
+        unsigned long step = (unsigned long)(target - cursor->position) < available ? (unsigned long)(target - cursor->position) : available;
+
+        if (copy) {
+            bool wholePiece = cursor->offsetInNode == 0 && step == node->size;
+            if (appendCommitPiece(sequence, cursor, node->isInFileBuffer, node->offset + cursor->offsetInNode, step,
+                                  wholePiece ? (long)node->lineBreaks : -1) == NULL) {
+                return -1;
+            }
+        } else {
+            Atomic *data = node->isInFileBuffer ? sequence->fileBuffer.data : sequence->addBuffer.data;
+            Atomic *first = data + node->offset + cursor->offsetInNode;
+            long indexed = step > 2 * LINE_INDEX_BLOCK_SIZE
+                               ? countWordStartsInPiece(sequence, node, cursor->offsetInNode, cursor->offsetInNode + step) : -1;
+            if (indexed >= 0) {
+                // Large deletions are counted with the line index, the first atomic may continue a deleted word
+                cursor->deletedWordStarts += indexed - (!cursor->deletedWasSeparator && !isWordSeparator(first[0]) ? 1 : 0);
+                cursor->deletedWasSeparator = isWordSeparator(first[step - 1]);
+            } else {
+                cursor->deletedWordStarts += countWordStarts(first, step, &cursor->deletedWasSeparator, getCurrentLineBidentifier());
+            }
+        }
+
+        cursor->position += step;
+        cursor->offsetInNode += step;
+        if (cursor->offsetInNode == node->size) {
+            cursor->node = node->next_ptr;
+            cursor->offsetInNode = 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Checks that the cursor of commitEdit() is not in the middle of a UTF-8 character.
+ */
+static bool commitCursorAtCharBorder(Sequence *sequence, CommitCursor *cursor) {
+    return cursor->node == sequence->pieceTable.last || isContinuationByte(sequence, cursor->node, cursor->offsetInNode) == 0;
+}
+
+/**
+ * Builds the new segment for the sorted edits of commitEdit() in one pass, starting at the cursor's piece.
+ * Afterwards the cursor is at the first piece which stays in place, wordDelta holds the change of the word count.
+ * On error the caller has to release the pieces built so far.
+ */
+static ReturnCode buildCommitSegment(Sequence *sequence, CommitCursor *cursor, PendingEdit *edits, size_t amount, long *wordDelta) {
+    *wordDelta = 0;
+    for (size_t i = 0; i < amount; i++) {
+        PendingEdit *edit = &edits[i];
+        if (advanceCommitCursor(sequence, cursor, edit->position, true) == -1 || !commitCursorAtCharBorder(sequence, cursor)) {
+            ERR_PRINT("commitEdit failed: edit at position %ld is not at a character border.\n", edit->position);
+            return -1;
+        }
+
+        // Emit the replacement, its words are counted with the text before it as left context
+        bool leftWasSeparator = cursor->lastWasSeparator;
+        bool insertedWasSeparator = leftWasSeparator;
+        long insertedWordStarts = 0;
+        if (edit->byteLength > 0) {
+            insertedWordStarts = countWordStarts(sequence->addBuffer.data + edit->bufferOffset, edit->byteLength,
+                                                 &insertedWasSeparator, getCurrentLineBidentifier());
+            if (appendCommitPiece(sequence, cursor, false, edit->bufferOffset, edit->byteLength, -1) == NULL) {
+                return -1;
+            }
+        }
+
+        // Skip the deleted atomics with the same left context
+        cursor->deletedWasSeparator = leftWasSeparator;
+        cursor->deletedWordStarts = 0;
+        if (advanceCommitCursor(sequence, cursor, edit->position + edit->deleteLength, false) == -1 ||
+            !commitCursorAtCharBorder(sequence, cursor)) {
+            ERR_PRINT("commitEdit failed: deletion at position %ld does not end at a character border.\n", edit->position);
+            return -1;
+        }
+
+        // A word right after the edit starts (or not) depending on what now comes before it
+        if (cursor->node != sequence->pieceTable.last) {
+            Atomic *data = cursor->node->isInFileBuffer ? sequence->fileBuffer.data : sequence->addBuffer.data;
+            if (!isWordSeparator(data[cursor->node->offset + cursor->offsetInNode])) {
+                insertedWordStarts += insertedWasSeparator;
+                cursor->deletedWordStarts += cursor->deletedWasSeparator;
+            }
+        }
+        *wordDelta += insertedWordStarts - cursor->deletedWordStarts;
+    }
+
+    // Copy the rest of the last touched piece, the pieces after it stay in place
+    if (cursor->offsetInNode > 0) {
+        return advanceCommitCursor(sequence, cursor, cursor->position + (Position)(cursor->node->size - cursor->offsetInNode), true);
+    }
+    return 1;
+}
+
+/**
+ * Releases the pieces built for a commit which failed before they were linked into the piece table.
+ */
+static void releaseCommitSegment(Sequence *sequence, DescriptorNode *segmentFirst) {
+    while (segmentFirst != NULL) {
+        DescriptorNode *next = segmentFirst->next_ptr;
+        slabFree(&sequence->nodeAllocator, segmentFirst);
+        segmentFirst = next;
+    }
+}
+
+ReturnCode commitEdit(Sequence *sequence) {
+    if (sequence == NULL || !sequence->transaction.active) {
+        ERR_PRINT("commitEdit called without a running transaction.\n");
+        return -1;
+    }
+    EditTransaction *transaction = &sequence->transaction;
+    PendingEdit *edits = transaction->edits;
+    size_t amount = transaction->amount;
+    transaction->active = false;
+    transaction->amount = 0;
+    if (amount == 0) {
+        return 1; // Nothing queued
+    }
+
+    // Apply the edits from front to back, all ranges have to lie inside the text and must not overlap
+    qsort(edits, amount, sizeof(PendingEdit), comparePendingEdits);
+    Position totalSize = (Position)getCurrentTotalSize(sequence);
+    for (size_t i = 0; i < amount; i++) {
+        Position editEnd = edits[i].position + edits[i].deleteLength;
+        if (editEnd > totalSize || (i + 1 < amount && editEnd > edits[i + 1].position)) {
+            ERR_PRINT("commitEdit failed: queued edits overlap or exceed the text.\n");
+            return -1;
+        }
+    }
+
+    // The new segment replaces everything from the piece of the first edit up to the piece of the last one
+    NodeResult startResult = getNodeForPosition(sequence, edits[0].position);
+    if (startResult.node == NULL) {
+        ERR_PRINT("No node found for commitEdit at position %ld.\n", edits[0].position);
+        return -1;
+    }
+    DescriptorNode *boundaryBefore = startResult.node->prev_ptr;
+    CommitCursor cursor = {startResult.node, 0, startResult.startPosition, NULL, NULL, true, true, 0};
+    if (boundaryBefore != sequence->pieceTable.first) {
+        Atomic *data = boundaryBefore->isInFileBuffer ? sequence->fileBuffer.data : sequence->addBuffer.data;
+        cursor.lastWasSeparator = isWordSeparator(data[boundaryBefore->offset + boundaryBefore->size - 1]);
+    }
+
+    long wordDelta = 0;
+    Operation *operation = NULL;
+    if (buildCommitSegment(sequence, &cursor, edits, amount, &wordDelta) == 1) {
+        operation = (Operation *)slabAlloc(&sequence->operationAllocator);
+    }
+    if (operation == NULL) {
+        releaseCommitSegment(sequence, cursor.segmentFirst);
+        return -1;
+    }
+    DescriptorNode *boundaryAfter = cursor.node;
+
+    // Line breaks of the replaced and the new pieces
+    long lineBreakDelta = 0;
+    for (DescriptorNode *node = boundaryBefore->next_ptr; node != boundaryAfter; node = node->next_ptr) {
+        lineBreakDelta -= (long)node->lineBreaks;
+    }
+    for (DescriptorNode *node = cursor.segmentFirst; node != NULL; node = node->next_ptr) {
+        lineBreakDelta += (long)node->lineBreaks;
+    }
+
+    // Save the replaced range as one undo entry
+    operation->first = boundaryBefore;
+    operation->oldNext = boundaryBefore->next_ptr;
+    operation->last = boundaryAfter;
+    operation->oldPrev = boundaryAfter->prev_ptr;
+    operation->wordCount = sequence->wordCount;
+    operation->lineCount = sequence->lineCount;
+    operation->previous = NULL;
+    operation->optimizedCase = 0;
+    operation->optimizedCaseSize = 0;
+    if (pushOperation(sequence->undoStack, operation) == 0) {
+        ERR_PRINT("Failed to push commit operation onto undo stack.\n");
+        slabFree(&sequence->operationAllocator, operation);
+        releaseCommitSegment(sequence, cursor.segmentFirst);
+        return -1;
+    }
+    clearOperationStack(sequence->redoStack);
+
+    sequence->lastInsert.lastAtomicPos = -1;
+    sequence->lastInsert.lastWritePos = -1;
+    sequence->lastInsert.lastCharSize = -1;
+
+    // Splice the new segment in with a single piece table update
+    bool wasEmpty = sequence->pieceTable.first->next_ptr == sequence->pieceTable.last;
+    if (cursor.segmentFirst != NULL) {
+        replaceTrackedRange(sequence, boundaryBefore, boundaryAfter, cursor.segmentFirst, cursor.segmentLast);
+    } else {
+        replaceTrackedRange(sequence, boundaryBefore, boundaryAfter, boundaryAfter, boundaryBefore);
+    }
+    sequence->editsSinceCompaction++;
+
+    // Update statistics
+    sequence->wordCount += wordDelta;
+    sequence->lineCount += lineBreakDelta + (wasEmpty ? 1 : 0);
+    if (sequence->pieceTable.first->next_ptr == sequence->pieceTable.last) {
+        sequence->lineCount = 0; // Text is empty now
+    }
+
+    return 1;
+}
+
+/*
+=========================
+  Maintenance
+=========================
+*/
+
+/**
+ * Checks if the second piece directly continues the first one in the same buffer.
+ */
+static bool isContiguousPiece(DescriptorNode *first, DescriptorNode *second) {
+    return first->isInFileBuffer == second->isInFileBuffer && first->offset + first->size == second->offset;
+}
+
+long compactPieces(Sequence *sequence) {
+    if (sequence == NULL) {
+        ERR_PRINT("compactPieces called with invalid sequence.\n");
+        return -1;
+    }
+    if (sequence->editsSinceCompaction == 0 || getOperationStackSize(sequence->redoStack) > 0) {
+        return 0; // Nothing changed since the last pass, or pending redo operations still refer to the current pieces
+    }
+    bool recordForUndo = getOperationStackSize(sequence->undoStack) > 0;
+
+    long savedPieces = 0;
+    DescriptorNode *last = sequence->pieceTable.last;
+    DescriptorNode *curr = sequence->pieceTable.first->next_ptr;
+    while (curr != last) {
+        // Collect the run of pieces which continue each other
+        DescriptorNode *runEnd = curr;
+        unsigned long runSize = curr->size;
+        unsigned long runLineBreaks = curr->lineBreaks;
+        long runLength = 1;
+        while (runEnd->next_ptr != last && isContiguousPiece(runEnd, runEnd->next_ptr)) {
+            runEnd = runEnd->next_ptr;
+            runSize += runEnd->size;
+            runLineBreaks += runEnd->lineBreaks;
+            runLength++;
+        }
+        if (runLength == 1) {
+            curr = curr->next_ptr;
+            continue;
+        }
+
+        DescriptorNode *merged = (DescriptorNode *)slabAlloc(&sequence->nodeAllocator);
+        Operation *operation = recordForUndo ? (Operation *)slabAlloc(&sequence->operationAllocator) : NULL;
+        if (merged == NULL || (recordForUndo && operation == NULL)) {
+            ERR_PRINT("Fatal malloc fail at piece compaction!\n");
+            slabFree(&sequence->nodeAllocator, merged);
+            slabFree(&sequence->operationAllocator, operation);
+            return -1;
+        }
+        DescriptorNode *before = curr->prev_ptr;
+        DescriptorNode *after = runEnd->next_ptr;
+        merged->isInFileBuffer = curr->isInFileBuffer;
+        merged->offset = curr->offset;
+        merged->size = runSize;
+        merged->lineBreaks = runLineBreaks;
+        merged->prev_ptr = before;
+        merged->next_ptr = after;
+
+        if (recordForUndo) {
+            // The old pieces may be referenced by undo operations: keep them and chain the merge in front of the latest undo bundle
+            operation->first = before;
+            operation->oldNext = curr;
+            operation->last = after;
+            operation->oldPrev = runEnd;
+            operation->wordCount = sequence->wordCount;
+            operation->lineCount = sequence->lineCount;
+            operation->optimizedCase = 0;     // Not an optimized case
+            operation->optimizedCaseSize = 0; // Not used in this case
+            operation->previous = popOperation(sequence->undoStack);
+            if (pushOperation(sequence->undoStack, operation) == 0) {
+                ERR_PRINT("Failed to push compaction operation onto undo stack.\n");
+                pushOperation(sequence->undoStack, operation->previous); // The pieces were not replaced yet
+                slabFree(&sequence->nodeAllocator, merged);
+                slabFree(&sequence->operationAllocator, operation);
+                return -1;
+            }
+        }
+        pieceTreeReplaceRange(&sequence->pieceTable, before, after, merged, merged);
+
+        if (!recordForUndo) {
+            // Without undo/redo history nothing refers to the old pieces anymore
+            DescriptorNode *old = curr;
+            while (old != after) {
+                DescriptorNode *next = old->next_ptr;
+                slabFree(&sequence->nodeAllocator, old);
+                old = next;
+            }
+        }
+
+        savedPieces += runLength - 1;
+        curr = after;
+    }
+
+    sequence->editsSinceCompaction = 0;
+    return savedPieces;
+}
+
 /*
 =========================
   Debug Utils
@@ -1155,19 +2527,27 @@ ReturnCode replaceUndoOption(Sequence *sequence, wchar_t *textToReplace, Positio
 void debugPrintInternalState(Sequence *sequence, bool showAddBuff, bool showFileBuff) {
     DEBG_PRINT("--- INTERNAL STATE OF SEQUENCE ---\n");
     if (sequence->addBuffer.data != NULL) {
-        DEBG_PRINT("Add buffer valid. Size: %d, Capacity: %d.\n", (int)sequence->addBuffer.size, (int)sequence->addBuffer.capacity);
+        DEBG_PRINT("Add buffer valid. Size: %zu, Capacity: %zu.\n", sequence->addBuffer.size, sequence->addBuffer.capacity);
     } else {
         DEBG_PRINT("Add buffer is NULL.\n");
     }
     if (sequence->fileBuffer.data != NULL) {
-        DEBG_PRINT("File buffer valid. Size: %d, Capacity: %d.\n", (int)sequence->fileBuffer.size, (int)sequence->fileBuffer.capacity);
+        DEBG_PRINT("File buffer valid. Size: %zu, Capacity: %zu.\n", sequence->fileBuffer.size, sequence->fileBuffer.capacity);
     } else {
         DEBG_PRINT("File buffer is NULL.\n");
     }
     DEBG_PRINT("Undo stack size: %d, Redo stack size: %d.\n", getOperationStackSize(sequence->undoStack), getOperationStackSize(sequence->redoStack));
+#ifdef DEBUG
+    SlabStats nodeStats = slabGetStats(&sequence->nodeAllocator);
+    SlabStats operationStats = slabGetStats(&sequence->operationAllocator);
+    DEBG_PRINT("Node allocator: %zu live (peak %zu), %zu allocs, %zu frees, %zu slabs (%zu bytes).\n", nodeStats.liveObjects, nodeStats.peakLiveObjects,
+               nodeStats.allocations, nodeStats.frees, nodeStats.slabs, nodeStats.reservedBytes);
+    DEBG_PRINT("Operation allocator: %zu live (peak %zu), %zu allocs, %zu frees, %zu slabs (%zu bytes).\n", operationStats.liveObjects, operationStats.peakLiveObjects,
+               operationStats.allocations, operationStats.frees, operationStats.slabs, operationStats.reservedBytes);
+#endif
 
     DEBG_PRINT("--- Piece Table ---\n");
-    int summedPosition = 0;
+    Position summedPosition = 0;
     DescriptorNode *curr = sequence->pieceTable.first;
     while (curr != NULL) {
         summedPosition += curr->size;
@@ -1181,14 +2561,14 @@ void debugPrintInternalState(Sequence *sequence, bool showAddBuff, bool showFile
     }
     if (showAddBuff && sequence->addBuffer.data != NULL) {
         DEBG_PRINT("--- Content of add buffer ---\n|");
-        for (int i = 0; i < (int)sequence->addBuffer.size; i++) {
+        for (size_t i = 0; i < sequence->addBuffer.size; i++) {
             DEBG_PRINT("%02X|", (uint8_t)sequence->addBuffer.data[i]);
         }
         DEBG_PRINT("\n");
     }
     if (showFileBuff && sequence->fileBuffer.data != NULL) {
         DEBG_PRINT("--- Content of file buffer ---\n|");
-        for (int i = 0; i < (int)sequence->fileBuffer.size; i++) {
+        for (size_t i = 0; i < sequence->fileBuffer.size; i++) {
             DEBG_PRINT("%02X|", (uint8_t)sequence->fileBuffer.data[i]);
         }
         DEBG_PRINT("\n");
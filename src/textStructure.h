@@ -6,6 +6,8 @@
 #include <stdlib.h>  // malloc() etc.
 #include <wchar.h>   // wide character support for utf-8
 
+#include "slabAllocator.h" // Memory for nodes and operations
+
 /*
 Main piece table data structure of the text editor.
 Some adjacent functionality is also included in this file.
@@ -21,8 +23,8 @@ Some of the fundamental principles were developed with regards to: https://www.c
 #define END_OF_TEXT_CHAR 0x03 /* indicator for end of the sequence, also see getItemBlock() below*/
 
 typedef int ReturnCode; /* 1: success; negative: failure; 0: undefined */
-typedef int Position;   /* a position in the sequence */
-typedef int Size;       /* a length measurement (size == last index +1, if first index == 0) */
+typedef int64_t Position; /* a position in the sequence (64 bit, files can be larger than 2 GiB) */
+typedef int64_t Size;     /* a length measurement (size == last index +1, if first index == 0) */
 typedef uint8_t Atomic; /* 1 byte (warning: is smaller then the atomic size of some utf-8 character (since up to 4 bytes for 1 utf-8 char)) */
 
 typedef enum {
@@ -44,7 +46,7 @@ typedef enum {
 =========================
 */
 
-/* Linked list node */
+/* Linked list node, which is at the same time a node of the balanced piece index (see pieceTree.h) */
 typedef struct DescriptorNode DescriptorNode;
 struct DescriptorNode {
     DescriptorNode *next_ptr;
@@ -52,12 +54,22 @@ struct DescriptorNode {
     bool isInFileBuffer;
     unsigned long offset;
     unsigned long size;
+    unsigned long lineBreaks; // Amount of line breaks inside this piece
+
+    // Piece index, only to be modified through pieceTree.h
+    DescriptorNode *parent;
+    DescriptorNode *left;
+    DescriptorNode *right;
+    uint32_t priority;
+    unsigned long subtreeSize;       // Summed size of all nodes in this subtree
+    unsigned long subtreeLineBreaks; // Summed line breaks of all nodes in this subtree
 };
 
-/* Piece table as a linked list */
+/* Piece table as a linked list, indexed by a balanced tree for fast position lookups */
 typedef struct {
     DescriptorNode *first;
     DescriptorNode *last;
+    DescriptorNode *root; // Root of the piece index
 } PieceTable;
 
 /* Buffer for storing text */
@@ -65,24 +77,60 @@ typedef struct {
     Atomic *data;
     size_t size;     // occupied space
     size_t capacity; // allocated space
+    size_t reserved; // reserved address space, the buffer can grow up to this size without moving (add buffer only)
 } Buffer;
 
+#define LINE_INDEX_BLOCK_SIZE 16384 /* distance in atomics between two checkpoints of a LineIndex */
+
+/* Sparse index of line break and word counts for an (append only) buffer, allows counting them in any range in O(LINE_INDEX_BLOCK_SIZE) */
+typedef struct {
+    unsigned long *checkpoints; // checkpoints[i]: amount of line breaks before atomic i * LINE_INDEX_BLOCK_SIZE
+    size_t amount;              // amount of valid checkpoints
+    size_t capacity;            // allocated checkpoints
+    size_t indexedSize;         // amount of atomics of the buffer covered so far
+    unsigned long indexedLineBreaks; // line breaks in the covered atomics
+    unsigned long *wordCheckpoints;  // wordCheckpoints[i]: amount of word starts before atomic i * LINE_INDEX_BLOCK_SIZE
+    unsigned long indexedWordStarts; // word starts in the covered atomics
+} LineIndex;
+
 /* Stack for keeping track of operations for undo/redo */
 typedef struct OperationStack OperationStack;
 
 /* Position and line number of a text in the sequence */
 typedef struct {
     Position foundPosition; // Position of the first character of the found text
-    int lineNumber;         // Line number of the found text (starting from 1)
+    long lineNumber;        // Line number of the found text (starting from 1), -1 while the file is counted in the background
 } SearchResult;
 
 /* Cache entry representing the last insertion */
 typedef struct {
-    int lastAtomicPos;
-    int lastCharSize;
-    long int lastWritePos;
+    Position lastAtomicPos;
+    Size lastCharSize;
+    Position lastWritePos;
 } LastInsert;
 
+/* Edit queued by queueEdit(), positions refer to the text at beginEdit() */
+typedef struct {
+    Position position;     // first atomic to replace
+    Size deleteLength;     // amount of atomics removed at position
+    Position bufferOffset; // replacement text in the add buffer
+    Size byteLength;       // byte size of the replacement text
+    size_t order;          // queue order, keeps inserts at the same position in order
+} PendingEdit;
+
+/* Batch of edits which is applied at once by commitEdit() */
+typedef struct {
+    PendingEdit *edits;
+    size_t amount;
+    size_t capacity;
+    bool active;
+} EditTransaction;
+
+typedef struct MatchIndex MatchIndex; /* see matchIndex.h */
+typedef struct TrigramIndex TrigramIndex; /* see trigramIndex.h */
+typedef struct FileCount FileCount; /* see statistics.h */
+typedef struct StatsCache StatsCache; /* see statsCache.h */
+
 /* Combined data structure */
 typedef struct {
     PieceTable pieceTable;
@@ -90,12 +138,29 @@ typedef struct {
     Buffer addBuffer;
     OperationStack *undoStack;
     OperationStack *redoStack;
-    int wordCount;
-    int lineCount;
-    SearchResult lastLineResult; // Internal cache
+    SlabAllocator nodeAllocator;      // All DescriptorNodes of the sequence
+    SlabAllocator operationAllocator; // All undo/redo Operations of the sequence
+    LineIndex fileLineIndex;
+    LineIndex addLineIndex;
+    long wordCount;
+    long lineCount;
+    unsigned long editsSinceCompaction; // Piece table changes since the last compactPieces() pass
     LastInsert lastInsert;       // Internal cache
+    EditTransaction transaction; // Edits queued between beginEdit() and commitEdit()
+    MatchIndex *matchIndex;      // All matches of the text searched last, NULL if there is none
+    TrigramIndex *trigramIndex;  // Index over the file buffer of large files, NULL if there is none
+    FileCount *fileCount;        // Count of the file running in the background, NULL once its totals are known
+    StatsCache *statsCache;      // Cached statistics of the opened file, NULL if they are not cached
 } Sequence;
 
+/* Stateful iterator over the text blocks of a sequence, see initBlockIterator() */
+typedef struct {
+    Sequence *sequence;
+    DescriptorNode *node;        // piece of the current block (tail sentinel at the end of the text)
+    unsigned long offsetInNode;  // offset of the current block inside its piece
+    Position blockStart;         // position of the first atomic of the current block
+} BlockIterator;
+
 /*
 =========================
   Setup
@@ -114,6 +179,18 @@ Sequence *loadOrCreateNewFile(char *filePath, LineBstd stdIfNewCreation);
 
 LineBstd getCurrentLineBstd();
 
+/**
+ * Sets the add buffer size (in bytes) above which newly added text is stored in a memory mapped temp file
+ * instead of anonymous memory, which keeps the resident memory bounded during huge edit sessions.
+ * 0 (default) disables spilling. Only affects add buffer memory committed after the call.
+ */
+void setAddBufferSpillThreshold(size_t thresholdBytes);
+
+/**
+ * Sets the amount of threads a search over a large text (and counting a freshly opened file) is split across, 0 (default) uses one per online CPU.
+ */
+void setSearchWorkers(int workers);
+
 /**
  * Returns '\n' for Linux & MSDOS or '\r' for MAC.
  */
@@ -147,17 +224,71 @@ ReturnCode closeSequence(Sequence *sequence, bool forceFlag);
  */
 Size getItemBlock(Sequence *sequence, Position position, Atomic **returnedItemBlock);
 
+/**
+ * Positions the iterator at the block containing the given position (only one lookup in the piece index).
+ * The current block then starts exactly at the position, like the block returned by getItemBlock().
+ * Returns -1 if the position is invalid.
+ */
+ReturnCode initBlockIterator(BlockIterator *iterator, Sequence *sequence, Position position);
+
+/**
+ * Returns the current block of the iterator, with the same conventions as getItemBlock().
+ */
+Size getCurrentBlock(BlockIterator *iterator, Atomic **returnedItemBlock);
+
+/**
+ * Moves the iterator to the following block in O(1) and returns it, with the same conventions as getItemBlock().
+ * After the last block of the text the END_OF_TEXT_CHAR block follows, moving past it returns -1.
+ */
+Size getNextBlock(BlockIterator *iterator, Atomic **returnedItemBlock);
+
+/**
+ * Moves the iterator to the preceding block in O(1) and returns it (the block always covers the whole preceding part of its piece).
+ * Returns -1 if the iterator is already at the first block.
+ */
+Size getPreviousBlock(BlockIterator *iterator, Atomic **returnedItemBlock);
+
+/**
+ * Returns the position of the first atomic of the iterator's current block.
+ */
+Position getBlockIteratorPosition(BlockIterator *iterator);
+
 /*
 =========================
   Query internals
 =========================
 */
 
-int getCurrentWordCount(Sequence *sequence);
-int getCurrentLineCount(Sequence *sequence);
-int backtrackToFirstAtomicInLine(Sequence *sequence, Position position);
+/**
+ * Takes over the totals and the line index of a file counted in the background once the count is done
+ * (with wait it blocks until then). If the count failed the file is counted right away. Returns 1 if there is no pending count (anymore), 0 if it is still running, -1 on error.
+ */
+ReturnCode finishBackgroundCount(Sequence *sequence, bool wait);
+
+/**
+ * Returns the percentage of the file counted so far, or -1 if no count is running. Until the count is done the
+ * word and line counts only contain the effect of the edits and lookups by line number return -1.
+ */
+int getBackgroundCountProgress(Sequence *sequence);
+
+long getCurrentWordCount(Sequence *sequence);
+long getCurrentLineCount(Sequence *sequence);
 size_t getCurrentTotalSize(Sequence *sequence);
 
+/**
+ * Returns the line number for a given position in the sequence (starting from 1).
+ * If there is a line break at the position, the line break itself is allocated to the next line
+ * (e.g. a call for position 5 in "Hello\nWorld" will return 2, not 1).
+ * If the position is invalid or the file is still counted in the background (its line breaks are not known yet), returns -1.
+ */
+long getLineNumber(Sequence *sequence, Position position);
+
+/**
+ * Returns the position of the first atomic of the given line (starting from 1), i.e. the position right after its preceding line break.
+ * Returns -1 if the line does not exist or (for lines after the first) while the file is still counted in the background.
+ */
+Position getFirstAtomicOfLine(Sequence *sequence, long lineNumber);
+
 /**
  * Returns the position of the first atomic in the line that contains the specified position.
  * The previous line break is not considered part of the line, i.e. the returned position comes right after the line break.
@@ -176,12 +307,49 @@ Position backtrackToFirstAtomicInLine(Sequence *sequence, Position position);
  */
 ReturnCode insert(Sequence *sequence, Position position, wchar_t *textToInsert);
 
+/**
+ * Inserts already UTF-8 encoded text (byteLength atomics, no terminator needed) at the specified position in the sequence.
+ * The text is copied into the add buffer as is, it must not start or end in the middle of a UTF-8 character.
+ */
+ReturnCode insertUtf8(Sequence *sequence, Position position, const Atomic *textToInsert, size_t byteLength);
+
 /**
  * Deletes a range of text from the sequence, specified by beginPosition and endPosition.
  * Both positions are inclusive.
  */
 ReturnCode delete(Sequence *sequence, Position beginPosition, Position endPosition);
 
+/**
+ * Replaces the text between beginPosition and endPosition (both inclusive) with already UTF-8 encoded text.
+ * Delete and insert are bundled, i.e. undone together.
+ */
+ReturnCode replaceUtf8(Sequence *sequence, Position beginPosition, Position endPosition, const Atomic *textToReplace, size_t byteLength);
+
+/**
+ * Starts a transaction: all following queueEdit() calls are collected and applied together by commitEdit().
+ * Returns -1 if a transaction is already running.
+ */
+ReturnCode beginEdit(Sequence *sequence);
+
+/**
+ * Queues the replacement of deleteLength atomics at position with already UTF-8 encoded text
+ * (deleteLength 0: pure insert, byteLength 0: pure delete). The text is copied into the add buffer right away.
+ * Positions refer to the text as it was at beginEdit(), the queued ranges must not overlap but may be queued in any order.
+ */
+ReturnCode queueEdit(Sequence *sequence, Position position, Size deleteLength, const Atomic *text, size_t byteLength);
+
+/**
+ * Applies all queued edits in a single pass over the affected pieces and ends the transaction.
+ * The whole batch becomes one undo entry, word and line counts are only recomputed around the edited ranges.
+ * If the edits are invalid (overlapping, out of bounds, inside a UTF-8 character) nothing is changed and -1 is returned.
+ */
+ReturnCode commitEdit(Sequence *sequence);
+
+/**
+ * Ends the transaction without applying the queued edits.
+ */
+void abortEdit(Sequence *sequence);
+
 /**
  * Searches for a given text (nullterminated string of wide chars) in the sequence.
  * The search starts at startPosition (inclusive) and, if necessary, wraps around to the beginning of the sequence.
@@ -189,6 +357,19 @@ ReturnCode delete(Sequence *sequence, Position beginPosition, Position endPositi
  */
 SearchResult find(Sequence *sequence, wchar_t *textToFind, Position startPosition);
 
+/**
+ * Reverse version of find(): returns the SearchResult for the last occurrence which starts before startPosition (exclusive),
+ * if necessary wrapping around to the end of the sequence. Returns -1 if no match was found.
+ */
+SearchResult findPrevious(Sequence *sequence, wchar_t *textToFind, Position startPosition);
+
+/**
+ * Case-insensitive versions of find() and findPrevious(): letters match in upper, lower and title case (simple case folding).
+ * Matches can differ in length from textToFind (only for non-ASCII letters).
+ */
+SearchResult findIgnoringCase(Sequence *sequence, wchar_t *textToFind, Position startPosition);
+SearchResult findPreviousIgnoringCase(Sequence *sequence, wchar_t *textToFind, Position startPosition);
+
 /**
  * Searches for a given text (nullterminated string of wide chars) in the sequence.
  * The first occurence after startPosition (inclusive) is deleted and replaced with the specified replacement text.
@@ -203,6 +384,33 @@ SearchResult findAndReplace(Sequence *sequence, wchar_t *textToFind, wchar_t *te
  */
 SearchResult findAndReplaceAll(Sequence *sequence, wchar_t *textToFind, wchar_t *textToReplace, Position startPosition);
 
+/**
+ * Returns the position of the first occurrence of the UTF-8 needle which starts in [from, to) (no wrap around), or -1.
+ */
+Position findNeedleBetween(Sequence *sequence, const Atomic *needle, size_t needleLength, Position from, Position to);
+
+/**
+ * Calls onMatch for every occurrence of the UTF-8 needle which starts in [from, to), in ascending order (occurrences may overlap).
+ * Returns the amount of occurrences or -1 on error.
+ */
+long forEachNeedleMatch(Sequence *sequence, const Atomic *needle, size_t needleLength, Position from, Position to,
+                        void (*onMatch)(Position position, void *context), void *context);
+
+/*
+=========================
+  Maintenance
+=========================
+*/
+
+/**
+ * Merges neighbouring pieces which reference directly contiguous atomics of the same buffer (e.g. left behind by undo/redo
+ * or by typing after the insert cache was reset). Meant to be called while the editor is idle.
+ * The replaced pieces stay valid for undo: the merge is added to the latest undo bundle and reverted before it.
+ * Does nothing while redo operations are pending, since they expect the current pieces.
+ * Returns the amount of pieces saved or -1 on error.
+ */
+long compactPieces(Sequence *sequence);
+
 /*
 =========================
   Debug Utils
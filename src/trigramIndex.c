@@ -0,0 +1,463 @@
+#include "trigramIndex.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "debugUtil.h"
+
+/*------ Definitions for internal use ------*/
+#define TRIGRAM_BUCKETS ((size_t)1 << TRIGRAM_BUCKET_BITS)
+#define NO_BLOCK UINT32_MAX
+#define SIDECAR_MAGIC 0x31474952544e5854ULL /* "TXNTRIG1" */
+
+/* Identifies the file (and index layout) a stored index belongs to */
+typedef struct {
+    uint64_t magic;
+    uint64_t fileSize;
+    uint64_t inode;
+    int64_t modifiedSeconds;
+    int64_t modifiedNanoseconds;
+    uint64_t blockSize;
+    uint64_t bucketBits;
+    uint64_t postingsSize;
+} SidecarHeader;
+
+/*------ Variables for internal use ------*/
+static bool _persistIndex = false; // store the index next to the file, see setTrigramIndexPersistence()
+
+struct TrigramIndex {
+    Sequence *sequence;
+    char *sidecarPath;         // NULL if the index is not stored
+    SidecarHeader identity;    // of the file when it was opened
+    size_t fileSize;
+    size_t blockCount;
+    uint64_t *bucketOffsets;   // TRIGRAM_BUCKETS + 1 offsets into postings
+    uint8_t *postings;         // per bucket: gaps between the blocks containing one of its trigrams (varint)
+    uint64_t *candidates;      // result of the last query
+    uint64_t *listBlocks;      // scratch bitmap of one posting list
+    // Background build
+    pthread_t builder;
+    bool builderStarted;
+    int stopRequested;
+    int ready;
+    int pass;                  // 0: not started, 1: count list sizes, 2: write lists
+    size_t nextBlock;
+    uint32_t *lastBlock;       // per bucket: last block written to the list
+    uint64_t *writeOffsets;    // pass 2: per bucket: end of its list so far
+    uint64_t *seenBuckets;     // bitmap of the buckets seen in the current block
+    uint32_t *touchedBuckets;  // buckets seen in the current block
+};
+
+static inline uint32_t trigramBucket(uint32_t trigram) {
+    return (trigram * 0x9E3779B1u) >> (32 - TRIGRAM_BUCKET_BITS);
+}
+
+static inline size_t varintLength(uint32_t value) {
+    size_t length = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        length++;
+    }
+    return length;
+}
+
+/*
+======================
+  Build
+======================
+*/
+
+/**
+ * Adds the block to the lists of all buckets of its trigrams (pass 1 only sums up the list sizes).
+ * Trigrams are assigned to the block in which they start.
+ */
+static void indexBlock(TrigramIndex *index, const Atomic *data, size_t block) {
+    size_t start = block * TRIGRAM_BLOCK_SIZE;
+    size_t end = start + TRIGRAM_BLOCK_SIZE < index->fileSize ? start + TRIGRAM_BLOCK_SIZE : index->fileSize;
+    if (end > index->fileSize - 2) {
+        end = index->fileSize - 2; // Last trigram starts two atomics before the end
+    }
+    size_t touched = 0;
+    if (start < end) {
+        uint32_t trigram = ((uint32_t)data[start] << 8) | data[start + 1];
+        for (size_t offset = start; offset < end; offset++) {
+            trigram = ((trigram << 8) | data[offset + 2]) & 0xFFFFFF;
+            uint32_t bucket = trigramBucket(trigram);
+            uint64_t bit = (uint64_t)1 << (bucket & 63);
+            if (!(index->seenBuckets[bucket >> 6] & bit)) {
+                index->seenBuckets[bucket >> 6] |= bit;
+                index->touchedBuckets[touched++] = bucket;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < touched; i++) {
+        uint32_t bucket = index->touchedBuckets[i];
+        index->seenBuckets[bucket >> 6] = 0;
+        uint32_t gap = index->lastBlock[bucket] == NO_BLOCK ? (uint32_t)block + 1 : (uint32_t)block - index->lastBlock[bucket];
+        index->lastBlock[bucket] = (uint32_t)block;
+        if (index->pass == 1) {
+            index->bucketOffsets[bucket + 1] += varintLength(gap);
+        } else {
+            uint8_t *out = index->postings + index->writeOffsets[bucket];
+            while (gap >= 0x80) {
+                *out++ = (uint8_t)(gap | 0x80);
+                gap >>= 7;
+            }
+            *out++ = (uint8_t)gap;
+            index->writeOffsets[bucket] = (uint64_t)(out - index->postings);
+        }
+    }
+}
+
+static void freeBuildState(TrigramIndex *index) {
+    free(index->lastBlock);
+    free(index->writeOffsets);
+    free(index->seenBuckets);
+    free(index->touchedBuckets);
+    index->lastBlock = NULL;
+    index->writeOffsets = NULL;
+    index->seenBuckets = NULL;
+    index->touchedBuckets = NULL;
+}
+
+/**
+ * Checks that the lists of a loaded index stay inside the postings and only name blocks of the current file,
+ * a damaged or foreign sidecar is built again instead (decoding all lists costs a fraction of building them).
+ */
+static bool isValidIndex(TrigramIndex *index, uint64_t postingsSize) {
+    if (index->bucketOffsets[0] != 0 || index->bucketOffsets[TRIGRAM_BUCKETS] != postingsSize) {
+        return false;
+    }
+    for (size_t bucket = 0; bucket < TRIGRAM_BUCKETS; bucket++) {
+        if (index->bucketOffsets[bucket + 1] < index->bucketOffsets[bucket]) {
+            return false;
+        }
+        // Decode the list once, the gaps have to stay inside the file's blocks
+        const uint8_t *in = index->postings + index->bucketOffsets[bucket];
+        const uint8_t *end = index->postings + index->bucketOffsets[bucket + 1];
+        uint64_t block = 0;
+        while (in < end) {
+            uint64_t gap = 0;
+            int shift = 0;
+            do {
+                if (in == end || shift > 28) {
+                    return false;
+                }
+                gap |= (uint64_t)(*in & 0x7F) << shift;
+                shift += 7;
+            } while (*in++ & 0x80);
+            block += gap;
+            if (gap == 0 || block > index->blockCount) { // block + 1 since the first gap counts from -1
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Opens the sidecar for reading, only if it is a regular file of the user (no symlink planted next to the file).
+ */
+static FILE *openSidecar(const char *path) {
+    int fd = open(path, O_RDONLY | O_NOFOLLOW);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat sidecarStat;
+    if (fstat(fd, &sidecarStat) < 0 || sidecarStat.st_uid != geteuid() || !S_ISREG(sidecarStat.st_mode)) {
+        close(fd);
+        return NULL;
+    }
+    FILE *file = fdopen(fd, "rb");
+    if (file == NULL) {
+        close(fd);
+    }
+    return file;
+}
+
+static ReturnCode loadSidecar(TrigramIndex *index) {
+    FILE *file = index->sidecarPath != NULL ? openSidecar(index->sidecarPath) : NULL;
+    if (file == NULL) {
+        return -1;
+    }
+    SidecarHeader header;
+    ReturnCode result = -1;
+    SidecarHeader expected = index->identity;
+    if (fread(&header, sizeof(header), 1, file) == 1) {
+        expected.postingsSize = header.postingsSize;
+        size_t blockCount = header.blockSize > 0 ? (header.fileSize + header.blockSize - 1) / header.blockSize : 0;
+        if (memcmp(&header, &expected, sizeof(header)) == 0 && blockCount == index->blockCount) {
+            index->postings = malloc(header.postingsSize > 0 ? header.postingsSize : 1);
+            if (index->postings != NULL
+                && fread(index->bucketOffsets, sizeof(uint64_t), TRIGRAM_BUCKETS + 1, file) == TRIGRAM_BUCKETS + 1
+                && fread(index->postings, 1, header.postingsSize, file) == header.postingsSize
+                && isValidIndex(index, header.postingsSize)) {
+                result = 1;
+            }
+        }
+    }
+    fclose(file);
+    if (result == -1) {
+        free(index->postings);
+        index->postings = NULL;
+    }
+    return result;
+}
+
+static void storeSidecar(TrigramIndex *index) {
+    if (index->sidecarPath == NULL) {
+        return;
+    }
+    // Written to a temp file which replaces the sidecar, a crash never leaves a partial index behind
+    size_t length = strlen(index->sidecarPath) + 8;
+    char *tempPath = malloc(length);
+    if (tempPath == NULL) {
+        ERR_PRINT("Memory allocation failed for trigram index path.\n");
+        return;
+    }
+    snprintf(tempPath, length, "%s.XXXXXX", index->sidecarPath);
+    int fd = mkstemp(tempPath);
+    FILE *file = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (file == NULL) {
+        DEBG_PRINT("Trigram index could not be stored at %s.\n", index->sidecarPath);
+        if (fd >= 0) {
+            close(fd);
+            remove(tempPath);
+        }
+        free(tempPath);
+        return;
+    }
+    SidecarHeader header = index->identity;
+    header.postingsSize = index->bucketOffsets[TRIGRAM_BUCKETS];
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1
+                   && fwrite(index->bucketOffsets, sizeof(uint64_t), TRIGRAM_BUCKETS + 1, file) == TRIGRAM_BUCKETS + 1
+                   && fwrite(index->postings, 1, header.postingsSize, file) == header.postingsSize;
+    if (fclose(file) != 0 || !written || rename(tempPath, index->sidecarPath) < 0) {
+        ERR_PRINT("Writing the trigram index to %s failed.\n", index->sidecarPath);
+        remove(tempPath);
+    }
+    free(tempPath);
+}
+
+/**
+ * Background thread: loads the stored index or builds it in two passes over the file buffer (sizes, then lists).
+ * Stops between two blocks if requested and continues from there when it is started again.
+ */
+static void *buildTrigramIndex(void *argument) {
+    TrigramIndex *index = (TrigramIndex *)argument;
+    const Atomic *data = index->sequence->fileBuffer.data; // The mapping is only replaced while the thread is suspended
+
+    if (index->pass == 0) {
+        if (loadSidecar(index) == 1) {
+            DEBG_PRINT("Trigram index loaded from %s.\n", index->sidecarPath);
+            __atomic_store_n(&index->ready, 1, __ATOMIC_RELEASE);
+            return NULL;
+        }
+        memset(index->bucketOffsets, 0, (TRIGRAM_BUCKETS + 1) * sizeof(uint64_t));
+        index->lastBlock = malloc(TRIGRAM_BUCKETS * sizeof(uint32_t));
+        index->seenBuckets = calloc(TRIGRAM_BUCKETS / 64, sizeof(uint64_t));
+        index->touchedBuckets = malloc(TRIGRAM_BLOCK_SIZE * sizeof(uint32_t));
+        if (index->lastBlock == NULL || index->seenBuckets == NULL || index->touchedBuckets == NULL) {
+            ERR_PRINT("Memory allocation failed for trigram index build.\n");
+            freeBuildState(index);
+            return NULL;
+        }
+        memset(index->lastBlock, 0xFF, TRIGRAM_BUCKETS * sizeof(uint32_t));
+        index->pass = 1;
+        index->nextBlock = 0;
+    }
+
+    while (index->pass <= 2) {
+        for (; index->nextBlock < index->blockCount; index->nextBlock++) {
+            if (__atomic_load_n(&index->stopRequested, __ATOMIC_RELAXED)) {
+                return NULL;
+            }
+            indexBlock(index, data, index->nextBlock);
+        }
+
+        if (index->pass == 1) {
+            // List sizes => offsets, the lists are written in the second pass
+            for (size_t bucket = 0; bucket < TRIGRAM_BUCKETS; bucket++) {
+                index->bucketOffsets[bucket + 1] += index->bucketOffsets[bucket];
+            }
+            index->postings = malloc(index->bucketOffsets[TRIGRAM_BUCKETS] > 0 ? index->bucketOffsets[TRIGRAM_BUCKETS] : 1);
+            index->writeOffsets = malloc(TRIGRAM_BUCKETS * sizeof(uint64_t));
+            if (index->postings == NULL || index->writeOffsets == NULL) {
+                ERR_PRINT("Memory allocation failed for trigram index lists.\n");
+                freeBuildState(index);
+                free(index->postings);
+                index->postings = NULL;
+                index->pass = 0;
+                return NULL;
+            }
+            memcpy(index->writeOffsets, index->bucketOffsets, TRIGRAM_BUCKETS * sizeof(uint64_t));
+            memset(index->lastBlock, 0xFF, TRIGRAM_BUCKETS * sizeof(uint32_t));
+            index->nextBlock = 0;
+        }
+        index->pass++;
+    }
+
+    freeBuildState(index);
+    DEBG_PRINT("Trigram index built: %zu blocks, %lu bytes of lists.\n", index->blockCount, (unsigned long)index->bucketOffsets[TRIGRAM_BUCKETS]);
+    storeSidecar(index);
+    __atomic_store_n(&index->ready, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/*
+======================
+  Interface
+======================
+*/
+
+void setTrigramIndexPersistence(bool persist) {
+    _persistIndex = persist;
+}
+
+ReturnCode createTrigramIndex(Sequence *sequence, const char *filePath) {
+    if (sequence == NULL || filePath == NULL) {
+        ERR_PRINT("createTrigramIndex called with invalid sequence or path.\n");
+        return -1;
+    }
+    if ((long)sequence->fileBuffer.size < TRIGRAM_INDEX_MIN_FILE_SIZE) {
+        return 1; // Small file, no index
+    }
+    TrigramIndex *index = calloc(1, sizeof(TrigramIndex));
+    if (index == NULL) {
+        ERR_PRINT("Memory allocation failed for trigram index.\n");
+        return -1;
+    }
+    index->sequence = sequence;
+    index->fileSize = sequence->fileBuffer.size;
+    index->blockCount = (index->fileSize + TRIGRAM_BLOCK_SIZE - 1) / TRIGRAM_BLOCK_SIZE;
+    index->bucketOffsets = malloc((TRIGRAM_BUCKETS + 1) * sizeof(uint64_t));
+    index->candidates = malloc((index->blockCount / 64 + 1) * sizeof(uint64_t));
+    index->listBlocks = malloc((index->blockCount / 64 + 1) * sizeof(uint64_t));
+    if (index->bucketOffsets == NULL || index->candidates == NULL || index->listBlocks == NULL) {
+        ERR_PRINT("Memory allocation failed for trigram index.\n");
+        sequence->trigramIndex = index;
+        freeTrigramIndex(sequence);
+        return -1;
+    }
+
+    struct stat fileStat;
+    index->identity.magic = SIDECAR_MAGIC;
+    index->identity.fileSize = index->fileSize;
+    index->identity.blockSize = TRIGRAM_BLOCK_SIZE;
+    index->identity.bucketBits = TRIGRAM_BUCKET_BITS;
+    if (_persistIndex && stat(filePath, &fileStat) == 0) {
+        index->identity.inode = (uint64_t)fileStat.st_ino;
+        index->identity.modifiedSeconds = (int64_t)fileStat.st_mtim.tv_sec;
+        index->identity.modifiedNanoseconds = (int64_t)fileStat.st_mtim.tv_nsec;
+        // Hidden file in the same directory: dir/.name.trigrams
+        const char *name = strrchr(filePath, '/');
+        size_t directoryLength = name != NULL ? (size_t)(name - filePath) + 1 : 0;
+        name = name != NULL ? name + 1 : filePath;
+        index->sidecarPath = malloc(strlen(filePath) + 11);
+        if (index->sidecarPath != NULL) {
+            sprintf(index->sidecarPath, "%.*s.%s.trigrams", (int)directoryLength, filePath, name);
+        }
+    }
+    sequence->trigramIndex = index;
+    return 1;
+}
+
+void requestTrigramIndex(Sequence *sequence) {
+    TrigramIndex *index = sequence->trigramIndex;
+    if (index == NULL || index->builderStarted || __atomic_load_n(&index->ready, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    index->stopRequested = 0;
+    if (pthread_create(&index->builder, NULL, buildTrigramIndex, index) != 0) {
+        ERR_PRINT("Trigram index thread could not be started.\n");
+        return;
+    }
+    index->builderStarted = true;
+}
+
+void suspendTrigramIndex(Sequence *sequence) {
+    TrigramIndex *index = sequence->trigramIndex;
+    if (index == NULL || !index->builderStarted) {
+        return;
+    }
+    __atomic_store_n(&index->stopRequested, 1, __ATOMIC_RELAXED);
+    pthread_join(index->builder, NULL);
+    index->builderStarted = false;
+}
+
+void freeTrigramIndex(Sequence *sequence) {
+    TrigramIndex *index = sequence->trigramIndex;
+    if (index == NULL) {
+        return;
+    }
+    suspendTrigramIndex(sequence);
+    freeBuildState(index);
+    free(index->sidecarPath);
+    free(index->bucketOffsets);
+    free(index->postings);
+    free(index->candidates);
+    free(index->listBlocks);
+    free(index);
+    sequence->trigramIndex = NULL;
+}
+
+bool isTrigramIndexReady(Sequence *sequence) {
+    return sequence->trigramIndex != NULL && __atomic_load_n(&sequence->trigramIndex->ready, __ATOMIC_ACQUIRE);
+}
+
+const uint64_t *getTrigramCandidates(Sequence *sequence, const Atomic *needle, size_t needleLength) {
+    if (!isTrigramIndexReady(sequence) || needleLength < 3 || needleLength > TRIGRAM_BLOCK_SIZE) {
+        return NULL;
+    }
+    TrigramIndex *index = sequence->trigramIndex;
+    size_t words = index->blockCount / 64 + 1;
+    memset(index->candidates, 0xFF, words * sizeof(uint64_t));
+
+    uint32_t trigram = ((uint32_t)needle[0] << 8) | needle[1];
+    for (size_t i = 2; i < needleLength; i++) {
+        trigram = ((trigram << 8) | needle[i]) & 0xFFFFFF;
+        uint32_t bucket = trigramBucket(trigram);
+
+        // A match starting in block b has its trigrams in block b or b + 1
+        memset(index->listBlocks, 0, words * sizeof(uint64_t));
+        const uint8_t *in = index->postings + index->bucketOffsets[bucket];
+        const uint8_t *end = index->postings + index->bucketOffsets[bucket + 1];
+        int64_t block = -1;
+        while (in < end) {
+            uint64_t gap = 0;
+            int shift = 0;
+            do {
+                if (in == end || shift > 28) {
+                    ERR_PRINT("Trigram index list of bucket %u is damaged.\n", bucket);
+                    return NULL;
+                }
+                gap |= (uint64_t)(*in & 0x7F) << shift;
+                shift += 7;
+            } while (*in++ & 0x80);
+            block += (int64_t)gap;
+            if (gap == 0 || block >= (int64_t)index->blockCount) {
+                ERR_PRINT("Trigram index list of bucket %u names block %ld of %zu.\n", bucket, (long)block, index->blockCount);
+                return NULL; // Damaged list, the caller scans everything
+            }
+            index->listBlocks[block >> 6] |= (uint64_t)1 << (block & 63);
+            if (block > 0) {
+                index->listBlocks[(block - 1) >> 6] |= (uint64_t)1 << ((block - 1) & 63);
+            }
+        }
+
+        bool anyLeft = false;
+        for (size_t word = 0; word < words; word++) {
+            index->candidates[word] &= index->listBlocks[word];
+            anyLeft |= index->candidates[word] != 0;
+        }
+        if (!anyLeft) {
+            break; // No block can contain the needle
+        }
+    }
+    return index->candidates;
+}
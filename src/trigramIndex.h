@@ -0,0 +1,53 @@
+#ifndef TRIGRAMINDEX_H
+#define TRIGRAMINDEX_H
+
+#include "textStructure.h"
+
+/*
+Trigram index over the file buffer, which never changes while the file is open (edits only go to the add buffer).
+The file buffer is split into blocks, for every trigram (hashed into buckets) the index lists the blocks in which
+it occurs (gaps between the block numbers, varint coded). A search only scans the blocks which contain all trigrams
+of the needle, pieces of the add buffer and text crossing piece boundaries are scanned directly.
+The index is built by a background thread on the first search, only reading the file buffer. If enabled (see
+setTrigramIndexPersistence()) it is stored next to the file (.<name>.trigrams) and reused as long as the file was not modified.
+*/
+
+#define TRIGRAM_BLOCK_SIZE (256 * 1024)                 /* atomics of the file buffer per indexed block */
+#define TRIGRAM_BUCKET_BITS 20                          /* trigrams are hashed into 2^20 buckets */
+#define TRIGRAM_INDEX_MIN_FILE_SIZE (64L * 1024 * 1024) /* smaller files are scanned faster than the index helps */
+
+/**
+ * Enables storing the index next to the file and reusing it at the next open (off by default, the sidecar takes
+ * about an eighth of the file size). Only affects files opened after the call.
+ */
+void setTrigramIndexPersistence(bool persist);
+
+/**
+ * Prepares the index for the file buffer of a freshly loaded file (nothing is built yet, see requestTrigramIndex()).
+ * Does nothing for files smaller than TRIGRAM_INDEX_MIN_FILE_SIZE. Returns -1 on error.
+ */
+ReturnCode createTrigramIndex(Sequence *sequence, const char *filePath);
+
+/**
+ * Starts the background thread which loads or builds the index, unless it is running or done already.
+ */
+void requestTrigramIndex(Sequence *sequence);
+
+/**
+ * Stops the background thread and waits for it (it continues on the next request).
+ * Has to be called before the mapping of the file buffer is replaced (see saveSequence()).
+ */
+void suspendTrigramIndex(Sequence *sequence);
+
+void freeTrigramIndex(Sequence *sequence);
+
+bool isTrigramIndexReady(Sequence *sequence);
+
+/**
+ * Returns a bitmap over the blocks of the file buffer (bit b of word b / 64) in which a match of the needle can start,
+ * or NULL if the index can not be used (not built yet, needle shorter than 3 or longer than a block).
+ * The bitmap stays valid until the next call.
+ */
+const uint64_t *getTrigramCandidates(Sequence *sequence, const Atomic *needle, size_t needleLength);
+
+#endif
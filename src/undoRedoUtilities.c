@@ -1,16 +1,14 @@
 #include "undoRedoUtilities.h"
 #include "debugUtil.h"
+#include "pieceTree.h"
+#include "statistics.h"
+#include "matchIndex.h"
 
 /*------ Data structures for internal use ------*/
-typedef struct OperationNode OperationNode;
-struct OperationNode {
-    Operation *operation;
-    OperationNode *next;
-};
-
 typedef struct OperationStack {
-    OperationNode *top;
+    Operation *top; // Bundles are linked through Operation.below, so pushing needs no allocation
     int size;
+    SlabAllocator *operationAllocator;
 } OperationStack;
 
 /*
@@ -19,6 +17,16 @@ typedef struct OperationStack {
 ======================
 */
 
+/**
+ * Line count of the text described by the pieces, for operations saved before the file was counted (lineCount -1).
+ */
+static long countLinesOfPieces(Sequence *sequence) {
+    if (sequence->pieceTable.first->next_ptr == sequence->pieceTable.last) {
+        return 0;
+    }
+    return (long)pieceTreeTotalLineBreaks(&sequence->pieceTable) + 1;
+}
+
 /**
  * Helper function to undo an operation.
  * This function should handle the logic of restoring the piece table.
@@ -31,15 +39,13 @@ Operation* undoOperation(Sequence *sequence, Operation *operation, Operation *ne
     DescriptorNode *oldNext = operation->oldNext;
     DescriptorNode *last = operation->last;
     DescriptorNode *oldPrev = operation->oldPrev;
-    int prevWordCount = operation->wordCount;
-    int prevLineCount = operation->lineCount;
+    long prevWordCount = operation->wordCount;
+    long prevLineCount = operation->lineCount;
     int optimizedCase = operation->optimizedCase;
     unsigned long optimizedCaseSize = operation->optimizedCaseSize;
-    free(operation); 
+    slabFree(&sequence->operationAllocator, operation);
 
     // Make cache invalid
-    sequence->lastLineResult.foundPosition = -1; 
-    sequence->lastLineResult.lineNumber = -1;
     sequence->lastInsert.lastAtomicPos = -1;
     sequence->lastInsert.lastWritePos = -1;
     sequence->lastInsert.lastCharSize = -1;
@@ -52,9 +58,14 @@ Operation* undoOperation(Sequence *sequence, Operation *operation, Operation *ne
         }
         // Restore the size of the first node
         first->size -= optimizedCaseSize;
+        first->lineBreaks = countLineBreaksInPiece(sequence, first, 0, first->size);
+        pieceTreeUpdate(&sequence->pieceTable, first);
+        long sizeChange = -(long)optimizedCaseSize; // Negative for undo, positive for redo of an extension
+        Position extensionStart = pieceTreePositionOf(&sequence->pieceTable, first) + (Position)first->size - (sizeChange > 0 ? sizeChange : 0);
+        matchIndexTextChanged(sequence, extensionStart, sizeChange < 0 ? -sizeChange : 0, sizeChange > 0 ? sizeChange : 0);
 
         // Create an inverse operation
-        Operation *inverse = (Operation*) malloc(sizeof(Operation));
+        Operation *inverse = (Operation*) slabAlloc(&sequence->operationAllocator);
         if (inverse == NULL) {
             ERR_PRINT("Failed to allocate memory for inverse operation in optimized case.\n");
             return NULL;
@@ -71,7 +82,7 @@ Operation* undoOperation(Sequence *sequence, Operation *operation, Operation *ne
         
         // Update the sequence statistics
         sequence->wordCount = prevWordCount;
-        sequence->lineCount = prevLineCount;
+        sequence->lineCount = prevLineCount >= 0 ? prevLineCount : countLinesOfPieces(sequence);
         
         return inverse;
     }
@@ -82,7 +93,7 @@ Operation* undoOperation(Sequence *sequence, Operation *operation, Operation *ne
     }
 
     // Create an inverse operation
-    Operation *inverse = (Operation*) malloc(sizeof(Operation));
+    Operation *inverse = (Operation*) slabAlloc(&sequence->operationAllocator);
     if (inverse == NULL) {
         ERR_PRINT("Failed to allocate memory for inverse operation.\n");
         return NULL;
@@ -98,12 +109,11 @@ Operation* undoOperation(Sequence *sequence, Operation *operation, Operation *ne
     inverse->optimizedCaseSize = 0; // Not used in this case
 
     // Restore the piece table by reconnecting the nodes
-    first->next_ptr = oldNext;
-    last->prev_ptr = oldPrev;
+    replaceTrackedRange(sequence, first, last, oldNext, oldPrev);
 
     // Update the sequence statistics
     sequence->wordCount = prevWordCount;
-    sequence->lineCount = prevLineCount;
+    sequence->lineCount = prevLineCount >= 0 ? prevLineCount : countLinesOfPieces(sequence);
 
     return inverse; 
 }
@@ -146,16 +156,16 @@ ReturnCode undo(Sequence *sequence) {
             return 0; // Undefined
         }
 
-        // Push the inverse operation onto the redo stack
-        if (pushOperation(redoStack, inverse) == 0) {
-            ERR_PRINT("Failed to push operation onto redo stack.\n");
-            free(inverse);
-            return 0; // Undefined
-        }
-
         operation = previousOperation; // Move to the next operation of the bundle
     }
 
+    // The last inverse heads the inverse bundle (it links all others), so the bundle is redone in the original order
+    if (pushOperation(redoStack, inverse) == 0) {
+        ERR_PRINT("Failed to push operation onto redo stack.\n");
+        return 0; // Undefined
+    }
+    sequence->editsSinceCompaction++;
+
     return 1; // Success
 }
 
@@ -191,16 +201,16 @@ ReturnCode redo(Sequence *sequence) {
             return 0; // Undefined
         }
 
-        // Push the inverse operation onto the undo stack
-        if (pushOperation(undoStack, inverse) == 0) {
-            ERR_PRINT("Failed to push operation onto undo stack.\n");
-            free(inverse);
-            return 0; // Undefined
-        }
-
         operation = previousOperation; // Move to the next operation of the bundle
     }
 
+    // The last inverse heads the inverse bundle, see undo()
+    if (pushOperation(undoStack, inverse) == 0) {
+        ERR_PRINT("Failed to push operation onto undo stack.\n");
+        return 0; // Undefined
+    }
+    sequence->editsSinceCompaction++;
+
     return 1; // Success
 }
 
@@ -210,7 +220,7 @@ ReturnCode redo(Sequence *sequence) {
 ==============================
 */
 
-OperationStack* createOperationStack() {
+OperationStack* createOperationStack(SlabAllocator *operationAllocator) {
     OperationStack *stack = (OperationStack *)malloc(sizeof(OperationStack));
     if (stack == NULL) {
         ERR_PRINT("Failed to allocate memory for operation stack.\n");
@@ -218,24 +228,18 @@ OperationStack* createOperationStack() {
     }
     stack->top = NULL;
     stack->size = 0;
+    stack->operationAllocator = operationAllocator;
     return stack;
 }
 
 ReturnCode pushOperation(OperationStack *stack, Operation *operation) {
-    if (stack == NULL) {
+    if (stack == NULL || operation == NULL) {
         ERR_PRINT("Cannot push operation onto a NULL stack.\n");
         return 0;
     }
-    
-    OperationNode *newNode = (OperationNode *)malloc(sizeof(OperationNode));
-    if (newNode == NULL) {
-        ERR_PRINT("Failed to allocate memory for new operation node.\n");
-        return 0;
-    }
-    
-    newNode->operation = operation;
-    newNode->next = stack->top;
-    stack->top = newNode;
+
+    operation->below = stack->top;
+    stack->top = operation;
     stack->size++;
 
     return 1; // Success
@@ -247,7 +251,7 @@ Operation* getOperation(OperationStack *stack) {
         return NULL;
     }
     
-    return stack->top->operation; // Return the operation at the top of the stack without removing it
+    return stack->top; // Return the operation at the top of the stack without removing it
 }
 
 Operation* popOperation(OperationStack *stack) {
@@ -256,10 +260,9 @@ Operation* popOperation(OperationStack *stack) {
         return NULL;
     }
     
-    OperationNode *nodeToPop = stack->top;
-    Operation *operation = nodeToPop->operation;
-    stack->top = nodeToPop->next;
-    free(nodeToPop);
+    Operation *operation = stack->top;
+    stack->top = operation->below;
+    operation->below = NULL;
     stack->size--;
     
     return operation;
@@ -273,28 +276,48 @@ int getOperationStackSize(OperationStack *stack) {
     return stack->size;
 }
 
-ReturnCode freeOperationStack(OperationStack *stack) {
+ReturnCode clearOperationStack(OperationStack *stack) {
     if (stack == NULL) {
         return 0;
     }
-    
-    OperationNode *current = stack->top;
+
+    Operation *current = stack->top;
     while (current != NULL) {
-        OperationNode *nextNode = current->next;
+        Operation *nextBundle = current->below;
 
         // Free the bundle of operations
-        Operation *operation = current->operation;
+        Operation *operation = current;
         while (operation != NULL) {
             Operation *previousOperation = operation->previous;
-            free(operation);
+            slabFree(stack->operationAllocator, operation);
             operation = previousOperation;
         }
 
-        free(current); // Free the node itself
-        current = nextNode;
+        current = nextBundle;
     }
-    
-    free(stack);
+    stack->top = NULL;
+    stack->size = 0;
+
     return 1; // Success
 }
 
+void forEachOperation(OperationStack *stack, void (*visit)(Operation *operation, void *context), void *context) {
+    if (stack == NULL) {
+        return;
+    }
+    for (Operation *bundle = stack->top; bundle != NULL; bundle = bundle->below) {
+        for (Operation *operation = bundle; operation != NULL; operation = operation->previous) {
+            visit(operation, context);
+        }
+    }
+}
+
+ReturnCode freeOperationStack(OperationStack *stack) {
+    if (stack == NULL) {
+        return 0;
+    }
+
+    clearOperationStack(stack);
+    free(stack);
+    return 1; // Success
+}
@@ -19,9 +19,10 @@ struct Operation {
     DescriptorNode *oldPrev; // The old previous node of the last node
 
     Operation *previous; // Pointer to the operation to undo after this one, NULL if this is the last operation
+    Operation *below;    // Next bundle on the undo/redo stack (only used by the stack)
 
-    int wordCount; // Word count before the operation
-    int lineCount; // Line count before the operation
+    long wordCount; // Word count before the operation
+    long lineCount; // Line count before the operation, -1: count it from the pieces
 
     // For optimization, some insertions simply extend a node.
     // In this case first stores the node to extend and the other nodes are NULL.
@@ -44,11 +45,22 @@ ReturnCode redo(Sequence *sequence);
   Undo/Redo Stack Management
 ==============================
 */
-OperationStack* createOperationStack();
+/**
+ * Creates a stack whose operations are released to the given allocator once they are dropped.
+ */
+OperationStack* createOperationStack(SlabAllocator *operationAllocator);
 ReturnCode pushOperation(OperationStack *stack, Operation *operation);
 Operation* getOperation(OperationStack *stack);
 Operation* popOperation(OperationStack *stack);
 int getOperationStackSize(OperationStack *stack);
+/**
+ * Drops all operations on the stack but keeps the stack itself usable.
+ */
+ReturnCode clearOperationStack(OperationStack *stack);
+/**
+ * Calls visit for every operation on the stack (all operations of every bundle).
+ */
+void forEachOperation(OperationStack *stack, void (*visit)(Operation *operation, void *context), void *context);
 ReturnCode freeOperationStack(OperationStack *stack);
 
 #endif
\ No newline at end of file